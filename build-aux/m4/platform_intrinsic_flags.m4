@@ -58,6 +58,19 @@ AC_DEFUN([INTRINSIC_FLAG_CHECK],
   AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AVX512F_FLAGS, $INTRINSICFLAGS)])
   AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AVX512F ")
 
+  dnl VAES (AES rounds on every 128 bit lane of a ymm/zmm register) is only used by the multi-buffer hash implementations, which need AVX2 or AVX512BW alongside it
+  INTRINSICFLAGS="-O3 -mmmx  -msse  -msse2  -msse3  -mssse3 -msse4.1 -msse4.2 -mavx -mavx2 -maes -mvaes -DCOMPILER_HAS_AVX2_VAES"
+  CXXFLAGS="-Werror $INTRINSICFLAGS"
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
+  AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AVX2_VAES_FLAGS, $INTRINSICFLAGS)])
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AVX2_VAES ")
+
+  INTRINSICFLAGS="-O3 -mmmx  -msse  -msse2  -msse3  -mssse3 -msse4.1 -msse4.2 -mavx -mavx2 -mavx512f -mavx512bw -maes -mvaes -DCOMPILER_HAS_AVX512BW_VAES"
+  CXXFLAGS="-Werror $INTRINSICFLAGS"
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
+  AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AVX512BW_VAES_FLAGS, $INTRINSICFLAGS)])
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AVX512BW_VAES ")
+
   dnl fixme: We should handle also -mavx512pf  -mavx512er  -mavx512cd  -mavx512vl -mavx512bw  -mavx512dq  -mavx512ifma  -mavx512vbmi - potentially, though its unclear if any of our code would benefit from these
 
   INTRINSICFLAGS="-maes -DCOMPILER_HAS_AES"
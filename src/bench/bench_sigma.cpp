@@ -38,6 +38,7 @@ uint64_t memAllowGb;
 uint64_t numUserVerifyThreads;
 uint64_t numFullHashesTarget = 50000;
 bool mineOnly=false;
+bool arenaAccessOnly=false;
     
 using namespace boost::program_options;
 std::vector<std::string> hashTestVector = {
@@ -385,6 +386,46 @@ double calculateSustainedHashrateForTimePeriod(uint64_t maxHashesPre, uint64_t m
     double nSustainedHashesPerMicrosecond = (1/nSustainedMicrosecondsPerHash);
     return nSustainedHashesPerMicrosecond * 1000000;
 }
+
+// Random fast hash sized reads from all over the arena, as performed by the mining inner loop.
+// Throughput here is dominated by TLB misses and therefore very sensitive to the page size backing the arena.
+void benchmarkArenaAccess(sigma_context& sigmaContext)
+{
+    uint64_t arenaSizeBytes = sigmaContext.allocatedArenaSizeKb*1024;
+    uint64_t numReads = 4000000;
+    std::atomic<uint64_t> checksum = 0;
+    for (uint64_t numReadThreads : {(uint64_t)1, numThreads})
+    {
+        uint64_t nStart = GetTimeMicros();
+        std::vector<std::thread> workerPool;
+        for (uint64_t nThreadIndex=0; nThreadIndex<numReadThreads; ++nThreadIndex)
+        {
+            workerPool.emplace_back([&]()
+            {
+                uint64_t nState = GetRand(std::numeric_limits<uint64_t>::max()) | 1;
+                uint64_t nSum = 0;
+                for (uint64_t i=0; i<numReads; ++i)
+                {
+                    nState ^= nState << 13;
+                    nState ^= nState >> 7;
+                    nState ^= nState << 17;
+                    const uint64_t* pChunk = (const uint64_t*)&sigmaContext.arena[(nState % (arenaSizeBytes - defaultSigmaSettings.fastHashSizeBytes)) & ~(uint64_t)7];
+                    for (uint64_t j=0; j<defaultSigmaSettings.fastHashSizeBytes/8; ++j)
+                    {
+                        nSum += pChunk[j];
+                    }
+                }
+                checksum += nSum;
+            });
+        }
+        for (auto& thread : workerPool) { thread.join(); }
+        uint64_t nTime = GetTimeMicros() - nStart;
+        double nReadsPerSecond = (numReads*numReadThreads) / (nTime * 0.000001);
+        printf("random %lu byte reads [%lu threads] total [%lu micros] per read [%.4f micros] [%.2f million reads/s]\n", defaultSigmaSettings.fastHashSizeBytes, numReadThreads, nTime, nTime / (double)numReads, nReadsPerSecond / 1000000);
+    }
+    // Print so the compiler can't optimise the reads away.
+    printf("checksum [%lu]\n\n", checksum.load());
+}
     
 int main(int argc, char** argv)
 {
@@ -403,6 +444,9 @@ int main(int argc, char** argv)
     ("mine-memory", value<int64_t>(), "Set how much memory in gb to mine with")
     ("mine-num-hashes", value<int64_t>(), "How many full hash attempts to run mining for (default 50000)")
     ("mine-only", value<bool>()->implicit_value(true), "Only benchmark actual mining, skip other benchmarks")
+    ("mine-hugepages", value<bool>()->implicit_value(true), "Back the mining arena with huge pages (1gb/2mb if reserved, otherwise transparent huge pages)")
+    ("mine-numa", value<bool>(), "Split the mining arena over NUMA nodes on multi socket machines (default true)")
+    ("arena-access-only", value<bool>()->implicit_value(true), "Only benchmark random arena access throughput (TLB sensitive), once with regular and once with huge pages")
     ("verify-threads", value<int64_t>(), "How many threads to use for verification, may not exceed sigma_verify_threads (defaults to same as sigma_verify_threads)")
     ("sigma-global-mem", value<int64_t>(), "How much global memory optimal mining should require (in gigabytes)")
     ("sigma-num-slow", value<int64_t>(), "How many slow hash attempts to allow for each global memory allocation  (maximum 65536)")
@@ -465,6 +509,18 @@ int main(int argc, char** argv)
         mineOnly = vm["mine-only"].as<bool>();;
         defaultSigma = false;
     }
+    if (vm.count("mine-hugepages"))
+    {
+        defaultSigmaArenaSettings.hugePages = vm["mine-hugepages"].as<bool>();
+    }
+    if (vm.count("mine-numa"))
+    {
+        defaultSigmaArenaSettings.numaAware = vm["mine-numa"].as<bool>();
+    }
+    if (vm.count("arena-access-only"))
+    {
+        arenaAccessOnly = vm["arena-access-only"].as<bool>();
+    }
     if (vm.count("verify-threads"))
     {
         numUserVerifyThreads = vm["verify-threads"].as<int64_t>();
@@ -576,6 +632,26 @@ int main(int argc, char** argv)
         printf("\n");
     }
     
+    if (arenaAccessOnly)
+    {
+        printf("Arena access====================================================\n\n");
+        for (bool hugePages : {false, true})
+        {
+            defaultSigmaArenaSettings.hugePages = hugePages;
+            sigma_context sigmaContext(defaultSigmaSettings, std::min(memAllowKb, defaultSigmaSettings.arenaSizeKb), numThreads, numThreads);
+            if (!sigmaContext.arenaIsValid())
+            {
+                printf("Failed to allocate arena memory, try again with lower memory settings.\n");
+                exit(EXIT_FAILURE);
+            }
+            printf("Arena backed by %s\n", sigmaContext.arenaAllocationDescription().c_str());
+            // Touch every page, the contents don't matter for access timing.
+            memset(sigmaContext.arena, 1, sigmaContext.allocatedArenaSizeKb*1024);
+            benchmarkArenaAccess(sigmaContext);
+        }
+        return 0;
+    }
+
     //Random header to benchmark with, we will randomly change it more throughout the tests.
     CBlockHeader header;
     header.nVersion = rand();
@@ -697,6 +773,34 @@ int main(int argc, char** argv)
                 sigmaContext.benchmarkFastHashes(hashData1, hashData2, &hashData3[0], numFastHashes);
                 printf("total [%lu micros] per hash [%.4f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numFastHashes);
             }
+            {
+                printf("Bench fast hashes multi-buffer [%s] [single thread]:\n", multiBufferSelectionName().c_str());
+                // One batch per round of the interleaved mining kernel, each lane with its own header/arena data.
+                std::vector<std::array<uint8_t, 80>> hashData1(SIGMA_MINING_LANES);
+                std::vector<std::array<uint8_t, 32>> hashData2(SIGMA_MINING_LANES);
+                std::vector<unsigned char> hashData3(defaultSigmaSettings.fastHashSizeBytes*SIGMA_MINING_LANES);
+                std::vector<uint256> outHashes(SIGMA_MINING_LANES);
+                std::vector<sigma_fast_hash_request> requests(SIGMA_MINING_LANES);
+                for (uint64_t nLane=0; nLane<SIGMA_MINING_LANES; ++nLane)
+                {
+                    for (auto& c : hashData1[nLane]) c = rand();
+                    for (auto& c : hashData2[nLane]) c = rand();
+                    requests[nLane] = {nLane%2, &hashData1[nLane][0], &hashData2[nLane][0], &hashData3[nLane*defaultSigmaSettings.fastHashSizeBytes], &outHashes[nLane]};
+                }
+                for (auto& c : hashData3) c = rand();
+                uint64_t nStart = GetTimeMicros();
+                uint64_t numFastHashes = 20000;
+                for (uint64_t i=0; i<numFastHashes; i+=SIGMA_MINING_LANES)
+                {
+                    for (uint64_t nLane=0; nLane<SIGMA_MINING_LANES; ++nLane)
+                    {
+                        hashData2[nLane][rand()%32] = i;
+                        requests[nLane].nPseudoRandomAlg = rand()%2;
+                    }
+                    sigmaRandomFastHashBatch(requests.data(), requests.size(), 80, 32, defaultSigmaSettings.fastHashSizeBytes);
+                }
+                printf("total [%lu micros] per hash [%.4f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numFastHashes);
+            }
             #endif
             {
                 printf("Bench fast hashes reference [single thread]:\n");
@@ -744,7 +848,12 @@ int main(int argc, char** argv)
                     sigmaContext.prepareArenas(header);
                 }
                 printf("total [%lu micros] per round: [%.2f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numArenas);
-            }  
+            }
+
+            {
+                printf("Bench random arena access [%s]:\n", sigmaContext.arenaAllocationDescription().c_str());
+                benchmarkArenaAccess(sigmaContext);
+            }
         }
         {
             {
@@ -795,11 +904,6 @@ int main(int argc, char** argv)
         
         printf("Bench mining for low difficulty target\n");
         uint64_t nStart = GetTimeMicros();
-        std::atomic<uint64_t> slowHashCounter = 0;
-        std::atomic<uint64_t> halfHashCounter = 0;
-        std::atomic<uint64_t> skippedHashCounter = 0;
-        std::atomic<uint64_t> hashCounter = 0;
-        std::atomic<uint64_t> blockCounter = 0;
         {
             auto workerThreads = new boost::asio::thread_pool(numThreads);
             for (auto sigmaContext : sigmaContexts)
@@ -811,24 +915,38 @@ int main(int argc, char** argv)
             }
             workerThreads->join();
         }
-        double nHalfHashAverage=0;
+        // Extrapolate from the fastest kernel, that is the one a miner would want to run.
+        double nHalfHashAverage=std::numeric_limits<double>::max();
         nArenaSetuptime = (GetTimeMicros() - nStart);
         printf("Arena setup time [%lu micros]\n", nArenaSetuptime);
-        nStart = GetTimeMicros();
-        {
-            auto workerThreads = new boost::asio::thread_pool(numThreads);
-            for (auto sigmaContext : sigmaContexts)
+        sigma_mining_kernel selectedKernel = gSelMiningKernel;
+        for (sigma_mining_kernel kernel : {sigma_mining_kernel::SERIAL, sigma_mining_kernel::INTERLEAVED})
+        {
+            gSelMiningKernel = kernel;
+            std::atomic<uint64_t> slowHashCounter = 0;
+            std::atomic<uint64_t> halfHashCounter = 0;
+            std::atomic<uint64_t> skippedHashCounter = 0;
+            std::atomic<uint64_t> hashCounter = 0;
+            std::atomic<uint64_t> blockCounter = 0;
+            nStart = GetTimeMicros();
             {
-                boost::asio::post(*workerThreads, [&, header, sigmaContext]() mutable
+                auto workerThreads = new boost::asio::thread_pool(numThreads);
+                for (auto sigmaContext : sigmaContexts)
                 {
-                    sigmaContext->benchmarkMining(header, slowHashCounter, halfHashCounter, skippedHashCounter, hashCounter, blockCounter, numFullHashesTarget);
-                });
+                    boost::asio::post(*workerThreads, [&, header, sigmaContext]() mutable
+                    {
+                        sigmaContext->benchmarkMining(header, slowHashCounter, halfHashCounter, skippedHashCounter, hashCounter, blockCounter, numFullHashesTarget);
+                    });
+                }
+                workerThreads->join();
             }
-            workerThreads->join();
+            uint64_t nTime = GetTimeMicros() - nStart;
+            nHalfHashAverage = std::min(nHalfHashAverage, nTime / (double)halfHashCounter);
+            printf("Kernel [%s]\n", miningKernelName(kernel).c_str());
+            printf("slow-hashes [%lu] half-hashes[%lu] skipped-hashes [%lu] full-hashes [%lu] blocks [%lu] total [%lu micros] per half-hash[%.2f micros] per hash [%.2f micros] half-hashes per second [%.2f]\n\n", slowHashCounter.load(), halfHashCounter.load(), skippedHashCounter.load(), hashCounter.load(), blockCounter.load(), nTime, nTime / (double)halfHashCounter, nTime / (double)hashCounter, halfHashCounter * 1000000.0 / nTime);
         }
-        nHalfHashAverage = ((GetTimeMicros() - nStart)) / (double)halfHashCounter;
-        printf("slow-hashes [%lu] half-hashes[%lu] skipped-hashes [%lu] full-hashes [%lu] blocks [%lu] total [%lu micros] per half-hash[%.2f micros] per hash [%.2f micros]\n\n", slowHashCounter.load(), halfHashCounter.load(), skippedHashCounter.load(), hashCounter.load(), blockCounter.load(), (GetTimeMicros() - nStart), nHalfHashAverage, ((GetTimeMicros() - nStart)) / (double)hashCounter);
-        
+        gSelMiningKernel = selectedKernel;
+
         //Extrapolate sustained hashing speed for various time intervals
         double nSustainedHashesPerSecond30s  = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 30);
         double nSustainedHashesPerSecond60s  = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 60);
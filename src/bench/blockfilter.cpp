@@ -0,0 +1,86 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "blockfilter.h"
+#include "random.h"
+#include "util.h"
+
+// Match a wallet sized address set against a static filter checkpoint sized set of ranged filters.
+// Compares matching each filter through GCSFilter::MatchAny (hashes the whole set again for every filter) against hashing the set once and
+// matching the encoded filters in place with GCSFilter::MatchAnyEncodedBatch.
+
+static const size_t nBenchRanges = 4600;
+static const size_t nBenchElementsPerRange = 600;
+static const size_t nBenchWalletAddresses = 10000;
+
+static GCSFilter::Element RandomAddress(FastRandomContext& rand)
+{
+    return rand.randbytes(20);
+}
+
+static const std::vector<GCSFilter>& BenchStaticFilters()
+{
+    static std::vector<GCSFilter> filters = []()
+    {
+        FastRandomContext rand(true);
+        std::vector<GCSFilter> result;
+        result.reserve(nBenchRanges);
+        for (size_t i = 0; i < nBenchRanges; ++i)
+        {
+            GCSFilter::ElementSet elements;
+            // Ranges vary a lot in size on the real chain.
+            size_t nElements = nBenchElementsPerRange / 2 + rand.randrange(nBenchElementsPerRange);
+            while (elements.size() < nElements)
+                elements.insert(RandomAddress(rand));
+            result.emplace_back(RangedCPBlockFilter::StaticParams(), elements);
+        }
+        return result;
+    }();
+    return filters;
+}
+
+static GCSFilter::ElementSet BenchWalletAddresses()
+{
+    FastRandomContext rand(uint256S("0x42"));
+    GCSFilter::ElementSet addresses;
+    while (addresses.size() < nBenchWalletAddresses)
+        addresses.insert(RandomAddress(rand));
+    return addresses;
+}
+
+static void GCSFilterMatchStaticRangesPerFilter(benchmark::State& state)
+{
+    const std::vector<GCSFilter>& filters = BenchStaticFilters();
+    const GCSFilter::ElementSet addresses = BenchWalletAddresses();
+    size_t nMatches = 0;
+    while (state.KeepRunning())
+    {
+        for (const auto& filter : filters)
+        {
+            if (filter.MatchAny(addresses))
+                ++nMatches;
+        }
+    }
+    (unused) nMatches;
+}
+
+static void GCSFilterMatchStaticRangesBatch(benchmark::State& state)
+{
+    const std::vector<GCSFilter>& filters = BenchStaticFilters();
+    const GCSFilter::ElementSet addresses = BenchWalletAddresses();
+    std::vector<Span<const unsigned char>> encodedFilters;
+    for (const auto& filter : filters)
+        encodedFilters.push_back(filter.GetEncoded());
+    std::vector<unsigned char> matches;
+    while (state.KeepRunning())
+    {
+        const std::vector<uint64_t> hashes = GCSFilter::HashElements(RangedCPBlockFilter::StaticParams(), addresses);
+        matches.assign(encodedFilters.size(), 0);
+        GCSFilter::MatchAnyEncodedBatch(RangedCPBlockFilter::StaticParams(), encodedFilters, hashes, matches);
+    }
+}
+
+BENCHMARK(GCSFilterMatchStaticRangesPerFilter);
+BENCHMARK(GCSFilterMatchStaticRangesBatch);
@@ -0,0 +1,91 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "chain.h"
+#include "memusage.h"
+#include "random.h"
+
+#include <iostream>
+
+// Build a mainnet sized block index of witness blocks, the shape of the index on a fully synced node, to measure how much memory the
+// entries take and how long the legacy hash lookups the witness code paths do (GetPoWBlockForPoSBlock and friends) take on it.
+
+static const size_t nBenchBlockIndexEntries = 1800000;
+static const size_t nBenchLegacyLookupWindow = 10000;
+
+struct BenchBlockIndex
+{
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex*> entries;
+
+    BenchBlockIndex()
+    {
+        FastRandomContext rand(true);
+        // Entries point at their hash, so these must not move.
+        hashes.reserve(nBenchBlockIndexEntries);
+        entries.reserve(nBenchBlockIndexEntries);
+        CBlockIndex* pprev = nullptr;
+        for (size_t i = 0; i < nBenchBlockIndexEntries; ++i)
+        {
+            CBlockHeader header;
+            header.nVersion = 4;
+            header.hashMerkleRoot = rand.rand256();
+            header.nTime = 1400000000 + i * 150;
+            header.nBits = 0x1e0fffff;
+            header.nNonce = rand.rand32();
+            header.nVersionPoW2Witness = 4;
+            header.nTimePoW2Witness = header.nTime + 60;
+            header.hashMerkleRootPoW2Witness = rand.rand256();
+            header.witnessHeaderPoW2Sig = rand.randbytes(65);
+
+            CBlockIndex* pindex = new CBlockIndex(header);
+            hashes.push_back(rand.rand256());
+            pindex->phashBlock = &hashes.back();
+            pindex->pprev = pprev;
+            pindex->nHeight = i;
+            pindex->BuildSkip();
+            entries.push_back(pindex);
+            pprev = pindex;
+        }
+    }
+
+    ~BenchBlockIndex()
+    {
+        for (CBlockIndex* pindex : entries)
+            delete pindex;
+    }
+};
+
+static void BlockIndexBuild(benchmark::State& state)
+{
+    bool fReported = false;
+    while (state.KeepRunning())
+    {
+        BenchBlockIndex index;
+        if (!fReported)
+        {
+            // The bench output itself is csv on stdout, so report the footprint on stderr. With the signature inline an entry is a
+            // single allocation.
+            size_t nUsage = nBenchBlockIndexEntries * memusage::MallocUsage(sizeof(CBlockIndex));
+            std::cerr << "BlockIndexBuild: " << nBenchBlockIndexEntries << " entries, " << nUsage << " bytes, " << nUsage / nBenchBlockIndexEntries << " bytes per entry" << std::endl;
+            fReported = true;
+        }
+    }
+}
+
+static void BlockIndexGetBlockHashLegacy(benchmark::State& state)
+{
+    static BenchBlockIndex index;
+    arith_uint256 hashAccumulated;
+    while (state.KeepRunning())
+    {
+        for (auto iter = index.entries.end() - nBenchLegacyLookupWindow; iter != index.entries.end(); ++iter)
+            hashAccumulated ^= UintToArith256((*iter)->GetBlockHashLegacy());
+    }
+    (unused) hashAccumulated;
+}
+
+BENCHMARK(BlockIndexBuild);
+BENCHMARK(BlockIndexGetBlockHashLegacy);
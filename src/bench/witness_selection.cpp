@@ -0,0 +1,163 @@
+// Copyright (c) 2017-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "bench.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "validation/witnessvalidation.h"
+#include "witnessutil.h"
+
+#include <boost/container/flat_set.hpp>
+
+// Compare the witness roulette over the historical flat_set/RouletteItem path against the columnar (structure of arrays) path.
+// Both are timed end to end, from the witness set through to the selected witness; that they agree is covered by witnessvalidation_tests.
+
+static const uint64_t nBenchBlockHeight = 1500000;
+
+// Compact witness coin (index based outpoint plus the lock details and value) that the bench witness sets are made up of.
+struct BenchWitnessItem
+{
+    uint64_t blockNumber;
+    uint64_t transactionIndex;
+    uint32_t transactionOutputIndex;
+    uint64_t lockUntilBlock;
+    uint64_t lockFromBlock;
+    CAmount nValue;
+
+    friend inline bool operator<(const BenchWitnessItem& a, const BenchWitnessItem& b)
+    {
+        if (a.blockNumber == b.blockNumber)
+        {
+            if (a.transactionIndex == b.transactionIndex)
+                return a.transactionOutputIndex < b.transactionOutputIndex;
+            return a.transactionIndex < b.transactionIndex;
+        }
+        return a.blockNumber < b.blockNumber;
+    }
+};
+
+static boost::container::flat_set<BenchWitnessItem> GenerateWitnessSet(uint64_t nWitnesses)
+{
+    FastRandomContext rand(true);
+    boost::container::flat_set<BenchWitnessItem> witnessSet;
+    witnessSet.reserve(nWitnesses);
+    while (witnessSet.size() < nWitnesses)
+    {
+        BenchWitnessItem item;
+        item.blockNumber = nBenchBlockHeight - 1 - rand.randrange(40000);
+        item.transactionIndex = rand.randrange(20);
+        item.transactionOutputIndex = rand.randrange(4);
+        item.lockFromBlock = item.blockNumber;
+        item.lockUntilBlock = item.blockNumber + 30 * 576 + rand.randrange(3 * 365 * 576);
+        item.nValue = (gMinimumWitnessAmount + rand.randrange(50000)) * COIN;
+        witnessSet.insert(item);
+    }
+    return witnessSet;
+}
+
+// Historical path: rebuild RouletteItems (recomputing weight/age for every candidate) then filter/sort/sum/scan.
+static uint64_t SelectWitnessFlatSet(const boost::container::flat_set<BenchWitnessItem>& witnessSet, const uint256& blockHash)
+{
+    CGetWitnessInfo witnessInfo;
+    for (const auto& simplifiedItem : witnessSet)
+    {
+        CTxOutPoW2Witness details;
+        details.lockFromBlock = simplifiedItem.lockFromBlock;
+        details.lockUntilBlock = simplifiedItem.lockUntilBlock;
+        Coin coin(CTxOut(simplifiedItem.nValue, CTxOutPoW2Witness(details)), simplifiedItem.blockNumber, 0, false, false);
+        RouletteItem item(COutPoint(simplifiedItem.blockNumber, simplifiedItem.transactionIndex, simplifiedItem.transactionOutputIndex), coin, 0, nBenchBlockHeight - simplifiedItem.blockNumber);
+        item.nWeight = GetPoW2RawWeightForAmount(simplifiedItem.nValue, nBenchBlockHeight, (simplifiedItem.lockUntilBlock - simplifiedItem.lockFromBlock) + 1);
+        if (item.nWeight < gMinimumWitnessWeight)
+            continue;
+        witnessInfo.witnessSelectionPoolUnfiltered.push_back(item);
+        witnessInfo.nTotalWeightRaw += item.nWeight;
+    }
+
+    uint64_t nMinAge = gMinimumParticipationAge;
+    auto& pool = witnessInfo.witnessSelectionPoolFiltered;
+    while (true)
+    {
+        pool = witnessInfo.witnessSelectionPoolUnfiltered;
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), pool.end());
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, witnessInfo.nTotalWeightRaw); }), pool.end());
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBenchBlockHeight) <= nMinAge); }), pool.end());
+        if (pool.size() >= 100 || nMinAge == 0 || (nMinAge <= 10 && pool.size() > 5))
+            break;
+        nMinAge -= 5;
+    }
+    assert(!pool.empty());
+    std::sort(pool.begin(), pool.end());
+
+    uint64_t nTotalWeightEligibleRaw = 0;
+    for (auto& item : pool)
+        nTotalWeightEligibleRaw += item.nWeight;
+    uint64_t nMaxIndividualWeight = std::max(nTotalWeightEligibleRaw / 100, (uint64_t)1);
+    uint64_t nTotalWeightEligibleAdjusted = 0;
+    for (auto& item : pool)
+    {
+        item.nWeight = std::min(item.nWeight, nMaxIndividualWeight);
+        nTotalWeightEligibleAdjusted += item.nWeight;
+        item.nCumulativeWeight = nTotalWeightEligibleAdjusted;
+    }
+
+    arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
+    if (rouletteSelectionSeed > arith_uint256(nTotalWeightEligibleAdjusted))
+        rouletteSelectionSeed = rouletteSelectionSeed - (arith_uint256(nTotalWeightEligibleAdjusted) * arith_uint256(rouletteSelectionSeed/arith_uint256(nTotalWeightEligibleAdjusted)));
+    return std::lower_bound(pool.begin(), pool.end(), rouletteSelectionSeed.GetLow64()) - pool.begin();
+}
+
+// Columnar path: lay the candidates out as columns (determining weight once per candidate) then select.
+static uint64_t SelectWitnessColumns(const boost::container::flat_set<BenchWitnessItem>& witnessSet, const uint256& blockHash)
+{
+    CWitnessRouletteColumns columns;
+    columns.nPreviousHeight = nBenchBlockHeight - 1;
+    columns.reserve(witnessSet.size());
+    for (const auto& item : witnessSet)
+    {
+        uint64_t nWeight = GetPoW2RawWeightForAmount(item.nValue, nBenchBlockHeight, (item.lockUntilBlock - item.lockFromBlock) + 1);
+        if (nWeight < gMinimumWitnessWeight)
+            continue;
+        columns.push_back(COutPoint(item.blockNumber, item.transactionIndex, item.transactionOutputIndex), item.blockNumber, nWeight, item.lockUntilBlock);
+    }
+
+    CWitnessRouletteSelection selection;
+    SelectWitnessFromRouletteColumns(blockHash, nBenchBlockHeight, 0, 0, columns, selection);
+    return selection.nSelectedEligibleIndex;
+}
+
+static void WitnessSelectionFlatSet(benchmark::State& state, uint64_t nWitnesses)
+{
+    auto witnessSet = GenerateWitnessSet(nWitnesses);
+    FastRandomContext rand(true);
+    uint64_t nSelected = 0;
+    while (state.KeepRunning())
+    {
+        nSelected += SelectWitnessFlatSet(witnessSet, rand.rand256());
+    }
+}
+
+static void WitnessSelectionColumns(benchmark::State& state, uint64_t nWitnesses)
+{
+    auto witnessSet = GenerateWitnessSet(nWitnesses);
+    FastRandomContext rand(true);
+    uint64_t nSelected = 0;
+    while (state.KeepRunning())
+    {
+        nSelected += SelectWitnessColumns(witnessSet, rand.rand256());
+    }
+}
+
+static void WitnessSelectionFlatSet1k(benchmark::State& state) { WitnessSelectionFlatSet(state, 1000); }
+static void WitnessSelectionFlatSet10k(benchmark::State& state) { WitnessSelectionFlatSet(state, 10000); }
+static void WitnessSelectionFlatSet100k(benchmark::State& state) { WitnessSelectionFlatSet(state, 100000); }
+static void WitnessSelectionColumns1k(benchmark::State& state) { WitnessSelectionColumns(state, 1000); }
+static void WitnessSelectionColumns10k(benchmark::State& state) { WitnessSelectionColumns(state, 10000); }
+static void WitnessSelectionColumns100k(benchmark::State& state) { WitnessSelectionColumns(state, 100000); }
+
+BENCHMARK(WitnessSelectionFlatSet1k);
+BENCHMARK(WitnessSelectionFlatSet10k);
+BENCHMARK(WitnessSelectionFlatSet100k);
+BENCHMARK(WitnessSelectionColumns1k);
+BENCHMARK(WitnessSelectionColumns10k);
+BENCHMARK(WitnessSelectionColumns100k);
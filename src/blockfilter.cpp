@@ -16,12 +16,24 @@
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <streams.h>
+#include <util/golombrice.h>
 #include <validation/validation.h>
 #include "blockstore.h"
 #include "checkpoints.h"
 
+#include <atomic>
 #include <limits>
+#include <thread>
 #include "clientversion.h"
+#include "sync.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /// SerType used to serialize parameters in GCS filter encoding.
 static constexpr int GCS_SER_TYPE = SER_NETWORK;
@@ -33,37 +45,6 @@ static const std::map<BlockFilterType, std::string> g_filter_types = {
     {BASIC, "basic"},
 };
 
-template <typename OStream>
-static void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t P, uint64_t x)
-{
-    // Write quotient as unary-encoded: q 1's followed by one 0.
-    uint64_t q = x >> P;
-    while (q > 0) {
-        int nbits = q <= 64 ? static_cast<int>(q) : 64;
-        bitwriter.Write(~0ULL, nbits);
-        q -= nbits;
-    }
-    bitwriter.Write(0, 1);
-
-    // Write the remainder in P bits. Since the remainder is just the bottom
-    // P bits of x, there is no need to mask first.
-    bitwriter.Write(x, P);
-}
-
-template <typename IStream>
-static uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t P)
-{
-    // Read unary-encoded quotient: q 1's followed by one 0.
-    uint64_t q = 0;
-    while (bitreader.Read(1) == 1) {
-        ++q;
-    }
-
-    uint64_t r = bitreader.Read(P);
-
-    return (q << P) + r;
-}
-
 // Map a value x that is uniformly distributed in the range [0, 2^64) to a
 // value uniformly distributed in [0, n) by returning the upper 64 bits of
 // x * n.
@@ -173,18 +154,18 @@ GCSFilter::GCSFilter(const Params& params, const ElementSet& elements)
 
 bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
 {
-    VectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, m_encoded, 0);
+    SpanReader stream(GCS_SER_TYPE, GCS_SER_VERSION, m_encoded);
 
     // Seek forward by size of N
     uint64_t N = ReadCompactSize(stream);
     assert(N == m_N);
 
-    BitStreamReader<VectorReader> bitreader(stream);
+    GolombRiceWordDecoder decoder(Span<const unsigned char>(m_encoded).last(stream.size()));
 
     uint64_t value = 0;
     size_t hashes_index = 0;
     for (uint32_t i = 0; i < m_N; ++i) {
-        uint64_t delta = GolombRiceDecode(bitreader, m_params.m_P);
+        uint64_t delta = decoder.Decode(m_params.m_P);
         value += delta;
 
         while (true) {
@@ -220,6 +201,68 @@ unsigned int GCSFilter::NumElements() const
     return m_N;
 }
 
+std::vector<uint64_t> GCSFilter::HashElements(const Params& params, const ElementSet& elements)
+{
+    std::vector<uint64_t> hashed_elements;
+    hashed_elements.reserve(elements.size());
+    for (const Element& element : elements) {
+        hashed_elements.push_back(CSipHasher(params.m_siphash_k0, params.m_siphash_k1).Write(element.data(), element.size()).Finalize());
+    }
+    std::sort(hashed_elements.begin(), hashed_elements.end());
+    return hashed_elements;
+}
+
+bool GCSFilter::MatchAnyEncoded(const Params& params, Span<const unsigned char> encoded, const std::vector<uint64_t>& sortedHashes)
+{
+    if (sortedHashes.empty())
+        return false;
+
+    SpanReader stream(GCS_SER_TYPE, GCS_SER_VERSION, encoded);
+    uint64_t N = ReadCompactSize(stream);
+    const uint64_t F = N * static_cast<uint64_t>(params.m_M);
+
+    GolombRiceWordDecoder decoder(encoded.last(stream.size()));
+
+    // Same walk as MatchInternal, mapping each hash into this filter's range only once it is reached.
+    uint64_t value = 0;
+    size_t hashes_index = 0;
+    uint64_t query = MapIntoRange(sortedHashes[0], F);
+    for (uint64_t i = 0; i < N; ++i) {
+        value += decoder.Decode(params.m_P);
+
+        while (true) {
+            if (query == value) {
+                return true;
+            } else if (query > value) {
+                break;
+            }
+            if (++hashes_index == sortedHashes.size()) {
+                return false;
+            }
+            query = MapIntoRange(sortedHashes[hashes_index], F);
+        }
+    }
+
+    return false;
+}
+
+void GCSFilter::MatchAnyEncodedBatch(const Params& params, Span<const Span<const unsigned char>> filters, const std::vector<uint64_t>& sortedHashes, Span<unsigned char> results)
+{
+    assert(results.size() == filters.size());
+    if (sortedHashes.empty())
+        return;
+
+    for (size_t i = 0; i < filters.size(); ++i) {
+        if (results[i])
+            continue;
+        try {
+            results[i] = MatchAnyEncoded(params, filters[i], sortedHashes);
+        } catch (const std::ios_base::failure&) {
+            results[i] = 1;
+        }
+    }
+}
+
 const std::string& BlockFilterTypeName(BlockFilterType filter_type)
 {
     static std::string unknown_retval = "";
@@ -417,6 +460,13 @@ RangedCPBlockFilter::RangedCPBlockFilter(std::vector<unsigned char> filter)
 
 bool RangedCPBlockFilter::BuildParams(GCSFilter::Params& params) const
 {
+    params = StaticParams();
+    return true;
+}
+
+GCSFilter::Params RangedCPBlockFilter::StaticParams()
+{
+    GCSFilter::Params params;
     params.m_siphash_k0 = 0;
     params.m_siphash_k1 = 0;
     // Filters have a false positive rate of '1/M' while M needs to be roughly '2^P' for optimal space usage, with some possible variance.
@@ -438,12 +488,193 @@ bool RangedCPBlockFilter::BuildParams(GCSFilter::Params& params) const
     //When/if we decide on more appropriate settings.
     params.m_P = 12;
     params.m_M = 4096;
+    return params;
+}
+
+
+static const unsigned char STATIC_FILTER_FILE_MAGIC[4] = {0xff, 'F', 'C', 'P'};
+// Size of a range table entry: start height, end height, offset, size
+static const size_t STATIC_FILTER_TABLE_ENTRY_SIZE = 16;
+
+CStaticFilterCheckpoints::~CStaticFilterCheckpoints()
+{
+#ifndef WIN32
+    if (mappedData)
+        munmap((void*)mappedData, nMappedSize);
+#endif
+}
+
+bool CStaticFilterCheckpoints::Load(const std::string& path, uint64_t nOffset, uint64_t nLength)
+{
+    uint64_t nFileSize;
+    try {
+        nFileSize = boost::filesystem::file_size(path);
+    } catch (const boost::filesystem::filesystem_error&) {
+        return false;
+    }
+    if (nLength == 0 && nFileSize > nOffset)
+        nLength = nFileSize - nOffset;
+    if (nLength == 0 || nOffset + nLength > nFileSize)
+        return false;
+
+#ifndef WIN32
+    // The section may live inside a bigger file (e.g. an uncompressed asset of an app package), map from the start of the file so the mapping is page aligned.
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        void* mapping = mmap(nullptr, nOffset + nLength, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping != MAP_FAILED)
+        {
+            mappedData = (const unsigned char*)mapping;
+            nMappedSize = nOffset + nLength;
+            data = Span<const unsigned char>(mappedData + nOffset, nLength);
+        }
+    }
+#endif
+    if (!mappedData)
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull() || fseek(file.Get(), nOffset, SEEK_SET) != 0)
+            return false;
+        vBuffer.resize(nLength);
+        try {
+            file.read(AsWritableBytes(Span{vBuffer.data(), vBuffer.size()}));
+        } catch (const std::ios_base::failure&) {
+            return false;
+        }
+        data = Span<const unsigned char>(vBuffer.data(), vBuffer.size());
+    }
+
+    if (data.size() >= sizeof(STATIC_FILTER_FILE_MAGIC) && memcmp(data.data(), STATIC_FILTER_FILE_MAGIC, sizeof(STATIC_FILTER_FILE_MAGIC)) == 0)
+        return ReadTable();
+    return ReadLegacyTable();
+}
+
+bool CStaticFilterCheckpoints::ReadTable()
+{
+    const size_t nHeaderSize = sizeof(STATIC_FILTER_FILE_MAGIC) + 8;
+    if (data.size() < nHeaderSize)
+        return false;
+    uint32_t nVersion = ReadLE32(data.data() + 4);
+    uint32_t nCount = ReadLE32(data.data() + 8);
+    if (nVersion != FILE_VERSION)
+        return error("%s: unsupported static filter file version %u", __func__, nVersion);
+    if (nCount > (data.size() - nHeaderSize) / STATIC_FILTER_TABLE_ENTRY_SIZE)
+        return false;
+
+    vRanges.reserve(nCount);
+    const unsigned char* entry = data.data() + nHeaderSize;
+    for (uint32_t i = 0; i < nCount; ++i, entry += STATIC_FILTER_TABLE_ENTRY_SIZE)
+    {
+        uint64_t nFilterOffset = ReadLE32(entry + 8);
+        uint64_t nFilterSize = ReadLE32(entry + 12);
+        if (nFilterOffset + nFilterSize > data.size())
+            return false;
+        vRanges.push_back({ReadLE32(entry), ReadLE32(entry + 4), data.subspan(nFilterOffset, nFilterSize)});
+    }
     return true;
 }
 
+bool CStaticFilterCheckpoints::ReadLegacyTable()
+{
+    // Intervals of the legacy dumpfiltercheckpoints output
+    const uint64_t nInterval1 = 500;
+    const uint64_t nInterval2 = 100;
+    const uint64_t nCrossOver = 10000;
+
+    uint64_t nStartIndex = 0;//Earliest possible recovery phrase (before this we didn't use phrases)
+    Span<const unsigned char> remaining = data;
+    while (!remaining.empty())
+    {
+        SpanReader stream(SER_DISK, CLIENT_VERSION, remaining);
+        uint64_t nDataSize;
+        try {
+            nDataSize = ReadCompactSize(stream);
+        } catch (const std::ios_base::failure&) {
+            break;
+        }
+        size_t nPrefixSize = remaining.size() - stream.size();
+        if (nDataSize > stream.size())
+            break;
+        uint64_t nInterval = nStartIndex >= nCrossOver ? nInterval2 : nInterval1;
+        vRanges.push_back({nStartIndex, nStartIndex + nInterval, remaining.subspan(nPrefixSize, nDataSize)});
+        remaining = remaining.subspan(nPrefixSize + nDataSize);
+        nStartIndex += nInterval;
+    }
+    return !vRanges.empty();
+}
+
+void CStaticFilterCheckpoints::MatchRanges(const std::vector<uint64_t>& sortedHashes, std::vector<unsigned char>& vMatches, int nThreads) const
+{
+    vMatches.resize(vRanges.size(), 0);
+    if (sortedHashes.empty())
+        return;
+
+    const GCSFilter::Params params = RangedCPBlockFilter::StaticParams();
+    std::vector<Span<const unsigned char>> vFilters;
+    vFilters.reserve(vRanges.size());
+    for (const auto& range : vRanges)
+        vFilters.push_back(range.encodedFilter);
+
+    // Workers take the ranges a chunk at a time, small enough to still balance the (very uneven) filter sizes across threads.
+    const size_t nChunkSize = 64;
+    std::atomic<size_t> nNext{0};
+    auto matchRanges = [&]()
+    {
+        for (size_t nChunkStart = nChunkSize * nNext++; nChunkStart < vRanges.size(); nChunkStart = nChunkSize * nNext++)
+        {
+            const size_t nCount = std::min(nChunkSize, vRanges.size() - nChunkStart);
+            GCSFilter::MatchAnyEncodedBatch(params, Span(vFilters).subspan(nChunkStart, nCount), sortedHashes, Span(vMatches).subspan(nChunkStart, nCount));
+        }
+    };
+    std::vector<std::thread> vWorkers;
+    for (int i = 1; i < nThreads && (size_t)i * nChunkSize < vRanges.size(); ++i)
+        vWorkers.emplace_back(matchRanges);
+    matchRanges();
+    for (auto& worker : vWorkers)
+        worker.join();
+}
+
+std::vector<unsigned char> CStaticFilterCheckpoints::Serialize(const std::vector<std::tuple<uint64_t, uint64_t, std::vector<unsigned char>>>& ranges)
+{
+    std::vector<unsigned char> vData;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, vData, 0);
+    writer.write(AsBytes(Span{STATIC_FILTER_FILE_MAGIC}));
+    writer << FILE_VERSION << (uint32_t)ranges.size();
+
+    uint64_t nFilterOffset = sizeof(STATIC_FILTER_FILE_MAGIC) + 8 + ranges.size() * STATIC_FILTER_TABLE_ENTRY_SIZE;
+    for (const auto& [nStartHeight, nEndHeight, filter] : ranges)
+    {
+        writer << (uint32_t)nStartHeight << (uint32_t)nEndHeight << (uint32_t)nFilterOffset << (uint32_t)filter.size();
+        nFilterOffset += filter.size();
+    }
+    for (const auto& [nStartHeight, nEndHeight, filter] : ranges)
+    {
+        (unused) nStartHeight;
+        (unused) nEndHeight;
+        writer.write(AsBytes(Span{filter.data(), filter.size()}));
+    }
+    return vData;
+}
+
+/**
+ * The loaded checkpoint file along with the match state for the wallet elements seen so far.
+ * Wallets only ever gain keys (key pool top up) between calls, so normally only the new elements have to be matched, and only against the ranges that didn't match yet.
+ */
+struct CStaticFilterMatchState
+{
+    std::string path;
+    uint64_t nOffset = 0;
+    uint64_t nLength = 0;
+    std::unique_ptr<CStaticFilterCheckpoints> checkpoints;
+    //! Sorted element hashes vMatches reflects.
+    std::vector<uint64_t> vMatchedHashes;
+    std::vector<unsigned char> vMatches;
+};
+static Mutex cs_staticFilterMatchState;
+static CStaticFilterMatchState staticFilterMatchState GUARDED_BY(cs_staticFilterMatchState);
 
-//fixme: (POST-PHASE4) We can potentially further improve this by indexing only the actual key hashes and not the entire script
-//This should be slightly smaller and faster
 void getBlockFilterBirthAndRanges(uint64_t nHardBirthDate, uint64_t& nSoftBirthDate, const GCSFilter::ElementSet& walletAddresses, std::vector<std::tuple<uint64_t, uint64_t>>& blockFilterRanges)
 {
     std::string dataFilePath = GetArg("-spvstaticfilterfile", "");
@@ -453,54 +684,55 @@ void getBlockFilterBirthAndRanges(uint64_t nHardBirthDate, uint64_t& nSoftBirthD
         nSoftBirthDate = nHardBirthDate;
         return;
     }
-    else
+
+    uint64_t nStaticFilterOffset = GetArg("-spvstaticfilterfileoffset", (uint64_t)0);
+    uint64_t nStaticFilterLength = GetArg("-spvstaticfilterfilelength", (uint64_t)0);
+
+    LOCK(cs_staticFilterMatchState);
+    CStaticFilterMatchState& state = staticFilterMatchState;
+    if (!state.checkpoints || state.path != dataFilePath || state.nOffset != nStaticFilterOffset || state.nLength != nStaticFilterLength)
     {
-        
-        FILE *file = fsbridge::fopen(dataFilePath, "rb");
-        CAutoFile dataFile(file, SER_DISK, CLIENT_VERSION);            
-        if (dataFile.IsNull() || !dataFile.peek())
+        LogPrintf("Loading staticfiltercp file [%s] [%d] [%d]\n", dataFilePath, nStaticFilterOffset, nStaticFilterLength);
+        state = CStaticFilterMatchState();
+        std::unique_ptr<CStaticFilterCheckpoints> checkpoints(new CStaticFilterCheckpoints());
+        if (!checkpoints->Load(dataFilePath, nStaticFilterOffset, nStaticFilterLength))
         {
             LogPrintf("Failed to read staticfiltercp file [%s]\n", dataFilePath.c_str());
             nSoftBirthDate = nHardBirthDate;
             return;
         }
-        uint64_t nStaticFilterOffset = GetArg("-spvstaticfilterfileoffset", (uint64_t)0);
-        uint64_t nStaticFilterLength = GetArg("-spvstaticfilterfilelength", (uint64_t)0);
-        
-        LogPrintf("Loading staticfiltercp file [%s] [%d] [%d]\n", dataFilePath, nStaticFilterOffset, nStaticFilterLength);
-        if (nStaticFilterLength == 0)
-        {
-            nStaticFilterLength = boost::filesystem::file_size(dataFilePath);
-        }
+        state.path = dataFilePath;
+        state.nOffset = nStaticFilterOffset;
+        state.nLength = nStaticFilterLength;
+        state.checkpoints = std::move(checkpoints);
+    }
 
-        uint64_t nStartIndex = 0;//Earliest possible recovery phrase (before this we didn't use phrases)
-        uint64_t nInterval1 = 500;
-        uint64_t nInterval2 = 100;
-        uint64_t nCrossOver = 10000;
-        uint32_t nRanges=0;
-        dataFile.seekg(nStaticFilterOffset);
-        while (((uint64_t)dataFile.tellg() - nStaticFilterOffset < nStaticFilterLength) && (dataFile.peek() != EOF))
+    std::vector<uint64_t> vHashes = GCSFilter::HashElements(RangedCPBlockFilter::StaticParams(), walletAddresses);
+    std::vector<uint64_t> vNewHashes;
+    if (std::includes(vHashes.begin(), vHashes.end(), state.vMatchedHashes.begin(), state.vMatchedHashes.end()))
+    {
+        std::set_difference(vHashes.begin(), vHashes.end(), state.vMatchedHashes.begin(), state.vMatchedHashes.end(), std::back_inserter(vNewHashes));
+    }
+    else
+    {
+        // Elements went away (different wallet), start over.
+        state.vMatches.clear();
+        vNewHashes = vHashes;
+    }
+    state.checkpoints->MatchRanges(vNewHashes, state.vMatches, std::max(GetNumCores(), 1));
+    state.vMatchedHashes = std::move(vHashes);
+
+    const std::vector<CStaticFilterCheckpoints::Range>& ranges = state.checkpoints->GetRanges();
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (!state.vMatches[i])
+            continue;
+        // Move the birth date forwards as far as possible from the 'hard' birthdate while still including all possible matches
+        if (ranges[i].nStartHeight > nHardBirthDate && ranges[i].nStartHeight < nSoftBirthDate)
         {
-            int nInterval = nInterval1;
-            if (nStartIndex >= nCrossOver)
-                nInterval = nInterval2;
-            size_t nDataSize = ReadCompactSize(dataFile);
-            std::vector<unsigned char> vchData;
-            vchData.resize(nDataSize);
-            dataFile.read(AsWritableBytes(Span{vchData.data(), nDataSize}));
-            RangedCPBlockFilter rangeFilter(vchData);
-            ++nRanges;
-            if (rangeFilter.GetFilter().MatchAny(walletAddresses))
-            {
-                // Move the birth date forwards as far as possible from the 'hard' birthdate while still including all possible matches
-                if (nStartIndex > nHardBirthDate && nStartIndex < nSoftBirthDate)
-                {
-                    nSoftBirthDate = nStartIndex;
-                }
-                blockFilterRanges.push_back(std::tuple(nStartIndex, nStartIndex+nInterval));
-            }
-            nStartIndex+=nInterval;
+            nSoftBirthDate = ranges[i].nStartHeight;
         }
-        LogPrintf("Hard birth block=%d; Soft birth block=%d; Last checkpoint=%d; Addresses=%d; Ranges=%d/%d\n", nHardBirthDate, nSoftBirthDate, Checkpoints::LastCheckPointHeight(), walletAddresses.size(), blockFilterRanges.size(), nRanges);
+        blockFilterRanges.push_back(std::tuple(ranges[i].nStartHeight, ranges[i].nEndHeight));
     }
+    LogPrintf("Hard birth block=%d; Soft birth block=%d; Last checkpoint=%d; Addresses=%d (%d new); Ranges=%d/%d\n", nHardBirthDate, nSoftBirthDate, Checkpoints::LastCheckPointHeight(), walletAddresses.size(), vNewHashes.size(), blockFilterRanges.size(), ranges.size());
 }
@@ -19,6 +19,7 @@
 
 #include <primitives/block.h>
 #include <serialize.h>
+#include <span.h>
 #include <uint256.h>
 #include <undo.h>
 #include "chain.h"
@@ -88,6 +89,24 @@ public:
      */
     bool MatchAny(const ElementSet& elements) const;
     unsigned int NumElements() const;
+
+    /**
+     * Sorted siphashes of elements, not yet mapped into the [0, N * M) range of a particular filter.
+     * As that mapping preserves order the result can be matched against any number of filters that share the siphash keys (see MatchAnyEncoded).
+     */
+    static std::vector<uint64_t> HashElements(const Params& params, const ElementSet& elements);
+
+    /**
+     * MatchAny of hashes (as returned by HashElements) against an encoded filter (as GetEncoded()), decoded in place without copying it or constructing a GCSFilter.
+     * Throws std::ios_base::failure if the encoding is truncated.
+     */
+    static bool MatchAnyEncoded(const Params& params, Span<const unsigned char> encoded, const std::vector<uint64_t>& sortedHashes);
+
+    /**
+     * MatchAnyEncoded of one set of hashes against many filters that share params: results[i] is set if filters[i] may contain one of sortedHashes.
+     * Filters whose result is already set are skipped; filters that fail to decode count as a match, as the caller can't rule them out.
+     */
+    static void MatchAnyEncodedBatch(const Params& params, Span<const Span<const unsigned char>> filters, const std::vector<uint64_t>& sortedHashes, Span<unsigned char> results);
 };
 
 constexpr uint8_t BASIC_FILTER_P = 19;
@@ -186,10 +205,64 @@ public:
 
     //! Reconstruct from parts.
     RangedCPBlockFilter(std::vector<unsigned char> filter);
+
+    //! The (fixed) parameters of all ranged filters.
+    static GCSFilter::Params StaticParams();
 private:
     virtual bool BuildParams(GCSFilter::Params& params) const;
 };
 
+/**
+ * Memory mapped static filter checkpoint file (-spvstaticfilterfile), the ranged filters SPV wallets use to find their block ranges of interest.
+ *
+ * Layout (little endian integers):
+ *   0xff 'F' 'C' 'P'                          magic; a legacy file starts with the compact size of its first filter, which never starts with 0xff
+ *   uint32 version, uint32 count
+ *   count x {uint32 startHeight, uint32 endHeight, uint32 offset, uint32 size}   offset is relative to the start of the file (section)
+ *   the encoded filters
+ * Legacy files (compact size prefixed filters back to back with implied intervals) are read as well, their table is built by skipping over the size prefixes.
+ */
+class CStaticFilterCheckpoints
+{
+public:
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    struct Range
+    {
+        uint64_t nStartHeight;
+        uint64_t nEndHeight;
+        Span<const unsigned char> encodedFilter;
+    };
+
+    CStaticFilterCheckpoints() = default;
+    ~CStaticFilterCheckpoints();
+    CStaticFilterCheckpoints(const CStaticFilterCheckpoints&) = delete;
+    CStaticFilterCheckpoints& operator=(const CStaticFilterCheckpoints&) = delete;
+
+    //! Map nLength bytes (0 for the rest of the file) at nOffset of the file at path and read the range table.
+    bool Load(const std::string& path, uint64_t nOffset, uint64_t nLength);
+
+    const std::vector<Range>& GetRanges() const { return vRanges; }
+
+    //! Set vMatches[i] for every range i that may contain one of sortedHashes (see GCSFilter::HashElements), ranges already set are not checked again.
+    //! Ranges are spread over nThreads threads.
+    void MatchRanges(const std::vector<uint64_t>& sortedHashes, std::vector<unsigned char>& vMatches, int nThreads) const;
+
+    //! Serialize ranges (start height, end height, encoded filter) in the above format.
+    static std::vector<unsigned char> Serialize(const std::vector<std::tuple<uint64_t, uint64_t, std::vector<unsigned char>>>& ranges);
+
+private:
+    bool ReadTable();
+    bool ReadLegacyTable();
+
+    const unsigned char* mappedData = nullptr;
+    size_t nMappedSize = 0;
+    //! Fallback if the file can't be mapped.
+    std::vector<unsigned char> vBuffer;
+    Span<const unsigned char> data;
+    std::vector<Range> vRanges;
+};
+
 void getBlockFilterBirthAndRanges(uint64_t nHardBirthDate, uint64_t& nSoftBirthDate, const GCSFilter::ElementSet& walletAddresses, std::vector<std::tuple<uint64_t, uint64_t>>& blockFilterRanges);
 
 #endif
@@ -0,0 +1,384 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// File contains modifications by: The Centure developers
+// All modifications:
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "blockfilterindex.h"
+#include "blockstore.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "util.h"
+#include "util/syscall_sandbox.h"
+#include "util/threadnames.h"
+#include "validation/validation.h"
+
+CBlockFilterIndex* pblockfilterindex = nullptr;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe)
+: filterType(filterTypeIn)
+, indexPath(GetDataDir() / "blockfilter" / BlockFilterTypeName(filterTypeIn))
+{
+    fs::create_directories(indexPath);
+    db.reset(new CBlockFilterIndexDB(indexPath / "db", nCacheSize, fMemory, fWipe));
+
+    // Anything in the flat files beyond the committed position is from an interrupted run and will simply be overwritten.
+    if (!db->ReadNextFilePos(nextFilePos))
+        nextFilePos = CDiskBlockPos(0, 0);
+    db->ReadBestBlock(bestBlockHash);
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+    if (writeFile)
+        fclose(writeFile);
+}
+
+void CBlockFilterIndex::Start(int nThreads)
+{
+    if (nThreads <= 0)
+        nThreads = std::max(GetNumCores(), 1);
+    interruptSync.reset();
+    syncThread = std::thread([this, nThreads]() {
+        util::ThreadRename("blockfilterindex");
+        SetSyscallSandboxPolicy(SyscallSandboxPolicy::TX_INDEX);
+        ThreadSync(nThreads);
+    });
+}
+
+void CBlockFilterIndex::Stop()
+{
+    interruptSync();
+    if (syncThread.joinable())
+        syncThread.join();
+    Commit();
+}
+
+fs::path CBlockFilterIndex::GetFilterFilename(int nFile) const
+{
+    return indexPath / strprintf("fltr%05u.dat", nFile);
+}
+
+bool CBlockFilterIndex::WriteFilterToFile(const std::vector<unsigned char>& encodedFilter, CDiskBlockPos& pos)
+{
+    AssertLockHeld(cs_blockFilterIndex);
+
+    unsigned int nSize = GetSizeOfCompactSize(encodedFilter.size()) + encodedFilter.size();
+    if (nextFilePos.nPos > 0 && nextFilePos.nPos + nSize > MAX_FLTR_FILE_SIZE)
+    {
+        // Move on to the next file, what we have is made durable with the next commit
+        if (writeFile)
+        {
+            FileCommit(writeFile);
+            fclose(writeFile);
+            writeFile = nullptr;
+        }
+        nextFilePos = CDiskBlockPos(nextFilePos.nFile + 1, 0);
+    }
+
+    if (!writeFile)
+    {
+        fs::path path = GetFilterFilename(nextFilePos.nFile);
+        writeFile = fsbridge::fopen(path, "rb+");
+        if (!writeFile)
+            writeFile = fsbridge::fopen(path, "wb+");
+        if (!writeFile)
+            return error("%s: Unable to open file %s", __func__, path.string());
+    }
+    if (fseek(writeFile, nextFilePos.nPos, SEEK_SET))
+        return error("%s: Unable to seek to position %u of %s", __func__, nextFilePos.nPos, GetFilterFilename(nextFilePos.nFile).string());
+
+    CFile fileout(writeFile, SER_DISK, CLIENT_VERSION);
+    try {
+        fileout << COMPACTSIZEVECTOR(encodedFilter);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    // Make the filter visible to readers (which use their own handle) straight away
+    if (fflush(writeFile) != 0)
+        return error("%s: Failed to flush %s", __func__, GetFilterFilename(nextFilePos.nFile).string());
+
+    pos = nextFilePos;
+    nextFilePos.nPos += nSize;
+    return true;
+}
+
+bool CBlockFilterIndex::ReadFilterFromFile(const CDiskBlockPos& pos, std::vector<unsigned char>& encodedFilter) const
+{
+    CAutoFile filein(fsbridge::fopen(GetFilterFilename(pos.nFile), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: Unable to open filter file %d", __func__, pos.nFile);
+    if (fseek(filein.Get(), pos.nPos, SEEK_SET))
+        return error("%s: Unable to seek to %s", __func__, pos.ToString());
+    try {
+        filein >> COMPACTSIZEVECTOR(encodedFilter);
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupEntry(const uint256& blockHash, CBlockFilterIndexEntry& entry)
+{
+    LOCK(cs_blockFilterIndex);
+    auto iter = mapPendingEntries.find(blockHash);
+    if (iter != mapPendingEntries.end())
+    {
+        entry = iter->second;
+        return true;
+    }
+    return db->ReadFilterEntry(blockHash, entry);
+}
+
+bool CBlockFilterIndex::AppendFilter(const CBlockIndex* pIndex, const BlockFilter& filter)
+{
+    LOCK(cs_blockFilterIndex);
+
+    uint256 prevHeader;
+    if (pIndex->pprev)
+    {
+        CBlockFilterIndexEntry prevEntry;
+        if (!LookupEntry(pIndex->pprev->GetBlockHashPoW2(), prevEntry))
+            return error("%s: Missing filter header for parent of block %s", __func__, pIndex->GetBlockHashPoW2().ToString());
+        prevHeader = prevEntry.header;
+    }
+
+    CBlockFilterIndexEntry entry;
+    if (!WriteFilterToFile(filter.GetEncodedFilter(), entry.pos))
+        return false;
+    entry.filterHash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prevHeader);
+    mapPendingEntries[pIndex->GetBlockHashPoW2()] = entry;
+    bestBlockHash = pIndex->GetBlockHashPoW2();
+    return true;
+}
+
+bool CBlockFilterIndex::Commit()
+{
+    LOCK(cs_blockFilterIndex);
+    if (mapPendingEntries.empty())
+        return true;
+
+    // The flat file data has to be durable before the DB may point at it.
+    if (writeFile)
+        FileCommit(writeFile);
+    if (!db->WriteCommit(mapPendingEntries, bestBlockHash, nextFilePos))
+        return error("%s: Failed to commit block filter index", __func__);
+    mapPendingEntries.clear();
+    return true;
+}
+
+CBlockFilterIndex::BlockDataPos CBlockFilterIndex::GetBlockDataPos(const CBlockIndex* pIndex)
+{
+    AssertLockHeld(cs_main); // Required for the index status and block/undo positions.
+
+    BlockDataPos blockDataPos;
+    blockDataPos.pIndex = pIndex;
+    blockDataPos.hashBlock = pIndex->GetBlockHashPoW2();
+    if (pIndex->nStatus & BLOCK_HAVE_DATA)
+        blockDataPos.blockPos = pIndex->GetBlockPos();
+    if (pIndex->pprev)
+    {
+        blockDataPos.undoPos = pIndex->GetUndoPos();
+        blockDataPos.hashPrevBlock = pIndex->pprev->GetBlockHashPoW2();
+    }
+    return blockDataPos;
+}
+
+bool CBlockFilterIndex::ReadBlockAndUndo(const BlockDataPos& blockDataPos, CBlock& block, CBlockUndo& blockUndo)
+{
+    if (!blockStore.ReadBlockFromDiskConcurrent(block, blockDataPos.blockPos, blockDataPos.hashBlock))
+        return false;
+    if (!blockDataPos.hashPrevBlock.IsNull())
+    {
+        if (!blockStore.UndoReadFromDiskConcurrent(blockUndo, blockDataPos.undoPos, blockDataPos.hashPrevBlock))
+            return false;
+    }
+    return true;
+}
+
+void CBlockFilterIndex::ThreadSync(int nThreads)
+{
+    const CBlockIndex* pBest = nullptr;
+    {
+        LOCK(cs_main);
+        uint256 committedBest;
+        {
+            LOCK(cs_blockFilterIndex);
+            committedBest = bestBlockHash;
+        }
+        BlockMap::iterator iter = mapBlockIndex.find(committedBest);
+        if (iter != mapBlockIndex.end())
+            pBest = chainActive.FindFork(iter->second);
+    }
+    LogPrintf("%s: Syncing block filter index from height %d with %d threads\n", __func__, pBest ? pBest->nHeight : -1, nThreads);
+
+    int64_t nLastLog = 0;
+    while (!interruptSync)
+    {
+        std::vector<BlockDataPos> vBatch;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pTip = chainActive.Tip();
+            if (!pTip)
+            {
+                if (!interruptSync.sleep_for(std::chrono::seconds(1)))
+                    return;
+                continue;
+            }
+            // Our last indexed block may have been reorganised away in the meantime
+            if (pBest && chainActive[pBest->nHeight] != pBest)
+                pBest = chainActive.FindFork(pBest);
+            if (pBest == pTip)
+            {
+                // From here on BlockConnected takes over, as we hold cs_main no block can connect in between.
+                fSynced = true;
+                LogPrintf("%s: Block filter index is synced at height %d\n", __func__, pTip->nHeight);
+                break;
+            }
+            for (int nHeight = pBest ? pBest->nHeight + 1 : 0; nHeight <= pTip->nHeight && vBatch.size() < BLOCKFILTERINDEX_SYNC_BATCH_SIZE; ++nHeight)
+                vBatch.push_back(GetBlockDataPos(chainActive[nHeight]));
+        }
+
+        // Build the filters for the batch in parallel, the headers chain so those are computed in order afterwards.
+        std::vector<BlockFilter> vFilters(vBatch.size());
+        std::atomic<size_t> nNext{0};
+        std::atomic<bool> fFailed{false};
+        auto buildFilters = [&]()
+        {
+            for (size_t i = nNext++; i < vBatch.size() && !fFailed && !interruptSync; i = nNext++)
+            {
+                CBlock block;
+                CBlockUndo blockUndo;
+                if (!ReadBlockAndUndo(vBatch[i], block, blockUndo))
+                {
+                    LogPrintf("%s: Unable to read block data for %s\n", __func__, vBatch[i].hashBlock.ToString());
+                    fFailed = true;
+                    return;
+                }
+                vFilters[i] = BlockFilter(filterType, block, blockUndo);
+            }
+        };
+        std::vector<std::thread> vWorkers;
+        for (int i = 1; i < nThreads && (size_t)i < vBatch.size(); ++i)
+            vWorkers.emplace_back(buildFilters);
+        buildFilters();
+        for (auto& worker : vWorkers)
+            worker.join();
+
+        if (interruptSync)
+            break;
+        if (fFailed)
+        {
+            LogPrintf("%s: Block filter index sync stopped, block data unavailable (pruned?)\n", __func__);
+            break;
+        }
+
+        for (size_t i = 0; i < vBatch.size(); ++i)
+        {
+            if (!AppendFilter(vBatch[i].pIndex, vFilters[i]))
+            {
+                LogPrintf("%s: Block filter index sync stopped, failed to write filter\n", __func__);
+                Commit();
+                return;
+            }
+        }
+        Commit();
+        pBest = vBatch.back().pIndex;
+
+        if (GetTimeMillis() - nLastLog > 30000)
+        {
+            LogPrintf("%s: Block filter index synced up to height %d\n", __func__, pBest->nHeight);
+            nLastLog = GetTimeMillis();
+        }
+    }
+    Commit();
+}
+
+void CBlockFilterIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, [[maybe_unused]] const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (!fSynced)
+        return;
+
+    // Notifications queued before the sync thread finished may refer to blocks it already indexed
+    CBlockFilterIndexEntry existingEntry;
+    if (LookupEntry(pindex->GetBlockHashPoW2(), existingEntry))
+        return;
+
+    CBlockUndo blockUndo;
+    if (pindex->pprev)
+    {
+        BlockDataPos blockDataPos;
+        {
+            LOCK(cs_main);
+            blockDataPos = GetBlockDataPos(pindex);
+        }
+        if (!blockStore.UndoReadFromDiskConcurrent(blockUndo, blockDataPos.undoPos, blockDataPos.hashPrevBlock))
+        {
+            LogPrintf("%s: Unable to read undo data for %s, not indexed\n", __func__, pindex->GetBlockHashPoW2().ToString());
+            return;
+        }
+    }
+
+    if (!AppendFilter(pindex, BlockFilter(filterType, *block, blockUndo)))
+        return;
+
+    bool fCommit;
+    {
+        LOCK(cs_blockFilterIndex);
+        fCommit = mapPendingEntries.size() >= BLOCKFILTERINDEX_MAX_PENDING;
+    }
+    if (fCommit)
+        Commit();
+}
+
+void CBlockFilterIndex::SetBestChain([[maybe_unused]] const CBlockLocator& locator)
+{
+    // The chain state was flushed, commit along with it so that the index doesn't fall far behind on a crash.
+    if (fSynced)
+        Commit();
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pIndex, BlockFilter& filter)
+{
+    CBlockFilterIndexEntry entry;
+    if (!LookupEntry(pIndex->GetBlockHashPoW2(), entry))
+        return false;
+
+    std::vector<unsigned char> encodedFilter;
+    if (!ReadFilterFromFile(entry.pos, encodedFilter))
+        return false;
+    filter = BlockFilter(filterType, pIndex->GetBlockHashPoW2(), std::move(encodedFilter));
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pIndex, uint256& header)
+{
+    CBlockFilterIndexEntry entry;
+    if (!LookupEntry(pIndex->GetBlockHashPoW2(), entry))
+        return false;
+    header = entry.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pStopIndex, std::vector<BlockFilter>& filters)
+{
+    if (nStartHeight < 0 || !pStopIndex || nStartHeight > pStopIndex->nHeight)
+        return false;
+
+    filters.resize(pStopIndex->nHeight - nStartHeight + 1);
+    const CBlockIndex* pIndex = pStopIndex;
+    for (auto iter = filters.rbegin(); iter != filters.rend(); ++iter, pIndex = pIndex->pprev)
+    {
+        if (!LookupFilter(pIndex, *iter))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// File contains modifications by: The Centure developers
+// All modifications:
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef BLOCKFILTERINDEX_H
+#define BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "chain.h"
+#include "sync.h"
+#include "threadinterrupt.h"
+#include "txdb.h"
+#include "validation/validationinterface.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+//! -blockfilterindexthreads default, 0 means one thread per core
+static const int DEFAULT_BLOCKFILTERINDEX_THREADS = 0;
+//! Maximum size of a single flat filter file (fltr?????.dat)
+static const unsigned int MAX_FLTR_FILE_SIZE = 0x1000000; // 16 MiB
+//! Number of blocks the background sync builds (in parallel) before committing them
+static const unsigned int BLOCKFILTERINDEX_SYNC_BATCH_SIZE = 1000;
+//! Commit after this many newly connected blocks even if no chain state flush happened in between
+static const unsigned int BLOCKFILTERINDEX_MAX_PENDING = 1000;
+
+/** Persistent index of BIP 157 block filters (and filter headers) for every block in the active chain.
+ *
+ *  Encoded filters are appended to flat files in blockfilter/<type>/, their location and the filter header are kept in a LevelDB keyed by block hash.
+ *  Historic blocks are indexed by a background sync thread that builds filters on multiple threads and commits them in chain order;
+ *  once that has caught up with the tip new blocks are indexed as they connect (via the validation interface).
+ */
+class CBlockFilterIndex : public CValidationInterface
+{
+public:
+    CBlockFilterIndex(BlockFilterType filterType, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    virtual ~CBlockFilterIndex();
+
+    /** Start the background sync over historic blocks using nThreads threads to build filters. */
+    void Start(int nThreads);
+    /** Interrupt the background sync and commit all pending entries. */
+    void Stop();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    /** True once the background sync has caught up with the tip and new blocks are indexed as they connect. */
+    bool IsSynced() const { return fSynced; }
+
+    bool LookupFilter(const CBlockIndex* pIndex, BlockFilter& filter);
+    bool LookupFilterHeader(const CBlockIndex* pIndex, uint256& header);
+    /** Filters for all blocks from nStartHeight up to and including pStopIndex (in height order). */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pStopIndex, std::vector<BlockFilter>& filters);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void SetBestChain(const CBlockLocator& locator) override;
+
+private:
+    //! Location of a block and its undo data, taken from the block index under cs_main so that the data can then be read without it.
+    struct BlockDataPos
+    {
+        const CBlockIndex* pIndex = nullptr;
+        uint256 hashBlock;
+        CDiskBlockPos blockPos;
+        //! Null (along with hashPrevBlock) for the genesis block, which has no undo data.
+        CDiskBlockPos undoPos;
+        uint256 hashPrevBlock;
+    };
+    static BlockDataPos GetBlockDataPos(const CBlockIndex* pIndex);
+
+    void ThreadSync(int nThreads);
+    bool ReadBlockAndUndo(const BlockDataPos& blockDataPos, CBlock& block, CBlockUndo& blockUndo);
+    bool AppendFilter(const CBlockIndex* pIndex, const BlockFilter& filter);
+    bool LookupEntry(const uint256& blockHash, CBlockFilterIndexEntry& entry);
+    bool Commit();
+
+    fs::path GetFilterFilename(int nFile) const;
+    bool WriteFilterToFile(const std::vector<unsigned char>& encodedFilter, CDiskBlockPos& pos);
+    bool ReadFilterFromFile(const CDiskBlockPos& pos, std::vector<unsigned char>& encodedFilter) const;
+
+    const BlockFilterType filterType;
+    const fs::path indexPath;
+    std::unique_ptr<CBlockFilterIndexDB> db;
+
+    std::atomic<bool> fSynced{false};
+    std::thread syncThread;
+    CThreadInterrupt interruptSync;
+
+    RecursiveMutex cs_blockFilterIndex;
+    //! Entries written to the flat files but not yet committed to the DB.
+    std::map<uint256, CBlockFilterIndexEntry> mapPendingEntries;
+    //! Most recently indexed block (committed as best block with the pending entries).
+    uint256 bestBlockHash;
+    CDiskBlockPos nextFilePos;
+    FILE* writeFile = nullptr;
+};
+
+extern CBlockFilterIndex* pblockfilterindex;
+
+#endif // BLOCKFILTERINDEX_H
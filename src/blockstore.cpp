@@ -13,12 +13,33 @@
 #include "blockstore.h"
 #include "checkpoints.h"
 #include "streams.h"
+#include "txdb.h"
 #include "clientversion.h"
 #include "validation/validation.h" //For cs_main
 #include "util.h" // For DO_BENCHMARK
+#include "crypto/common.h"
+#include "hash.h"
+#include "util/syscall_sandbox.h"
+#include "util/threadnames.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 CBlockStore blockStore;
 
+// Size of the index header (network magic + record size) that precedes every block and undo record.
+static const unsigned int BLOCK_RECORD_HEADER_SIZE = 8;
+
+CBlockStore::~CBlockStore()
+{
+    if (writerThread.joinable())
+        StopWriter();
+}
+
 fs::path CBlockStore::GetBlockPosFilename(const CDiskBlockPos &pos, BlockFileType fileType)
 {
     std::string basename = mainPrefix + (fileType == BlockFileType::block ? "blk" : "rev");
@@ -35,12 +56,19 @@ FILE* CBlockStore::GetDiskFile(const CDiskBlockPos &pos, BlockFileType fileType,
     if (pos.IsNull())
         return NULL;
 
+    // Direct file access has to observe everything that has been queued for the file so far
+    WaitForPendingFileWrites(BlockFileKey(pos.nFile, fileType));
+
     if (int(vBlockfiles.size()) <= pos.nFile) {
         vBlockfiles.resize(pos.nFile + 1);
     }
 
     FILE*& file = fileType == BlockFileType::block ? vBlockfiles[pos.nFile].blockfile
                                                     : vBlockfiles[pos.nFile].undofile;
+    // Anything that may append to the file invalidates the mapping (the mapping would not cover the new data)
+    if (!fNoCreate)
+        MarkFileWritable(pos.nFile, fileType);
+
     if (!file) {
         fs::path path = GetBlockPosFilename(pos, fileType);
         fs::create_directories(path.parent_path());
@@ -76,33 +104,406 @@ FILE* CBlockStore::GetUndoFile(const CDiskBlockPos &pos, bool fNoCreate) {
 
 void CBlockStore::CloseBlockFiles()
 {
+    StopWriter();
     vBlockfiles.clear();
+    {
+        LOCK(cs_mappedFiles);
+        vMappedFiles.clear();
+    }
     LogPrintStr("Block and undo files closed\n");
 }
 
+void CBlockStore::FinalizeBlockFile(int nFile)
+{
+    LOCK(cs_mappedFiles);
+    if (nFile < 0 || nFile >= int(vMappedFiles.size()))
+        return;
+    vMappedFiles[nFile].fBlockWritable = false;
+    vMappedFiles[nFile].fUndoWritable = false;
+}
+
+CBlockStore::MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    munmap((void*)data, nSize);
+#endif
+}
+
+bool CBlockStore::MappedFile::GetRecord(const CDiskBlockPos& pos, size_t nTrailerSize, Span<const unsigned char>& record) const
+{
+    // Every record is preceded by the network magic and a 4 byte (little endian) record size
+    if (pos.nPos < 4 || pos.nPos > nSize)
+        return false;
+    uint64_t nRecordSize = ReadLE32(data + pos.nPos - 4);
+    if (nRecordSize > MAX_SIZE || pos.nPos + nRecordSize + nTrailerSize > nSize)
+        return false;
+    record = Span<const unsigned char>(data + pos.nPos, nRecordSize + nTrailerSize);
+    return true;
+}
+
+std::shared_ptr<const CBlockStore::MappedFile> CBlockStore::GetMappedFile(const CDiskBlockPos& pos, BlockFileType fileType)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    if (pos.IsNull())
+        return nullptr;
+
+    LOCK(cs_mappedFiles);
+    if (int(vMappedFiles.size()) <= pos.nFile)
+        vMappedFiles.resize(pos.nFile + 1);
+
+    MappedFilePair& mappedPair = vMappedFiles[pos.nFile];
+    if (fileType == BlockFileType::block ? mappedPair.fBlockWritable : mappedPair.fUndoWritable)
+        return nullptr;
+    std::shared_ptr<const MappedFile>& mapped = fileType == BlockFileType::block ? mappedPair.blockmap : mappedPair.undomap;
+    if (mapped)
+        return mapped;
+
+    fs::path path = GetBlockPosFilename(pos, fileType);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        LogPrint(BCLog::IO, "Unable to map file %s, falling back to buffered reads\n", path.string());
+        return nullptr;
+    }
+    mapped = std::make_shared<const MappedFile>((const unsigned char*)data, (size_t)fileStat.st_size);
+    return mapped;
+#endif
+}
+
+void CBlockStore::MarkFileWritable(int nFile, BlockFileType fileType)
+{
+    LOCK(cs_mappedFiles);
+    if (int(vMappedFiles.size()) <= nFile)
+        vMappedFiles.resize(nFile + 1);
+    if (fileType == BlockFileType::block)
+    {
+        vMappedFiles[nFile].fBlockWritable = true;
+        vMappedFiles[nFile].blockmap = nullptr;
+    }
+    else
+    {
+        vMappedFiles[nFile].fUndoWritable = true;
+        vMappedFiles[nFile].undomap = nullptr;
+    }
+}
+
+void CBlockStore::UnmapFiles(int nFile)
+{
+    LOCK(cs_mappedFiles);
+    if (nFile < 0 || nFile >= int(vMappedFiles.size()))
+        return;
+    vMappedFiles[nFile].blockmap = nullptr;
+    vMappedFiles[nFile].undomap = nullptr;
+}
+
+bool CBlockStore::ReadBlockFromMemory(CBlock& block, const CDiskBlockPos& pos)
+{
+    // Blocks still queued for the writer are served from the queued record, blocks in finalized files from the mapping.
+    std::shared_ptr<const std::vector<unsigned char>> pendingRecord = GetPendingRecord(pos, BlockFileType::block);
+    std::shared_ptr<const MappedFile> mapped;
+    Span<const unsigned char> record;
+    if (pendingRecord)
+    {
+        record = Span<const unsigned char>(*pendingRecord).subspan(BLOCK_RECORD_HEADER_SIZE);
+    }
+    else
+    {
+        mapped = GetMappedFile(pos, BlockFileType::block);
+        if (!mapped || !mapped->GetRecord(pos, 0, record))
+            return false;
+    }
+
+    try {
+        SpanReader(SER_DISK, CLIENT_VERSION, record) >> block;
+    }
+    catch (const std::exception& e) {
+        LogPrint(BCLog::IO, "%s: Deserialize error from memory - %s at %s\n", __func__, e.what(), pos.ToString());
+        block.SetNull();
+        return false;
+    }
+    return true;
+}
+
+bool CBlockStore::UndoReadFromMemory(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    std::shared_ptr<const std::vector<unsigned char>> pendingRecord = GetPendingRecord(pos, BlockFileType::undo);
+    std::shared_ptr<const MappedFile> mapped;
+    Span<const unsigned char> record;
+    if (pendingRecord)
+    {
+        record = Span<const unsigned char>(*pendingRecord).subspan(BLOCK_RECORD_HEADER_SIZE);
+    }
+    else
+    {
+        mapped = GetMappedFile(pos, BlockFileType::undo);
+        if (!mapped || !mapped->GetRecord(pos, sizeof(uint256), record))
+            return false;
+    }
+    Span<const unsigned char> undoData = record.first(record.size() - sizeof(uint256));
+
+    // The checksum covers the serialized undo data as stored, so hash the bytes directly instead of reserializing.
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write(AsBytes(undoData));
+    if (memcmp(hasher.GetHash().begin(), record.data() + undoData.size(), sizeof(uint256)) != 0)
+        return false;
+
+    try {
+        SpanReader(SER_DISK, CLIENT_VERSION, undoData) >> blockundo;
+    }
+    catch (const std::exception& e) {
+        LogPrint(BCLog::IO, "%s: Deserialize error from memory - %s\n", __func__, e.what());
+        blockundo = CBlockUndo();
+        return false;
+    }
+    return true;
+}
+
+bool CBlockStore::EnqueueWrite(WriteOperation&& operation)
+{
+    // The file is growing, it can't be served from a mapping until finalized again
+    MarkFileWritable(operation.file.first, operation.file.second);
+
+    WAIT_LOCK(cs_writer, lock);
+    if (!writerThread.joinable())
+    {
+        fWriterStop = false;
+        writerThread = std::thread([this]() {
+            util::ThreadRename("blockwriter");
+            SetSyscallSandboxPolicy(SyscallSandboxPolicy::BLOCK_WRITER);
+            WriterThread();
+        });
+    }
+
+    // Apply back pressure if the disk can't keep up
+    size_t nRecordSize = operation.record ? operation.record->size() : 0;
+    while (nWriteQueueBytes > 0 && nWriteQueueBytes + nRecordSize > MAX_BLOCK_WRITER_QUEUE_BYTES)
+        cvWriterProgress.wait(lock);
+
+    ++mapPendingFileWrites[operation.file];
+    if (operation.record)
+    {
+        mapPendingRecords[PendingRecordKey{operation.file, operation.nPos + BLOCK_RECORD_HEADER_SIZE}] = operation.record;
+        nWriteQueueBytes += nRecordSize;
+    }
+    writeQueue.push_back(std::move(operation));
+    cvWriterWork.notify_one();
+    return !fWriterFailed;
+}
+
+std::shared_ptr<const std::vector<unsigned char>> CBlockStore::GetPendingRecord(const CDiskBlockPos& pos, BlockFileType fileType)
+{
+    LOCK(cs_writer);
+    auto iter = mapPendingRecords.find(PendingRecordKey{BlockFileKey(pos.nFile, fileType), pos.nPos});
+    if (iter == mapPendingRecords.end())
+        return nullptr;
+    return iter->second;
+}
+
+void CBlockStore::WaitForPendingFileWrites(const BlockFileKey& file)
+{
+    WAIT_LOCK(cs_writer, lock);
+    while (mapPendingFileWrites.count(file))
+        cvWriterProgress.wait(lock);
+}
+
+FILE* CBlockStore::GetWriterFile(const BlockFileKey& file)
+{
+    FILE*& writerFile = mapWriterFiles[file];
+    if (!writerFile)
+    {
+        fs::path path = GetBlockPosFilename(CDiskBlockPos(file.first, 0), file.second);
+        fs::create_directories(path.parent_path());
+        writerFile = fsbridge::fopen(path, "rb+");
+        if (!writerFile)
+            writerFile = fsbridge::fopen(path, "wb+");
+        if (!writerFile)
+            LogPrintf("Unable to open file %s\n", path.string());
+    }
+    return writerFile;
+}
+
+void CBlockStore::WriterThread()
+{
+    std::vector<WriteOperation> batch;
+    while (true)
+    {
+        {
+            WAIT_LOCK(cs_writer, lock);
+            // Clean up after the previous batch, which is on disk (or at least with the OS) now
+            for (const auto& operation : batch)
+            {
+                if (--mapPendingFileWrites[operation.file] == 0)
+                    mapPendingFileWrites.erase(operation.file);
+                if (operation.record)
+                {
+                    mapPendingRecords.erase(PendingRecordKey{operation.file, operation.nPos + BLOCK_RECORD_HEADER_SIZE});
+                    nWriteQueueBytes -= operation.record->size();
+                }
+            }
+            batch.clear();
+            fWriterBusy = false;
+            cvWriterProgress.notify_all();
+
+            while (writeQueue.empty() && !fWriterStop)
+                cvWriterWork.wait(lock);
+            if (writeQueue.empty())
+                return;
+
+            // Take everything that is queued, consecutive records in the same file then turn into a single buffered write.
+            fWriterBusy = true;
+            batch.reserve(writeQueue.size());
+            while (!writeQueue.empty())
+            {
+                batch.push_back(std::move(writeQueue.front()));
+                writeQueue.pop_front();
+            }
+        }
+
+        std::set<BlockFileKey> setWrittenFiles;
+        bool fFailed = false;
+        for (const auto& operation : batch)
+        {
+            FILE* file = GetWriterFile(operation.file);
+            if (!file)
+            {
+                fFailed = true;
+                continue;
+            }
+            setWrittenFiles.insert(operation.file);
+            if (!operation.record)
+            {
+                AllocateFileRange(file, operation.nPos, operation.nPreallocateLength);
+                continue;
+            }
+            if ((long)operation.nPos != ftell(file) && fseek(file, operation.nPos, SEEK_SET) != 0)
+            {
+                fFailed = true;
+                continue;
+            }
+            if (fwrite(operation.record->data(), 1, operation.record->size(), file) != operation.record->size())
+                fFailed = true;
+        }
+        for (const auto& file : setWrittenFiles)
+        {
+            if (fflush(mapWriterFiles[file]) != 0)
+                fFailed = true;
+        }
+
+        LOCK(cs_writer);
+        setUnsyncedFiles.insert(setWrittenFiles.begin(), setWrittenFiles.end());
+        if (fFailed)
+        {
+            LogPrintf("%s: Failed to write block or undo data\n", __func__);
+            fWriterFailed = true;
+        }
+    }
+}
+
+bool CBlockStore::SyncPendingWrites()
+{
+    DO_BENCHMARK("CBlockStore: SyncPendingWrites", BCLog::BENCH|BCLog::IO);
+
+    WAIT_LOCK(cs_writer, lock);
+    while (!writeQueue.empty() || fWriterBusy)
+        cvWriterProgress.wait(lock);
+
+    // One fsync per file touched since the previous sync, regardless of how many records were written to it.
+    for (const auto& file : setUnsyncedFiles)
+    {
+        if (mapWriterFiles[file])
+            FileCommit(mapWriterFiles[file]);
+    }
+    setUnsyncedFiles.clear();
+    return !fWriterFailed;
+}
+
+void CBlockStore::CloseWriterFiles()
+{
+    WAIT_LOCK(cs_writer, lock);
+    while (!writeQueue.empty() || fWriterBusy)
+        cvWriterProgress.wait(lock);
+
+    for (const auto& file : setUnsyncedFiles)
+    {
+        if (mapWriterFiles[file])
+            FileCommit(mapWriterFiles[file]);
+    }
+    setUnsyncedFiles.clear();
+    for (auto& [file, writerFile] : mapWriterFiles)
+    {
+        if (writerFile)
+            fclose(writerFile);
+    }
+    mapWriterFiles.clear();
+}
+
+void CBlockStore::StopWriter()
+{
+    CloseWriterFiles();
+    {
+        LOCK(cs_writer);
+        fWriterStop = true;
+        cvWriterWork.notify_all();
+    }
+    if (writerThread.joinable())
+        writerThread.join();
+}
+
+void CBlockStore::PreallocateBlockFile(const CDiskBlockPos& pos, unsigned int nLength)
+{
+    WriteOperation operation;
+    operation.file = BlockFileKey(pos.nFile, BlockFileType::block);
+    operation.nPos = pos.nPos;
+    operation.nPreallocateLength = nLength;
+    EnqueueWrite(std::move(operation));
+}
+
+void CBlockStore::PreallocateUndoFile(const CDiskBlockPos& pos, unsigned int nLength)
+{
+    WriteOperation operation;
+    operation.file = BlockFileKey(pos.nFile, BlockFileType::undo);
+    operation.nPos = pos.nPos;
+    operation.nPreallocateLength = nLength;
+    EnqueueWrite(std::move(operation));
+}
+
 bool CBlockStore::WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     DO_BENCHMARK("CBlockStore: WriteBlockToDisk", BCLog::BENCH|BCLog::IO);
 
     AssertLockHeld(cs_main);
 
-    // Open history file to append
-    CFile fileout(GetBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
+    if (pos.IsNull())
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
-    // Write index header
-    unsigned int nSize = ::GetSerializeSize(fileout, block);
-
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
-
+    // Serialize the complete record (index header + block) here, the writer only has to put the bytes on disk.
+    auto record = std::make_shared<std::vector<unsigned char>>();
+    CVectorWriter recordWriter(SER_DISK, CLIENT_VERSION, *record, 0);
+    unsigned int nSize = ::GetSerializeSize(recordWriter, block);
+    record->reserve(BLOCK_RECORD_HEADER_SIZE + nSize);
+    recordWriter << FLATDATA(messageStart) << nSize << block;
+
+    WriteOperation operation;
+    operation.file = BlockFileKey(pos.nFile, BlockFileType::block);
+    operation.nPos = pos.nPos;
+    operation.record = std::move(record);
+    pos.nPos += BLOCK_RECORD_HEADER_SIZE;
+    if (!EnqueueWrite(std::move(operation)))
+        return error("WriteBlockToDisk: block writer failed");
     return true;
 }
 
@@ -114,17 +515,21 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
 
     block.SetNull();
 
-    // Open history file to read
-    CFile filein(GetBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    // Queued blocks and finalized files are served straight from memory, everything else (or any failure) goes through the buffered file.
+    if (!ReadBlockFromMemory(block, pos))
+    {
+        // Open history file to read
+        CFile filein(GetBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     if (index && block.GetHashPoW2() != index->GetBlockHashPoW2())
@@ -145,6 +550,10 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
         {
             fPOW_ok = checkedPoWCache.get(hashLegacy);
         }
+        else if (ppowcachedb && ppowcachedb->HaveVerifiedPoW(hashLegacy))
+        {
+            fPOW_ok = true;
+        }
         else
         {
             //fPOW_ok = CheckProofOfWork(&block, params.GetConsensus());
@@ -160,32 +569,64 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
     return true;
 }
 
+bool CBlockStore::ReadBlockFromDiskConcurrent(CBlock& block, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    DO_BENCHMARK("CBlockStore: ReadBlockFromDiskConcurrent", BCLog::BENCH|BCLog::IO);
+
+    block.SetNull();
+    if (pos.IsNull())
+        return false;
+
+    if (!ReadBlockFromMemory(block, pos))
+    {
+        WaitForPendingFileWrites(BlockFileKey(pos.nFile, BlockFileType::block));
+
+        CFile filein(fsbridge::fopen(GetBlockPosFilename(pos, BlockFileType::block), "rb"), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull() || fseek(filein.Get(), pos.nPos, SEEK_SET))
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+
+    if (block.GetHashPoW2() != hashBlock)
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, hashBlock.ToString(), pos.ToString());
+
+    // Matching the (validated) index entry is all the header check of ReadBlockFromDisk amounts to as well
+    block.fPOWChecked = true;
+    return true;
+}
+
 bool CBlockStore::UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     DO_BENCHMARK("CBlockStore: UndoWriteToDisk", BCLog::BENCH|BCLog::IO);
 
-    // Open history file to append
-    CFile fileout(GetUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
+    if (pos.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
-    // Write index header
-    unsigned int nSize = ::GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    // Serialize the complete record (index header + undo data + checksum) for the writer
+    auto record = std::make_shared<std::vector<unsigned char>>();
+    CVectorWriter recordWriter(SER_DISK, CLIENT_VERSION, *record, 0);
+    unsigned int nSize = ::GetSerializeSize(recordWriter, blockundo);
+    record->reserve(BLOCK_RECORD_HEADER_SIZE + nSize + sizeof(uint256));
+    recordWriter << FLATDATA(messageStart) << nSize << blockundo;
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
-
+    recordWriter << hasher.GetHash();
+
+    WriteOperation operation;
+    operation.file = BlockFileKey(pos.nFile, BlockFileType::undo);
+    operation.nPos = pos.nPos;
+    operation.record = std::move(record);
+    pos.nPos += BLOCK_RECORD_HEADER_SIZE;
+    if (!EnqueueWrite(std::move(operation)))
+        return error("%s: block writer failed", __func__);
     return true;
 }
 
@@ -193,6 +634,9 @@ bool CBlockStore::UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& p
 {
     DO_BENCHMARK("CBlockStore: UndoReadFromDisk", BCLog::BENCH|BCLog::IO);
 
+    if (UndoReadFromMemory(blockundo, pos, hashBlock))
+        return true;
+
     // Open history file to read
     CFile filein(GetUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -217,10 +661,44 @@ bool CBlockStore::UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& p
     return true;
 }
 
+bool CBlockStore::UndoReadFromDiskConcurrent(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    DO_BENCHMARK("CBlockStore: UndoReadFromDiskConcurrent", BCLog::BENCH|BCLog::IO);
+
+    if (pos.IsNull())
+        return false;
+    if (UndoReadFromMemory(blockundo, pos, hashBlock))
+        return true;
+
+    WaitForPendingFileWrites(BlockFileKey(pos.nFile, BlockFileType::undo));
+
+    CFile filein(fsbridge::fopen(GetBlockPosFilename(pos, BlockFileType::undo), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull() || fseek(filein.Get(), pos.nPos, SEEK_SET))
+        return error("%s: OpenUndoFile failed for %s", __func__, pos.ToString());
+
+    uint256 hashChecksum;
+    CHashVerifier<CAutoFile> verifier(&filein);
+    try {
+        verifier << hashBlock;
+        verifier >> blockundo;
+        filein >> hashChecksum;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    if (hashChecksum != verifier.GetHash())
+        return error("%s: Checksum mismatch at %s", __func__, pos.ToString());
+
+    return true;
+}
+
 void CBlockStore::UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
+    CloseWriterFiles();
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         int nFile = *it;
+        UnmapFiles(nFile);
         if (nFile < 0 || nFile >= int(vBlockfiles.size()))
             break;
         BlockFilePair& p = vBlockfiles[nFile];
@@ -17,15 +17,32 @@
 // revert the changes in this commit for blockstore.h + .cpp back to 517362d123ce7c7e83de86a962ad099abbf199b0
 
 #include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
 #include "chain.h"
 #include "chainparams.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
+#include "span.h"
+#include "sync.h"
 #include "undo.h"
 
+/** Maximum amount of serialized block/undo data that may be queued for the block writer before WriteBlockToDisk/UndoWriteToDisk block */
+static const size_t MAX_BLOCK_WRITER_QUEUE_BYTES = 64 * 1024 * 1024;
+
+namespace blockstore_tests
+{
+    class CBlockStoreTestAccess;
+}
+
 class CBlockStore
 {
+friend class blockstore_tests::CBlockStoreTestAccess; // for test access to the mappings and the block writer
 public:
     CBlockStore() {}
+    ~CBlockStore();
 
     bool BlockFileExists(const CDiskBlockPos &pos);
 
@@ -42,7 +59,16 @@ public:
     /** Closes all open block and undo files */
     void CloseBlockFiles();
 
+    /** Mark the block and undo file nFile as finalized (no further appends expected) so that reads can be served from a memory mapping again.
+        Must be called after the file has been flushed to disk.
+    */
+    void FinalizeBlockFile(int nFile);
+
 
+    /** Queue block for writing at pos (as allocated by FindBlockPos), on return pos points at the block data.
+        The write is performed asynchronously by the block writer thread, reads of the block are served from the queue until it is on disk.
+        Durability is only guaranteed after a subsequent SyncPendingWrites.
+    */
     bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 
     /** Read block from disk and do basic verifiaction to guard against (disk) corruption.
@@ -53,8 +79,26 @@ public:
     */
     bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const CChainParams& params, const CBlockIndex* index = nullptr);
 
+    /** Read an already validated block without holding cs_main, for readers that run alongside validation (e.g. a wallet rescan).
+        Served from memory where possible, otherwise through a private file handle so that no shared file state is touched.
+        pos and hashBlock have to be taken from the index under cs_main beforehand; fails if the block has been pruned since.
+    */
+    bool ReadBlockFromDiskConcurrent(CBlock& block, const CDiskBlockPos& pos, const uint256& hashBlock);
+
+    /** Queue undo data for writing, see WriteBlockToDisk */
     bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart);
     bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+    /** Undo data counterpart of ReadBlockFromDiskConcurrent, hashBlock is the hash of the parent block (as for UndoReadFromDisk) */
+    bool UndoReadFromDiskConcurrent(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+
+    /** Queue pre-allocation of nLength bytes from pos onwards, performed by the block writer in order with the queued writes */
+    void PreallocateBlockFile(const CDiskBlockPos& pos, unsigned int nLength);
+    void PreallocateUndoFile(const CDiskBlockPos& pos, unsigned int nLength);
+
+    /** Wait for all queued writes to reach the OS and fsync every file written to since the previous sync.
+        Returns false if any queued write failed.
+    */
+    bool SyncPendingWrites();
 
     /**
      *  Actually unlink the specified files
@@ -72,6 +116,7 @@ public:
 
 private:
     enum class BlockFileType { block, undo };
+    typedef std::pair<int, BlockFileType> BlockFileKey;
     fs::path GetBlockPosFilename(const CDiskBlockPos &pos, BlockFileType fileType);
     FILE* GetDiskFile(const CDiskBlockPos &pos, BlockFileType fileType, bool fNoCreate);
 
@@ -98,6 +143,84 @@ private:
 
     std::vector<BlockFilePair> vBlockfiles;
 
+    /** Read-only memory mapping of a complete block or undo file.
+        Readers hold a shared reference so that a mapping can be dropped (file written to, pruned, closed) while a read is still in progress.
+    */
+    class MappedFile
+    {
+    public:
+        MappedFile(const unsigned char* dataIn, size_t nSizeIn) : data(dataIn), nSize(nSizeIn) {}
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /** Locate the serialized record at pos, using the size from the record header that precedes it.
+            nTrailerSize bytes following the record (e.g. undo checksum) are also required to be inside the mapping.
+        */
+        bool GetRecord(const CDiskBlockPos& pos, size_t nTrailerSize, Span<const unsigned char>& record) const;
+
+        const unsigned char* data;
+        size_t nSize;
+    };
+
+    struct MappedFilePair {
+        std::shared_ptr<const MappedFile> blockmap;
+        std::shared_ptr<const MappedFile> undomap;
+        // Files that have been opened for writing in this session are never mapped (until finalized) as their size is still changing.
+        bool fBlockWritable = false;
+        bool fUndoWritable = false;
+    };
+
+    /** Return a mapping of the (finalized) file containing pos, or nullptr if the file is not (or can't be) mapped in which case the caller should use the FILE* path */
+    std::shared_ptr<const MappedFile> GetMappedFile(const CDiskBlockPos& pos, BlockFileType fileType);
+    void MarkFileWritable(int nFile, BlockFileType fileType);
+    void UnmapFiles(int nFile);
+
+    bool ReadBlockFromMemory(CBlock& block, const CDiskBlockPos& pos);
+    bool UndoReadFromMemory(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+
+    Mutex cs_mappedFiles;
+    std::vector<MappedFilePair> vMappedFiles;
+
+    // Block writer stage; validation hands over fully serialized records, a dedicated thread puts them on disk.
+    struct WriteOperation {
+        BlockFileKey file;
+        unsigned int nPos = 0;
+        //! Full record (index header, payload and any trailer), nullptr for a pre-allocation
+        std::shared_ptr<const std::vector<unsigned char>> record;
+        unsigned int nPreallocateLength = 0;
+    };
+    struct PendingRecordKey {
+        BlockFileKey file;
+        unsigned int nDataPos;
+        bool operator<(const PendingRecordKey& other) const { return std::tie(file, nDataPos) < std::tie(other.file, other.nDataPos); }
+    };
+
+    bool EnqueueWrite(WriteOperation&& operation);
+    std::shared_ptr<const std::vector<unsigned char>> GetPendingRecord(const CDiskBlockPos& pos, BlockFileType fileType);
+    /** Wait until the writer has no queued or in progress writes for file */
+    void WaitForPendingFileWrites(const BlockFileKey& file);
+    /** Wait for the writer to go idle and close its file handles (for files being closed, pruned or renamed) */
+    void CloseWriterFiles();
+    void StopWriter();
+    void WriterThread();
+    FILE* GetWriterFile(const BlockFileKey& file);
+
+    Mutex cs_writer;
+    std::condition_variable cvWriterWork;
+    std::condition_variable cvWriterProgress;
+    std::deque<WriteOperation> writeQueue;
+    size_t nWriteQueueBytes = 0;
+    std::map<BlockFileKey, int> mapPendingFileWrites;
+    std::map<PendingRecordKey, std::shared_ptr<const std::vector<unsigned char>>> mapPendingRecords;
+    bool fWriterBusy = false;
+    bool fWriterStop = false;
+    bool fWriterFailed = false;
+    std::thread writerThread;
+    // Only touched by the writer thread, or by other threads while holding cs_writer with the writer idle.
+    std::map<BlockFileKey, FILE*> mapWriterFiles;
+    std::set<BlockFileKey> setUnsyncedFiles;
+
     // more block store format conversion support:
     fs::path GetBlockPosNewFilename(const CDiskBlockPos &pos, BlockFileType fileType, const std::string& newPrefix);
     std::string mainPrefix;
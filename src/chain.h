@@ -14,11 +14,13 @@
 #define CHAIN_H
 
 #include "arith_uint256.h"
+#include "prevector.h"
 #include "primitives/block.h"
 #include "pow/pow.h"
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <vector>
 #include <valarray>
 
@@ -194,6 +196,57 @@ enum BlockStatus: uint32_t {
     BLOCK_PARTIAL_MASK = BLOCK_PARTIAL_TREE | BLOCK_PARTIAL_TRANSACTIONS | BLOCK_PARTIAL_RESERVED1 | BLOCK_PARTIAL_RESERVED2,
 };
 
+/** A hash memoized on first use, for hashes of block index entries that are expensive to recompute.
+ * Concurrent readers are safe; whoever changes the fields the hash is computed from must Reset() it.
+ */
+class CCachedBlockHash
+{
+public:
+    CCachedBlockHash() {}
+    CCachedBlockHash(const CCachedBlockHash& other) { *this = other; }
+
+    CCachedBlockHash& operator=(const CCachedBlockHash& other)
+    {
+        if (other.state.load(std::memory_order_acquire) == STATE_SET)
+        {
+            hash = other.hash;
+            state.store(STATE_SET, std::memory_order_release);
+        }
+        else
+        {
+            state.store(STATE_UNSET, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    void Reset()
+    {
+        state.store(STATE_UNSET, std::memory_order_relaxed);
+    }
+
+    template <typename Compute>
+    uint256 Get(Compute compute) const
+    {
+        if (state.load(std::memory_order_acquire) == STATE_SET)
+            return hash;
+
+        uint256 computed = compute();
+        // Only the first of several racing readers publishes its result, the others just return theirs.
+        uint8_t expected = STATE_UNSET;
+        if (state.compare_exchange_strong(expected, STATE_WRITING, std::memory_order_acquire))
+        {
+            hash = computed;
+            state.store(STATE_SET, std::memory_order_release);
+        }
+        return computed;
+    }
+
+private:
+    enum : uint8_t { STATE_UNSET, STATE_WRITING, STATE_SET };
+    mutable std::atomic<uint8_t> state{STATE_UNSET};
+    mutable uint256 hash;
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -243,7 +296,8 @@ public:
     int32_t nVersionPoW2Witness;
     uint32_t nTimePoW2Witness;
     uint256 hashMerkleRootPoW2Witness;
-    std::vector<unsigned char> witnessHeaderPoW2Sig; // 65 bytes
+    //! Always 65 bytes (or empty) so kept inline instead of in a separate heap allocation per entry.
+    prevector<65, unsigned char> witnessHeaderPoW2Sig;
 
     #ifdef WITNESS_HEADER_SYNC
     // Changes in the witness UTXO that this block causes
@@ -272,6 +326,10 @@ public:
     //! (memory only) Maximum nTime in the chain upto and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Legacy hash of witness blocks, see GetBlockHashLegacy.
+    //! Reset by SetHeader and SetPrev, which existing entries must be changed through.
+    CCachedBlockHash hashLegacyCached;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -295,6 +353,7 @@ public:
         #ifdef WITNESS_HEADER_SYNC
         witnessUTXODelta.clear();
         #endif
+        hashLegacyCached.Reset();
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -311,11 +370,16 @@ public:
     CBlockIndex(const CBlockHeader& block)
     {
         SetNull();
+        SetHeader(block);
+    }
 
+    //! Take over the header fields (all but hashPrevBlock, which comes from pprev) of block.
+    void SetHeader(const CBlockHeader& block)
+    {
         nVersionPoW2Witness = block.nVersionPoW2Witness;
         nTimePoW2Witness = block.nTimePoW2Witness;
         hashMerkleRootPoW2Witness = block.hashMerkleRootPoW2Witness;
-        witnessHeaderPoW2Sig = block.witnessHeaderPoW2Sig;
+        witnessHeaderPoW2Sig.assign(block.witnessHeaderPoW2Sig.begin(), block.witnessHeaderPoW2Sig.end());
         #ifdef WITNESS_HEADER_SYNC
         witnessUTXODelta = block.witnessUTXODelta;
         #endif
@@ -324,6 +388,14 @@ public:
         nTime          = block.nTime;
         nBits          = block.nBits;
         nNonce         = block.nNonce;
+        hashLegacyCached.Reset();
+    }
+
+    //! Link the entry to another parent (or none), existing entries must be relinked through here so that their legacy hash is recomputed.
+    void SetPrev(CBlockIndex* pprevIn)
+    {
+        pprev = pprevIn;
+        hashLegacyCached.Reset();
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -350,7 +422,7 @@ public:
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
         block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.witnessHeaderPoW2Sig.assign(witnessHeaderPoW2Sig.begin(), witnessHeaderPoW2Sig.end());
         #ifdef WITNESS_HEADER_SYNC
         block.witnessUTXODelta = witnessUTXODelta;
         #endif
@@ -371,7 +443,7 @@ public:
         if (nVersionPoW2Witness == 0)
             return *phashBlock;
         else
-            return GetBlockHeader().GetHashLegacy();
+            return hashLegacyCached.Get([this]() { return GetBlockHeader().GetHashLegacy(); });
     }
 
     uint256 GetBlockHashPoW2() const
@@ -534,6 +606,7 @@ public:
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
+
 };
 
 /** Find the last common ancestor two blocks have. Both pa and pb must be non-NULL. */
@@ -592,18 +665,19 @@ public:
                 READWRITE(hashMerkleRootPoW2Witness);
                 if (ser_action.ForRead())
                     witnessHeaderPoW2Sig.resize(65);
-                READWRITENOSIZEVECTOR(witnessHeaderPoW2Sig);
-
-                #ifdef WITNESS_HEADER_SYNC
-                if( ((s.GetType() == SER_DISK) && (_nVersion>= 2030013)) || 
-                ((s.GetType() == SER_NETWORK) && (_nVersion % 80000 >= WITNESS_SYNC_VERSION)) ||
-                ((s.GetType() == SER_GETHASH) && (witnessUTXODelta.size() > 0)) )
-                {
-                    //fixme: (WITNESS_SYNC) - If size is frequently above 200 then switch to varint instead
-                    READWRITECOMPACTSIZEVECTOR(witnessUTXODelta);
-                }
-                #endif
+                READWRITE(REF(CFlatData(witnessHeaderPoW2Sig)));
+            }
+
+            #ifdef WITNESS_HEADER_SYNC
+            // Blocks without a witness header have a delta too (the PoW portion of the block changes the witness set as well).
+            if( ((s.GetType() == SER_DISK) && (_nVersion>= 2030013)) || 
+            ((s.GetType() == SER_NETWORK) && (_nVersion % 80000 >= WITNESS_SYNC_VERSION)) ||
+            ((s.GetType() == SER_GETHASH) && (witnessUTXODelta.size() > 0)) )
+            {
+                //fixme: (WITNESS_SYNC) - If size is frequently above 200 then switch to varint instead
+                READWRITECOMPACTSIZEVECTOR(witnessUTXODelta);
             }
+            #endif
         }
         catch (...)
         {
@@ -616,7 +690,7 @@ public:
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
         block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.witnessHeaderPoW2Sig.assign(witnessHeaderPoW2Sig.begin(), witnessHeaderPoW2Sig.end());
         #ifdef WITNESS_HEADER_SYNC
         block.witnessUTXODelta = witnessUTXODelta;
         #endif
@@ -635,7 +709,7 @@ public:
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
         block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.witnessHeaderPoW2Sig.assign(witnessHeaderPoW2Sig.begin(), witnessHeaderPoW2Sig.end());
         #ifdef WITNESS_HEADER_SYNC
         block.witnessUTXODelta = witnessUTXODelta;
         #endif
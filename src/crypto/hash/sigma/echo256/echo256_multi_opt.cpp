@@ -0,0 +1,178 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+// Multi-buffer echo256: the AES-NI round structure of 'echo256_opt.cpp' applied to several independent messages at once (one per lane, see multi_opt_lanes.h).
+// The wrapper including this file defines ECHO256_MULTI_OPT_LANES as the number of lanes (4 or 8).
+// There is no 2 lane AES-NI variant: the 16 independent state words of a single echo256 already keep the AES units busy, so interleaving two messages gains nothing.
+// As all lanes have the same message length the block counter and padding are shared, only the message words differ per lane.
+
+#include "echo256_multi_opt.h"
+
+#ifdef ECHO256_MULTI_OPT_IMPL
+
+#include "../multi_opt_lanes.h"
+
+typedef mb_vec<ECHO256_MULTI_OPT_LANES> echo256_multi_vec;
+
+static const uint64_t ECHO256_MULTI_BLOCK_BYTES = 192;
+static const int ECHO256_MULTI_ROUNDS = 8;
+
+// GF(2^8) doubling of every byte.
+static inline echo256_multi_vec echo256_multi_mul2(const echo256_multi_vec& x, const echo256_multi_vec& lsbmask, const echo256_multi_vec& mul2mask)
+{
+    echo256_multi_vec t = mb_and(mb_srli16<7>(x), lsbmask);
+    return mb_xor(mb_add8(x, x), mb_shuffle8(mul2mask, t));
+}
+
+// SubWords (two AES rounds per word, the first keyed with the running counter) over all 16 words, in the same order as ECHO_SUBBYTES.
+static inline void echo256_multi_subwords(echo256_multi_vec state[4][4], echo256_multi_vec& k1, const echo256_multi_vec& one, const echo256_multi_vec& zero)
+{
+    #pragma GCC unroll 4
+    for (int j = 0; j < 4; ++j)
+    {
+        #pragma GCC unroll 4
+        for (int i = 0; i < 4; ++i)
+        {
+            state[i][j] = mb_aesenc(state[i][j], k1);
+            state[i][j] = mb_aesenc(state[i][j], zero);
+            k1 = mb_add32(k1, one);
+        }
+    }
+}
+
+// ShiftRows + MixColumns of ECHO_MIXBYTES: column j of out from the shifted words of in, multiplied by the (2 3 1 1) circulant.
+static inline void echo256_multi_mixcolumns(echo256_multi_vec in[4][4], echo256_multi_vec out[4][4], const echo256_multi_vec& lsbmask, const echo256_multi_vec& mul2mask)
+{
+    #pragma GCC unroll 4
+    for (int j = 0; j < 4; ++j)
+    {
+        const echo256_multi_vec& a0 = in[0][j];
+        const echo256_multi_vec& a1 = in[1][(j + 1) & 3];
+        const echo256_multi_vec& a2 = in[2][(j + 2) & 3];
+        const echo256_multi_vec& a3 = in[3][(j + 3) & 3];
+        echo256_multi_vec b0 = echo256_multi_mul2(a0, lsbmask, mul2mask);
+        echo256_multi_vec b1 = echo256_multi_mul2(a1, lsbmask, mul2mask);
+        echo256_multi_vec b2 = echo256_multi_mul2(a2, lsbmask, mul2mask);
+        echo256_multi_vec b3 = echo256_multi_mul2(a3, lsbmask, mul2mask);
+        out[0][j] = mb_xor(mb_xor(b0, mb_xor(b1, a1)), mb_xor(a2, a3));
+        out[1][j] = mb_xor(mb_xor(a0, b1), mb_xor(mb_xor(b2, a2), a3));
+        out[2][j] = mb_xor(mb_xor(a0, a1), mb_xor(b2, mb_xor(b3, a3)));
+        out[3][j] = mb_xor(mb_xor(mb_xor(b0, a0), a1), mb_xor(a2, b3));
+    }
+}
+
+// Compress one 192 byte block per lane into the chaining words state[i] (state[i][0] of the scalar implementation); k is the block counter.
+static void echo256_multi_compress(echo256_multi_vec chaining[4], unsigned char* const* blocks, uint64_t k)
+{
+    const echo256_multi_vec zero = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_setzero_si128());
+    const echo256_multi_vec one = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0, 0, 1));
+    const echo256_multi_vec lsbmask = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_set1_epi32(0x01010101));
+    const echo256_multi_vec mul2mask = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0, 0, 0x00001b00));
+
+    echo256_multi_vec state[4][4];
+    echo256_multi_vec state2[4][4];
+    echo256_multi_vec backup[4][4];
+    for (int i = 0; i < 4; ++i)
+    {
+        state[i][0] = chaining[i];
+        for (int j = 1; j < 4; ++j)
+        {
+            state[i][j] = mb_load<ECHO256_MULTI_OPT_LANES>(blocks, 16 * (4 * (j - 1) + i));
+        }
+        for (int j = 0; j < 4; ++j)
+        {
+            backup[i][j] = state[i][j];
+        }
+    }
+
+    echo256_multi_vec k1 = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_set_epi64x(0, k));
+    for (int r = 0; r < ECHO256_MULTI_ROUNDS / 2; ++r)
+    {
+        echo256_multi_subwords(state, k1, one, zero);
+        echo256_multi_mixcolumns(state, state2, lsbmask, mul2mask);
+        echo256_multi_subwords(state2, k1, one, zero);
+        echo256_multi_mixcolumns(state2, state, lsbmask, mul2mask);
+    }
+
+    // BigFinal (Davies-Meyer style feed forward of the message and chaining value)
+    for (int i = 0; i < 4; ++i)
+    {
+        echo256_multi_vec x = mb_xor(mb_xor(state[i][0], state[i][1]), mb_xor(state[i][2], state[i][3]));
+        x = mb_xor(x, mb_xor(mb_xor(backup[i][0], backup[i][1]), mb_xor(backup[i][2], backup[i][3])));
+        chaining[i] = x;
+    }
+}
+
+void echo256_multi_opt_HashLanes(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes)
+{
+    const int numLanes = ECHO256_MULTI_OPT_LANES;
+    const uint64_t nMessageBytes = data1Size + data2Size + data3Size;
+
+    __attribute__((aligned(64))) unsigned char blockData[numLanes][ECHO256_MULTI_BLOCK_BYTES];
+    unsigned char* blocks[numLanes];
+    for (int nLane = 0; nLane < numLanes; ++nLane)
+    {
+        blocks[nLane] = blockData[nLane];
+    }
+
+    // Chaining words start out as the digest size (256) in every word.
+    echo256_multi_vec chaining[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        chaining[i] = mb_broadcast<ECHO256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0, 0, 256));
+    }
+
+    uint64_t k = 0;
+    uint64_t nOffset = 0;
+    for (; nOffset + ECHO256_MULTI_BLOCK_BYTES <= nMessageBytes; nOffset += ECHO256_MULTI_BLOCK_BYTES)
+    {
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            mb_gather_message(blocks[nLane], nOffset, ECHO256_MULTI_BLOCK_BYTES, data1[nLane], data1Size, data2[nLane], data2Size, data3[nLane], data3Size);
+        }
+        k += ECHO256_MULTI_BLOCK_BYTES * 8;
+        echo256_multi_compress(chaining, blocks, k);
+    }
+
+    // Padding: 0x80, zeros, then the digest size (16 bits) and the message length in bits (128 bits) at the end of the (last) block.
+    const uint64_t nRemainingBytes = nMessageBytes - nOffset;
+    const uint64_t nMessageBits = nMessageBytes * 8;
+    auto writeLengthTrailer = [&](unsigned char* block)
+    {
+        uint16_t nHashSize = 256;
+        uint64_t nZero = 0;
+        memcpy(block + ECHO256_MULTI_BLOCK_BYTES - 18, &nHashSize, 2);
+        memcpy(block + ECHO256_MULTI_BLOCK_BYTES - 16, &nMessageBits, 8);
+        memcpy(block + ECHO256_MULTI_BLOCK_BYTES - 8, &nZero, 8);
+    };
+    for (int nLane = 0; nLane < numLanes; ++nLane)
+    {
+        mb_gather_message(blocks[nLane], nOffset, nRemainingBytes, data1[nLane], data1Size, data2[nLane], data2Size, data3[nLane], data3Size);
+        blocks[nLane][nRemainingBytes] = 0x80;
+        memset(blocks[nLane] + nRemainingBytes + 1, 0, ECHO256_MULTI_BLOCK_BYTES - (nRemainingBytes + 1));
+    }
+    if (ECHO256_MULTI_BLOCK_BYTES - (nRemainingBytes + 1) >= 18)
+    {
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            writeLengthTrailer(blocks[nLane]);
+        }
+        // A final block without any message bits is compressed with a zero counter.
+        echo256_multi_compress(chaining, blocks, nRemainingBytes == 0 ? 0 : k + nRemainingBytes * 8);
+    }
+    else
+    {
+        echo256_multi_compress(chaining, blocks, k + nRemainingBytes * 8);
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            memset(blocks[nLane], 0, ECHO256_MULTI_BLOCK_BYTES);
+            writeLengthTrailer(blocks[nLane]);
+        }
+        echo256_multi_compress(chaining, blocks, 0);
+    }
+
+    mb_store(chaining[0], hashes, 0);
+    mb_store(chaining[1], hashes, 16);
+}
+#endif
@@ -0,0 +1,23 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef ECHO256_MULTI_OPT_H
+#define ECHO256_MULTI_OPT_H
+#include <compat/arch.h>
+#include <stdint.h>
+#endif
+
+#ifndef ECHO256_MULTI_OPT_IMPL
+
+#ifdef ARCH_CPU_X86_FAMILY
+#include "opt/echo256_multi_opt_avx2_vaes.h"
+#include "opt/echo256_multi_opt_avx512bw_vaes.h"
+#endif
+
+#else
+
+// Hash one message per lane (4 or 8 depending on the implementation) at once, writing each 32 byte digest to hashes[lane].
+// Message i is the concatenation of data1[i], data2[i] and data3[i]; all lanes share the same sizes.
+void echo256_multi_opt_HashLanes(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes);
+#endif
@@ -0,0 +1,16 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'echo256_multi_opt' implementation, along with various other similarly named files.
+// The build system compiles each file with different instruction set flags, which determines how many lanes it hashes at once.
+
+#ifndef HASH_ECHO256_MULTI_AVX2_VAES_H
+#define HASH_ECHO256_MULTI_AVX2_VAES_H
+    #define echo256_multi_opt_HashLanes echo256_multi_opt_avx2_vaes_HashLanes
+
+    #define ECHO256_MULTI_OPT_IMPL
+    #include "../echo256_multi_opt.h"
+    #undef ECHO256_MULTI_OPT_IMPL
+
+    #undef echo256_multi_opt_HashLanes
+#endif
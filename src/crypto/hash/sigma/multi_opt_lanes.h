@@ -0,0 +1,176 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+// Lane vectors for the multi-buffer ('*_multi_opt') hash implementations.
+// A lane is one independent hash computation whose 128 bit state words occupy one 128 bit slice of a register.
+// Every AES round based operation used by echo256 and shavite3 is lane local (aesenc, pshufb, byte shifts within 128 bits etc.)
+// so the scalar algorithms carry over unchanged, just with more lanes per instruction:
+//   mb_vec<2> - 2 lanes in __m128i registers (AES-NI)
+//   mb_vec<4> - 4 lanes in __m256i registers (VAES)
+//   mb_vec<8> - 8 lanes in __m512i registers (VAES + AVX512BW)
+// Each mb_vec is two registers wide so that there are always two independent dependency chains in flight per instruction.
+// NB! Everything here is static inline and only available for the instruction sets the including file is compiled for.
+
+#ifndef HASH_SIGMA_MULTI_OPT_LANES_H
+#define HASH_SIGMA_MULTI_OPT_LANES_H
+
+#include "compat.h"
+#include <compat/arch.h>
+#include <compat/sse.h>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(ARCH_CPU_X86_FAMILY) && defined(__AES__)
+
+// ---------------------------------------- 2 lanes, AES-NI ----------------------------------------
+static inline __m128i mb_aesenc(__m128i a, __m128i k) { return _mm_aesenc_si128(a, k); }
+static inline __m128i mb_xor(__m128i a, __m128i b)    { return _mm_xor_si128(a, b); }
+static inline __m128i mb_and(__m128i a, __m128i b)    { return _mm_and_si128(a, b); }
+static inline __m128i mb_add8(__m128i a, __m128i b)   { return _mm_add_epi8(a, b); }
+static inline __m128i mb_add32(__m128i a, __m128i b)  { return _mm_add_epi32(a, b); }
+static inline __m128i mb_shuffle8(__m128i a, __m128i b) { return _mm_shuffle_epi8(a, b); }
+template<int n> static inline __m128i mb_srli16(__m128i a)  { return _mm_srli_epi16(a, n); }
+template<int n> static inline __m128i mb_bsrli(__m128i a)   { return _mm_srli_si128(a, n); }
+template<int n> static inline __m128i mb_bslli(__m128i a)   { return _mm_slli_si128(a, n); }
+template<int n> static inline __m128i mb_shuffle32(__m128i a) { return _mm_shuffle_epi32(a, n); }
+static inline void mb_broadcast_reg(__m128i& r, __m128i a) { r = a; }
+static inline void mb_load_reg(__m128i& r, const unsigned char* const* lanes, uint64_t nOffset)
+{
+    r = _mm_loadu_si128((const __m128i*)(lanes[0] + nOffset));
+}
+static inline void mb_store_reg(const __m128i& r, unsigned char* const* lanes, uint64_t nOffset)
+{
+    _mm_storeu_si128((__m128i*)(lanes[0] + nOffset), r);
+}
+
+// ---------------------------------------- 4 lanes, VAES ----------------------------------------
+#if defined(__AVX2__) && defined(__VAES__)
+static inline __m256i mb_aesenc(__m256i a, __m256i k) { return _mm256_aesenc_epi128(a, k); }
+static inline __m256i mb_xor(__m256i a, __m256i b)    { return _mm256_xor_si256(a, b); }
+static inline __m256i mb_and(__m256i a, __m256i b)    { return _mm256_and_si256(a, b); }
+static inline __m256i mb_add8(__m256i a, __m256i b)   { return _mm256_add_epi8(a, b); }
+static inline __m256i mb_add32(__m256i a, __m256i b)  { return _mm256_add_epi32(a, b); }
+static inline __m256i mb_shuffle8(__m256i a, __m256i b) { return _mm256_shuffle_epi8(a, b); }
+template<int n> static inline __m256i mb_srli16(__m256i a)  { return _mm256_srli_epi16(a, n); }
+template<int n> static inline __m256i mb_bsrli(__m256i a)   { return _mm256_bsrli_epi128(a, n); }
+template<int n> static inline __m256i mb_bslli(__m256i a)   { return _mm256_bslli_epi128(a, n); }
+template<int n> static inline __m256i mb_shuffle32(__m256i a) { return _mm256_shuffle_epi32(a, n); }
+static inline void mb_broadcast_reg(__m256i& r, __m128i a) { r = _mm256_broadcastsi128_si256(a); }
+static inline void mb_load_reg(__m256i& r, const unsigned char* const* lanes, uint64_t nOffset)
+{
+    r = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(lanes[0] + nOffset))), _mm_loadu_si128((const __m128i*)(lanes[1] + nOffset)), 1);
+}
+static inline void mb_store_reg(const __m256i& r, unsigned char* const* lanes, uint64_t nOffset)
+{
+    _mm_storeu_si128((__m128i*)(lanes[0] + nOffset), _mm256_castsi256_si128(r));
+    _mm_storeu_si128((__m128i*)(lanes[1] + nOffset), _mm256_extracti128_si256(r, 1));
+}
+#endif
+
+// ---------------------------------------- 8 lanes, VAES + AVX512BW ----------------------------------------
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__VAES__)
+static inline __m512i mb_aesenc(__m512i a, __m512i k) { return _mm512_aesenc_epi128(a, k); }
+static inline __m512i mb_xor(__m512i a, __m512i b)    { return _mm512_xor_si512(a, b); }
+static inline __m512i mb_and(__m512i a, __m512i b)    { return _mm512_and_si512(a, b); }
+static inline __m512i mb_add8(__m512i a, __m512i b)   { return _mm512_add_epi8(a, b); }
+static inline __m512i mb_add32(__m512i a, __m512i b)  { return _mm512_add_epi32(a, b); }
+static inline __m512i mb_shuffle8(__m512i a, __m512i b) { return _mm512_shuffle_epi8(a, b); }
+template<int n> static inline __m512i mb_srli16(__m512i a)  { return _mm512_srli_epi16(a, n); }
+template<int n> static inline __m512i mb_bsrli(__m512i a)   { return _mm512_bsrli_epi128(a, n); }
+template<int n> static inline __m512i mb_bslli(__m512i a)   { return _mm512_bslli_epi128(a, n); }
+template<int n> static inline __m512i mb_shuffle32(__m512i a) { return _mm512_shuffle_epi32(a, (_MM_PERM_ENUM)n); }
+static inline void mb_broadcast_reg(__m512i& r, __m128i a) { r = _mm512_broadcast_i32x4(a); }
+static inline void mb_load_reg(__m512i& r, const unsigned char* const* lanes, uint64_t nOffset)
+{
+    r = _mm512_zextsi128_si512(_mm_loadu_si128((const __m128i*)(lanes[0] + nOffset)));
+    r = _mm512_inserti32x4(r, _mm_loadu_si128((const __m128i*)(lanes[1] + nOffset)), 1);
+    r = _mm512_inserti32x4(r, _mm_loadu_si128((const __m128i*)(lanes[2] + nOffset)), 2);
+    r = _mm512_inserti32x4(r, _mm_loadu_si128((const __m128i*)(lanes[3] + nOffset)), 3);
+}
+static inline void mb_store_reg(const __m512i& r, unsigned char* const* lanes, uint64_t nOffset)
+{
+    _mm_storeu_si128((__m128i*)(lanes[0] + nOffset), _mm512_castsi512_si128(r));
+    _mm_storeu_si128((__m128i*)(lanes[1] + nOffset), _mm512_extracti32x4_epi32(r, 1));
+    _mm_storeu_si128((__m128i*)(lanes[2] + nOffset), _mm512_extracti32x4_epi32(r, 2));
+    _mm_storeu_si128((__m128i*)(lanes[3] + nOffset), _mm512_extracti32x4_epi32(r, 3));
+}
+#endif
+
+// ---------------------------------------- Two register lane vectors ----------------------------------------
+template<int numLanes> struct mb_vec;
+template<> struct mb_vec<2> { typedef __m128i reg; reg v[2]; };
+#if defined(__AVX2__) && defined(__VAES__)
+template<> struct mb_vec<4> { typedef __m256i reg; reg v[2]; };
+#endif
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__VAES__)
+template<> struct mb_vec<8> { typedef __m512i reg; reg v[2]; };
+#endif
+
+#define MB_VEC_BINARY_OP(name) \
+template<int L> static inline mb_vec<L> name(const mb_vec<L>& a, const mb_vec<L>& b) { return {{name(a.v[0], b.v[0]), name(a.v[1], b.v[1])}}; }
+MB_VEC_BINARY_OP(mb_aesenc)
+MB_VEC_BINARY_OP(mb_xor)
+MB_VEC_BINARY_OP(mb_and)
+MB_VEC_BINARY_OP(mb_add8)
+MB_VEC_BINARY_OP(mb_add32)
+MB_VEC_BINARY_OP(mb_shuffle8)
+#undef MB_VEC_BINARY_OP
+
+#define MB_VEC_IMMEDIATE_OP(name) \
+template<int n, int L> static inline mb_vec<L> name(const mb_vec<L>& a) { return {{name<n>(a.v[0]), name<n>(a.v[1])}}; }
+MB_VEC_IMMEDIATE_OP(mb_srli16)
+MB_VEC_IMMEDIATE_OP(mb_bsrli)
+MB_VEC_IMMEDIATE_OP(mb_bslli)
+MB_VEC_IMMEDIATE_OP(mb_shuffle32)
+#undef MB_VEC_IMMEDIATE_OP
+
+// Every lane set to the same 128 bit value.
+template<int L> static inline mb_vec<L> mb_broadcast(__m128i a)
+{
+    mb_vec<L> r;
+    mb_broadcast_reg(r.v[0], a);
+    mb_broadcast_reg(r.v[1], a);
+    return r;
+}
+
+// Lane i gets the 16 bytes at lanes[i]+nOffset.
+template<int L> static inline mb_vec<L> mb_load(const unsigned char* const* lanes, uint64_t nOffset)
+{
+    mb_vec<L> r;
+    mb_load_reg(r.v[0], lanes, nOffset);
+    mb_load_reg(r.v[1], lanes + L/2, nOffset);
+    return r;
+}
+
+// The 16 bytes of lane i are written to lanes[i]+nOffset.
+template<int L> static inline void mb_store(const mb_vec<L>& a, unsigned char* const* lanes, uint64_t nOffset)
+{
+    mb_store_reg(a.v[0], lanes, nOffset);
+    mb_store_reg(a.v[1], lanes + L/2, nOffset);
+}
+
+// Copy nLength bytes starting at nOffset of the message formed by concatenating data1, data2 and data3 into out.
+// All lanes of a multi-buffer hash have equal length inputs, this is how each lane gathers its message blocks.
+static inline void mb_gather_message(unsigned char* out, uint64_t nOffset, uint64_t nLength, const unsigned char* data1, uint64_t data1Size, const unsigned char* data2, uint64_t data2Size, const unsigned char* data3, uint64_t data3Size)
+{
+    const unsigned char* parts[3] = {data1, data2, data3};
+    const uint64_t partSizes[3] = {data1Size, data2Size, data3Size};
+    for (int i=0; i<3 && nLength>0; ++i)
+    {
+        if (nOffset >= partSizes[i])
+        {
+            nOffset -= partSizes[i];
+            continue;
+        }
+        uint64_t nCopy = std::min(nLength, partSizes[i]-nOffset);
+        memcpy(out, parts[i]+nOffset, nCopy);
+        out += nCopy;
+        nLength -= nCopy;
+        nOffset = 0;
+    }
+}
+
+#endif
+#endif
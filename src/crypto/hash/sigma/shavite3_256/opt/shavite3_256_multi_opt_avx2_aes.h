@@ -0,0 +1,16 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'shavite3_256_multi_opt' implementation, along with various other similarly named files.
+// The build system compiles each file with different instruction set flags, which determines how many lanes it hashes at once.
+
+#ifndef HASH_SHAVITE3_256_MULTI_AVX2_AES_H
+#define HASH_SHAVITE3_256_MULTI_AVX2_AES_H
+    #define shavite3_256_multi_opt_HashLanes shavite3_256_multi_opt_avx2_aes_HashLanes
+
+    #define SHAVITE3_256_MULTI_OPT_IMPL
+    #include "../shavite3_256_multi_opt.h"
+    #undef SHAVITE3_256_MULTI_OPT_IMPL
+
+    #undef shavite3_256_multi_opt_HashLanes
+#endif
@@ -0,0 +1,15 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+// This file is a thin wrapper around the actual 'shavite3_256_multi_opt' implementation, along with various other similarly named files.
+// The build system compiles each file with different instruction set flags, which determines how many lanes it hashes at once.
+
+#if defined(COMPILER_HAS_AVX2_VAES)
+    #define shavite3_256_multi_opt_HashLanes shavite3_256_multi_opt_avx2_vaes_HashLanes
+    #define SHAVITE3_256_MULTI_OPT_LANES 4
+
+    #define USE_HARDWARE_AES
+    #define SHAVITE3_256_MULTI_OPT_IMPL
+    #include "../shavite3_256_multi_opt.cpp"
+#endif
@@ -0,0 +1,373 @@
+// Copyright (c) 2019-2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+// Multi-buffer shavite3-256: the AES-NI compression function of 'shavite3_256_opt.cpp' applied to several independent messages at once (one per lane, see multi_opt_lanes.h).
+// The wrapper including this file defines SHAVITE3_256_MULTI_OPT_LANES as the number of lanes (2, 4 or 8).
+// As all lanes have the same message length the counters and padding are shared, only the message words differ per lane.
+
+#include "shavite3_256_multi_opt.h"
+
+#ifdef SHAVITE3_256_MULTI_OPT_IMPL
+
+#include "../multi_opt_lanes.h"
+
+typedef mb_vec<SHAVITE3_256_MULTI_OPT_LANES> shavite3_256_multi_vec;
+
+static const uint64_t SHAVITE3_256_MULTI_BLOCK_BYTES = 64;
+
+// Chaining value after initialisation for a 256 bit digest, i.e. the one shavite3_256_opt_Init computes with its two compressions.
+__attribute__((aligned(16))) static const uint32_t SHAVITE3_256_MULTI_IV[8] = {0x49BB3E47, 0x2674860D, 0xA8B392AC, 0x021AC4E6, 0x409283CF, 0x620E5D86, 0x6D929DCB, 0x96CC2A8B};
+
+#define SHAVITE_MULTI_MIXING_256 \
+    x11 = x15;                   \
+    x10 = x14;                   \
+    x9 =  x13;                   \
+    x8 = x12;                    \
+                                 \
+    x6 = x11;                    \
+    x6 = mb_bsrli<4>(x6);        \
+    x8 = mb_xor(x8,  x6);        \
+    x6 = x8;                     \
+    x6 = mb_bslli<12>(x6);       \
+    x8 = mb_xor(x8, x6);         \
+                                 \
+    x7 = x8;                     \
+    x7 =  mb_bsrli<4>(x7);       \
+    x9 = mb_xor(x9,  x7);        \
+    x7 = x9;                     \
+    x7 = mb_bslli<12>(x7);       \
+    x9 = mb_xor(x9, x7);         \
+                                 \
+    x6 = x9;                     \
+    x6 =  mb_bsrli<4>(x6);       \
+    x10 = mb_xor(x10, x6);       \
+    x6 = x10;                    \
+    x6 = mb_bslli<12>(x6);       \
+    x10 = mb_xor(x10, x6);       \
+                                 \
+    x7 = x10;                    \
+    x7 = mb_bsrli<4>(x7);        \
+    x11 = mb_xor(x11, x7);       \
+    x7 = x11;                    \
+    x7 = mb_bslli<12>(x7);       \
+    x11 = mb_xor(x11, x7);
+
+// encryption + Davies-Meyer transform of one 64 byte block per lane, identical to shavite3_256_opt_Compress256 instruction for instruction.
+static void shavite3_256_multi_compress(shavite3_256_multi_vec& chaining1, shavite3_256_multi_vec& chaining2, unsigned char* const* blocks, uint64_t counter)
+{
+    const shavite3_256_multi_vec reverse = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_set_epi32(0x03020100, 0x0f0e0d0c, 0x0b0a0908, 0x07060504));
+    const shavite3_256_multi_vec xor3 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0xFFFFFFFF, 0, 0));
+    const shavite3_256_multi_vec xor4 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_set_epi32(0xFFFFFFFF, 0, 0, 0));
+
+    shavite3_256_multi_vec x0, x1, x2, x3, x4, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
+
+    // (L,R) = (xmm0,xmm1)
+    const shavite3_256_multi_vec ptxt1 = chaining1;
+    const shavite3_256_multi_vec ptxt2 = chaining2;
+
+    x0 = ptxt1;
+    x1 = ptxt2;
+
+    x3 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0, (int)(counter >> 32), (int)(counter & 0xFFFFFFFFULL)));
+    x4 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_set_epi32(0, 0, 0xFFFFFFFF, 0));
+    x2 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_setzero_si128());
+
+    // init key schedule
+    x8 = mb_load<SHAVITE3_256_MULTI_OPT_LANES>(blocks, 0);
+    x9 = mb_load<SHAVITE3_256_MULTI_OPT_LANES>(blocks, 16);
+    x10 = mb_load<SHAVITE3_256_MULTI_OPT_LANES>(blocks, 32);
+    x11 = mb_load<SHAVITE3_256_MULTI_OPT_LANES>(blocks, 48);
+
+    // xmm8..xmm11 = rk[0..15]
+    // start key schedule
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+
+    const shavite3_256_multi_vec xtemp = reverse;
+    x12 = mb_shuffle8(x12, xtemp);
+    x13 = mb_shuffle8(x13, xtemp);
+    x14 = mb_shuffle8(x14, xtemp);
+    x15 = mb_shuffle8(x15, xtemp);
+
+    x12 = mb_aesenc(x12, x2);
+    x13 = mb_aesenc(x13, x2);
+    x14 = mb_aesenc(x14, x2);
+    x15 = mb_aesenc(x15, x2);
+
+    x12 = mb_xor(x12, x3);
+    x12 = mb_xor(x12, x4);
+    x4 = xor3;
+    x12 = mb_xor(x12, x11);
+    x13 = mb_xor(x13, x12);
+    x14 = mb_xor(x14, x13);
+    x15 = mb_xor(x15, x14);
+   
+    // xmm12..xmm15 = rk[16..31]
+    // F3 - first round 
+    x6 = x8;
+    x8 = mb_xor(x8, x1);
+    x8 = mb_aesenc(x8, x9);
+    x8 = mb_aesenc(x8, x10);
+    x8 = mb_aesenc(x8, x2);
+    x0 = mb_xor(x0, x8);
+    x8 = x6;
+
+    // F3 - second round
+    x6 = x11;
+    x11 = mb_xor(x11, x0);
+    x11 = mb_aesenc(x11, x12);
+    x11 = mb_aesenc(x11, x13);
+    x11 = mb_aesenc(x11, x2);
+    x1 = mb_xor(x1, x11);
+    x11 = x6;
+
+    // key schedule
+    SHAVITE_MULTI_MIXING_256
+
+    // xmm8..xmm11 - rk[32..47]
+    // F3 - third round
+    x6 = x14;
+    x14 = mb_xor(x14, x1);
+    x14 = mb_aesenc(x14, x15);
+    x14 = mb_aesenc(x14, x8);
+    x14 = mb_aesenc(x14, x2);
+    x0 = mb_xor(x0, x14);
+    x14 = x6;
+
+    // key schedule
+    x3 = mb_shuffle32<135>(x3);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = mb_shuffle8(x12, xtemp);
+    x13 = mb_shuffle8(x13, xtemp);
+    x14 = mb_shuffle8(x14, xtemp);
+    x15 = mb_shuffle8(x15, xtemp);
+    x12 = mb_aesenc(x12, x2);
+    x13 = mb_aesenc(x13, x2);
+    x14 = mb_aesenc(x14, x2);
+    x15 = mb_aesenc(x15, x2);
+
+    x12 = mb_xor(x12, x11);
+    x14 = mb_xor(x14, x3);
+    x14 = mb_xor(x14, x4);
+    x4 = xor4;
+    x13 = mb_xor(x13, x12);
+    x14 = mb_xor(x14, x13);
+    x15 = mb_xor(x15, x14);
+
+    // xmm12..xmm15 - rk[48..63]
+
+    // F3 - fourth round
+    x6 = x9;
+    x9 = mb_xor(x9, x0);
+    x9 = mb_aesenc(x9, x10);
+    x9 = mb_aesenc(x9, x11);
+    x9 = mb_aesenc(x9, x2);
+    x1 = mb_xor(x1, x9);
+    x9 = x6;
+
+    // key schedule
+    SHAVITE_MULTI_MIXING_256
+    // xmm8..xmm11 = rk[64..79]
+    // F3  - fifth round
+    x6 = x12;
+    x12 = mb_xor(x12, x1);
+    x12 = mb_aesenc(x12, x13);
+    x12 = mb_aesenc(x12, x14);
+    x12 = mb_aesenc(x12, x2);
+    x0 = mb_xor(x0, x12);
+    x12 = x6;
+
+    // F3 - sixth round
+    x6 = x15;
+    x15 = mb_xor(x15, x0);
+    x15 = mb_aesenc(x15, x8);
+    x15 = mb_aesenc(x15, x9);
+    x15 = mb_aesenc(x15, x2);
+    x1 = mb_xor(x1, x15);
+    x15 = x6;
+
+    // key schedule
+    x3 = mb_shuffle32<147>(x3);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = mb_shuffle8(x12, xtemp);
+    x13 = mb_shuffle8(x13, xtemp);
+    x14 = mb_shuffle8(x14, xtemp);
+    x15 = mb_shuffle8(x15, xtemp);
+    x12 = mb_aesenc(x12, x2);
+    x13 = mb_aesenc(x13, x2);
+    x14 = mb_aesenc(x14, x2);
+    x15 = mb_aesenc(x15, x2);
+    x12 = mb_xor(x12, x11);
+    x13 = mb_xor(x13, x3);
+    x13 = mb_xor(x13, x4);
+    x13 = mb_xor(x13, x12);
+    x14 = mb_xor(x14, x13);
+    x15 = mb_xor(x15, x14);
+
+    // xmm12..xmm15 = rk[80..95]
+    // F3 - seventh round
+    x6 = x10;
+    x10 = mb_xor(x10, x1);
+    x10 = mb_aesenc(x10, x11);
+    x10 = mb_aesenc(x10, x12);
+    x10 = mb_aesenc(x10, x2);
+    x0 = mb_xor(x0, x10);
+    x10 = x6;
+
+    // key schedule
+    SHAVITE_MULTI_MIXING_256
+
+    // xmm8..xmm11 = rk[96..111]
+    // F3 - eigth round
+    x6 = x13;
+    x13 = mb_xor(x13, x0);
+    x13 = mb_aesenc(x13, x14);
+    x13 = mb_aesenc(x13, x15);
+    x13 = mb_aesenc(x13, x2);
+    x1 = mb_xor(x1, x13);
+    x13 = x6;
+
+
+    // key schedule
+    x3 = mb_shuffle32<135>(x3);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = mb_shuffle8(x12, xtemp);
+    x13 = mb_shuffle8(x13, xtemp);
+    x14 = mb_shuffle8(x14, xtemp);
+    x15 = mb_shuffle8(x15, xtemp);
+    x12 = mb_aesenc(x12, x2);
+    x13 = mb_aesenc(x13, x2);
+    x14 = mb_aesenc(x14, x2);
+    x15 = mb_aesenc(x15, x2);
+    x12 = mb_xor(x12, x11);
+    x15 = mb_xor(x15, x3);
+    x15 = mb_xor(x15, x4);
+    x13 = mb_xor(x13, x12);
+    x14 = mb_xor(x14, x13);
+    x15 = mb_xor(x15, x14);
+
+    // xmm12..xmm15 = rk[112..127]
+    // F3 - ninth round
+    x6 = x8;
+    x8 = mb_xor(x8, x1);
+    x8 = mb_aesenc(x8, x9);
+    x8 = mb_aesenc(x8, x10);
+    x8 = mb_aesenc(x8, x2);
+    x0 = mb_xor(x0, x8);
+    x8 = x6;
+    // F3 - tenth round
+    x6 = x11;
+    x11 = mb_xor(x11, x0);
+    x11 = mb_aesenc(x11, x12);
+    x11 = mb_aesenc(x11, x13);
+    x11 = mb_aesenc(x11, x2);
+    x1 = mb_xor(x1, x11);
+    x11 = x6;
+
+    // key schedule
+    SHAVITE_MULTI_MIXING_256
+
+    // xmm8..xmm11 = rk[128..143]
+    // F3 - eleventh round
+    x6 = x14;
+    x14 = mb_xor(x14, x1);
+    x14 = mb_aesenc(x14, x15);
+    x14 = mb_aesenc(x14, x8);
+    x14 = mb_aesenc(x14, x2);
+    x0 = mb_xor(x0, x14);
+    x14 = x6;
+
+    // F3 - twelfth round
+    x6 = x9;
+    x9 = mb_xor(x9, x0);
+    x9 = mb_aesenc(x9, x10);
+    x9 = mb_aesenc(x9, x11);
+    x9 = mb_aesenc(x9, x2);
+    x1 = mb_xor(x1, x9);
+    x9 = x6;
+
+    // feedforward
+    chaining1 = mb_xor(x0, ptxt1);
+    chaining2 = mb_xor(x1, ptxt2);
+}
+
+void shavite3_256_multi_opt_HashLanes(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes)
+{
+    const int numLanes = SHAVITE3_256_MULTI_OPT_LANES;
+    const uint64_t nMessageBytes = data1Size + data2Size + data3Size;
+
+    __attribute__((aligned(64))) unsigned char blockData[numLanes][SHAVITE3_256_MULTI_BLOCK_BYTES];
+    unsigned char* blocks[numLanes];
+    for (int nLane = 0; nLane < numLanes; ++nLane)
+    {
+        blocks[nLane] = blockData[nLane];
+    }
+
+    shavite3_256_multi_vec chaining1 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_load_si128((const __m128i*)&SHAVITE3_256_MULTI_IV[0]));
+    shavite3_256_multi_vec chaining2 = mb_broadcast<SHAVITE3_256_MULTI_OPT_LANES>(_mm_load_si128((const __m128i*)&SHAVITE3_256_MULTI_IV[4]));
+
+    // The counter of every full block is the number of bits hashed up to and including it.
+    uint64_t nOffset = 0;
+    for (; nOffset + SHAVITE3_256_MULTI_BLOCK_BYTES <= nMessageBytes; nOffset += SHAVITE3_256_MULTI_BLOCK_BYTES)
+    {
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            mb_gather_message(blocks[nLane], nOffset, SHAVITE3_256_MULTI_BLOCK_BYTES, data1[nLane], data1Size, data2[nLane], data2Size, data3[nLane], data3Size);
+        }
+        shavite3_256_multi_compress(chaining1, chaining2, blocks, (nOffset + SHAVITE3_256_MULTI_BLOCK_BYTES) * 8);
+    }
+
+    // Padding: 0x80, zeros, then the message length in bits (64 bits) and the digest size (16 bits) at the end of the (last) block.
+    const uint64_t nRemainingBytes = nMessageBytes - nOffset;
+    const uint64_t nMessageBits = nMessageBytes * 8;
+    auto writeLengthTrailer = [&](unsigned char* block)
+    {
+        uint16_t nDigestSize = 256;
+        memcpy(block + SHAVITE3_256_MULTI_BLOCK_BYTES - 10, &nMessageBits, 8);
+        memcpy(block + SHAVITE3_256_MULTI_BLOCK_BYTES - 2, &nDigestSize, 2);
+    };
+    for (int nLane = 0; nLane < numLanes; ++nLane)
+    {
+        mb_gather_message(blocks[nLane], nOffset, nRemainingBytes, data1[nLane], data1Size, data2[nLane], data2Size, data3[nLane], data3Size);
+        blocks[nLane][nRemainingBytes] = 0x80;
+        memset(blocks[nLane] + nRemainingBytes + 1, 0, SHAVITE3_256_MULTI_BLOCK_BYTES - (nRemainingBytes + 1));
+    }
+    if (nRemainingBytes >= SHAVITE3_256_MULTI_BLOCK_BYTES - 10)
+    {
+        // No room for the trailer, it goes into an additional block (compressed with a zero counter as it holds no message bits).
+        shavite3_256_multi_compress(chaining1, chaining2, blocks, nMessageBits);
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            memset(blocks[nLane], 0, SHAVITE3_256_MULTI_BLOCK_BYTES);
+            writeLengthTrailer(blocks[nLane]);
+        }
+        shavite3_256_multi_compress(chaining1, chaining2, blocks, 0);
+    }
+    else
+    {
+        for (int nLane = 0; nLane < numLanes; ++nLane)
+        {
+            writeLengthTrailer(blocks[nLane]);
+        }
+        shavite3_256_multi_compress(chaining1, chaining2, blocks, nRemainingBytes == 0 ? 0 : nMessageBits);
+    }
+
+    mb_store(chaining1, hashes, 0);
+    mb_store(chaining2, hashes, 16);
+}
+#endif
@@ -26,7 +26,32 @@
 #include <TargetConditionals.h>
 #endif
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <fstream>
+#include <sstream>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// Avoid a dependency on libnuma/linux headers for the handful of constants we need.
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
 sigma_settings defaultSigmaSettings;
+sigma_arena_settings defaultSigmaArenaSettings;
 
 inline void sigmaRandomFastHash(uint64_t nPseudoRandomAlg, uint8_t* data1, uint64_t data1Size, uint8_t* data2, uint64_t data2Size, uint8_t* data3, uint64_t data3Size, uint256& outHash)
 {
@@ -117,6 +142,85 @@ inline void sigmaRandomFastHashRef(uint64_t nPseudoRandomAlg, uint8_t* data1, ui
 uint64_t gSelShavite=0;
 uint64_t gSelEcho=0;
 uint64_t gSelArgon=0;
+uint64_t gSelEchoMultiLanes=1;
+uint64_t gSelShaviteMultiLanes=1;
+std::string gSelMultiBuffer="none";
+sigma_mining_kernel gSelMiningKernel=sigma_mining_kernel::INTERLEAVED;
+
+std::string multiBufferSelectionName()
+{
+    return strprintf("%s (echo %d lanes, shavite %d lanes)", gSelMultiBuffer, gSelEchoMultiLanes, gSelShaviteMultiLanes);
+}
+
+void sigmaRandomFastHashBatch(const sigma_fast_hash_request* requests, uint64_t numRequests, uint64_t data1Size, uint64_t data2Size, uint64_t data3Size)
+{
+    for (uint64_t nAlg=0; nAlg<2; ++nAlg)
+    {
+        auto hashLanes = (nAlg == 0) ? selected_echo256_multi_opt_HashLanes : selected_shavite3_256_multi_opt_HashLanes;
+        const uint64_t numLanes = (nAlg == 0) ? gSelEchoMultiLanes : gSelShaviteMultiLanes;
+
+        const unsigned char* data1[SIGMA_MAX_MULTI_LANES];
+        const unsigned char* data2[SIGMA_MAX_MULTI_LANES];
+        const unsigned char* data3[SIGMA_MAX_MULTI_LANES];
+        unsigned char* hashes[SIGMA_MAX_MULTI_LANES];
+        const sigma_fast_hash_request* lastRequest = nullptr;
+        uint64_t numQueued = 0;
+        uint256 discardedHash;
+
+        auto flush = [&]()
+        {
+            if (numQueued == 1)
+            {
+                // Not worth paying for a full set of lanes to hash a single message.
+                sigmaRandomFastHash(nAlg, lastRequest->data1, data1Size, lastRequest->data2, data2Size, lastRequest->data3, data3Size, *lastRequest->outHash);
+            }
+            else
+            {
+                // Pad a partial set of lanes by repeating the last message.
+                for (uint64_t nLane=numQueued; nLane<numLanes; ++nLane)
+                {
+                    data1[nLane] = data1[numQueued-1];
+                    data2[nLane] = data2[numQueued-1];
+                    data3[nLane] = data3[numQueued-1];
+                    hashes[nLane] = discardedHash.begin();
+                }
+                hashLanes(data1, data1Size, data2, data2Size, data3, data3Size, hashes);
+            }
+            numQueued = 0;
+        };
+
+        for (uint64_t i=0; i<numRequests; ++i)
+        {
+            const sigma_fast_hash_request& request = requests[i];
+            if (request.nPseudoRandomAlg != nAlg)
+                continue;
+            if (!hashLanes)
+            {
+                sigmaRandomFastHash(nAlg, request.data1, data1Size, request.data2, data2Size, request.data3, data3Size, *request.outHash);
+                continue;
+            }
+            data1[numQueued] = request.data1;
+            data2[numQueued] = request.data2;
+            data3[numQueued] = request.data3;
+            hashes[numQueued] = request.outHash->begin();
+            lastRequest = &request;
+            if (++numQueued == numLanes)
+                flush();
+        }
+        if (numQueued > 0)
+            flush();
+    }
+}
+
+std::string miningKernelName(sigma_mining_kernel kernel)
+{
+    switch (kernel)
+    {
+        case sigma_mining_kernel::SERIAL: return "serial";
+        case sigma_mining_kernel::INTERLEAVED: return strprintf("interleaved (%d lanes)", SIGMA_MINING_LANES);
+    }
+    return "";
+}
 
 uint64_t nNumShaviteTrials=100;
 uint64_t nNumEchoTrials=100;
@@ -205,6 +309,17 @@ uint64_t nNumArgonTrials=10;
     gSelArgon=IDX;\
 }
 
+#define FORCE_SELECT_MULTI_BUFFER_ECHO(CPU, LANES) \
+{\
+    selected_echo256_multi_opt_HashLanes = echo256_multi_opt_##CPU##_HashLanes;\
+    gSelEchoMultiLanes=LANES;\
+}
+#define FORCE_SELECT_MULTI_BUFFER_SHAVITE(CPU, LANES) \
+{\
+    selected_shavite3_256_multi_opt_HashLanes = shavite3_256_multi_opt_##CPU##_HashLanes;\
+    gSelShaviteMultiLanes=LANES;\
+}
+
 #ifdef ARCH_CPU_X86_FAMILY
 std::string selectedAlgorithmName(uint64_t nSel)
 {
@@ -542,6 +657,47 @@ logselection:
     LogSelection(gSelShavite, "shavite");
     LogSelection(gSelEcho, "echo");
     LogSelection(gSelArgon, "argon");
+
+    #ifdef ARCH_CPU_X86_FAMILY
+    // The multi-buffer fast hashes are only an option when one of the hardware AES implementations was selected above.
+    if (gSelEcho >= 1 && gSelEcho <= 5)
+    {
+        std::string forceSigmaMultiBuffer = GetArg("-sigmamultibuffer", "");
+        #define SELECT_MULTI_BUFFER(x, supported) (gSelMultiBuffer == "none" && ((forceSigmaMultiBuffer.empty() && (supported)) || (forceSigmaMultiBuffer==x)))
+        #if defined(COMPILER_HAS_AVX512BW_VAES)
+        if (SELECT_MULTI_BUFFER("avx512bw-vaes", __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("vaes")))
+        {
+            FORCE_SELECT_MULTI_BUFFER_ECHO(avx512bw_vaes, 8);
+            FORCE_SELECT_MULTI_BUFFER_SHAVITE(avx512bw_vaes, 8);
+            gSelMultiBuffer = "avx512bw-vaes";
+        }
+        #endif
+        #if defined(COMPILER_HAS_AVX2_VAES)
+        if (SELECT_MULTI_BUFFER("avx2-vaes", __builtin_cpu_supports("avx2") && __builtin_cpu_supports("vaes")))
+        {
+            FORCE_SELECT_MULTI_BUFFER_ECHO(avx2_vaes, 4);
+            FORCE_SELECT_MULTI_BUFFER_SHAVITE(avx2_vaes, 4);
+            gSelMultiBuffer = "avx2-vaes";
+        }
+        #endif
+        #if defined(COMPILER_HAS_AVX2) && defined(COMPILER_HAS_AES)
+        // No 2 lane echo, it is no faster than the scalar implementation.
+        if (SELECT_MULTI_BUFFER("avx2-aes", __builtin_cpu_supports("avx2") && __builtin_cpu_supports("aes")))
+        {
+            FORCE_SELECT_MULTI_BUFFER_SHAVITE(avx2_aes, 2);
+            gSelMultiBuffer = "avx2-aes";
+        }
+        #endif
+        #undef SELECT_MULTI_BUFFER
+    }
+    #endif
+    LogPrintf("[multi-buffer] Selected %s\n", multiBufferSelectionName());
+
+    {
+        std::string forceSigmaKernel = GetArg("-sigmakernel", "");
+        gSelMiningKernel = (forceSigmaKernel == miningKernelName(sigma_mining_kernel::SERIAL)) ? sigma_mining_kernel::SERIAL : sigma_mining_kernel::INTERLEAVED;
+        LogPrintf("[mining kernel] Selected %s\n", miningKernelName(gSelMiningKernel));
+    }
 }
 
 void normaliseBufferSize(uint64_t& nBufferSizeBytes)
@@ -564,6 +720,46 @@ void sigma_settings::verify()
 }
 
 
+// Returns the cpus of every NUMA node that has any, empty if the topology can't be determined.
+static std::vector<sigma_numa_node> getNumaNodes()
+{
+    std::vector<sigma_numa_node> nodes;
+    #if defined(__linux__)
+    for (int nNode=0; nNode<64; ++nNode)
+    {
+        std::ifstream cpuListFile(strprintf("/sys/devices/system/node/node%d/cpulist", nNode));
+        if (!cpuListFile.good())
+            continue;
+
+        // Comma separated list of cpus and cpu ranges e.g. "0-7,16-23"
+        sigma_numa_node node;
+        node.nodeId = nNode;
+        std::string cpuList;
+        std::getline(cpuListFile, cpuList);
+        std::stringstream cpuRanges(cpuList);
+        std::string cpuRange;
+        while (std::getline(cpuRanges, cpuRange, ','))
+        {
+            try
+            {
+                size_t nDash = cpuRange.find('-');
+                int nFirst = std::stoi(cpuRange.substr(0, nDash));
+                int nLast = (nDash == std::string::npos) ? nFirst : std::stoi(cpuRange.substr(nDash+1));
+                for (int nCpu=nFirst; nCpu<=nLast; ++nCpu)
+                    node.cpus.push_back(nCpu);
+            }
+            catch (...)
+            {
+            }
+        }
+        // Memory only nodes are of no use to us as we can't place threads on them.
+        if (!node.cpus.empty())
+            nodes.push_back(node);
+    }
+    #endif
+    return nodes;
+}
+
 sigma_context::sigma_context(sigma_settings settings_, uint64_t allocateArenaSizeKb_, uint64_t numThreads_, uint64_t numArenaThreads_)
 : numThreads(numThreads_)
 , numArenaThreads(numArenaThreads_)
@@ -573,19 +769,158 @@ sigma_context::sigma_context(sigma_settings settings_, uint64_t allocateArenaSiz
     assert(allocatedArenaSizeKb <= settings.arenaSizeKb);
     assert(allocatedArenaSizeKb%settings.argonMemoryCostKb==0);
 
+    if (defaultSigmaArenaSettings.numaAware)
+    {
+        numaNodes = getNumaNodes();
+        if (numaNodes.size() < 2)
+            numaNodes.clear();
+    }
+
+    allocateArena();
+    if (arena && !numaNodes.empty())
+        bindArenaToNumaNodes();
+
+    numHashesPossibleWithAvailableMemory = (allocatedArenaSizeKb*1024)/settings.arenaChunkSizeBytes;
+}
+
+void sigma_context::allocateArena()
+{
+    uint64_t arenaSizeBytes = allocatedArenaSizeKb*1024;
+
     // Node/electron addons have issues with large memory (>2gb) allocations, due to chrome overriding malloc and doing various custom things with it
     // Work around this by bypassing malloc and doing a direct mmap instead
     #if (defined(__linux__)||defined(__APPLE__)) && defined(DJINNI_NODEJS)
-    arena = (uint8_t*)mmap(0, (allocatedArenaSizeKb*1024), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,-1, 0);
+    arena = (uint8_t*)mmap(0, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,-1, 0);
+    if (arena == MAP_FAILED)
+    {
+        arena = nullptr;
+    }
     if (arena)
     {
-        memset(arena, 0, allocatedArenaSizeKb*1024);
+        memset(arena, 0, arenaSizeBytes);
+        arenaAllocation = sigma_arena_allocation::MMAP;
+        arenaMappedBytes = arenaSizeBytes;
     }
     #else
-    arena = (uint8_t*)malloc(allocatedArenaSizeKb*1024);
+    #if defined(__linux__)
+    // Huge pages and NUMA binding both need a page aligned mapping of our own, malloc doesn't give us that.
+    if (defaultSigmaArenaSettings.hugePages || !numaNodes.empty())
+    {
+        if (defaultSigmaArenaSettings.hugePages)
+        {
+            // Explicit huge pages only succeed if the administrator has reserved enough of them (vm.nr_hugepages or hugepagesz=1G on the kernel command line)
+            const uint64_t nSize1GB = 1024*1024*1024;
+            if (arenaSizeBytes % nSize1GB == 0)
+            {
+                void* mapping = mmap(0, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_1GB, -1, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    arena = (uint8_t*)mapping;
+                    arenaAllocation = sigma_arena_allocation::MMAP_HUGEPAGES_1GB;
+                }
+            }
+            if (!arena)
+            {
+                // Arena size is always a multiple of the argon memory cost (4mb) so no rounding is required for 2mb pages.
+                void* mapping = mmap(0, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_2MB, -1, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    arena = (uint8_t*)mapping;
+                    arenaAllocation = sigma_arena_allocation::MMAP_HUGEPAGES_2MB;
+                }
+            }
+        }
+        if (!arena)
+        {
+            void* mapping = mmap(0, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (mapping != MAP_FAILED)
+            {
+                arena = (uint8_t*)mapping;
+                arenaAllocation = sigma_arena_allocation::MMAP;
+                // Fall back to transparent huge pages, the kernel will back what it can with 2mb pages.
+                if (defaultSigmaArenaSettings.hugePages && madvise(arena, arenaSizeBytes, MADV_HUGEPAGE) == 0)
+                    arenaAllocation = sigma_arena_allocation::MMAP_TRANSPARENT_HUGEPAGES;
+            }
+        }
+        if (arena)
+        {
+            arenaMappedBytes = arenaSizeBytes;
+            return;
+        }
+    }
     #endif
+    arena = (uint8_t*)malloc(arenaSizeBytes);
+    arenaAllocation = sigma_arena_allocation::MALLOC;
+    #endif
+}
 
-    numHashesPossibleWithAvailableMemory = (allocatedArenaSizeKb*1024)/settings.arenaChunkSizeBytes;
+void sigma_context::bindArenaToNumaNodes()
+{
+    #if defined(__linux__)
+    if (arenaAllocation == sigma_arena_allocation::MALLOC)
+    {
+        numaNodes.clear();
+        return;
+    }
+
+    // Each node gets an equal contiguous slice of the arena, slices are aligned to whole argon chunks (which are in turn a multiple of every page size but 1gb).
+    // Fast hashes read uniformly from the whole arena so no thread can be fully local; the aim is to spread the memory traffic evenly over all memory controllers,
+    // and to let the arena threads build each slice on the node that owns it.
+    uint64_t nPageSize = (arenaAllocation == sigma_arena_allocation::MMAP_HUGEPAGES_1GB) ? 1024*1024*1024 : settings.argonMemoryCostKb*1024;
+    uint64_t arenaSizeBytes = allocatedArenaSizeKb*1024;
+    uint64_t nSliceSize = ((arenaSizeBytes / numaNodes.size()) / nPageSize) * nPageSize;
+    if (nSliceSize == 0)
+    {
+        numaNodes.clear();
+        return;
+    }
+    for (uint64_t i=0; i<numaNodes.size(); ++i)
+    {
+        numaNodes[i].arenaBegin = nSliceSize*i;
+        numaNodes[i].arenaEnd = (i == numaNodes.size()-1) ? arenaSizeBytes : nSliceSize*(i+1);
+
+        unsigned long nodeMask = 1UL << numaNodes[i].nodeId;
+        if (syscall(SYS_mbind, arena+numaNodes[i].arenaBegin, numaNodes[i].arenaEnd-numaNodes[i].arenaBegin, MPOL_BIND, &nodeMask, sizeof(nodeMask)*8, 0) != 0)
+        {
+            LogPrintf("sigma: Failed to bind arena to NUMA node %d, continuing without NUMA placement\n", numaNodes[i].nodeId);
+            numaNodes.clear();
+            return;
+        }
+    }
+    #else
+    numaNodes.clear();
+    #endif
+}
+
+void sigma_context::pinThreadToNumaNode(uint64_t nThreadIndex)
+{
+    #if defined(__linux__)
+    if (numaNodes.empty())
+        return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int nCpu : numaNodes[nThreadIndex%numaNodes.size()].cpus)
+    {
+        CPU_SET(nCpu, &cpuset);
+    }
+    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+    #endif
+}
+
+std::string sigma_context::arenaAllocationDescription()
+{
+    std::string description;
+    switch (arenaAllocation)
+    {
+        case sigma_arena_allocation::MALLOC: description = "regular pages (malloc)"; break;
+        case sigma_arena_allocation::MMAP: description = "regular pages (mmap)"; break;
+        case sigma_arena_allocation::MMAP_TRANSPARENT_HUGEPAGES: description = "transparent huge pages"; break;
+        case sigma_arena_allocation::MMAP_HUGEPAGES_2MB: description = "2mb huge pages"; break;
+        case sigma_arena_allocation::MMAP_HUGEPAGES_1GB: description = "1gb huge pages"; break;
+    }
+    if (!numaNodes.empty())
+        description += strprintf(" split over %d NUMA nodes", numaNodes.size());
+    return description;
 }
 
 bool sigma_context::arenaIsValid()
@@ -603,6 +938,12 @@ void sigma_context::prepareArenas(CBlockHeader& headerData)
     // Even if he should find a way to otherwise manipulate things, this measure makes it a bit trickier.
     // This is a bit of a paranoid measure as realistically the argon hashes are of the block header which should always be different anyway.
     uint32_t nBaseNonce = headerData.nBits ^ (uint32_t)(headerData.hashPrevBlock.GetCheapHash());
+
+    // Which chunks a thread fills has no effect on the arena contents, only on where the work happens.
+    // When the arena is split over NUMA nodes have each thread fill chunks from the slice bound to the node it is pinned to.
+    bool fNumaPlacement = !numaNodes.empty() && numArenaThreads >= numaNodes.size();
+    uint64_t nChunkSizeBytes = settings.argonMemoryCostKb*1024;
+
     std::vector<std::thread> workerPool;
     workerPool.reserve(numArenaThreads);
     for (uint32_t nThreadIndex=0; nThreadIndex<numArenaThreads; ++nThreadIndex)
@@ -616,13 +957,25 @@ void sigma_context::prepareArenas(CBlockHeader& headerData)
             sched_setaffinity(0, sizeof(cpuset), &cpuset);
             #endif
 
-            for (;nThreadIndex<numHashes;nThreadIndex+=numArenaThreads)
+            uint32_t nFirstChunk = nThreadIndex;
+            uint32_t nEndChunk = numHashes;
+            uint32_t nChunkStride = numArenaThreads;
+            if (fNumaPlacement)
+            {
+                const sigma_numa_node& node = numaNodes[nThreadIndex%numaNodes.size()];
+                pinThreadToNumaNode(nThreadIndex);
+                nFirstChunk = ((node.arenaBegin + nChunkSizeBytes - 1) / nChunkSizeBytes) + (nThreadIndex/numaNodes.size());
+                nEndChunk = std::min((uint64_t)numHashes, (node.arenaEnd + nChunkSizeBytes - 1) / nChunkSizeBytes);
+                nChunkStride = (numArenaThreads - (nThreadIndex%numaNodes.size()) + numaNodes.size() - 1) / numaNodes.size();
+            }
+
+            for (uint32_t nChunk=nFirstChunk; nChunk<nEndChunk; nChunk+=nChunkStride)
             {
-                headerData.nNonce = nBaseNonce+nThreadIndex;
+                headerData.nNonce = nBaseNonce+nChunk;
                 argon2_echo_context context;
                 context.t_cost = settings.argonArenaRoundCost;
                 context.m_cost = settings.argonMemoryCostKb;
-                context.allocated_memory = &arena[(settings.argonMemoryCostKb*1024)*nThreadIndex];
+                context.allocated_memory = &arena[nChunkSizeBytes*nChunk];
                 context.pwd = (uint8_t*)&headerData.nVersion;
                 context.pwdlen = 80;
 
@@ -707,6 +1060,162 @@ void sigma_context::benchmarkFastHashesRef(uint8_t* hashData1, uint8_t* hashData
 }
 
 
+// Pull the cache lines of an upcoming fast hash input into cache without waiting on them.
+inline void sigmaPrefetchFastHashInput(const uint8_t* data, uint64_t dataSize)
+{
+    #if defined(__GNUC__) || defined(__clang__)
+    for (uint64_t nOffset = 0; nOffset < dataSize; nOffset += 64)
+    {
+        __builtin_prefetch(data + nOffset, 0, 0);
+    }
+    __builtin_prefetch(data + dataSize - 1, 0, 0);
+    #endif
+}
+
+// One independent pre-nonce stream of the interleaved kernel, along with the fast hash it has queued up (and prefetched) for the next round.
+struct sigma_mining_lane
+{
+    CBlockHeader headerData;
+    CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
+    std::array<uint64_t, 4> prngState;
+    bool active=false;
+    bool pending=false;
+    uint64_t nPseudoRandomNonce1=0;
+    uint64_t nPseudoRandomNonce2=0;
+    uint64_t nPseudoRandomAlg1=0;
+    uint64_t nPseudoRandomAlg2=0;
+    uint64_t nFastHashOffset1=0;
+    uint64_t nFastHashOffset2=0;
+};
+
+// Produces exactly the same fast hashes as the serial loop in mineBlock for every pre/post nonce, only the order in which they are computed differs.
+// The serial loop is bound by a dependent DRAM miss for every half hash; here the inputs all lanes prefetched in the previous round are first hashed as one batch
+// (which lets the multi-buffer implementations hash several lanes per instruction) and then every lane advances its PRNG and issues the prefetch for its next input,
+// so each arena read has a full round of fast hashes of compute to land.
+// Hooks:
+//   bool interrupted()                              - checked once per round, stop mining when true.
+//   void slowHash()                                 - a new pre-nonce was slow hashed.
+//   void skipped()                                  - a post-nonce was skipped (arena chunk not available with our memory).
+//   bool fullHash(const CBlockHeader&, const uint256&) - both halves were hashed, return true to stop mining.
+template<uint64_t numLanes, typename MiningHooks> void sigma_context::mineLanes(CBlockHeader headerData, uint64_t nThreadIndex, argon2_echo_context& argonContext, const arith_uint256& hashTarget, std::atomic<uint64_t>& halfHashCounter, MiningHooks& hooks)
+{
+    const uint32_t nBaseNonce = headerData.nBits ^ (uint32_t)(headerData.hashPrevBlock.GetCheapHash());
+    const uint64_t nChunkOffsetRange = settings.arenaChunkSizeBytes-settings.fastHashSizeBytes;
+    uint64_t nNextPreNonce = nThreadIndex;
+    std::array<sigma_mining_lane, numLanes> lanes;
+    std::array<sigma_fast_hash_request, numLanes> batch;
+    std::array<uint256, numLanes> batchHashes;
+
+    // Advance the lanes PRNG for its current post nonce, queue the resulting fast hash and prefetch its (first) arena input.
+    auto queueNextFastHash = [&](sigma_mining_lane& lane)
+    {
+        unsigned char ciphered[32];
+        lane.prng.ProcessData((unsigned char*)&ciphered[0], (const unsigned char*)&lane.prngState[0], 32);
+        memcpy(&lane.prngState[0], &ciphered[0], (size_t)32);
+        const auto& state = lane.prngState;
+        lane.nPseudoRandomNonce1 = (state[0] ^ state[1]) % settings.numHashesPost;
+        lane.nPseudoRandomNonce2 = (state[2] ^ state[3]) % settings.numHashesPost;
+        lane.pending = lane.nPseudoRandomNonce1 < numHashesPossibleWithAvailableMemory && lane.nPseudoRandomNonce2 < numHashesPossibleWithAvailableMemory;
+        if (UNLIKELY(!lane.pending))
+        {
+            hooks.skipped();
+            return;
+        }
+        lane.nPseudoRandomAlg1 = (state[0] ^ state[3]) % 2;
+        lane.nPseudoRandomAlg2 = (state[1] ^ state[2]) % 2;
+        lane.nFastHashOffset1 = (state[0] ^ state[2]) % nChunkOffsetRange;
+        lane.nFastHashOffset2 = (state[1] ^ state[3]) % nChunkOffsetRange;
+        if constexpr (numLanes > 1)
+        {
+            sigmaPrefetchFastHashInput(&arena[(lane.nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+lane.nFastHashOffset1], settings.fastHashSizeBytes);
+        }
+    };
+
+    // Give the lane the next pre nonce of this thread (if there are any left) and slow hash it.
+    auto startLane = [&](sigma_mining_lane& lane) -> bool
+    {
+        lane.active = false;
+        if (nNextPreNonce > settings.numHashesPre)
+            return true;
+        lane.headerData = headerData;
+        lane.headerData.nNonce = nBaseNonce;
+        lane.headerData.nPreNonce = nNextPreNonce;
+        nNextPreNonce += numThreads;
+
+        argonContext.pwd = (uint8_t*)&lane.headerData.nVersion;
+        if (selected_argon2_echo_hash(&argonContext, true) != ARGON2_OK)
+            return false;
+        hooks.slowHash();
+
+        lane.prngState = argonContext.outHash;
+        lane.prng.SetKey((const unsigned char*)&lane.prngState[0], 32);
+        lane.headerData.nPostNonce = 0;
+        lane.active = true;
+        queueNextFastHash(lane);
+        return true;
+    };
+
+    for (auto& lane : lanes)
+    {
+        if (!startLane(lane))
+            return;
+    }
+
+    while (true)
+    {
+        if (UNLIKELY(hooks.interrupted()))
+            return;
+
+        // Compute the first half hash of every lane that has one queued as a single batch, so the multi-buffer implementations get full sets of lanes.
+        uint64_t numBatched = 0;
+        bool anyActive = false;
+        for (auto& lane : lanes)
+        {
+            if (!lane.active)
+                continue;
+            anyActive = true;
+            if (LIKELY(lane.pending))
+            {
+                batch[numBatched] = {lane.nPseudoRandomAlg1, (uint8_t*)&lane.headerData.nVersion, (uint8_t*)&lane.prngState[0], &arena[(lane.nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+lane.nFastHashOffset1], &batchHashes[numBatched]};
+                ++numBatched;
+            }
+        }
+        if (!anyActive)
+            return;
+        sigmaRandomFastHashBatch(batch.data(), numBatched, 80, 32, settings.fastHashSizeBytes);
+        halfHashCounter += numBatched;
+
+        // Lanes are visited in the same order as above, so the n-th pending lane owns the n-th hash of the batch.
+        numBatched = 0;
+        for (auto& lane : lanes)
+        {
+            if (!lane.active)
+                continue;
+
+            if (LIKELY(lane.pending))
+            {
+                const uint256& halfHash = batchHashes[numBatched++];
+                if (UNLIKELY(UintToArith256(halfHash) <= hashTarget))
+                {
+                    uint256 fastHash;
+                    sigmaRandomFastHash(lane.nPseudoRandomAlg2, (uint8_t*)&lane.headerData.nVersion, 80, (uint8_t*)&lane.prngState[0], 32, &arena[(lane.nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+lane.nFastHashOffset2], settings.fastHashSizeBytes, fastHash);
+                    if (hooks.fullHash(lane.headerData, fastHash))
+                        return;
+                }
+            }
+
+            if (UNLIKELY(lane.headerData.nPostNonce == settings.numHashesPost-1))
+            {
+                if (!startLane(lane))
+                    return;
+                continue;
+            }
+            ++lane.headerData.nPostNonce;
+            queueNextFastHash(lane);
+        }
+    }
+}
+
 //fixme: (SIGMA) - dedup with benchmarkMining
 void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt)
 {
@@ -728,6 +1237,8 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                 CPU_ZERO(&cpuset);
                 CPU_SET(nThreadIndex, &cpuset);
                 sched_setaffinity(0, sizeof(cpuset), &cpuset);
+                #else
+                pinThreadToNumaNode(nThreadIndex);
                 #endif
 
                 //fixme: (CBSU) - Theoretically we can reduce thread contention here if we allocate on the stack (VLA) instead of the heap...
@@ -744,6 +1255,33 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                 argonContext.lanes = settings.numVerifyThreads;
                 argonContext.threads = 1;
 
+                if (gSelMiningKernel == sigma_mining_kernel::INTERLEAVED)
+                {
+                    struct
+                    {
+                        bool& interrupt;
+                        CBlock* pBlock;
+                        uint256& foundBlockHash;
+                        const arith_uint256& hashTarget;
+                        bool interrupted() { return interrupt; }
+                        void slowHash() {}
+                        void skipped() {}
+                        bool fullHash(const CBlockHeader& header, const uint256& fastHash)
+                        {
+                            if (LIKELY(UintToArith256(fastHash) > hashTarget))
+                                return false;
+                            // Found a block, set it and exit.
+                            pBlock->nNonce = header.nNonce;
+                            foundBlockHash = fastHash;
+                            interrupt=true;
+                            return true;
+                        }
+                    } hooks{interrupt, pBlock, foundBlockHash, hashTarget};
+                    mineLanes<SIGMA_MINING_LANES>(headerData, nThreadIndex, argonContext, hashTarget, halfHashCounter, hooks);
+                    delete[] hashMem;
+                    return;
+                }
+
                 for (; nThreadIndex <= settings.numHashesPre;nThreadIndex+=numThreads)
                 {
                     if (UNLIKELY(interrupt))
@@ -868,6 +1406,8 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                 CPU_ZERO(&cpuset);
                 CPU_SET(nThreadIndex, &cpuset);
                 sched_setaffinity(0, sizeof(cpuset), &cpuset);
+                #else
+                pinThreadToNumaNode(nThreadIndex);
                 #endif
 
                 //fixme: (CBSU) - Theoretically we can reduce thread contention here if we allocate on the stack (VLA) instead of the heap...
@@ -884,6 +1424,32 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                 argonContext.lanes = settings.numVerifyThreads;
                 argonContext.threads = 1;
 
+                if (gSelMiningKernel == sigma_mining_kernel::INTERLEAVED)
+                {
+                    struct
+                    {
+                        std::atomic<uint64_t>& slowHashCounter;
+                        std::atomic<uint64_t>& skippedHashCounter;
+                        std::atomic<uint64_t>& hashCounter;
+                        std::atomic<uint64_t>& blockCounter;
+                        const arith_uint256& hashTarget;
+                        uint64_t nRoundsTarget;
+                        bool interrupted() { return hashCounter >= nRoundsTarget; }
+                        void slowHash() { ++slowHashCounter; }
+                        void skipped() { ++skippedHashCounter; }
+                        bool fullHash([[maybe_unused]] const CBlockHeader& header, const uint256& fastHash)
+                        {
+                            ++hashCounter;
+                            if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                                ++blockCounter;
+                            return hashCounter >= nRoundsTarget;
+                        }
+                    } hooks{slowHashCounter, skippedHashCounter, hashCounter, blockCounter, hashTarget, nRoundsTarget};
+                    mineLanes<SIGMA_MINING_LANES>(headerData, nThreadIndex, argonContext, hashTarget, halfHashCounter, hooks);
+                    delete[] hashMem;
+                    return;
+                }
+
                 for (; nThreadIndex <= settings.numHashesPre;nThreadIndex+=numThreads)
                 {
                     uint16_t nPreNonce = nThreadIndex;
@@ -995,13 +1561,264 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
     }
 }
 
-sigma_context::~sigma_context()
+sigma_mining_engine::sigma_mining_engine(sigma_settings settings_, uint64_t arenaSizeKb, uint64_t numThreads_, uint64_t numArenaThreads_, bool doubleBuffer_)
+: settings(settings_)
+, numThreads(numThreads_)
 {
-    #if (defined(__linux__)||defined(__APPLE__)) && defined(DJINNI_NODEJS)
-    (uint8_t*)munmap(arena, (allocatedArenaSizeKb*1024));
+    std::vector<uint64_t> memorySizesKb;
+    uint64_t nMemoryAllocatedKb=0;
+    while (nMemoryAllocatedKb < arenaSizeKb)
+    {
+        uint64_t nMemoryChunkKb = std::min((arenaSizeKb-nMemoryAllocatedKb), settings.arenaSizeKb);
+        nMemoryAllocatedKb += nMemoryChunkKb;
+        memorySizesKb.emplace_back(nMemoryChunkKb);
+    }
+    if (memorySizesKb.empty())
+        return;
+
+    //fixme: (SIGMA) - better memory size handling - right now we just blindly allocate until we succeed...
+    //And we don't even attempt to account for swap, so if the user sets a memory size too large for system memory we will just happily swap and perform worse than if the user picked a more reasonable size.
+    for (uint64_t nBuffer=0; nBuffer < (doubleBuffer_ ? 2 : 1); ++nBuffer)
+    {
+        for (auto instanceMemorySizeKb : memorySizesKb)
+        {
+            uint64_t trySizeBytes = instanceMemorySizeKb*1024;
+            while (trySizeBytes > 0)
+            {
+                normaliseBufferSize(trySizeBytes);
+                try
+                {
+                    buffers[nBuffer].push_back(std::unique_ptr<sigma_context>(new sigma_context(settings, trySizeBytes/1024, numThreads/memorySizesKb.size(), numArenaThreads_/memorySizesKb.size())));
+                    break;
+                }
+                catch (...)
+                {
+                    // reduce by 256mb and try again.
+                    if (trySizeBytes < 256*1024*1024)
+                        break;
+                    trySizeBytes -= 256*1024*1024;
+                }
+            }
+        }
+    }
+    // Mining threads are tied to a context index, so the second buffer is only usable if it has the same layout as the first.
+    if (buffers[1].size() != buffers[0].size())
+    {
+        if (doubleBuffer_)
+            LogPrintf("sigma_mining_engine: unable to allocate a second arena buffer, mining single buffered\n");
+        buffers[1].clear();
+    }
+
+    for (uint64_t nContext=0; nContext < buffers[0].size(); ++nContext)
+    {
+        for (uint64_t nThreadIndex=0; nThreadIndex < buffers[0][nContext]->numThreads; ++nThreadIndex)
+        {
+            workerPool.emplace_back(&sigma_mining_engine::workerThread, this, nContext, nThreadIndex);
+        }
+    }
+}
+
+sigma_mining_engine::~sigma_mining_engine()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        shutdown = true;
+        currentJob = nullptr;
+        nCurrentJobId = 0;
+    }
+    jobCondition.notify_all();
+    for (auto& thread : workerPool) { thread.join(); }
+}
+
+std::string sigma_mining_engine::arenaAllocationDescription()
+{
+    if (!isValid())
+        return "";
+    std::string description = buffers[0][0]->arenaAllocationDescription();
+    if (isDoubleBuffered())
+        description += " (double buffered)";
+    return description;
+}
+
+void sigma_mining_engine::publishJob(std::shared_ptr<const sigma_mining_job> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        currentJob = job;
+        nCurrentJobId = job ? job->nJobId : 0;
+        numThreadsExhausted = 0;
+    }
+    jobCondition.notify_all();
+}
+
+void sigma_mining_engine::pause()
+{
+    publishJob(nullptr);
+}
+
+uint64_t sigma_mining_engine::setJob(const CBlockHeader& header)
+{
+    // Double buffered we build into the buffer that isn't being mined, so the current job keeps all threads busy until the new one is ready.
+    uint64_t nBuffer = nActiveBuffer;
+    if (isDoubleBuffered())
+        nBuffer = 1 - nActiveBuffer;
+    else
+        pause();
+
+    // Threads still on an older job that used this buffer abandon it at their next interrupt check, wait for that before overwriting the arena.
+    {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        resultCondition.wait(lock, [&]() { return nBufferUsers[nBuffer] == 0; });
+    }
+
+    CBlockHeader arenaHeader = header;
+    std::vector<std::thread> prepareThreads;
+    for (uint64_t nContext=1; nContext < buffers[nBuffer].size(); ++nContext)
+    {
+        prepareThreads.emplace_back([&, nContext]() { buffers[nBuffer][nContext]->prepareArenas(arenaHeader); });
+    }
+    {
+        CBlockHeader firstArenaHeader = header;
+        buffers[nBuffer][0]->prepareArenas(firstArenaHeader);
+    }
+    for (auto& thread : prepareThreads) { thread.join(); }
+
+    auto job = std::make_shared<sigma_mining_job>();
+    job->header = header;
+    job->hashTarget = arith_uint256().SetCompact(header.nBits);
+    job->nBuffer = nBuffer;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        // Publishing now would hide the found block from the caller, who is still about to replace the block it belongs to.
+        if (foundJob)
+            return 0;
+        job->nJobId = ++nLastJobId;
+        nActiveBuffer = nBuffer;
+        currentJob = job;
+        nCurrentJobId = job->nJobId;
+        numThreadsExhausted = 0;
+    }
+    jobCondition.notify_all();
+    return job->nJobId;
+}
+
+bool sigma_mining_engine::waitForResult(std::chrono::milliseconds timeout, sigma_mining_result& result)
+{
+    std::unique_lock<std::mutex> lock(jobMutex);
+    resultCondition.wait_for(lock, timeout, [&]() { return foundJob || numThreadsExhausted > 0; });
+    if (!foundJob)
+        return false;
+    result.nJobId = foundJob->nJobId;
+    result.header = foundJob->header;
+    result.header.nNonce = nFoundNonce;
+    result.foundBlockHash = foundHash;
+    foundJob = nullptr;
+    return true;
+}
+
+bool sigma_mining_engine::isJobExhausted()
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    return currentJob && numThreadsExhausted > 0;
+}
+
+bool sigma_mining_engine::hasResult()
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    return foundJob != nullptr;
+}
+
+void sigma_mining_engine::workerThread(uint64_t nContext, uint64_t nThreadIndex)
+{
+    #ifdef SIGMA_SET_THREAD_AFFINITY
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(nThreadIndex, &cpuset);
+    sched_setaffinity(0, sizeof(cpuset), &cpuset);
     #else
-    free(arena);
+    buffers[0][nContext]->pinThreadToNumaNode(nThreadIndex);
     #endif
+
+    // Allocated once for the lifetime of the engine instead of once per block.
+    std::unique_ptr<uint8_t[]> hashMem(new uint8_t[settings.argonMemoryCostKb*1024]);
+
+    argon2_echo_context argonContext;
+    argonContext.t_cost = settings.argonSlowHashRoundCost;
+    argonContext.m_cost = settings.argonMemoryCostKb;
+    argonContext.allocated_memory = hashMem.get();
+    argonContext.pwdlen = 80;
+    argonContext.lanes = settings.numVerifyThreads;
+    argonContext.threads = 1;
+
+    uint64_t nMinedJobId = 0;
+    while (true)
+    {
+        std::shared_ptr<const sigma_mining_job> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCondition.wait(lock, [&]() { return shutdown || (currentJob && currentJob->nJobId != nMinedJobId); });
+            if (shutdown)
+                return;
+            job = currentJob;
+            ++nBufferUsers[job->nBuffer];
+        }
+        nMinedJobId = job->nJobId;
+
+        struct
+        {
+            sigma_mining_engine& engine;
+            const sigma_mining_job& job;
+            bool interrupted() { return engine.nCurrentJobId.load(std::memory_order_relaxed) != job.nJobId; }
+            void slowHash() {}
+            void skipped() {}
+            bool fullHash(const CBlockHeader& header, const uint256& fastHash)
+            {
+                if (LIKELY(UintToArith256(fastHash) > job.hashTarget))
+                    return false;
+                {
+                    std::lock_guard<std::mutex> lock(engine.jobMutex);
+                    if (engine.nCurrentJobId == job.nJobId && !engine.foundJob)
+                    {
+                        // Found a block, record it and stop every thread mining this job.
+                        engine.foundJob = engine.currentJob;
+                        engine.nFoundNonce = header.nNonce;
+                        engine.foundHash = fastHash;
+                        engine.nCurrentJobId = 0;
+                    }
+                }
+                engine.resultCondition.notify_all();
+                return true;
+            }
+        } hooks{*this, *job};
+
+        sigma_context& context = *buffers[job->nBuffer][nContext];
+        if (gSelMiningKernel == sigma_mining_kernel::INTERLEAVED)
+            context.mineLanes<SIGMA_MINING_LANES>(job->header, nThreadIndex, argonContext, job->hashTarget, halfHashCounter, hooks);
+        else
+            context.mineLanes<1>(job->header, nThreadIndex, argonContext, job->hashTarget, halfHashCounter, hooks);
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            --nBufferUsers[job->nBuffer];
+            if (nCurrentJobId == job->nJobId)
+                ++numThreadsExhausted;
+        }
+        resultCondition.notify_all();
+    }
+}
+
+sigma_context::~sigma_context()
+{
+    if (!arena)
+        return;
+    #if defined(__linux__)||defined(__APPLE__)
+    if (arenaAllocation != sigma_arena_allocation::MALLOC)
+    {
+        munmap(arena, arenaMappedBytes);
+        return;
+    }
+    #endif
+    free(arena);
 }
 
 
@@ -1153,3 +1970,108 @@ sigma_verify_context::~sigma_verify_context()
 {
     delete[] hashMem;
 }
+
+sigma_verify_pool::sigma_verify_pool(sigma_settings settings_, uint64_t numContexts_)
+{
+    // Parallelism comes from verifying multiple headers at once, so each context runs argon with a single thread.
+    contexts.reserve(std::max((uint64_t)1, numContexts_));
+    for (uint64_t i=0; i<std::max((uint64_t)1, numContexts_); ++i)
+    {
+        contexts.emplace_back(std::make_unique<sigma_verify_context>(settings_, 1));
+    }
+    // The calling thread of verifyHeaders does its share of the work with the first context.
+    workerPool.reserve(contexts.size()-1);
+    for (uint64_t nContext=1; nContext<contexts.size(); ++nContext)
+    {
+        workerPool.emplace_back(&sigma_verify_pool::workerThread, this, nContext);
+    }
+}
+
+sigma_verify_pool::~sigma_verify_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        shutdown = true;
+    }
+    batchCondition.notify_all();
+    for (auto& thread : workerPool) { thread.join(); }
+}
+
+void sigma_verify_pool::verifyBatch(sigma_verify_context& verify)
+{
+    for (uint64_t nIndex = nNextHeader++; nIndex < batchHeaders.size() && !failed; nIndex = nNextHeader++)
+    {
+        bool valid = true;
+        switch (batchVerifyLevels[nIndex])
+        {
+            case 0: valid = verify.verifyHeader<0>(batchHeaders[nIndex]); break;
+            case 1: valid = verify.verifyHeader<1>(batchHeaders[nIndex]); break;
+            case 2: valid = verify.verifyHeader<2>(batchHeaders[nIndex]); break;
+            default: break;
+        }
+        if (!valid)
+        {
+            failed = true;
+            return;
+        }
+        batchResults[nIndex] = 1;
+    }
+}
+
+void sigma_verify_pool::workerThread(uint64_t nContext)
+{
+    uint64_t nLastBatchId=0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(batchMutex);
+            batchCondition.wait(lock, [&]{ return shutdown || nBatchId != nLastBatchId; });
+            if (shutdown)
+                return;
+            nLastBatchId = nBatchId;
+        }
+        verifyBatch(*contexts[nContext]);
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            if (--numWorkersBusy == 0)
+                doneCondition.notify_all();
+        }
+    }
+}
+
+bool sigma_verify_pool::verifyHeaders(Span<const CBlockHeader> headers, Span<const int> verifyLevels, std::vector<uint8_t>& results)
+{
+    assert(headers.size() == verifyLevels.size());
+    results.assign(headers.size(), 0);
+
+    // Only wake the workers if there is more than one header for them to share.
+    bool fUseWorkers = !workerPool.empty() && headers.size() > 1;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batchHeaders = headers;
+        batchVerifyLevels = verifyLevels;
+        batchResults = results.data();
+        nNextHeader = 0;
+        failed = false;
+        if (fUseWorkers)
+        {
+            numWorkersBusy = workerPool.size();
+            ++nBatchId;
+        }
+    }
+    if (fUseWorkers)
+        batchCondition.notify_all();
+
+    verifyBatch(*contexts[0]);
+
+    if (fUseWorkers)
+    {
+        std::unique_lock<std::mutex> lock(batchMutex);
+        doneCondition.wait(lock, [&]{ return numWorkersBusy == 0; });
+    }
+    batchHeaders = Span<const CBlockHeader>();
+    batchVerifyLevels = Span<const int>();
+    batchResults = nullptr;
+
+    return !failed;
+}
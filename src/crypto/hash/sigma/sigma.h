@@ -7,12 +7,23 @@
 #define CRYPTO_HASH_SIGMA_HASH_H
 
 #include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <arith_uint256.h>
 #include <primitives/block.h>
+#include <span.h>
 
 #include <crypto/hash/sigma/argon_echo/argon_echo.h>
 #include <crypto/hash/sigma/echo256/sphlib/sph_echo.h>
 #include <crypto/hash/sigma/echo256/echo256_opt.h>
 #include <crypto/hash/sigma/shavite3_256/shavite3_256_opt.h>
+#include <crypto/hash/sigma/echo256/echo256_multi_opt.h>
+#include <crypto/hash/sigma/shavite3_256/shavite3_256_multi_opt.h>
 #include <crypto/hash/sigma/shavite3_256/ref/shavite3_ref.h>
 
 //  SIGMA hash
@@ -96,6 +107,18 @@ public:
 // Consensus level SIGMA defaults.
 extern sigma_settings defaultSigmaSettings;
 
+// Non consensus options, these only affect how a sigma_context allocates and lays out its arena and never the resulting hashes.
+class sigma_arena_settings
+{
+public:
+    // Back the arena with explicit huge pages (1gb/2mb MAP_HUGETLB) falling back to transparent huge pages if none are reserved.
+    // Fast hashes read from random locations throughout the entire arena, so with regular 4kb pages mining is heavily TLB bound.
+    bool hugePages=false;
+    // On multi socket machines split the arena evenly over the NUMA nodes and spread (pin) arena/mining threads over the nodes to match.
+    bool numaAware=true;
+};
+extern sigma_arena_settings defaultSigmaArenaSettings;
+
 
 // We select the optimal implementation of these hash functions to match our CPU once at program start and then just use the function pointers throghout the SIGMA code.
 void selectOptimisedImplementations();
@@ -105,6 +128,19 @@ extern uint64_t gSelArgon;
 // Get a human readable name for the selections above
 std::string selectedAlgorithmName(uint64_t nSel);
 
+// Mining kernels (how each mining thread schedules its fast hashes), selected alongside the hash implementations above; override with -sigmakernel.
+// SERIAL:      One pre-nonce at a time, every fast hash waits on its own random arena read.
+// INTERLEAVED: SIGMA_MINING_LANES independent pre-nonces per thread, the arena chunk for each lane is prefetched a full round of the other lanes ahead of being hashed.
+enum class sigma_mining_kernel
+{
+    SERIAL,
+    INTERLEAVED
+};
+// NB! The lanes also feed the multi-buffer fast hashes (see sigmaRandomFastHashBatch), so there should be enough of them to fill the widest multi-buffer implementation with lanes of either algorithm.
+static const uint64_t SIGMA_MINING_LANES = 16;
+extern sigma_mining_kernel gSelMiningKernel;
+std::string miningKernelName(sigma_mining_kernel kernel);
+
 inline HashReturn (*selected_echo256_opt_Init)(echo256_opt_hashState* state) = nullptr;
 inline HashReturn (*selected_echo256_opt_Update)(echo256_opt_hashState* state, const unsigned char* data, uint64_t databitlen) = nullptr;
 inline HashReturn (*selected_echo256_opt_Final)(echo256_opt_hashState* state, unsigned char* hashval) = nullptr;
@@ -114,8 +150,49 @@ inline bool (*selected_shavite3_256_opt_Update)(shavite3_256_opt_hashState* stat
 inline bool (*selected_shavite3_256_opt_Final)(shavite3_256_opt_hashState* state, unsigned char* hashval) = nullptr;
 inline int (*selected_argon2_echo_hash)(argon2_echo_context* context, bool doHash) = argon2_echo_ctx_ref;
 
+// Multi-buffer fast hash implementations, which hash several independent (equal length) messages at once; override with -sigmamultibuffer.
+// nullptr (and 1 lane) when there is no multi-buffer implementation for the CPU, in which case the scalar implementation above is used one message at a time.
+inline void (*selected_echo256_multi_opt_HashLanes)(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes) = nullptr;
+inline void (*selected_shavite3_256_multi_opt_HashLanes)(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes) = nullptr;
+static const uint64_t SIGMA_MAX_MULTI_LANES = 8;
+extern uint64_t gSelEchoMultiLanes;
+extern uint64_t gSelShaviteMultiLanes;
+std::string multiBufferSelectionName();
+
+// One fast hash for sigmaRandomFastHashBatch: the hash of data1|data2|data3 with the given algorithm (0 echo, 1 shavite) is written to outHash.
+struct sigma_fast_hash_request
+{
+    uint64_t nPseudoRandomAlg;
+    uint8_t* data1;
+    uint8_t* data2;
+    uint8_t* data3;
+    uint256* outHash;
+};
+// Compute a batch of fast hashes that all share the same data sizes, the requests of each algorithm are handed to its multi-buffer implementation as many at a time as it has lanes.
+// Results are identical to hashing every request individually.
+void sigmaRandomFastHashBatch(const sigma_fast_hash_request* requests, uint64_t numRequests, uint64_t data1Size, uint64_t data2Size, uint64_t data3Size);
+
 void normaliseBufferSize(uint64_t& nBufferSizeBytes);
 
+// A NUMA node (that has cpus) along with the slice of the arena that is bound to it.
+struct sigma_numa_node
+{
+    int nodeId=0;
+    std::vector<int> cpus;
+    uint64_t arenaBegin=0;
+    uint64_t arenaEnd=0;
+};
+
+// How the arena memory was obtained, so that it can be released correctly.
+enum class sigma_arena_allocation
+{
+    MALLOC,
+    MMAP,
+    MMAP_TRANSPARENT_HUGEPAGES,
+    MMAP_HUGEPAGES_2MB,
+    MMAP_HUGEPAGES_1GB
+};
+
 // Heavy weight sigma context for mining - allocated the entire arena (currently 4gb)
 // NB!!! Take care creating/using these they allocate lots of memory..
 class sigma_context
@@ -129,6 +206,8 @@ public:
     void benchmarkFastHashesRef(uint8_t* hashData1, uint8_t* hashData2, uint8_t* hashData3, uint64_t numFastHashes);
     void benchmarkMining(CBlockHeader& headerData, std::atomic<uint64_t>& slowHashCounter, std::atomic<uint64_t>& halfHashCounter, std::atomic<uint64_t>& skippedHashCounter, std::atomic<uint64_t>&hashCounter, std::atomic<uint64_t>&blockCounter, uint64_t nRoundsTarget);
     void mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt);
+    // Human readable description of how the arena is backed (page size, NUMA nodes)
+    std::string arenaAllocationDescription();
     virtual ~sigma_context();
     sigma_context(const sigma_context&) = delete;
     sigma_context& operator=(const sigma_context&) = delete;
@@ -138,8 +217,96 @@ public:
     uint64_t allocatedArenaSizeKb=0;
     uint8_t* arena=nullptr;
 private:
+    void allocateArena();
+    void bindArenaToNumaNodes();
+    // Pin the calling thread to the cpus of the NUMA node that nThreadIndex is assigned to, does nothing unless the arena spans multiple nodes.
+    void pinThreadToNumaNode(uint64_t nThreadIndex);
+    // Mining loop of a single thread over numLanes interleaved pre-nonce streams (SIGMA_MINING_LANES for the INTERLEAVED kernel, 1 behaves as the SERIAL kernel).
+    // The argon context must already be set up for slow hashing; the hooks let mineBlock, benchmarkMining and sigma_mining_engine share it, see sigma.cpp.
+    template<uint64_t numLanes, typename MiningHooks> void mineLanes(CBlockHeader headerData, uint64_t nThreadIndex, argon2_echo_context& argonContext, const arith_uint256& hashTarget, std::atomic<uint64_t>& halfHashCounter, MiningHooks& hooks);
+    friend class sigma_mining_engine;
     sigma_settings settings;
     uint64_t numHashesPossibleWithAvailableMemory=0;
+    sigma_arena_allocation arenaAllocation=sigma_arena_allocation::MALLOC;
+    uint64_t arenaMappedBytes=0;
+    std::vector<sigma_numa_node> numaNodes;
+};
+
+// A job for sigma_mining_engine, published to the mining threads as a whole through an atomic shared_ptr.
+struct sigma_mining_job
+{
+    uint64_t nJobId=0;
+    CBlockHeader header;
+    arith_uint256 hashTarget;
+    // Which of the engines arena buffers was prepared for this header.
+    uint64_t nBuffer=0;
+};
+
+// A block found by sigma_mining_engine; header is that of the job it was found for with the winning nonce filled in.
+struct sigma_mining_result
+{
+    uint64_t nJobId=0;
+    CBlockHeader header;
+    uint256 foundBlockHash;
+};
+
+// Long lived mining engine: the mining threads (and their argon scratch memory) stay resident across blocks and are handed new work through setJob().
+// Optionally keeps two arena buffers so that the arena for the next job can be built while the current job is still being mined in the other one.
+// NB!!! Like sigma_context this allocates lots of memory (twice as much when double buffered).
+class sigma_mining_engine
+{
+public:
+    // The arena of arenaSizeKb (per buffer) is split into sigma_contexts of at most settings_.arenaSizeKb, with the threads divided evenly over them.
+    sigma_mining_engine(sigma_settings settings_, uint64_t arenaSizeKb, uint64_t numThreads_, uint64_t numArenaThreads_, bool doubleBuffer_);
+    virtual ~sigma_mining_engine();
+    sigma_mining_engine(const sigma_mining_engine&) = delete;
+    sigma_mining_engine& operator=(const sigma_mining_engine&) = delete;
+
+    bool isValid() const { return !buffers[0].empty(); }
+    bool isDoubleBuffered() const { return !buffers[1].empty(); }
+    std::string arenaAllocationDescription();
+
+    // Build the arena for header and switch all mining threads over to it.
+    // When double buffered the current job keeps being mined while the arena is built, otherwise mining is paused first; blocks until the job is live.
+    // Returns the id of the new job, or 0 if it wasn't published because a block found for an earlier job hasn't been collected with waitForResult yet
+    // (e.g. one found by the outgoing job while the new arena was being built) - collect and submit that first, then set the job again.
+    uint64_t setJob(const CBlockHeader& header);
+    // Stop mining the current job, threads stay resident waiting for the next one.
+    void pause();
+    // Wait until a block has been found, all threads ran out of nonces for the current job or the timeout expires.
+    // Returns true (and hands over the result, which is then cleared) if a block was found; check result.nJobId for the job it belongs to.
+    bool waitForResult(std::chrono::milliseconds timeout, sigma_mining_result& result);
+    // True once every mining thread has exhausted all nonces of the current job.
+    bool isJobExhausted();
+    // True if a found block is waiting to be collected with waitForResult.
+    bool hasResult();
+
+    std::atomic<uint64_t> halfHashCounter=0;
+private:
+    void workerThread(uint64_t nContext, uint64_t nThreadIndex);
+    void publishJob(std::shared_ptr<const sigma_mining_job> job);
+
+    sigma_settings settings;
+    uint64_t numThreads=0;
+    std::vector<std::unique_ptr<sigma_context>> buffers[2];
+    uint64_t nActiveBuffer=0;
+    std::vector<std::thread> workerPool;
+
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::condition_variable resultCondition;
+    bool shutdown=false;
+    // The job descriptor; threads compare nCurrentJobId (0 when paused) against the job they are mining to find out when to abandon it.
+    std::shared_ptr<const sigma_mining_job> currentJob;
+    std::atomic<uint64_t> nCurrentJobId=0;
+    uint64_t nLastJobId=0;
+    uint64_t numThreadsExhausted=0;
+    // Number of threads currently mining a job in each buffer, a buffer is only rebuilt once nobody uses it anymore.
+    uint64_t nBufferUsers[2]={0, 0};
+    // The job a block was found for (nullptr if none or collected already) - kept across job changes so that a found block is never lost.
+    std::shared_ptr<const sigma_mining_job> foundJob;
+    uint32_t nFoundNonce=0;
+    uint256 foundHash;
 };
 
 // Light weight sigma context for header verification - allocates just the size of one argon round (16mb)
@@ -163,4 +330,42 @@ private:
     uint8_t* hashMem;
 };
 
+// Pool of light weight verify contexts, one per worker thread each with its own argon memory.
+// Used to verify an entire batch of headers (e.g. a 'headers' message during header sync) concurrently instead of one header at a time.
+class sigma_verify_pool
+{
+public:
+    // The worker threads (one per context but the first, which the caller of verifyHeaders uses) are started here and stay resident until destruction.
+    sigma_verify_pool(sigma_settings settings_, uint64_t numContexts_);
+    ~sigma_verify_pool();
+    // verifyLevels holds one verifyLevel (see sigma_verify_context::verifyHeader) per header, a negative level skips verification of that header.
+    // On return results[i] is 1 if header i verified (or was skipped) and 0 if it failed or was never checked.
+    // Returns false if any header failed; remaining work is abandoned as soon as a failure is detected.
+    // NB! Not reentrant, callers have to serialise calls.
+    bool verifyHeaders(Span<const CBlockHeader> headers, Span<const int> verifyLevels, std::vector<uint8_t>& results);
+    uint64_t size() const { return contexts.size(); }
+    sigma_verify_pool(const sigma_verify_pool&) = delete;
+    sigma_verify_pool& operator=(const sigma_verify_pool&) = delete;
+private:
+    void workerThread(uint64_t nContext);
+    void verifyBatch(sigma_verify_context& verify);
+
+    std::vector<std::unique_ptr<sigma_verify_context>> contexts;
+    std::vector<std::thread> workerPool;
+
+    std::mutex batchMutex;
+    std::condition_variable batchCondition;
+    std::condition_variable doneCondition;
+    bool shutdown=false;
+    // Incremented for every batch, workers compare it against the last batch they worked on to find out when there is a new one.
+    uint64_t nBatchId=0;
+    uint64_t numWorkersBusy=0;
+    // The current batch, only valid while verifyHeaders runs.
+    Span<const CBlockHeader> batchHeaders;
+    Span<const int> batchVerifyLevels;
+    uint8_t* batchResults=nullptr;
+    std::atomic<uint64_t> nNextHeader=0;
+    std::atomic<bool> failed=false;
+};
+
 #endif
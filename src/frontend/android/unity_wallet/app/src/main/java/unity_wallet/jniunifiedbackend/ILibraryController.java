@@ -355,6 +355,26 @@ public abstract class ILibraryController {
         return CppProxy.getTransactionHistory();
     }
 
+    /**
+     * Get a page of wallet mutations, newest first, skipping the first 'offset' mutations and returning at most 'count'
+     *NB! This is SPV specific, non SPV wallets should use account specific getMutationHistory on an accounts controller instead
+     */
+    public static ArrayList<MutationRecord> getMutationHistoryPage(int offset, int count)
+    {
+        return CppProxy.getMutationHistoryPage(offset,
+                                               count);
+    }
+
+    /**
+     * Get a page of the transactions the wallet has been involved in, newest first, skipping the first 'offset' transactions and returning at most 'count'
+     *NB! This is SPV specific, non SPV wallets should use account specific getTransactionHistory on an accounts controller instead
+     */
+    public static ArrayList<TransactionRecord> getTransactionHistoryPage(int offset, int count)
+    {
+        return CppProxy.getTransactionHistoryPage(offset,
+                                                  count);
+    }
+
     /**
      * Check if the wallet has any transactions that are still pending confirmation, to be used to determine if e.g. it is safe to perform a link or whether we should wait.
      *NB! This is SPV specific, non SPV wallets should use HaveUnconfirmedFunds on wallet controller instead
@@ -492,6 +512,10 @@ public abstract class ILibraryController {
 
         public static native ArrayList<TransactionRecord> getTransactionHistory();
 
+        public static native ArrayList<MutationRecord> getMutationHistoryPage(int offset, int count);
+
+        public static native ArrayList<TransactionRecord> getTransactionHistoryPage(int offset, int count);
+
         public static native boolean HaveUnconfirmedFunds();
 
         public static native long GetBalance();
@@ -23,6 +23,8 @@ let controllers = [
       "PersistAndPruneForSPV",
       "getMutationHistory",
       "getTransactionHistory",
+      "getMutationHistoryPage",
+      "getTransactionHistoryPage",
       "HaveUnconfirmedFunds",
       "GetBalance"
     ]
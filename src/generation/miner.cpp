@@ -230,7 +230,7 @@ static bool InsertPoW2WitnessIntoCoinbase(CBlock& block, const CBlockIndex* pind
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nVersionPoW2Witness); //4 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nTimePoW2Witness); //4 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->hashMerkleRootPoW2Witness); // 32 bytes
-            ::Serialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(pWitnessBlockToEmbed->witnessHeaderPoW2Sig)); //65 bytes
+            ::Serialize(serialisedWitnessHeaderInfoStream, CFlatData(pWitnessBlockToEmbed->witnessHeaderPoW2Sig)); //65 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pindexPrev->GetBlockHashLegacy()); //32 bytes
         }
 
@@ -1086,6 +1086,11 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
 
     unsigned int nExtraNonce = 0;
     std::shared_ptr<CReserveKeyOrScript> coinbaseScript;
+    // Mining threads and arenas stay resident for the lifetime of this generate thread and are handed each new block template.
+    std::unique_ptr<sigma_mining_engine> sigmaEngine;
+    // The block of the job that is live in the engine, a block can still be found for it while the arena of the next job is being built.
+    std::shared_ptr<CBlock> pMiningBlock;
+    uint64_t nMiningJobId = 0;
     if (fixedGenerateAddress.size() > 0)
     {
         CNativeAddress address(fixedGenerateAddress);
@@ -1155,6 +1160,8 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
                     {
                         break;
                     }
+                    if (sigmaEngine)
+                        sigmaEngine->pause();
                     MilliSleep(100);
                 }
             }
@@ -1181,6 +1188,8 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
             pindexParent = FindMiningTip(pindexParent, chainparams, strError, pWitnessBlockToEmbed);
             if (!pindexParent)
             {
+                if (sigmaEngine)
+                    sigmaEngine->pause();
                 if (GetTimeMillis() - nUpdateTimeStart > 5000)
                 {
                     CAlert::Notify(strError.c_str(), true, true);
@@ -1218,107 +1227,85 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
             if (pblock->nTime > defaultSigmaSettings.activationDate)
             {
-                std::vector<std::unique_ptr<sigma_context>> sigmaContexts;
-                std::vector<uint64_t> sigmaMemorySizes;
-                uint64_t nMemoryAllocatedKb=0;
-                
-                
-                while (nMemoryAllocatedKb < nMemoryKb)
+                if (!sigmaEngine)
                 {
-                    uint64_t nMemoryChunkKb = std::min((nMemoryKb-nMemoryAllocatedKb), defaultSigmaSettings.arenaSizeKb);
-                    nMemoryAllocatedKb += nMemoryChunkKb;
-                    sigmaMemorySizes.emplace_back(nMemoryChunkKb);
-                }
-                //fixme: (SIGMA) - better memory size handling - right now we just blindly allocate until we succeed...
-                //And we don't even attempt to account for swap, so if the user sets a memory size too large for system memory we will just happily swap and perform worse than if the user picked a more reasonable size.
-                for (auto instanceMemorySizeKb : sigmaMemorySizes)
-                {
-                    uint64_t trySizeBytes = instanceMemorySizeKb*1024;
-                    while (trySizeBytes > 0)
+                    sigmaEngine.reset(new sigma_mining_engine(defaultSigmaSettings, nMemoryKb, nThreads, nArenaThreads, GetBoolArg("-minerarenadoublebuffer", DEFAULT_GENERATE_ARENA_DOUBLEBUFFER)));
+                    if (!sigmaEngine->isValid())
                     {
-                        normaliseBufferSize(trySizeBytes);
-                        try
-                        {
-                            sigmaContexts.push_back(std::unique_ptr<sigma_context>(new sigma_context(defaultSigmaSettings, trySizeBytes/1024, nThreads/sigmaMemorySizes.size(), nArenaThreads/sigmaMemorySizes.size())));
-                            break;
-                        }
-                        catch (...)
-                        {
-                            // reduce by 256mb and try again.
-                            if (trySizeBytes < 256*1024*1024)
-                                break;
-                            trySizeBytes -= 256*1024*1024;
-                        }
+                        sigmaEngine = nullptr;
+                        throw std::runtime_error("Unable to allocate mining arena");
                     }
+                    LogPrintf("PoWGenerate: mining arena backed by %s\n", sigmaEngine->arenaAllocationDescription());
                 }
-                
-                // Prepare arenas
-                CBlockHeader header = pblock->GetBlockHeader();
+
+                auto submitFoundBlock = [&](const sigma_mining_result& result)
                 {
-                    auto workerThreads = new boost::asio::thread_pool(nThreads);
-                    for (const auto& sigmaContext : sigmaContexts)
-                    {
-                        boost::asio::post(*workerThreads, [&, header]() mutable
-                        {
-                            sigmaContext->prepareArenas(header);
-                        });
-                    }
-                    workerThreads->join();
+                    if (!pMiningBlock || result.nJobId != nMiningJobId)
+                        return;
+                    TRY_LOCK(processBlockCS, lockProcessBlock);
+                    if(!lockProcessBlock)
+                        return;
+
+                    // Found a solution
+                    pMiningBlock->nNonce = result.header.nNonce;
+                    LogPrintf("generated PoW\n  hash: %s\n  diff: %s\n", result.foundBlockHash.GetHex(), arith_uint256().SetCompact(pMiningBlock->nBits).GetHex());
+                    std::shared_ptr<const CBlock> shared_pblock = pMiningBlock;
+                    pMiningBlock = nullptr;
+                    ProcessBlockFound(shared_pblock, chainparams);
+                    coinbaseScript->keepScriptOnDestroy();
+
+                    // In regression test mode, stop mining after a block is found.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
+                };
+
+                // Prepare arenas; when double buffered the previous block keeps being mined in the meantime.
+                uint64_t nHalfHashesAtStart = sigmaEngine->halfHashCounter;
+                uint64_t nJobId = sigmaEngine->setJob(pblock->GetBlockHeader());
+                if (nJobId == 0)
+                {
+                    // The previous block was solved before the new job went live, submit it and start over with a fresh template.
+                    sigma_mining_result result;
+                    if (sigmaEngine->waitForResult(std::chrono::milliseconds(0), result))
+                        submitFoundBlock(result);
+                    continue;
                 }
+                pMiningBlock = std::make_shared<CBlock>(*pblock);
+                nMiningJobId = nJobId;
                 nArenaSetupTime = GetTimeMillis() - nStart;
                 #ifdef ENABLE_WALLET
                 static_cast<CExtWallet*>(pactiveWallet)->NotifyGenerationStatisticsUpdate();
                 #endif
-                
+
                 // Mine
                 {
-                    //fixme: (SIGMA) use hash instead of bool so we can log it
                     //fixme: (SIGMA) set limitdeltadiffdrop for mining from wallet (SoftSetArg)
-                    uint256 foundBlockHash;
-                    std::atomic<uint64_t> halfHashCounter=0;
-                    std::atomic<uint64_t> nThreadCounter=0;
-                    bool interrupt = false;
-                    
-                    auto workerThreads = new boost::asio::thread_pool(nThreads);
-                    for (const auto& sigmaContext : sigmaContexts)
+                    sigma_mining_result result;
+                    bool fFound = false;
                     {
-                        ++nThreadCounter;
-                        boost::asio::post(*workerThreads, [&, header]() mutable
-                        {
-                            sigmaContext->mineBlock(pblock, halfHashCounter, foundBlockHash, interrupt);
-                            --nThreadCounter;
-                        });
-                    }
-                    {
-                        // If this thread gets interrupted then terminate mining
-                        BOOST_SCOPE_EXIT(&workerThreads, &interrupt) { interrupt=true; workerThreads->stop(); workerThreads->join(); delete workerThreads;} BOOST_SCOPE_EXIT_END
                         int nCount = 0;
                         while (true)
                         {
-                            //fixme: (SIGMA) - Instead of busy polling it would be better if we could wait here on various signals, we would need to wait on several signals
-                            // 1) A signal for block found by one of our mining threads
-                            // 2) A signal for chain tip change
-                            // 3) A signal for 'top level witness orphan' changes
-                            MilliSleep(100);
-
-                            // If we have found a block then exit loop and process it immediately
-                            if (foundBlockHash != uint256())
-                                break;
-                            
-                            //fixme: (SIGMA) - This can be improved in cases where we have 'uneven' contexts, one may still have lots of work when another is finished, we might want to only restart one of them and not both...
-                            // If at least one of the threads is done working then abandon the rest of them, and then see if we have found a block or need to start again with a different block etc.
-                            if (nThreadCounter < sigmaContexts.size())
+                            //fixme: (SIGMA) - Chain tip and 'top level witness orphan' changes are still polled for here instead of signalled.
+                            // Wakes immediately if one of our mining threads finds a block or runs out of work.
+                            if (sigmaEngine->waitForResult(std::chrono::milliseconds(100), result))
                             {
+                                fFound = true;
                                 break;
                             }
-                            
+
+                            //fixme: (SIGMA) - This can be improved in cases where we have 'uneven' contexts, one may still have lots of work when another is finished, we might want to only restart one of them and not both...
+                            // If at least one of the threads is done working then move on to a new block, when double buffered the others keep mining this one until it is ready.
+                            if (sigmaEngine->isJobExhausted())
+                                break;
+
                             // Abort mining and start mining a new block instead if chain tip changed
                             {
                                 LOCK(cs_main);
                                 if (pTipAtStartOfMining != chainActive.Tip())
                                     break;
                             }
-                            
+
                             // Abort mining and start mining a new block instead if alternative chain tip changed
                             if (nOrphansAtStartOfMining != GetTopLevelWitnessOrphans(pTipAtStartOfMining->nHeight).size())
                             {
@@ -1326,12 +1313,12 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
                                 if (pindexParent != FindMiningTip(pindexParent, chainparams, strError, pWitnessBlockToEmbed))
                                     break;
                             }
-                            
+
                             if (++nCount>5)
                             {
-                                updateHashesPerSec(nStart, GetTimeMillis(), halfHashCounter);
+                                updateHashesPerSec(nStart, GetTimeMillis(), sigmaEngine->halfHashCounter - nHalfHashesAtStart);
                                 nCount=0;
-                                
+
                                 // Abort for timestamp update if difficulty has dropped
                                 std::uint64_t nUpdateMissedSteps = CalculateMissedTimeSteps(GetAdjustedFutureTime(), pindexParent->GetBlockTime());
                                 if (nMissedSteps != nUpdateMissedSteps)
@@ -1344,29 +1331,15 @@ void static PoWGenerate(const CChainParams& chainparams, CAccount* forAccount, u
                                     }
                                 }
                             }
-                            
+
                             // Allow opportunity for user to terminate mining.
                             boost::this_thread::interruption_point();
                         }
-                    
-                        updateHashesPerSec(nStart, GetTimeMillis(), halfHashCounter);
 
-                        if (foundBlockHash != uint256())
-                        {
-                            TRY_LOCK(processBlockCS, lockProcessBlock);
-                            if(!lockProcessBlock)
-                                continue;
+                        updateHashesPerSec(nStart, GetTimeMillis(), sigmaEngine->halfHashCounter - nHalfHashesAtStart);
 
-                            // Found a solution
-                            LogPrintf("generated PoW\n  hash: %s\n  diff: %s\n", foundBlockHash.GetHex(), hashTarget.GetHex());
-                            std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
-                            ProcessBlockFound(shared_pblock, chainparams);
-                            coinbaseScript->keepScriptOnDestroy();
-
-                            // In regression test mode, stop mining after a block is found.
-                            if (chainparams.MineBlocksOnDemand())
-                                throw boost::thread_interrupted();
-                        }
+                        if (fFound)
+                            submitFoundBlock(result);
                     }
                     boost::this_thread::interruption_point();
                     // Try again with a new updated block header
@@ -45,6 +45,9 @@ namespace Consensus { struct Params; };
 
 static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
+static const bool DEFAULT_GENERATE_ARENA_HUGEPAGES = false;
+static const bool DEFAULT_GENERATE_ARENA_NUMA = true;
+static const bool DEFAULT_GENERATE_ARENA_DOUBLEBUFFER = false;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
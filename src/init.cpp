@@ -20,6 +20,7 @@
 #include "addrman.h"
 #include "appname.h"
 #include "amount.h"
+#include "blockfilterindex.h"
 #include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -246,6 +247,14 @@ void CoreShutdown(boost::thread_group& threadGroup, node::NodeContext& nodeConte
     }
 
 
+    if (pblockfilterindex)
+    {
+        LogPrintf("Core shutdown: stop block filter index.\n");
+        UnregisterValidationInterface(pblockfilterindex);
+        delete pblockfilterindex;
+        pblockfilterindex = nullptr;
+    }
+
     LogPrintf("Core shutdown: close coin databases.\n");
     {
         LOCK(cs_main);
@@ -265,6 +274,7 @@ void CoreShutdown(boost::thread_group& threadGroup, node::NodeContext& nodeConte
 
         //Already flushed to disk by FlushStateToDisk, setting to nullptr should trigger deletion.
         ppow2witTip = nullptr;
+        pow2WitnessCoinIndex.Invalidate();
         delete ppow2witcatcher;
         ppow2witcatcher = NULL;
         delete ppow2witdbview;
@@ -272,6 +282,12 @@ void CoreShutdown(boost::thread_group& threadGroup, node::NodeContext& nodeConte
 
         delete pblocktree;
         pblocktree = NULL;
+
+        delete ppowcachedb;
+        ppowcachedb = NULL;
+
+        delete pwitnessweightdb;
+        pwitnessweightdb = NULL;
     }
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
 
@@ -811,6 +827,8 @@ bool AppInitParameterInteraction()
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(errortr("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(errortr("Prune mode is incompatible with -blockfilterindex."));
     }
 
     // Make sure enough file descriptors are available
@@ -1140,6 +1158,8 @@ bool AppInitMain(boost::thread_group& threadGroup, node::NodeContext& node)
     //fixme: (SIGMA) Improve.
     // Select optimised algorithms for SIGMA
     selectOptimisedImplementations();
+    defaultSigmaArenaSettings.hugePages = GetBoolArg("-minerarenahugepages", DEFAULT_GENERATE_ARENA_HUGEPAGES);
+    defaultSigmaArenaSettings.numaAware = GetBoolArg("-minerarenanuma", DEFAULT_GENERATE_ARENA_NUMA);
 
 #ifndef WIN32
     CreatePidFile(GetPidFile(), getpid());
@@ -1426,6 +1446,12 @@ bool AppInitMain(boost::thread_group& threadGroup, node::NodeContext& node)
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
+    // Survives reindexing on purpose, see CPoWCacheDB.
+    delete ppowcachedb;
+    ppowcachedb = new CPoWCacheDB(nPoWCacheDBCache << 20);
+    delete pwitnessweightdb;
+    pwitnessweightdb = new CWitnessWeightDB(nWitnessWeightDBCache << 20);
+
     if (fReverseHeaders)
     {
         LogPrintf("Reverse header sync will temporarily use up to %.1fMiB until initial sync is complete", sizeof(CBlockHeader) * 1000000.0 / 1024.0 / 1024.0);
@@ -1467,6 +1493,7 @@ bool AppInitMain(boost::thread_group& threadGroup, node::NodeContext& node)
                 ppow2witTip = std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(ppow2witcatcher));
 
                 pcoinsTip->SetSiblingView(ppow2witTip);
+                pow2WitnessCoinIndex.Invalidate();
 
 
                 if (fReindex)
@@ -1731,6 +1758,13 @@ bool AppInitMain(boost::thread_group& threadGroup, node::NodeContext& node)
             vImportFiles.push_back(strFile);
     }
 
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+    {
+        pblockfilterindex = new CBlockFilterIndex(BlockFilterType::BASIC, nBlockFilterIndexDBCache << 20, false, fReindex);
+        RegisterValidationInterface(pblockfilterindex);
+        pblockfilterindex->Start(GetArg("-blockfilterindexthreads", DEFAULT_BLOCKFILTERINDEX_THREADS));
+    }
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
     // Wait for genesis block to be processed
@@ -1776,6 +1810,7 @@ bool AppInitMain(boost::thread_group& threadGroup, node::NodeContext& node)
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nNetThreads = GetArg("-netthreads", DEFAULT_NET_THREADS);
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
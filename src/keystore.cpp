@@ -78,6 +78,14 @@ bool CBasicKeyStore::GetCScript(const CScriptID &hash, CScript& redeemScriptOut)
     return false;
 }
 
+void CBasicKeyStore::GetCScripts(std::set<CScriptID>& setScripts) const
+{
+    LOCK(cs_KeyStore);
+    setScripts.clear();
+    for (const auto& item : mapScripts)
+        setScripts.insert(item.first);
+}
+
 static bool ExtractPubKey(const CScript &dest, CPubKey& pubKeyOut)
 {
     //TODO: Use Solver to extract this?
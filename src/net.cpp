@@ -710,6 +710,69 @@ void CNode::copyStats(CNodeStats &stats)
 }
 #undef X
 
+static std::atomic<size_t> nRecvMsgPoolBytesTotal{0};
+
+static size_t RecvMsgPoolClass(unsigned int nMessageSize)
+{
+    size_t nClass = 0;
+    while (nClass < RECV_MSG_POOL_CLASSES - 1 && nMessageSize > RECV_MSG_POOL_CLASS_LIMIT[nClass])
+        ++nClass;
+    return nClass;
+}
+
+CNetMessage& CNode::NewRecvMsg(unsigned int nSizeHint)
+{
+    {
+        LOCK(cs_vRecvMsgPool);
+        for (size_t nClass = RecvMsgPoolClass(nSizeHint); nClass < RECV_MSG_POOL_CLASSES; ++nClass) {
+            if (!vRecvMsgPool[nClass].empty()) {
+                size_t nBytes = vRecvMsgPool[nClass].front().vRecv.capacity();
+                nRecvMsgPoolBytes -= nBytes;
+                nRecvMsgPoolBytesTotal -= nBytes;
+                vRecvMsg.splice(vRecvMsg.end(), vRecvMsgPool[nClass], vRecvMsgPool[nClass].begin());
+                vRecvMsg.back().Reset(Params().MessageStart(), INIT_PROTO_VERSION);
+                return vRecvMsg.back();
+            }
+        }
+    }
+    vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    return vRecvMsg.back();
+}
+
+void CNode::RecycleRecvMsgs(std::list<CNetMessage>& msgs)
+{
+    LOCK(cs_vRecvMsgPool);
+    while (!msgs.empty()) {
+        const CNetMessage& msg = msgs.front();
+        if (msg.in_data && msg.hdr.nMessageSize <= RECV_MSG_POOL_CLASS_LIMIT[RECV_MSG_POOL_CLASSES - 1]) {
+            size_t nClass = RecvMsgPoolClass(msg.hdr.nMessageSize);
+            size_t nBytes = msg.vRecv.capacity();
+            if (vRecvMsgPool[nClass].size() < RECV_MSG_POOL_CLASS_DEPTH[nClass]) {
+                if (nRecvMsgPoolBytesTotal.fetch_add(nBytes) + nBytes <= RECV_MSG_POOL_MAX_BYTES) {
+                    nRecvMsgPoolBytes += nBytes;
+                    vRecvMsgPool[nClass].splice(vRecvMsgPool[nClass].end(), msgs, msgs.begin());
+                    continue;
+                }
+                nRecvMsgPoolBytesTotal -= nBytes;
+            }
+        }
+        msgs.pop_front();
+    }
+}
+
+void CNode::CompleteRecvMsg(CNetMessage& msg, int64_t nTimeMicros)
+{
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    msg.nTime = nTimeMicros;
+}
+
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
 {
     complete = false;
@@ -721,8 +784,11 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
 
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.back().complete()) {
+            // With the whole header at hand its size field picks a pooled message with a fitting payload buffer.
+            unsigned int nSizeHint = nBytes >= CMessageHeader::HEADER_SIZE ? ReadLE32((const unsigned char*)pch + CMessageHeader::MESSAGE_SIZE_OFFSET) : 0;
+            NewRecvMsg(nSizeHint);
+        }
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -745,20 +811,44 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         nBytes -= handled;
 
         if (msg.complete()) {
+            CompleteRecvMsg(msg, nTimeMicros);
+            complete = true;
+        }
+    }
 
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+    return true;
+}
 
-            msg.nTime = nTimeMicros;
-            complete = true;
+boost::asio::mutable_buffer CNode::GetReceiveBuffer(bool& fInPlace)
+{
+    LOCK(cs_vRecv);
+    if (!vRecvMsg.empty() && vRecvMsg.back().in_data && !vRecvMsg.back().complete()) {
+        CNetMessage& msg = vRecvMsg.back();
+        if (msg.hdr.nMessageSize - msg.nDataPos >= RECV_IN_PLACE_MIN_BYTES) {
+            fInPlace = true;
+            unsigned int nBytes = msg.ReserveData(sizeof(pchBuf));
+            return boost::asio::mutable_buffer(&msg.vRecv[msg.nDataPos], nBytes);
         }
     }
+    fInPlace = false;
+    return boost::asio::mutable_buffer(pchBuf, sizeof(pchBuf));
+}
+
+bool CNode::ReceivedMsgBytesInPlace(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
 
+    assert(!vRecvMsg.empty());
+    CNetMessage& msg = vRecvMsg.back();
+    msg.CommitData(nBytes);
+    if (msg.complete()) {
+        CompleteRecvMsg(msg, nTimeMicros);
+        complete = true;
+    }
     return true;
 }
 
@@ -789,22 +879,45 @@ int CNode::GetSendVersion() const
 }
 
 
+void CNetMessage::Reset(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nVersionIn)
+{
+    hasher.Reset();
+    data_hash.SetNull();
+    in_data = false;
+    hdr = CMessageHeader(pchMessageStartIn);
+    nHdrPos = 0;
+    vRecv.clear();
+    vRecv.SetVersion(nVersionIn);
+    nDataPos = 0;
+    nTime = 0;
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    unsigned int nCopy;
+    Span<const unsigned char> header;
+    if (nHdrPos == 0 && nBytes >= CMessageHeader::HEADER_SIZE) {
+        // Usual case: the whole header is in the received data, parse it in place.
+        nCopy = CMessageHeader::HEADER_SIZE;
+        header = Span<const unsigned char>((const unsigned char*)pch, nCopy);
+    } else {
+        // copy data to temporary parsing buffer
+        unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
+        nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
+        memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+        nHdrPos += nCopy;
 
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+        // if header incomplete, exit
+        if (nHdrPos < CMessageHeader::HEADER_SIZE)
+            return nCopy;
+        header = Span<const unsigned char>(hdrbuf, CMessageHeader::HEADER_SIZE);
+    }
 
     // deserialize to CMessageHeader
     try {
-        hdrbuf >> hdr;
+        SpanReader stream(SER_NETWORK, INIT_PROTO_VERSION, header);
+        stream >> hdr;
     }
     catch (const std::exception&) {
         return -1;
@@ -820,7 +933,7 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
-int CNetMessage::readData(const char *pch, unsigned int nBytes)
+unsigned int CNetMessage::ReserveData(unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
@@ -829,10 +942,20 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
         // Allocate up to 256 KiB ahead, but never more than the total message size.
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
+    return nCopy;
+}
 
-    hasher.Write((const unsigned char*)pch, nCopy);
+void CNetMessage::CommitData(unsigned int nBytes)
+{
+    hasher.Write((const unsigned char*)&vRecv[nDataPos], nBytes);
+    nDataPos += nBytes;
+}
+
+int CNetMessage::readData(const char *pch, unsigned int nBytes)
+{
+    unsigned int nCopy = ReserveData(nBytes);
     memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+    CommitData(nCopy);
 
     return nCopy;
 }
@@ -1017,8 +1140,12 @@ void CConnman::NodeDisconnectAndDeleter()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                    // close socket and cleanup, on the node's strand as its handlers may be using the socket on another net thread
+                    pnode->AddRef();
+                    boost::asio::post(pnode->strand, [pnode]() {
+                        pnode->CloseSocketDisconnect();
+                        pnode->Release();
+                    });
 
                     // hold in disconnected pool until all refs are released
                     pnode->Release();
@@ -1087,7 +1214,7 @@ void CConnman::NodeInactivityChecker(CNode* pnode)
     const int INTERVAL_SEC = 1;
 
     pnode->inactivityTimer.expires_from_now(boost::posix_time::seconds(INTERVAL_SEC));
-    pnode->inactivityTimer.async_wait([this, pnode](const boost::system::error_code& ec) {
+    pnode->inactivityTimer.async_wait(boost::asio::bind_executor(pnode->strand, [this, pnode](const boost::system::error_code& ec) {
 
         if (!ec) {
             int64_t nTime = GetTimeSeconds();
@@ -1131,7 +1258,7 @@ void CConnman::NodeInactivityChecker(CNode* pnode)
             LogPrint(BCLog::NET, "inactivity timer for %d failed [%s]\n", pnode->GetId(), ec.message().c_str());
         }
         pnode->Release();
-    });
+    }));
 }
 
 void CConnman::ResumeReceive(CNode* pnode)
@@ -1147,68 +1274,76 @@ void CConnman::ResumeReceive(CNode* pnode)
     if (interruptNet)
         return;
 
-    if (pnode->fPauseRecv)
-        return;
-
     pnode->AddRef();
 
-    pnode->hSocket.async_receive(boost::asio::mutable_buffer(pnode->pchBuf, sizeof(pnode->pchBuf)),
-                                 [this,pnode] (const boost::system::error_code& ec, std::size_t bytes_transferred) {
-        if (!ec) {
-            bool msgcomplete = false;
-            if (!pnode->ReceiveMsgBytes(pnode->pchBuf, bytes_transferred, msgcomplete)) {
-                pnode->fDisconnect = true;
+    // Socket operations are only started from the node's strand, callers outside of it (the message handler) get there through dispatch.
+    // The pause decision is made there too: the message handler can unpause while a receive completes on the strand, and both would
+    // otherwise start a receive.
+    boost::asio::dispatch(pnode->strand, [this, pnode]() {
+        if (interruptNet || pnode->fPauseRecv || pnode->fReceivePending) {
+            pnode->Release();
+            return;
+        }
+        pnode->fReceivePending = true;
+        bool fInPlace;
+        boost::asio::mutable_buffer buffer = pnode->GetReceiveBuffer(fInPlace);
+        pnode->hSocket.async_receive(buffer,
+                                     boost::asio::bind_executor(pnode->strand, [this, pnode, fInPlace] (const boost::system::error_code& ec, std::size_t bytes_transferred) {
+            pnode->fReceivePending = false;
+            if (!ec) {
+                bool msgcomplete = false;
+                bool fReceived = fInPlace ? pnode->ReceivedMsgBytesInPlace(bytes_transferred, msgcomplete) : pnode->ReceiveMsgBytes(pnode->pchBuf, bytes_transferred, msgcomplete);
+                if (!fReceived) {
+                    pnode->fDisconnect = true;
+                }
+                else {
+                    RecordBytesRecv(bytes_transferred);
+                    if (msgcomplete) {
+                        size_t nSizeAdded = 0;
+                        auto it(pnode->vRecvMsg.begin());
+                        for (; it != pnode->vRecvMsg.end(); ++it) {
+                            if (!it->complete())
+                                break;
+                            nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                        }
+                        {
+                            LOCK(pnode->cs_vProcessMsg);
+                            pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                            pnode->nProcessQueueSize += nSizeAdded;
+                            pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                        }
+                        WakeMessageHandler();
+                    }
+                    this->ResumeReceive(pnode);
+                }
             }
             else {
-                RecordBytesRecv(bytes_transferred);
-                if (msgcomplete) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                if (boost::asio::error::eof == ec) {
+                    // socket closed gracefully
+                    if (!pnode->fDisconnect) {
+                        LogPrint(BCLog::NET, "socket closed\n");
                     }
-                    WakeMessageHandler();
                 }
-                this->ResumeReceive(pnode);
-            }
-        }
-        else {
-            if (boost::asio::error::eof == ec) {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed\n");
+                else {
+                    if (!pnode->fDisconnect)
+                        LogPrintf("socket recv error %s\n", ec.message());
                 }
+                pnode->fDisconnect = true;
             }
-            else {
-                if (!pnode->fDisconnect)
-                    LogPrintf("socket recv error %s\n", ec.message());
-            }
-            pnode->fDisconnect = true;
-        }
 
-        pnode->Release();
+            pnode->Release();
+        }));
     });
 }
 
-void CConnman::ThreadSocketHandler()
-{
-    NodeDisconnectAndDeleter();
-    NumConnectionsNotifier();
+// Index of the current thread in the -netthreads pool, -1 on any other thread.
+static thread_local int nNetThreadIndex = -1;
 
-    while (!interruptNet) {
-        get_io_context().run();
-        if (!interruptNet.sleep_for(std::chrono::milliseconds(50)))
-            return;
-        get_io_context().restart();
-    }
+void CConnman::ThreadSocketHandler(int nThreadIndex)
+{
+    nNetThreadIndex = nThreadIndex;
+    // Returns once Interrupt stops the io_context, the work guard keeps it running while idle.
+    get_io_context().run();
 }
 
 void CConnman::WakeMessageHandler()
@@ -2035,6 +2170,7 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+    nNetThreads = 0;
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2059,6 +2195,9 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
 
+    nNetThreads = connOptions.nNetThreads > 0 ? connOptions.nNetThreads : std::max(GetNumCores(), 1);
+    netThreadCounters.reset(new NetThreadCounters[nNetThreads]);
+
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
@@ -2129,7 +2268,13 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     }
 
     // Send and receive from sockets, accept connections
-    threadSocketHandler = std::thread(&util::TraceThread, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
+    get_io_context().restart();
+    ioWorkGuard.reset(new boost::asio::executor_work_guard<boost::asio::io_context::executor_type>(get_io_context().get_executor()));
+    NodeDisconnectAndDeleter();
+    NumConnectionsNotifier();
+    LogPrintf("Servicing network sockets with %d threads\n", nNetThreads);
+    for (int i = 0; i < nNetThreads; ++i)
+        threadSocketHandlers.emplace_back(&util::TraceThread, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this, i)));
 
     if (!GetBoolArg("-dnsseed", true))
         LogPrintf("DNS seeding disabled\n");
@@ -2178,6 +2323,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    ioWorkGuard.reset();
     get_io_context().stop();
     InterruptSocks5(true);
 
@@ -2206,8 +2352,11 @@ void CConnman::Stop()
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
         threadDNSAddressSeed.join();
-    if (threadSocketHandler.joinable())
-        threadSocketHandler.join();
+    for (auto& thread : threadSocketHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadSocketHandlers.clear();
 
     if (fAddressesInitialized)
     {
@@ -2360,12 +2509,22 @@ bool CConnman::DisconnectNode(NodeId id)
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
 {
+    if (nNetThreadIndex >= 0 && nNetThreadIndex < nNetThreads) {
+        netThreadCounters[nNetThreadIndex].nBytesRecv += bytes;
+        ++netThreadCounters[nNetThreadIndex].nRecvOps;
+    }
+
     LOCK(cs_totalBytesRecv);
     nTotalBytesRecv += bytes;
 }
 
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
+    if (nNetThreadIndex >= 0 && nNetThreadIndex < nNetThreads) {
+        netThreadCounters[nNetThreadIndex].nBytesSent += bytes;
+        ++netThreadCounters[nNetThreadIndex].nSendOps;
+    }
+
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
 
@@ -2466,6 +2625,19 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+std::vector<CConnman::NetThreadStats> CConnman::GetNetThreadStats() const
+{
+    std::vector<NetThreadStats> stats(nNetThreads);
+    for (int i = 0; i < nNetThreads; ++i)
+    {
+        stats[i].nBytesRecv = netThreadCounters[i].nBytesRecv;
+        stats[i].nBytesSent = netThreadCounters[i].nBytesSent;
+        stats[i].nRecvOps = netThreadCounters[i].nRecvOps;
+        stats[i].nSendOps = netThreadCounters[i].nSendOps;
+    }
+    return stats;
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2486,6 +2658,7 @@ unsigned int CConnman::GetSendBufferSize() const{ return nSendBufferMaxSize; }
 
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, socket_t hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress &addrBindIn, const std::string& addrNameIn, bool fInboundIn) :
     hSocket(std::move(hSocketIn)),
+    strand(boost::asio::make_strand(get_io_context())),
     nTimeConnected(GetTimeSeconds()),
     addr(addrIn),
     addrBind(addrBindIn),
@@ -2545,6 +2718,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fReceivePending = false;
     nProcessQueueSize = 0;
 
     for(const std::string &msg : getAllNetMessageTypes())
@@ -2560,6 +2734,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
 
 CNode::~CNode()
 {
+    LOCK(cs_vRecvMsgPool);
+    nRecvMsgPoolBytesTotal -= nRecvMsgPoolBytes;
 }
 
 void CNode::AskFor(const CInv& inv)
@@ -2607,14 +2783,10 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
     uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
-
     {
         LOCK(pnode->cs_vSend);
 
@@ -2624,14 +2796,22 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+
+        std::vector<unsigned char> serializedHeader;
+        if (!pnode->vSendHeaderPool.empty()) {
+            serializedHeader = std::move(pnode->vSendHeaderPool.back());
+            pnode->vSendHeaderPool.pop_back();
+            serializedHeader.clear();
+        } else {
+            serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
+        }
+        CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+        pnode->vSendMsg.push_back(CSendQueueEntry{std::move(serializedHeader), std::move(msg.data)});
 
         if (!pnode->fResumeSendActive) {
             pnode->fResumeSendActive = true;
             pnode->AddRef();
-            boost::asio::post(get_io_context(), [this, pnode]() {
+            boost::asio::post(pnode->strand, [this, pnode]() {
                 this->ResumeSend(pnode);
                 pnode->Release();
             });
@@ -2639,24 +2819,49 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     }
 }
 
+// View of CNode::vSendBuffers handed to async_write; asio keeps a copy of the buffer sequence it is given, for the vector itself that would be an allocation per write.
+struct CSendBufferSequence
+{
+    typedef boost::asio::const_buffer value_type;
+    typedef std::vector<boost::asio::const_buffer>::const_iterator const_iterator;
+
+    const_iterator first;
+    const_iterator last;
+
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return last; }
+};
+
 void CConnman::ResumeSend(CNode *pnode)
 {
     LOCK(pnode->cs_vSend);
 
+    // Recycle the headers of the previous write.
+    for (auto& entry : pnode->vSendInFlight) {
+        if (pnode->vSendHeaderPool.size() < MAX_SEND_GATHER_MESSAGES)
+            pnode->vSendHeaderPool.push_back(std::move(entry.header));
+    }
+    pnode->vSendInFlight.clear();
+    pnode->vSendBuffers.clear();
+
     if (pnode->vSendMsg.empty()) {
         pnode->fResumeSendActive = false;
         return;
     }
 
-    // buffer to hold and own the message data, Asio buffers don't take ownership
-    using BufferHolder = std::shared_ptr<std::vector<unsigned char> >;
-    auto bufferHolder = BufferHolder(new std::vector<unsigned char>(std::move(pnode->vSendMsg.front())));
-    pnode->vSendMsg.pop_front();
-    boost::asio::const_buffer buffer = boost::asio::buffer(reinterpret_cast<const char*>(bufferHolder->data()), bufferHolder->size());
+    // Gather everything queued (up to MAX_SEND_GATHER_MESSAGES) into a single vectored write.
+    while (!pnode->vSendMsg.empty() && pnode->vSendInFlight.size() < MAX_SEND_GATHER_MESSAGES) {
+        pnode->vSendInFlight.push_back(std::move(pnode->vSendMsg.front()));
+        pnode->vSendMsg.pop_front();
+        const CSendQueueEntry& entry = pnode->vSendInFlight.back();
+        pnode->vSendBuffers.push_back(boost::asio::buffer(entry.header));
+        if (!entry.data.empty())
+            pnode->vSendBuffers.push_back(boost::asio::buffer(entry.data));
+    }
 
     pnode->AddRef();
-    boost::asio::async_write(pnode->hSocket, buffer,
-                             [this, pnode, bufferHolder](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+    boost::asio::async_write(pnode->hSocket, CSendBufferSequence{pnode->vSendBuffers.cbegin(), pnode->vSendBuffers.cend()},
+                             boost::asio::bind_executor(pnode->strand, [this, pnode](const boost::system::error_code& ec, std::size_t bytes_transferred) {
         if (ec) {
             LogPrint(BCLog::NET, "socket send error %s\n", ec.message());
             pnode->fDisconnect = true;
@@ -2676,7 +2881,7 @@ void CConnman::ResumeSend(CNode *pnode)
 
         this->ResumeSend(pnode);
         pnode->Release();
-    });
+    }));
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
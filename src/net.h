@@ -97,6 +97,20 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 static const size_t DEFAULT_MAXRECEIVEBUFFER_LOWMEM = 1 * 1000;
+/** Number of payload size classes in the per-connection pool of received messages. */
+static const size_t RECV_MSG_POOL_CLASSES = 3;
+/** Largest payload of each class: up to 1 KB (inv, tx, ping...), up to 64 KB and up to 512 KB. Larger messages (blocks) are rare enough per peer that keeping their buffers around isn't worth the memory. */
+static const unsigned int RECV_MSG_POOL_CLASS_LIMIT[RECV_MSG_POOL_CLASSES] = {1000, 64 * 1000, 512 * 1000};
+/** How many processed messages of each class a node keeps. */
+static const size_t RECV_MSG_POOL_CLASS_DEPTH[RECV_MSG_POOL_CLASSES] = {16, 4, 1};
+/** Payload buffer bytes all nodes together may keep pooled, a full pool is ~784 KB so only a handful of (the busiest) peers get to keep all of theirs. */
+static const size_t RECV_MSG_POOL_MAX_BYTES = 8 * 1000 * 1000;
+/** Payloads with at least this much outstanding are read from the socket straight into the message instead of through pchBuf. */
+static const unsigned int RECV_IN_PLACE_MIN_BYTES = 16 * 1024;
+/** Default number of threads servicing socket I/O (-netthreads), 0 means one per core. */
+static const int DEFAULT_NET_THREADS = 1;
+/** Maximum number of queued messages gathered into one socket write (header and payload each take an iovec, so this keeps a write to a single writev). */
+static const size_t MAX_SEND_GATHER_MESSAGES = 32;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -157,6 +171,16 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
+        int nNetThreads = DEFAULT_NET_THREADS;
+    };
+
+    /** Socket I/O handled by one thread of the -netthreads pool. */
+    struct NetThreadStats
+    {
+        uint64_t nBytesRecv = 0;
+        uint64_t nBytesSent = 0;
+        uint64_t nRecvOps = 0;
+        uint64_t nSendOps = 0;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -284,6 +308,7 @@ public:
 
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
+    std::vector<NetThreadStats> GetNetThreadStats() const;
 
     void SetBestHeight(int height);
     int GetBestHeight() const;
@@ -320,7 +345,7 @@ private:
     void ThreadOpenConnections();
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
-    void ThreadSocketHandler();
+    void ThreadSocketHandler(int nThreadIndex);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -362,6 +387,16 @@ private:
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
 
+    struct NetThreadCounters
+    {
+        std::atomic<uint64_t> nBytesRecv{0};
+        std::atomic<uint64_t> nBytesSent{0};
+        std::atomic<uint64_t> nRecvOps{0};
+        std::atomic<uint64_t> nSendOps{0};
+    };
+    int nNetThreads;
+    std::unique_ptr<NetThreadCounters[]> netThreadCounters;
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
     uint64_t nMaxOutboundCycleStartTime;
@@ -423,7 +458,9 @@ private:
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
-    std::thread threadSocketHandler;
+    // Threads running the io_context, the work guard keeps them in run() while there are no pending handlers.
+    std::vector<std::thread> threadSocketHandlers;
+    std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> ioWorkGuard;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
@@ -537,7 +574,7 @@ private:
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    unsigned char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
@@ -546,14 +583,16 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    //! Return to the state of a newly constructed message for reuse, keeping the capacity of vRecv.
+    void Reset(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nVersionIn);
+
     bool complete() const
     {
         if (!in_data)
@@ -565,15 +604,26 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    //! Make room in vRecv for up to nBytes more payload and return how many of them belong to this message.
+    unsigned int ReserveData(unsigned int nBytes);
+    //! Account for nBytes of payload that were written to vRecv at nDataPos.
+    void CommitData(unsigned int nBytes);
 };
 
 
+/** A message queued for sending: serialized header and payload, both are written to the socket as is. */
+struct CSendQueueEntry
+{
+    std::vector<unsigned char> header;
+    std::vector<unsigned char> data;
+};
+
 /** Information about a peer */
 class CNode
 {
@@ -583,9 +633,16 @@ public:
     std::atomic<ServiceFlags> nServices;
     ServiceFlags nServicesExpected;
     socket_t hSocket;
-    size_t nSendSize; // total size of all vSendMsg entries
+    // All socket and timer handlers of the node run through its strand, so that they stay serialized when several threads run the io_context.
+    boost::asio::strand<boost::asio::io_context::executor_type> strand;
+    size_t nSendSize; // total size of all vSendMsg and vSendInFlight entries
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendQueueEntry> vSendMsg;
+    // Messages of the write in progress along with the buffer list handed to async_write, owned here so that a write needs no holder allocation; both keep their capacity between writes.
+    std::vector<CSendQueueEntry> vSendInFlight;
+    std::vector<boost::asio::const_buffer> vSendBuffers;
+    // Header buffers of sent messages, reused by PushMessage.
+    std::vector<std::vector<unsigned char>> vSendHeaderPool;
     RecursiveMutex cs_vSend;
     bool fResumeSendActive;
     RecursiveMutex cs_vRecv;
@@ -594,6 +651,12 @@ public:
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
 
+    // Processed messages kept for reuse along with their payload buffers, bucketed by payload size class.
+    Mutex cs_vRecvMsgPool;
+    std::list<CNetMessage> vRecvMsgPool[RECV_MSG_POOL_CLASSES];
+    // Payload buffer bytes held by vRecvMsgPool, counted against the pool budget shared by all nodes.
+    size_t nRecvMsgPoolBytes = 0;
+
     RecursiveMutex cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
@@ -633,6 +696,8 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Whether an async_receive is outstanding, so that at most one is; only touched on the strand.
+    bool fReceivePending;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -711,6 +776,9 @@ private:
     int nSendVersion;
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
 
+    CNetMessage& NewRecvMsg(unsigned int nSizeHint);
+    void CompleteRecvMsg(CNetMessage& msg, int64_t nTimeMicros);
+
     mutable RecursiveMutex cs_addrName;
     std::string addrName;
 
@@ -746,6 +814,12 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    //! Where the next socket read should go: straight into the payload of a partially received message if enough of it is outstanding (fInPlace), otherwise pchBuf.
+    boost::asio::mutable_buffer GetReceiveBuffer(bool& fInPlace);
+    //! Account for nBytes read into the buffer GetReceiveBuffer returned with fInPlace set.
+    bool ReceivedMsgBytesInPlace(unsigned int nBytes, bool& complete);
+    //! Return processed messages to the pool for reuse by later messages.
+    void RecycleRecvMsgs(std::list<CNetMessage>& msgs);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -44,6 +44,7 @@
 #include "checkpoints.h"
 
 #include <boost/foreach.hpp>
+#include <boost/scope_exit.hpp>
 
 #include <algorithm>
 
@@ -336,7 +337,7 @@ void InitializeNode(CNode *pnode, CConnman& connman)
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
     connman.ResumeReceive(pnode);
-    boost::asio::post(get_io_context(), [pnode, &connman]()
+    boost::asio::post(pnode->strand, [pnode, &connman]()
     {
         connman.NodeInactivityChecker(pnode);
     });
@@ -1072,6 +1073,11 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
             }
             else
             {
+#ifdef WITNESS_HEADER_SYNC
+                // The witness UTXO delta is only generated once the block connects; leave it to SendMessages to announce so the header goes out with it.
+                if (pnode->nVersion >= WITNESS_SYNC_VERSION && pindex->witnessUTXODelta.empty())
+                    return;
+#endif
                 std::vector<CBlock> vHeaders;
                 vHeaders.push_back(pindex->GetBlockHeader());
                 LogPrint(BCLog::NET, "%s fast-announce sending header %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock", hashBlock.ToString(), pnode->GetId());
@@ -3530,6 +3536,8 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
+    // The message and its payload buffer go back to the node for reuse once processed.
+    BOOST_SCOPE_EXIT(&msgs, pfrom) { pfrom->RecycleRecvMsgs(msgs); } BOOST_SCOPE_EXIT_END
 
     msg.SetVersion(pfrom->GetRecvVersion());
     // Scan for message start
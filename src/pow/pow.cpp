@@ -18,6 +18,7 @@
 #include "uint256.h"
 #include "crypto/hash/sigma/sigma.h"
 #include "random.h"
+#include <algorithm>
 #include <thread>
 
 #include "chainparams.h"
@@ -25,81 +26,177 @@
 
 uint64_t verifyFactor=200;
 
-bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params)
-{    
+static bool GetProofOfWorkTarget(const CBlockHeader& header, const Consensus::Params& params, arith_uint256& bnTarget)
+{
     bool fNegative;
     bool fOverflow;
-    arith_uint256 bnTarget;
 
-    bnTarget.SetCompact(block->nBits, &fNegative, &fOverflow);
+    bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
 
     defaultSigmaSettings.verify();
-    
+
     // Check range
     if (fNegative || bnTarget == 0 || fOverflow || bnTarget > UintToArith256(params.powLimit))
         return false;
+    return true;
+}
+
+// Returns the SIGMA verifyLevel (see sigma_verify_context::verifyHeader) to check a header with, or -1 if the check should be skipped.
+static int SelectSigmaVerifyLevel(const CBlockHeader& header)
+{
+    #ifdef VALIDATION_MOBILE
+        //fixme: (SIGMA) (PHASE5) (HIGH) This is a temporary measure to keep SPV performance adequate on low power devices for now.
+        //With WITNESS_HEADER_SYNC headers below the last checkpoint whose witness checks out against the simplified witness set skip this altogether (see AcceptBlockHeader),
+        //past the checkpoint the witness UTXO deltas aren't committed to by anything so they can't stand in for the PoW; remove once they are.
+        int verifyLevel = GetRand(verifyFactor);
+        if (verifyLevel == 0)
+        {
+            return 1;
+        }
+        else if (verifyLevel == 1)
+        {
+            return 2;
+        }
+        return -1;
+    #else
+        // Testnet optimisation - only verify last 5 days worth of blocks
+        if (Params().IsOfficialTestnetV1() && (header.nTime < GetTime() - 86400*5))
+        {
+            return -1;
+        }
+        //fixme: (SIGMA) - Detect faster machines and disable this optimisation for them, this will further increase network security.
+        // We speed up verification by doing a half verify 40% of the time instead of a full verify
+        // As a half verify has a 50% chance of detecting a 'half valid' hash an attacker has only a 20% chance of a node accepting his header without banning him
+        // This should provide a ~20% speed up for slow machines
+        int verifyLevel = GetRand(100);
+        if (verifyLevel < 20)
+        {
+            return 1;
+        }
+        else if (verifyLevel < 40)
+        {
+            return 2;
+        }
+        return 0;
+    #endif
+}
+
+// Number of cores we are willing to dedicate to verification.
+static uint64_t GetNumVerifyCores()
+{
+    #ifdef VALIDATION_MOBILE
+        // Benchmarking on 6 core mobile device showed roughly double performance when using 2 threads instead of 1
+        // when further increasing the number of threads (3 and 4) performance stayed roughly the same though at the cost of
+        // higher cpu and energy consumption and overall app/device responsiveness.
+        // As such the number of threads is limited to 2 (if reported by the OS). Further research and benchmarking on a wider range of devices
+        // would be needed to create a solution that gets the most out of a wide range of OS and devices. This might not be worth it though
+        // as for mobile/SPV the witness-header-sync will probably completely skip the pow check in the future.
+        return std::max(1, std::min(2, (int)std::thread::hardware_concurrency()));
+    #else
+        return std::max(1, (int)std::thread::hardware_concurrency());
+    #endif
+}
+
+bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params, bool* pfFullyVerified)
+{
+    if (pfFullyVerified)
+        *pfFullyVerified = false;
+
+    arith_uint256 bnTarget;
+    if (!GetProofOfWorkTarget(*block, params, bnTarget))
+        return false;
 
     //fixme: (SIGMA) - Post activation we can simplify this.
     // Check proof of work matches claimed amount
     if (block->nTime > 1602307283)
     {
-        #ifdef VALIDATION_MOBILE
-            //fixme: (SIGMA) (PHASE5) (HIGH) Remove/improve this once we have witness-header-sync; this is a temporary measure to keep SPV performance adequate on low power devices for now.
-            // Benchmarking on 6 core mobile device showed roughly double performance when using 2 threads instead of 1
-            // when further increasing the number of threads (3 and 4) performance stayed roughly the same though at the cost of
-            // higher cpu and energy consumption and overall app/device responsiveness.
-            // As such the number of threads is limited to 2 (if reported by the OS). Further research and benchmarking on a wider range of devices
-            // would be needed to create a solution that gets the most out of a wide range of OS and devices. This might not be worth it though
-            // as for mobile/SPV the witness-header-sync will probably completely skip the pow check in the future.
-            uint32_t numVerifyThreads = std::min(defaultSigmaSettings.numVerifyThreads, (uint64_t)std::max(1, std::min(2, (int)std::thread::hardware_concurrency())));
-            static sigma_verify_context verify(defaultSigmaSettings, numVerifyThreads);
-            static RecursiveMutex csPOW;
-            LOCK(csPOW);
-
-            int verifyLevel = GetRand(verifyFactor);
-            if (verifyLevel == 0)
-            {
-                return verify.verifyHeader<1>(*block);
-            }
-            else if (verifyLevel == 1)
-            {
-                return verify.verifyHeader<2>(*block);
-            }
-            else
-            {
-                return true;
-            }
-        #else
-            static sigma_verify_context verify(defaultSigmaSettings,std::min(defaultSigmaSettings.numVerifyThreads, (uint64_t)std::thread::hardware_concurrency()));
-            static RecursiveMutex csPOW;
-            LOCK(csPOW);
+        static sigma_verify_context verify(defaultSigmaSettings, std::min(defaultSigmaSettings.numVerifyThreads, GetNumVerifyCores()));
+        static RecursiveMutex csPOW;
+        LOCK(csPOW);
 
-            // Testnet optimisation - only verify last 5 days worth of blocks
-            if (Params().IsOfficialTestnetV1() && (block->nTime < GetTime() - 86400*5))
-            {
+        switch (SelectSigmaVerifyLevel(*block))
+        {
+            case 0:
+                if (!verify.verifyHeader<0>(*block))
+                    return false;
+                if (pfFullyVerified)
+                    *pfFullyVerified = true;
                 return true;
-            }
-            //fixme: (SIGMA) - Detect faster machines and disable this optimisation for them, this will further increase network security.
-            // We speed up verification by doing a half verify 40% of the time instead of a full verify
-            // As a half verify has a 50% chance of detecting a 'half valid' hash an attacker has only a 20% chance of a node accepting his header without banning him
-            // This should provide a ~20% speed up for slow machines
-            int verifyLevel = GetRand(100);
-            if (verifyLevel < 20)
-            {
+            case 1:
                 return verify.verifyHeader<1>(*block);
-            }
-            else if (verifyLevel < 40)
-            {
+            case 2:
                 return verify.verifyHeader<2>(*block);
-            }
-            return verify.verifyHeader<0>(*block);
-        #endif
+            default:
+                return true;
+        }
     }
     else if (block->nTime <= defaultSigmaSettings.activationDate)
     {
         if (UintToArith256(block->GetPoWHash()) > bnTarget)
             return false;
+        if (pfFullyVerified)
+            *pfFullyVerified = true;
     }
 
     return true;
 }
+
+bool CheckProofOfWorkBatch(Span<const CBlockHeader> headers, const Consensus::Params& params, std::vector<uint8_t>& results)
+{
+    // Cheap checks first (serially), only the SIGMA checks are worth farming out to the pool.
+    // We stop at the first failure, there is no point in verifying anything past it.
+    bool fValid = true;
+    size_t nCount = 0;
+    std::vector<int> verifyLevels;
+    std::vector<bool> fullyVerifiedLegacy;
+    verifyLevels.reserve(headers.size());
+    fullyVerifiedLegacy.reserve(headers.size());
+    for (; nCount < headers.size(); ++nCount)
+    {
+        const CBlockHeader& header = headers[nCount];
+        arith_uint256 bnTarget;
+        if (!GetProofOfWorkTarget(header, params, bnTarget))
+        {
+            fValid = false;
+            break;
+        }
+        if (header.nTime > 1602307283)
+        {
+            verifyLevels.push_back(SelectSigmaVerifyLevel(header));
+            fullyVerifiedLegacy.push_back(false);
+        }
+        else
+        {
+            bool fLegacyPoW = header.nTime <= defaultSigmaSettings.activationDate;
+            if (fLegacyPoW && UintToArith256(CBlock(header).GetPoWHash()) > bnTarget)
+            {
+                fValid = false;
+                break;
+            }
+            verifyLevels.push_back(-1);
+            fullyVerifiedLegacy.push_back(fLegacyPoW);
+        }
+    }
+
+    results.clear();
+    if (nCount > 0)
+    {
+        // One context per core, each verifying a different header.
+        static sigma_verify_pool verifyPool(defaultSigmaSettings, GetNumVerifyCores());
+        static RecursiveMutex csPOWBatch;
+        LOCK(csPOWBatch);
+
+        if (!verifyPool.verifyHeaders(headers.first(nCount), verifyLevels, results))
+            fValid = false;
+    }
+    results.resize(headers.size(), POW_CHECK_FAILED);
+    // Workers can finish headers past the first failure before they notice it, those still count as not checked.
+    std::fill(std::find(results.begin(), results.end(), POW_CHECK_FAILED), results.end(), POW_CHECK_FAILED);
+    for (size_t i = 0; i < nCount; ++i)
+    {
+        if (results[i] && (verifyLevels[i] == 0 || fullyVerifiedLegacy[i]))
+            results[i] = POW_CHECK_FULLY_VERIFIED;
+    }
+
+    return fValid;
+}
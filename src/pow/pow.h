@@ -15,15 +15,28 @@
 
 #include "consensus/params.h"
 #include "crypto/hash/sigma/sigma.h"
+#include "span.h"
 
 #include <stdint.h>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
 class uint256;
 
-/** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
-bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params);
+/** Check whether a block hash satisfies the proof-of-work requirement specified by nBits
+ *  If pfFullyVerified is passed it is set to true only when the entire PoW was actually computed, and not skipped or partially verified. */
+bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params, bool* pfFullyVerified=nullptr);
+
+static const uint8_t POW_CHECK_FAILED = 0;
+static const uint8_t POW_CHECK_PASSED = 1;
+static const uint8_t POW_CHECK_FULLY_VERIFIED = 2;
+
+/** Check the proof-of-work of a batch of headers concurrently (one SIGMA verify context per core)
+ *  results[i] is set to POW_CHECK_FULLY_VERIFIED or POW_CHECK_PASSED (see pfFullyVerified above) if headers[i] passed,
+ *  or POW_CHECK_FAILED if it failed or was not checked because an earlier header failed.
+ *  Returns false if any header failed. */
+bool CheckProofOfWorkBatch(Span<const CBlockHeader> headers, const Consensus::Params& params, std::vector<uint8_t>& results);
 
 extern uint64_t verifyFactor;
 
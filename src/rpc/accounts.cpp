@@ -37,6 +37,7 @@
 #include <boost/algorithm/string/split.hpp>
 
 #include "txdb.h"
+#include "blockstore.h"
 #include "coins.h"
 #include "blockfilter.h"
 #include "primitives/transaction.h"
@@ -233,70 +234,84 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
 
     #ifdef ENABLE_WALLET
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
-    LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
     if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
         return NullUniValue;
-    #else
-    LOCK(cs_main);
     #endif
 
-    CBlockIndex* pTipIndexStart = nullptr;
-    CBlockIndex* pTipIndexEnd = nullptr;
     bool fVerbose = false;
     bool showMineOnly = false;
-    if (request.params.size() > 0)
+    if (request.params.size() >= 2)
+        fVerbose = request.params[1].get_bool();
+
+    if (request.params.size() > 2)
+        showMineOnly = request.params[2].get_bool();
+
+    // cs_main is only needed to resolve the range and take a snapshot of where its blocks are stored.
+    // The witness sets are then rewound from the witness state snapshot and the network weights served by the network weight series.
+    std::vector<std::pair<CBlockIndex*, CDiskBlockPos>> vRangeBlocks;
     {
-        std::string sTipSpecifier = request.params[0].get_str();
-        int nRangeCount = std::count(sTipSpecifier.begin(), sTipSpecifier.end(), '-');
-        if (nRangeCount > 1)
-        {
-            throw std::runtime_error("Cannot have more than one range (-) in block specifier");
-        }
-        else if (nRangeCount == 1)
+        LOCK(cs_main);
+
+        CBlockIndex* pTipIndexStart = nullptr;
+        CBlockIndex* pTipIndexEnd = nullptr;
+        if (request.params.size() > 0)
         {
-            std::vector<std::string> rangeSpecifiers;
-            boost::algorithm::split(rangeSpecifiers, sTipSpecifier, boost::is_any_of("-"));
-            pTipIndexStart = GetIndexFromSpecifier(rangeSpecifiers[0]);
-            pTipIndexEnd = GetIndexFromSpecifier(rangeSpecifiers[1]);
-            if (pTipIndexStart == pTipIndexEnd)
+            std::string sTipSpecifier = request.params[0].get_str();
+            int nRangeCount = std::count(sTipSpecifier.begin(), sTipSpecifier.end(), '-');
+            if (nRangeCount > 1)
             {
-                throw std::runtime_error("End and start of range are identical");
+                throw std::runtime_error("Cannot have more than one range (-) in block specifier");
+            }
+            else if (nRangeCount == 1)
+            {
+                std::vector<std::string> rangeSpecifiers;
+                boost::algorithm::split(rangeSpecifiers, sTipSpecifier, boost::is_any_of("-"));
+                pTipIndexStart = GetIndexFromSpecifier(rangeSpecifiers[0]);
+                pTipIndexEnd = GetIndexFromSpecifier(rangeSpecifiers[1]);
+                if (pTipIndexStart == pTipIndexEnd)
+                {
+                    throw std::runtime_error("End and start of range are identical");
+                }
+            }
+            else
+            {
+                pTipIndexEnd = pTipIndexStart = GetIndexFromSpecifier(sTipSpecifier);
             }
         }
         else
         {
-            pTipIndexEnd = pTipIndexStart = GetIndexFromSpecifier(sTipSpecifier);
+            pTipIndexEnd = pTipIndexStart = chainActive.Tip();
         }
-    }
-    else
-    {
-        pTipIndexEnd = pTipIndexStart = chainActive.Tip();
-    }
 
-    if (!pTipIndexStart || (uint64_t)pTipIndexStart->nHeight < Params().GetConsensus().pow2Phase2FirstBlockHeight || pTipIndexStart->nHeight == 0)
-        return NullUniValue;
-    
-    if (pTipIndexStart->nHeight < pTipIndexEnd->nHeight)
-    {
-        std::swap(pTipIndexStart, pTipIndexEnd);
-    }
+        if (!pTipIndexStart || (uint64_t)pTipIndexStart->nHeight < Params().GetConsensus().pow2Phase2FirstBlockHeight || pTipIndexStart->nHeight == 0)
+            return NullUniValue;
 
-    if (request.params.size() >= 2)
-        fVerbose = request.params[1].get_bool();
+        if (pTipIndexStart->nHeight < pTipIndexEnd->nHeight)
+        {
+            std::swap(pTipIndexStart, pTipIndexEnd);
+        }
 
-    if (request.params.size() > 2)
-        showMineOnly = request.params[2].get_bool();
+        for (CBlockIndex* pIndex = pTipIndexStart; pIndex && pIndex->nHeight >= pTipIndexEnd->nHeight; pIndex = pIndex->pprev)
+        {
+            vRangeBlocks.emplace_back(pIndex, (pIndex->nStatus & BLOCK_HAVE_DATA) ? pIndex->GetBlockPos() : CDiskBlockPos());
+        }
+    }
 
     UniValue witnessInfoForBlocks(UniValue::VOBJ);
-    
-    CBlockIndex* pTipIndex_ = nullptr;
-    //fixme: (PHASE5) - Fix this to only do a shallow clone of whats needed (need to fix recursive cloning mess first)
-    CCloneChain tempChain(chainActive, GetPow2ValidationCloneHeight(chainActive, pTipIndexEnd, 10), pTipIndexStart, pTipIndex_);
-    if (!pTipIndex_)
-            throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
-    CCoinsViewCache viewNew(pcoinsTip);
-        
-    while (pTipIndex_ && (pTipIndex_->nHeight >= pTipIndexEnd->nHeight))
+
+    // The range is walked from the top down, so a single copy of the snapshot witness set can be rewound block by block.
+    // Only blocks beyond the reach of the snapshot (forks, or more than WITNESS_COIN_INDEX_DELTA_DEPTH below the tip) go via the witness coin index.
+    auto witnessSnapshot = GetWitnessStateSnapshot(false);
+    std::map<COutPoint, Coin> rewoundWitnessCoins;
+    int64_t nRewoundHeight = -1;
+
+    // Network weights for the whole range in one go, blocks that are not (or no longer) on chainActive are looked up individually below.
+    std::vector<CNetworkWeightPoint> rangeWeights;
+    uint64_t nRangeWeightsFrom = vRangeBlocks.empty() ? 0 : vRangeBlocks.back().first->nHeight;
+    if (!vRangeBlocks.empty())
+        GetPow2NetworkWeightRange(nRangeWeightsFrom, vRangeBlocks.front().first->nHeight, Params(), rangeWeights);
+
+    for (const auto& [pTipIndex_, blockPos] : vRangeBlocks)
     {
         int64_t nTotalWeightAll = 0;
         int64_t nNumWitnessAddressesAll = 0;
@@ -308,17 +323,11 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
         boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::with_p_square_quantile), boost::accumulators::tag::mean, boost::accumulators::tag::min, boost::accumulators::tag::max> > lockPeriodWeightStats;
         boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::with_p_square_quantile), boost::accumulators::tag::mean, boost::accumulators::tag::min, boost::accumulators::tag::max> > ageStats;
 
-        CValidationState state;
-        if (!ForceActivateChain(pTipIndex_, nullptr, state, Params(), tempChain, viewNew))
-            throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
-        if (!state.IsValid())
-            throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
-
-        if (IsPow2Phase5Active(pTipIndex_, Params(), tempChain, &viewNew))
+        if (IsPow2Phase5Active(pTipIndex_->nHeight))
             nPow2Phase = 5;
         else if (IsPow2Phase4Active(pTipIndex_))
             nPow2Phase = 4;
-        else if (IsPow2Phase3Active(pTipIndex_?pTipIndex_->nHeight:0))
+        else if (IsPow2Phase3Active(pTipIndex_->nHeight))
             nPow2Phase = 3;
         else if (IsPow2Phase2Active(pTipIndex_))
             nPow2Phase = 2;
@@ -328,17 +337,37 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
         if (nPow2Phase >= 2)
         {
             CBlock block;
+            if (!blockStore.ReadBlockFromDiskConcurrent(block, blockPos, pTipIndex_->GetBlockHashPoW2()))
+                throw std::runtime_error("Could not load block to obtain PoW² information.");
+
+            const CBlockIndex* pPreviousIndex = pTipIndex_->pprev;
+            if (witnessSnapshot && nRewoundHeight < pPreviousIndex->nHeight && pPreviousIndex->nHeight <= witnessSnapshot->nTipHeight && witnessSnapshot->nTipHeight - pPreviousIndex->nHeight <= (int64_t)witnessSnapshot->recentDeltas.size())
             {
-                LOCK(cs_main);// cs_main lock required for ReadBlockFromDisk
-                if (!ReadBlockFromDisk(block, pTipIndex_, Params()))
-                    throw std::runtime_error("Could not load block to obtain PoW² information.");
+                rewoundWitnessCoins = *witnessSnapshot->witnessCoins;
+                nRewoundHeight = witnessSnapshot->nTipHeight;
+            }
+            if (witnessSnapshot && witnessSnapshot->RewindWitnessCoins(rewoundWitnessCoins, nRewoundHeight, pPreviousIndex))
+            {
+                GetWitnessInfoFromWitnessCoins(rewoundWitnessCoins, pPreviousIndex->nHeight, block, witInfo, pTipIndex_->nHeight, pPreviousIndex == witnessSnapshot->pTip ? witnessSnapshot->rouletteColumns : nullptr);
+            }
+            else
+            {
+                // GetWitnessInfo walks chainActive, so unlike the snapshot it needs cs_main.
+                LOCK(cs_main);
+                if (!GetWitnessInfo(chainActive, Params(), nullptr, pTipIndex_->pprev, block, witInfo, pTipIndex_->nHeight))
+                    throw std::runtime_error("Could not enumerate all PoW² witness information for block.");
             }
 
-            if (!GetWitnessInfo(tempChain, Params(), &viewNew, pTipIndex_->pprev, block, witInfo, pTipIndex_->nHeight))
-                throw std::runtime_error("Could not enumerate all PoW² witness information for block.");
-
-            if (!GetPow2NetworkWeight(pTipIndex_, Params(), nNumWitnessAddressesAll, nTotalWeightAll, tempChain, &viewNew))
+            uint64_t nRangeWeightIndex = pTipIndex_->nHeight - nRangeWeightsFrom;
+            if (nRangeWeightIndex < rangeWeights.size() && rangeWeights[nRangeWeightIndex].blockHash == pTipIndex_->GetBlockHashPoW2())
+            {
+                nNumWitnessAddressesAll = rangeWeights[nRangeWeightIndex].nNumWitnessAddresses;
+                nTotalWeightAll = rangeWeights[nRangeWeightIndex].nTotalWeight;
+            }
+            else if (!GetPow2NetworkWeight(pTipIndex_, Params(), nNumWitnessAddressesAll, nTotalWeightAll, chainActive))
+            {
                 throw std::runtime_error("Block does not form part of a valid PoW² chain.");
+            }
 
             if (nPow2Phase >= 3)
             {
@@ -422,7 +451,11 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
 
                 std::string strAddress = CNativeAddress(address).ToString();
                 #ifdef ENABLE_WALLET
-                std::string accountName = accountNameForAddress(*pwallet, address);
+                std::string accountName;
+                {
+                    LOCK(pwallet->cs_wallet);
+                    accountName = accountNameForAddress(*pwallet, address);
+                }
                 #endif
 
                 UniValue rec(UniValue::VOBJ);
@@ -526,12 +559,11 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             rec.pushKV("witness_address_list", jsonAllWitnessAddresses);
         }
         witnessInfoForBlock.push_back(rec);
-        if (pTipIndexStart == pTipIndexEnd)
+        if (vRangeBlocks.size() == 1)
         {
             return witnessInfoForBlock;
         }
         witnessInfoForBlocks.pushKV(pTipIndex_->GetBlockHashPoW2().ToString(), witnessInfoForBlock);
-        pTipIndex_ = pTipIndex_->pprev;
     }
     return witnessInfoForBlocks;
 }
@@ -578,32 +610,34 @@ static UniValue getwitnessutxo(const JSONRPCRequest& request)
             throw std::runtime_error("Could not load block to obtain PoW² information.");
     }
     
-    std::map<COutPoint, Coin> allWitnessCoinsIndexBased;
+    std::map<COutPoint, Coin> allWitnessCoins;
     // Fetch all unspent witness outputs for the chain in which -block- acts as the tip.
-    if (!getAllUnspentWitnessCoins(tempChain, Params(), pTipIndex_->pprev, allWitnessCoinsIndexBased, &block, &viewNew, true))
+    if (!getAllUnspentWitnessCoins(tempChain, Params(), pTipIndex_->pprev, allWitnessCoins, &block, &viewNew))
         throw std::runtime_error("Could not retrieve utxo for block.");
 
-    SimplifiedWitnessUTXOSet witnessUTXOset = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(allWitnessCoinsIndexBased);
+    SimplifiedWitnessUTXOSet witnessUTXOset = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(allWitnessCoins);
     
     CGetWitnessInfo witInfoSimplified;
-    if (!GetWitnessFromSimplifiedUTXO(witnessUTXOset, pTipIndex_, witInfoSimplified))
+    if (!GetWitnessFromSimplifiedUTXO(witnessUTXOset, block, pTipIndex_->nHeight, witInfoSimplified))
         throw std::runtime_error("Could not enumerate all simplified PoW² witness information for block.");
     
     CGetWitnessInfo witnessInfo;
     if (!GetWitness(tempChain, Params(), &viewNew, pTipIndex_->pprev, block, witnessInfo))
         throw std::runtime_error("Could not enumerate all PoW² witness information for block.");
     
-    assert(witInfoSimplified.selectedWitnessIndex == witnessInfo.selectedWitnessIndex);
-    if ((uint64_t)pTipIndex_->nHeight >= Params().GetConsensus().pow2WitnessSyncHeight)
+    // The simplified set has no transaction hashes so its outpoints are index based, compare the output they refer to instead.
+    if (witInfoSimplified.selectedWitnessIndex != witnessInfo.selectedWitnessIndex
+        || witInfoSimplified.selectedWitnessOutpoint.n != witnessInfo.selectedWitnessOutpoint.n
+        || witInfoSimplified.selectedWitnessTransaction.output.witnessDetails.witnessKeyID != witnessInfo.selectedWitnessTransaction.output.witnessDetails.witnessKeyID
+        || witInfoSimplified.selectedWitnessBlockHeight != witnessInfo.selectedWitnessBlockHeight
+        || witInfoSimplified.nTotalWeightRaw != witnessInfo.nTotalWeightRaw
+        || witInfoSimplified.nTotalWeightEligibleRaw != witnessInfo.nTotalWeightEligibleRaw
+        || witInfoSimplified.nTotalWeightEligibleAdjusted != witnessInfo.nTotalWeightEligibleAdjusted
+        || witInfoSimplified.nMaxIndividualWeight != witnessInfo.nMaxIndividualWeight)
     {
-        assert(witInfoSimplified.selectedWitnessOutpoint == witnessInfo.selectedWitnessOutpoint);
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Simplified PoW² witness information does not match the full witness information for block.");
     }
-    assert(witInfoSimplified.selectedWitnessBlockHeight == witnessInfo.selectedWitnessBlockHeight);
-    assert(witInfoSimplified.nTotalWeightRaw == witnessInfo.nTotalWeightRaw);
-    assert(witInfoSimplified.nTotalWeightEligibleRaw == witnessInfo.nTotalWeightEligibleRaw);
-    assert(witInfoSimplified.nTotalWeightEligibleAdjusted == witnessInfo.nTotalWeightEligibleAdjusted);
-    assert(witInfoSimplified.nMaxIndividualWeight == witnessInfo.nMaxIndividualWeight);    
-    
+
     for (const auto& item : witnessUTXOset.witnessCandidates)
     {
         UniValue rec(UniValue::VOBJ);   
@@ -670,8 +704,7 @@ static UniValue dumpfiltercheckpoints(const JSONRPCRequest& request)
     {
         LOCK2(cs_main, pactiveWallet->cs_wallet); // cs_main required for ReadBlockFromDisk.
 
-        std::vector<unsigned char> allFilters;
-        allFilters.reserve(3000000);
+        std::vector<std::tuple<uint64_t, uint64_t, std::vector<unsigned char>>> ranges;
         int nMaxHeight = chainActive.Height();
         int nInterval = nInterval1;
 
@@ -683,20 +716,14 @@ static UniValue dumpfiltercheckpoints(const JSONRPCRequest& request)
                 nInterval = nInterval2;
 
             RangedCPBlockFilter filter(chainActive[i-1], chainActive[i+nInterval-1]);
-            const std::vector<unsigned char>& filterData = filter.GetEncodedFilter();
-            {
-                std::vector<unsigned char> filterSizeVector;
-                CVectorWriter sizeWriter(0, 0, filterSizeVector, 0);
-                WriteCompactSize(sizeWriter, filterData.size());
-                std::copy(filterSizeVector.cbegin(), filterSizeVector.cend(), std::back_inserter(allFilters));
-            }
-            std::copy(filterData.cbegin(), filterData.cend(), std::back_inserter(allFilters));
+            ranges.emplace_back(i, i+nInterval, filter.GetEncodedFilter());
 
             i += nInterval;
 
             nTotalElements += filter.GetFilter().NumElements();
             nTotalIntervals++;
         }
+        std::vector<unsigned char> allFilters = CStaticFilterCheckpoints::Serialize(ranges);
         LogPrintf("size: %d elements: %u intervals: %u\n", allFilters.size(), nTotalElements, nTotalIntervals);
         file.write((const char*)&allFilters[0], allFilters.size());
     }
@@ -1334,12 +1361,12 @@ static UniValue getminingrewardaddress(const JSONRPCRequest& request)
 
 static witnessOutputsInfoVector getCurrentOutputsForWitnessAddress(CNativeAddress& searchAddress)
 {
-    std::map<COutPoint, Coin> allWitnessCoins;
-    if (!getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+    if (!witnessSnapshot)
         throw std::runtime_error("Failed to enumerate all witness coins.");
 
     witnessOutputsInfoVector matchedOutputs;
-    for (const auto& [outpoint, coin] : allWitnessCoins)
+    for (const auto& [outpoint, coin] : *witnessSnapshot->witnessCoins)
     {
         CTxDestination compareDestination;
         bool fValidAddress = ExtractDestination(coin.out, compareDestination);
@@ -1354,12 +1381,12 @@ static witnessOutputsInfoVector getCurrentOutputsForWitnessAddress(CNativeAddres
 
 static witnessOutputsInfoVector getCurrentOutputsForWitnessAccount(CAccount* forAccount)
 {
-    std::map<COutPoint, Coin> allWitnessCoins;
-    if (!getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+    if (!witnessSnapshot)
         throw std::runtime_error("Failed to enumerate all witness coins.");
 
     witnessOutputsInfoVector matchedOutputs;
-    for (const auto& [outpoint, coin] : allWitnessCoins)
+    for (const auto& [outpoint, coin] : *witnessSnapshot->witnessCoins)
     {
         if (IsMine(*forAccount, coin.out))
         {
@@ -3730,11 +3757,11 @@ static UniValue getwitnessaccountkeys(const JSONRPCRequest& request)
 
     EnsureWalletIsUnlocked(pwallet);
 
-    std::map<COutPoint, Coin> allWitnessCoins;
-    if (!getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+    if (!witnessSnapshot)
         throw std::runtime_error("Failed to enumerate all witness coins.");
 
-    std::string linkUrl = witnessKeysLinkUrlForAccount(pwallet, forAccount);
+    std::string linkUrl = witnessKeysLinkUrlForAccount(pwallet, forAccount, witnessSnapshot);
 
     if (linkUrl.empty())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Witness account has no active keys.");
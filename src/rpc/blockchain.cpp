@@ -13,6 +13,7 @@
 #include "rpc/blockchain.h"
 
 #include "appname.h"
+#include "blockfilterindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -741,6 +742,60 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block (requires -blockfilterindex).\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"          (string, required) The hash of the block\n"
+            "2. \"filtertype\"         (string, optional, default=basic) The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",    (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"     (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash(uint256S(request.params[0].get_str()));
+
+    BlockFilterType filterType = BlockFilterType::BASIC;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+    {
+        if (!BlockFilterTypeByName(request.params[1].get_str(), filterType))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    if (!pblockfilterindex || pblockfilterindex->GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filterType));
+
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mapBlockIndex[hash];
+    }
+
+    BlockFilter filter;
+    uint256 filterHeader;
+    if (!pblockfilterindex->LookupFilter(pblockindex, filter) || !pblockfilterindex->LookupFilterHeader(pblockindex, filterHeader))
+    {
+        if (!pblockfilterindex->IsSynced())
+            throw JSONRPCError(RPC_MISC_ERROR, "Filter not found. Block filters are still in the process of being indexed.");
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Filter not found.");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filterHeader.GetHex());
+    return ret;
+}
+
 static UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -2189,6 +2244,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "decodeblock",            &decodeblock,            true,  {"blockhex"} },
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "emptymempool",           &emptymempool,           true,  {} },
@@ -626,8 +626,8 @@ UniValue verifyproofoffunds(const JSONRPCRequest& request)
         return ret;
     }
     
-    std::map<COutPoint, Coin> allWitnessCoins;
-    if (!getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+    if (!witnessSnapshot)
     {
         ret.pushKV("info", "failed to enumerate all witness coins");
         return ret;
@@ -635,7 +635,7 @@ UniValue verifyproofoffunds(const JSONRPCRequest& request)
 
     CAmount fundsForKey = 0;
     int partsForKey = 0;
-    for (const auto& [outpoint, coin] : allWitnessCoins)
+    for (const auto& [outpoint, coin] : *witnessSnapshot->witnessCoins)
     {
         CTxDestination compareDestination;
         bool fValidAddress = ExtractDestination(coin.out, compareDestination);
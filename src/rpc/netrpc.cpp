@@ -376,7 +376,16 @@ static UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
-            "  }\n"
+            "  },\n"
+            "  \"netthreads\": [                 (array) Socket I/O handled by each thread of the -netthreads pool\n"
+            "    {\n"
+            "      \"bytesrecv\": n,              (numeric) Bytes received\n"
+            "      \"bytessent\": n,              (numeric) Bytes sent\n"
+            "      \"recvops\": n,                (numeric) Completed socket reads\n"
+            "      \"sendops\": n                 (numeric) Completed socket writes\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getnettotals", "")
@@ -398,6 +407,18 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.pushKV("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle());
     obj.pushKV("uploadtarget", outboundLimit);
+
+    UniValue netThreads(UniValue::VARR);
+    for (const auto& stats : g_connman->GetNetThreadStats())
+    {
+        UniValue threadObj(UniValue::VOBJ);
+        threadObj.pushKV("bytesrecv", stats.nBytesRecv);
+        threadObj.pushKV("bytessent", stats.nBytesSent);
+        threadObj.pushKV("recvops", stats.nRecvOps);
+        threadObj.pushKV("sendops", stats.nSendOps);
+        netThreads.push_back(threadObj);
+    }
+    obj.pushKV("netthreads", netThreads);
     return obj;
 }
 
@@ -276,6 +276,24 @@ public:
         memcpy(dst.data(), m_data.data(), dst.size());
         m_data = m_data.subspan(dst.size());
     }
+
+    void peek(char* pch, size_t nSize)
+    {
+        if (nSize == 0) return;
+
+        if (nSize > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::peek(): end of data");
+        }
+        memcpy(pch, m_data.data(), nSize);
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(nSize);
+    }
 };
 
 /** Double ended buffer combining vector and stream-like interfaces.
@@ -339,6 +357,7 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c = value_type{}) { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity(); }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
@@ -0,0 +1,367 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "blockfilter.h"
+#include "arith_uint256.h"
+#include "clientversion.h"
+#include "fs.h"
+#include "streams.h"
+#include "test/test.h"
+#include "test/testutil.h"
+#include "util.h"
+#include "util/golombrice.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+typedef std::vector<std::tuple<uint64_t, uint64_t, std::vector<unsigned char>>> FilterRanges;
+
+static GCSFilter::ElementSet RandomElements(size_t nCount)
+{
+    GCSFilter::ElementSet elements;
+    while (elements.size() < nCount)
+        elements.insert(InsecureRandBytes(20));
+    return elements;
+}
+
+// nCount ranged filters over random elements, with the elements each filter was built from in vElements.
+static FilterRanges MakeFilterRanges(size_t nCount, uint64_t nInterval, std::vector<GCSFilter::ElementSet>& vElements)
+{
+    FilterRanges ranges;
+    for (size_t i = 0; i < nCount; ++i)
+    {
+        vElements.push_back(RandomElements(1 + InsecureRandRange(40)));
+        GCSFilter filter(RangedCPBlockFilter::StaticParams(), vElements.back());
+        ranges.emplace_back(i * nInterval, (i + 1) * nInterval, filter.GetEncoded());
+    }
+    return ranges;
+}
+
+static fs::path WriteTempFile(const std::string& name, const std::vector<unsigned char>& data)
+{
+    fs::path path = GetTempPath() / strprintf("%s_%08x", name, InsecureRand32());
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+    return path;
+}
+
+static void CheckRanges(const CStaticFilterCheckpoints& checkpoints, const FilterRanges& expected)
+{
+    const std::vector<CStaticFilterCheckpoints::Range>& ranges = checkpoints.GetRanges();
+    BOOST_REQUIRE_EQUAL(ranges.size(), expected.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        const auto& [nStartHeight, nEndHeight, filter] = expected[i];
+        BOOST_CHECK_EQUAL(ranges[i].nStartHeight, nStartHeight);
+        BOOST_CHECK_EQUAL(ranges[i].nEndHeight, nEndHeight);
+        BOOST_CHECK(std::equal(ranges[i].encodedFilter.begin(), ranges[i].encodedFilter.end(), filter.begin(), filter.end()));
+    }
+}
+
+// Reference result: MatchAny of elements against every range, one filter at a time.
+static std::vector<unsigned char> MatchRangesReference(const FilterRanges& ranges, const GCSFilter::ElementSet& elements)
+{
+    std::vector<unsigned char> vMatches;
+    for (const auto& [nStartHeight, nEndHeight, filter] : ranges)
+    {
+        (unused) nStartHeight;
+        (unused) nEndHeight;
+        vMatches.push_back(GCSFilter(RangedCPBlockFilter::StaticParams(), filter).MatchAny(elements));
+    }
+    return vMatches;
+}
+
+// Every value of an encoded filter, decoded with the BitStreamReader based GolombRiceDecode.
+static std::vector<uint64_t> DecodeReference(const GCSFilter::Params& params, const std::vector<unsigned char>& encoded)
+{
+    SpanReader stream(SER_NETWORK, 0, encoded);
+    uint64_t N = ReadCompactSize(stream);
+    BitStreamReader<SpanReader> bitreader(stream);
+    std::vector<uint64_t> values;
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        value += GolombRiceDecode(bitreader, params.m_P);
+        values.push_back(value);
+    }
+    return values;
+}
+
+// MatchAny worked out from those values: is any of the hashes (as HashElements), mapped into [0, N * M) with a 256 bit multiply, one of them.
+static bool MatchAnyReference(const GCSFilter::Params& params, const std::vector<unsigned char>& encoded, const std::vector<uint64_t>& hashes)
+{
+    const std::vector<uint64_t> values = DecodeReference(params, encoded);
+    const arith_uint256 F = arith_uint256(values.size()) * params.m_M;
+    for (uint64_t hash : hashes)
+    {
+        if (std::binary_search(values.begin(), values.end(), ((arith_uint256(hash) * F) >> 64).GetLow64()))
+            return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(static_filter_file_roundtrip)
+{
+    std::vector<GCSFilter::ElementSet> vElements;
+    const FilterRanges ranges = MakeFilterRanges(150, 100, vElements);
+    const std::vector<unsigned char> vData = CStaticFilterCheckpoints::Serialize(ranges);
+    BOOST_REQUIRE(vData.size() > 4);
+    BOOST_CHECK(vData[0] == 0xff && vData[1] == 'F' && vData[2] == 'C' && vData[3] == 'P');
+
+    // The whole file...
+    fs::path path = WriteTempFile("filtercp", vData);
+    {
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_REQUIRE(checkpoints.Load(path.string(), 0, 0));
+        CheckRanges(checkpoints, ranges);
+    }
+    fs::remove(path);
+
+    // ...and a section of a bigger file.
+    std::vector<unsigned char> vPackage = InsecureRandBytes(1000);
+    vPackage.insert(vPackage.end(), vData.begin(), vData.end());
+    std::vector<unsigned char> vTrailer = InsecureRandBytes(500);
+    vPackage.insert(vPackage.end(), vTrailer.begin(), vTrailer.end());
+    path = WriteTempFile("filtercp", vPackage);
+    {
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_REQUIRE(checkpoints.Load(path.string(), 1000, vData.size()));
+        CheckRanges(checkpoints, ranges);
+    }
+    {
+        // A section that runs past the end of the file.
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_CHECK(!checkpoints.Load(path.string(), 1000, vPackage.size()));
+    }
+    fs::remove(path);
+
+    // Unknown versions and tables or filters that run past the end of the section are rejected.
+    std::vector<unsigned char> vUnknownVersion = vData;
+    ++vUnknownVersion[4];
+    std::vector<unsigned char> vTruncatedTable(vData.begin(), vData.begin() + 12 + 16 * 10);
+    std::vector<unsigned char> vTruncatedFilters(vData.begin(), vData.end() - 1);
+    for (const auto& vBad : {vUnknownVersion, vTruncatedTable, vTruncatedFilters})
+    {
+        path = WriteTempFile("filtercp", vBad);
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_CHECK(!checkpoints.Load(path.string(), 0, 0));
+        fs::remove(path);
+    }
+
+    BOOST_CHECK(!CStaticFilterCheckpoints().Load((GetTempPath() / "filtercp_missing").string(), 0, 0));
+}
+
+// Files written by the old dumpfiltercheckpoints: compact size prefixed filters back to back, every 500 blocks up to 10000 and every 100 blocks after.
+BOOST_AUTO_TEST_CASE(static_filter_file_legacy)
+{
+    std::vector<GCSFilter::ElementSet> vElements;
+    FilterRanges ranges = MakeFilterRanges(20, 500, vElements);
+    FilterRanges rangesAfterCrossOver = MakeFilterRanges(30, 100, vElements);
+    for (auto& [nStartHeight, nEndHeight, filter] : rangesAfterCrossOver)
+        ranges.emplace_back(nStartHeight + 10000, nEndHeight + 10000, std::move(filter));
+
+    std::vector<unsigned char> vData;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, vData, 0);
+    for (const auto& [nStartHeight, nEndHeight, filter] : ranges)
+    {
+        (unused) nStartHeight;
+        (unused) nEndHeight;
+        writer << COMPACTSIZEVECTOR(filter);
+    }
+
+    fs::path path = WriteTempFile("filtercp_legacy", vData);
+    {
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_REQUIRE(checkpoints.Load(path.string(), 0, 0));
+        CheckRanges(checkpoints, ranges);
+
+        std::vector<unsigned char> vMatches;
+        checkpoints.MatchRanges(GCSFilter::HashElements(RangedCPBlockFilter::StaticParams(), vElements[3]), vMatches, 1);
+        BOOST_CHECK(vMatches == MatchRangesReference(ranges, vElements[3]));
+        BOOST_CHECK(vMatches[3]);
+    }
+    fs::remove(path);
+
+    // A trailing partial filter is dropped, the ranges before it are still served.
+    vData.pop_back();
+    path = WriteTempFile("filtercp_legacy", vData);
+    {
+        CStaticFilterCheckpoints checkpoints;
+        BOOST_REQUIRE(checkpoints.Load(path.string(), 0, 0));
+        ranges.pop_back();
+        CheckRanges(checkpoints, ranges);
+    }
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(static_filter_match_ranges)
+{
+    std::vector<GCSFilter::ElementSet> vElements;
+    const FilterRanges ranges = MakeFilterRanges(300, 100, vElements);
+    fs::path path = WriteTempFile("filtercp", CStaticFilterCheckpoints::Serialize(ranges));
+    CStaticFilterCheckpoints checkpoints;
+    BOOST_REQUIRE(checkpoints.Load(path.string(), 0, 0));
+
+    // Wallet elements: a few from some of the ranges and some that are in none.
+    GCSFilter::ElementSet elements = RandomElements(50);
+    GCSFilter::ElementSet newElements = RandomElements(50);
+    for (size_t i : {2, 70, 150, 299})
+        elements.insert(*vElements[i].begin());
+    for (size_t i : {5, 70, 200})
+        newElements.insert(*vElements[i].begin());
+    GCSFilter::ElementSet allElements = elements;
+    allElements.insert(newElements.begin(), newElements.end());
+    const GCSFilter::Params params = RangedCPBlockFilter::StaticParams();
+
+    for (int nThreads : {1, 4})
+    {
+        std::vector<unsigned char> vMatches;
+        checkpoints.MatchRanges(GCSFilter::HashElements(params, elements), vMatches, nThreads);
+        BOOST_CHECK(vMatches == MatchRangesReference(ranges, elements));
+
+        // Matching only the new elements on top of the previous result is the same as matching all of them.
+        checkpoints.MatchRanges(GCSFilter::HashElements(params, newElements), vMatches, nThreads);
+        BOOST_CHECK(vMatches == MatchRangesReference(ranges, allElements));
+        for (size_t i : {2, 5, 70, 150, 200, 299})
+            BOOST_CHECK(vMatches[i]);
+    }
+
+    // The match state getBlockFilterBirthAndRanges keeps between calls gives the same ranges as matching from scratch, also when elements go away.
+    ForceSetArg("-spvstaticfilterfile", path.string());
+    for (const auto& walletElements : {elements, allElements, newElements})
+    {
+        const std::vector<unsigned char> vExpected = MatchRangesReference(ranges, walletElements);
+        std::vector<std::tuple<uint64_t, uint64_t>> blockFilterRanges;
+        uint64_t nSoftBirthDate = std::numeric_limits<uint64_t>::max();
+        getBlockFilterBirthAndRanges(1, nSoftBirthDate, walletElements, blockFilterRanges);
+
+        std::vector<std::tuple<uint64_t, uint64_t>> expectedRanges;
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (vExpected[i])
+                expectedRanges.emplace_back(std::get<0>(ranges[i]), std::get<1>(ranges[i]));
+        }
+        BOOST_CHECK(blockFilterRanges == expectedRanges);
+        BOOST_REQUIRE(!expectedRanges.empty());
+        BOOST_CHECK_EQUAL(nSoftBirthDate, std::get<0>(expectedRanges[0]) > 1 ? std::get<0>(expectedRanges[0]) : std::get<0>(expectedRanges[1]));
+    }
+    ForceSetArg("-spvstaticfilterfile", "");
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(golomb_rice_word_decoder)
+{
+    for (uint8_t P : {0, 1, 5, 19, 20, 32, 40, 56})
+    {
+        // Mostly short quotients, with some that span more than one 64 bit word.
+        std::vector<uint64_t> values;
+        for (int i = 0; i < 1000; ++i)
+        {
+            uint64_t q = InsecureRandRange(10) == 0 ? InsecureRandRange(200) : InsecureRandRange(4);
+            values.push_back((q << P) | InsecureRandBits(P));
+        }
+
+        std::vector<unsigned char> encoded;
+        {
+            CVectorWriter stream(SER_NETWORK, 0, encoded, 0);
+            BitStreamWriter<CVectorWriter> bitwriter(stream);
+            for (uint64_t x : values)
+                GolombRiceEncode(bitwriter, P, x);
+        }
+
+        GolombRiceWordDecoder decoder(encoded);
+        SpanReader stream(SER_NETWORK, 0, encoded);
+        BitStreamReader<SpanReader> bitreader(stream);
+        for (uint64_t x : values)
+        {
+            BOOST_CHECK_EQUAL(decoder.Decode(P), x);
+            BOOST_CHECK_EQUAL(GolombRiceDecode(bitreader, P), x);
+        }
+
+        // Without the last byte at least the last value (and for small P those before it that end in that byte) can't be decoded.
+        // Both decoders give the values up to there and then throw.
+        const std::vector<unsigned char> truncated(encoded.begin(), encoded.end() - 1);
+        SpanReader truncatedStream(SER_NETWORK, 0, truncated);
+        BitStreamReader<SpanReader> truncatedReader(truncatedStream);
+        size_t nDecodable = 0;
+        try {
+            while (nDecodable < values.size()) {
+                GolombRiceDecode(truncatedReader, P);
+                ++nDecodable;
+            }
+        } catch (const std::ios_base::failure&) {
+        }
+        BOOST_CHECK(nDecodable < values.size());
+        GolombRiceWordDecoder truncatedDecoder(truncated);
+        for (size_t i = 0; i < nDecodable; ++i)
+            BOOST_CHECK_EQUAL(truncatedDecoder.Decode(P), values[i]);
+        BOOST_CHECK_THROW(truncatedDecoder.Decode(P), std::ios_base::failure);
+    }
+
+    BOOST_CHECK_THROW(GolombRiceWordDecoder(Span<const unsigned char>()).Decode(BASIC_FILTER_P), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcs_filter_match_matches_reference)
+{
+    // A small M so that false positives, and so matches in the middle of a filter, are common.
+    const std::vector<GCSFilter::Params> vParams = {
+        GCSFilter::Params(InsecureRand32(), InsecureRand32(), 2, 4),
+        GCSFilter::Params(InsecureRand32(), InsecureRand32(), BASIC_FILTER_P, BASIC_FILTER_M),
+        RangedCPBlockFilter::StaticParams(),
+    };
+    for (const GCSFilter::Params& params : vParams)
+    {
+        std::vector<GCSFilter::ElementSet> vElements;
+        std::vector<GCSFilter> filters;
+        for (size_t nCount : {0, 1, 2, 10, 100, 1000})
+        {
+            vElements.push_back(RandomElements(nCount));
+            filters.emplace_back(params, vElements.back());
+        }
+
+        for (int i = 0; i < 20; ++i)
+        {
+            GCSFilter::ElementSet queries = RandomElements(1 + InsecureRandRange(10));
+            if (InsecureRandBool())
+                queries.insert(*vElements.back().begin());
+            const std::vector<uint64_t> hashes = GCSFilter::HashElements(params, queries);
+
+            std::vector<Span<const unsigned char>> encodedFilters;
+            std::vector<unsigned char> vExpected;
+            for (const GCSFilter& filter : filters)
+            {
+                const bool fExpected = MatchAnyReference(params, filter.GetEncoded(), hashes);
+                BOOST_CHECK_EQUAL(filter.MatchAny(queries), fExpected);
+                BOOST_CHECK_EQUAL(GCSFilter::MatchAnyEncoded(params, filter.GetEncoded(), hashes), fExpected);
+                for (const GCSFilter::Element& query : queries)
+                    BOOST_CHECK_EQUAL(filter.Match(query), MatchAnyReference(params, filter.GetEncoded(), GCSFilter::HashElements(params, GCSFilter::ElementSet{query})));
+                encodedFilters.push_back(filter.GetEncoded());
+                vExpected.push_back(fExpected);
+            }
+
+            std::vector<unsigned char> vResults(filters.size(), 0);
+            GCSFilter::MatchAnyEncodedBatch(params, encodedFilters, hashes, vResults);
+            BOOST_CHECK(vResults == vExpected);
+        }
+    }
+
+    // A truncated filter can't be ruled out: MatchAnyEncoded throws once it runs out of data, the batch counts it as a match.
+    const GCSFilter::Params params = RangedCPBlockFilter::StaticParams();
+    const GCSFilter filter(params, RandomElements(100));
+    const std::vector<unsigned char> truncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 1);
+    const std::vector<uint64_t> lastHash = {std::numeric_limits<uint64_t>::max()};
+    BOOST_CHECK_THROW(GCSFilter::MatchAnyEncoded(params, truncated, lastHash), std::ios_base::failure);
+
+    const std::vector<Span<const unsigned char>> encodedFilters = {filter.GetEncoded(), truncated, filter.GetEncoded()};
+    std::vector<unsigned char> vResults = {0, 0, 1};
+    GCSFilter::MatchAnyEncodedBatch(params, encodedFilters, lastHash, vResults);
+    BOOST_CHECK(vResults == std::vector<unsigned char>({MatchAnyReference(params, filter.GetEncoded(), lastHash), 1, 1}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
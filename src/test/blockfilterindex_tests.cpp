@@ -0,0 +1,125 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "blockfilterindex.h"
+#include "blockstore.h"
+#include "consensus/validation.h"
+#include "validation/validation.h"
+#include "validation/validationinterface.h"
+#include "test/test.h"
+#include "util/time.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilterindex_tests, TestChain100Setup)
+
+// Reference filter, built straight from the block and undo data.
+static bool ComputeFilter(const CBlockIndex* pIndex, BlockFilter& filter)
+{
+    LOCK(cs_main);
+    CBlock block;
+    CBlockUndo blockUndo;
+    if (!ReadBlockFromDisk(block, pIndex, Params()))
+        return false;
+    if (pIndex->pprev && !blockStore.UndoReadFromDisk(blockUndo, pIndex->GetUndoPos(), pIndex->pprev->GetBlockHashPoW2()))
+        return false;
+    filter = BlockFilter(BlockFilterType::BASIC, block, blockUndo);
+    return true;
+}
+
+static bool WaitForSync(const CBlockFilterIndex& index)
+{
+    for (int i = 0; i < 2000 && !index.IsSynced(); ++i)
+        MilliSleep(10);
+    return index.IsSynced();
+}
+
+// Every block from genesis up to pTip must be served with the reference filter and a header that chains onto that of its parent.
+static void CheckFiltersMatchChain(CBlockFilterIndex& index, const CBlockIndex* pTip)
+{
+    uint256 prevHeader;
+    for (int nHeight = 0; nHeight <= pTip->nHeight; ++nHeight)
+    {
+        const CBlockIndex* pIndex = pTip->GetAncestor(nHeight);
+        BlockFilter expected;
+        BlockFilter filter;
+        uint256 header;
+        BOOST_REQUIRE(ComputeFilter(pIndex, expected));
+        BOOST_REQUIRE(index.LookupFilter(pIndex, filter));
+        BOOST_REQUIRE(index.LookupFilterHeader(pIndex, header));
+        BOOST_CHECK(filter.GetBlockHash() == pIndex->GetBlockHashPoW2());
+        BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+        BOOST_CHECK(header == expected.ComputeHeader(prevHeader));
+        prevHeader = header;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockfilterindex_build_and_serve)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+
+    // The background sync must produce the same index whether the filters are built on one thread or several.
+    for (int nThreads : {1, 4})
+    {
+        CBlockFilterIndex index(BlockFilterType::BASIC, 1 << 20, true, true);
+        index.Start(nThreads);
+        BOOST_REQUIRE(WaitForSync(index));
+        CheckFiltersMatchChain(index, chainActive.Tip());
+
+        // Ranges are served in height order.
+        std::vector<BlockFilter> filters;
+        BOOST_REQUIRE(index.LookupFilterRange(10, chainActive.Tip(), filters));
+        BOOST_REQUIRE_EQUAL(filters.size(), (size_t)chainActive.Height() - 10 + 1);
+        for (size_t i = 0; i < filters.size(); ++i)
+            BOOST_CHECK(filters[i].GetBlockHash() == chainActive[10 + i]->GetBlockHashPoW2());
+        BOOST_CHECK(!index.LookupFilterRange(chainActive.Height() + 1, chainActive.Tip(), filters));
+
+        // Once synced newly connected blocks are indexed as they come in.
+        RegisterValidationInterface(&index);
+        for (int i = 0; i < 3; ++i)
+            CreateAndProcessBlock({}, reservedScript);
+        SyncWithValidationInterfaceQueue();
+        UnregisterValidationInterface(&index);
+        CheckFiltersMatchChain(index, chainActive.Tip());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockfilterindex_disconnect)
+{
+    CBlockFilterIndex index(BlockFilterType::BASIC, 1 << 20, true, true);
+    index.Start(2);
+    BOOST_REQUIRE(WaitForSync(index));
+    RegisterValidationInterface(&index);
+
+    // Reorganise the tip away, the replacement blocks pay a different key so they can't coincide with the disconnected one.
+    CBlockIndex* pDisconnected = chainActive.Tip();
+    BlockFilter disconnectedFilter;
+    BOOST_REQUIRE(index.LookupFilter(pDisconnected, disconnectedFilter));
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pDisconnected));
+        BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    }
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(otherKey.GetPubKey()) << OP_CHECKSIG;
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+    for (int i = 0; i < 2; ++i)
+        CreateAndProcessBlock({}, reservedScript);
+    SyncWithValidationInterfaceQueue();
+    UnregisterValidationInterface(&index);
+
+    BOOST_CHECK(chainActive.Tip()->GetAncestor(pDisconnected->nHeight - 1) == pDisconnected->pprev);
+    CheckFiltersMatchChain(index, chainActive.Tip());
+
+    // Entries are keyed by block hash, so the disconnected block is still served.
+    BlockFilter filter;
+    BOOST_REQUIRE(index.LookupFilter(pDisconnected, filter));
+    BOOST_CHECK(filter.GetEncodedFilter() == disconnectedFilter.GetEncodedFilter());
+    BOOST_CHECK(!chainActive.Contains(pDisconnected));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,383 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "blockstore.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "util/time.h"
+#include "validation/validation.h"
+#include "warnings.h"
+#include "test/test.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+namespace blockstore_tests
+{
+class CBlockStoreTestAccess
+{
+public:
+    static CBlockStore::BlockFileKey FileKey(int nFile, bool fUndo)
+    {
+        return CBlockStore::BlockFileKey(nFile, fUndo ? CBlockStore::BlockFileType::undo : CBlockStore::BlockFileType::block);
+    }
+
+    // Hold the stdio lock of the writer's handle for the file, the writer then stalls on its next write to it until ResumeWriter.
+    static FILE* StallWriter(CBlockStore& store, int nFile, bool fUndo)
+    {
+        LOCK(store.cs_writer);
+        FILE* writerFile = store.GetWriterFile(FileKey(nFile, fUndo));
+        if (writerFile)
+            flockfile(writerFile);
+        return writerFile;
+    }
+
+    static void ResumeWriter(FILE* writerFile)
+    {
+        funlockfile(writerFile);
+    }
+
+    static bool HasPendingRecord(CBlockStore& store, const CDiskBlockPos& pos, bool fUndo)
+    {
+        return store.GetPendingRecord(pos, fUndo ? CBlockStore::BlockFileType::undo : CBlockStore::BlockFileType::block) != nullptr;
+    }
+
+    static auto GetMappedFile(CBlockStore& store, const CDiskBlockPos& pos, bool fUndo)
+    {
+        return store.GetMappedFile(pos, fUndo ? CBlockStore::BlockFileType::undo : CBlockStore::BlockFileType::block);
+    }
+
+    static bool ReadBlockFromMemory(CBlockStore& store, CBlock& block, const CDiskBlockPos& pos)
+    {
+        return store.ReadBlockFromMemory(block, pos);
+    }
+
+    static bool UndoReadFromMemory(CBlockStore& store, CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
+    {
+        return store.UndoReadFromMemory(blockundo, pos, hashBlock);
+    }
+
+    // Queue a raw record of nSize bytes of value ch, as WriteBlockToDisk does for a serialized block.
+    static bool EnqueueRecord(CBlockStore& store, int nFile, unsigned int nPos, size_t nSize, unsigned char ch)
+    {
+        CBlockStore::WriteOperation operation;
+        operation.file = FileKey(nFile, false);
+        operation.nPos = nPos;
+        operation.record = std::make_shared<const std::vector<unsigned char>>(nSize, ch);
+        return store.EnqueueWrite(std::move(operation));
+    }
+
+    static size_t QueuedBytes(CBlockStore& store)
+    {
+        LOCK(store.cs_writer);
+        return store.nWriteQueueBytes;
+    }
+
+    static bool WriterBusy(CBlockStore& store)
+    {
+        LOCK(store.cs_writer);
+        return store.fWriterBusy;
+    }
+
+    static size_t UnsyncedFiles(CBlockStore& store)
+    {
+        LOCK(store.cs_writer);
+        return store.setUnsyncedFiles.size();
+    }
+
+    static void SetWriterFailed(CBlockStore& store, bool fFailed)
+    {
+        LOCK(store.cs_writer);
+        store.fWriterFailed = fFailed;
+    }
+};
+}
+using namespace blockstore_tests;
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, TestingSetup)
+
+// File numbers well past anything the chain of the fixture uses.
+static const int nTestFileBase = 100;
+
+static CBlock BuildTestBlock(int nTransactions)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1600000000 + InsecureRandRange(1000000);
+    block.nBits = 0x207fffff;
+    for (int i = 0; i < nTransactions; ++i)
+    {
+        CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << InsecureRand32() << i;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 42 + i;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+static CBlockUndo BuildTestUndo(int nTransactions)
+{
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(nTransactions);
+    return blockundo;
+}
+
+static bool WaitFor(std::function<bool()> condition)
+{
+    for (int i = 0; i < 1000 && !condition(); ++i)
+        MilliSleep(10);
+    return condition();
+}
+
+static std::vector<unsigned char> ReadTestFile(int nFile)
+{
+    std::vector<unsigned char> data;
+    FILE* file = fsbridge::fopen(GetDataDir() / "blocks" / strprintf("blk%05u.dat", nFile), "rb");
+    if (!file)
+        return data;
+    unsigned char buffer[65536];
+    size_t nRead;
+    while ((nRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + nRead);
+    fclose(file);
+    return data;
+}
+
+static bool ReadTestBlock(CBlockStore& store, CBlock& block, const CDiskBlockPos& pos)
+{
+    LOCK(cs_main);
+    return store.ReadBlockFromDisk(block, pos, Params());
+}
+
+static CDiskBlockPos WriteTestBlock(CBlockStore& store, const CBlock& block, const CDiskBlockPos& posRecord)
+{
+    LOCK(cs_main);
+    CDiskBlockPos pos = posRecord;
+    BOOST_CHECK(store.WriteBlockToDisk(block, pos, Params().MessageStart()));
+    return pos;
+}
+
+/* Blocks still queued for the writer are read from the queued record, without waiting for the writer */
+BOOST_AUTO_TEST_CASE(blockstore_read_pending_records)
+{
+    CBlockStore store;
+    const int nFile = nTestFileBase;
+    CBlock block = BuildTestBlock(3);
+    CBlockUndo blockundo = BuildTestUndo(3);
+    uint256 hashParent = InsecureRand256();
+
+    FILE* blockWriterFile = CBlockStoreTestAccess::StallWriter(store, nFile, false);
+    FILE* undoWriterFile = CBlockStoreTestAccess::StallWriter(store, nFile, true);
+    BOOST_REQUIRE(blockWriterFile && undoWriterFile);
+
+    CDiskBlockPos pos = WriteTestBlock(store, block, CDiskBlockPos(nFile, 0));
+    CDiskBlockPos posUndo(nFile, 0);
+    BOOST_CHECK(store.UndoWriteToDisk(blockundo, posUndo, hashParent, Params().MessageStart()));
+    BOOST_CHECK(CBlockStoreTestAccess::HasPendingRecord(store, pos, false));
+    BOOST_CHECK(CBlockStoreTestAccess::HasPendingRecord(store, posUndo, true));
+
+    // Any other read would wait for the stalled writer.
+    CBlock blockRead;
+    BOOST_CHECK(CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, pos));
+    BOOST_CHECK(blockRead.GetHashPoW2() == block.GetHashPoW2());
+    CBlockUndo blockundoRead;
+    BOOST_CHECK(CBlockStoreTestAccess::UndoReadFromMemory(store, blockundoRead, posUndo, hashParent));
+    BOOST_CHECK_EQUAL(blockundoRead.vtxundo.size(), blockundo.vtxundo.size());
+    BOOST_CHECK(!CBlockStoreTestAccess::UndoReadFromMemory(store, blockundoRead, posUndo, InsecureRand256()));
+
+    CBlockStoreTestAccess::ResumeWriter(blockWriterFile);
+    CBlockStoreTestAccess::ResumeWriter(undoWriterFile);
+    BOOST_CHECK(store.SyncPendingWrites());
+    BOOST_CHECK(!CBlockStoreTestAccess::HasPendingRecord(store, pos, false));
+    BOOST_CHECK(!CBlockStoreTestAccess::HasPendingRecord(store, posUndo, true));
+    BOOST_CHECK(ReadTestBlock(store, blockRead, pos));
+    BOOST_CHECK(blockRead.GetHashPoW2() == block.GetHashPoW2());
+    BOOST_CHECK(store.UndoReadFromDisk(blockundoRead, posUndo, hashParent));
+    BOOST_CHECK_EQUAL(blockundoRead.vtxundo.size(), blockundo.vtxundo.size());
+}
+
+/* Files are only served from a mapping once finalized, and stop being so as soon as they are written to again */
+BOOST_AUTO_TEST_CASE(blockstore_mapped_reads)
+{
+    CBlockStore store;
+    const int nFile = nTestFileBase + 1;
+    CBlock firstBlock = BuildTestBlock(2);
+    CBlock secondBlock = BuildTestBlock(5);
+    CBlockUndo blockundo = BuildTestUndo(5);
+    uint256 hashParent = InsecureRand256();
+
+    CDiskBlockPos posFirst = WriteTestBlock(store, firstBlock, CDiskBlockPos(nFile, 0));
+    CDiskBlockPos posUndo(nFile, 0);
+    BOOST_CHECK(store.UndoWriteToDisk(blockundo, posUndo, hashParent, Params().MessageStart()));
+    BOOST_CHECK(store.SyncPendingWrites());
+
+    // Written in this session and not finalized, so only the buffered file path serves it.
+    CBlock blockRead;
+    CBlockUndo blockundoRead;
+    BOOST_CHECK(!CBlockStoreTestAccess::GetMappedFile(store, posFirst, false));
+    BOOST_CHECK(!CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, posFirst));
+    BOOST_CHECK(!CBlockStoreTestAccess::UndoReadFromMemory(store, blockundoRead, posUndo, hashParent));
+    BOOST_CHECK(ReadTestBlock(store, blockRead, posFirst));
+    BOOST_CHECK(blockRead.GetHashPoW2() == firstBlock.GetHashPoW2());
+
+    store.FinalizeBlockFile(nFile);
+    auto mapped = CBlockStoreTestAccess::GetMappedFile(store, posFirst, false);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->nSize, posFirst.nPos + ::GetSerializeSize(firstBlock, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, posFirst));
+    BOOST_CHECK(blockRead.GetHashPoW2() == firstBlock.GetHashPoW2());
+    BOOST_CHECK(CBlockStoreTestAccess::UndoReadFromMemory(store, blockundoRead, posUndo, hashParent));
+    BOOST_CHECK_EQUAL(blockundoRead.vtxundo.size(), blockundo.vtxundo.size());
+    BOOST_CHECK(!CBlockStoreTestAccess::UndoReadFromMemory(store, blockundoRead, posUndo, InsecureRand256()));
+
+    // Records have to lie entirely inside the mapping, including any trailer.
+    Span<const unsigned char> record;
+    BOOST_CHECK(mapped->GetRecord(posFirst, 0, record));
+    BOOST_CHECK_EQUAL(record.size(), mapped->nSize - posFirst.nPos);
+    BOOST_CHECK(!mapped->GetRecord(posFirst, 1, record));
+    BOOST_CHECK(!mapped->GetRecord(CDiskBlockPos(nFile, 2), 0, record));
+    BOOST_CHECK(!mapped->GetRecord(CDiskBlockPos(nFile, mapped->nSize + 8), 0, record));
+
+    // Appending drops the mapping, a reader that still holds it keeps a valid view of what it covered.
+    CDiskBlockPos posSecond = WriteTestBlock(store, secondBlock, CDiskBlockPos(nFile, mapped->nSize));
+    BOOST_CHECK(!CBlockStoreTestAccess::GetMappedFile(store, posFirst, false));
+    BOOST_CHECK(mapped->GetRecord(posFirst, 0, record));
+    BOOST_CHECK(!mapped->GetRecord(posSecond, 0, record));
+    BOOST_CHECK(store.SyncPendingWrites());
+    BOOST_CHECK(!CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, posSecond));
+    BOOST_CHECK(ReadTestBlock(store, blockRead, posSecond));
+    BOOST_CHECK(blockRead.GetHashPoW2() == secondBlock.GetHashPoW2());
+
+    // Finalizing again maps the file as it is now.
+    store.FinalizeBlockFile(nFile);
+    auto remapped = CBlockStoreTestAccess::GetMappedFile(store, posSecond, false);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    BOOST_CHECK(CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, posFirst));
+    BOOST_CHECK(blockRead.GetHashPoW2() == firstBlock.GetHashPoW2());
+    BOOST_CHECK(CBlockStoreTestAccess::ReadBlockFromMemory(store, blockRead, posSecond));
+    BOOST_CHECK(blockRead.GetHashPoW2() == secondBlock.GetHashPoW2());
+    BOOST_CHECK(store.ReadBlockFromDiskConcurrent(blockRead, posSecond, secondBlock.GetHashPoW2()));
+    BOOST_CHECK(!store.ReadBlockFromDiskConcurrent(blockRead, posSecond, firstBlock.GetHashPoW2()));
+
+    // Pruned files are neither mapped nor readable.
+    store.UnlinkPrunedFiles({nFile});
+    BOOST_CHECK(!CBlockStoreTestAccess::GetMappedFile(store, posFirst, false));
+    BOOST_CHECK(!store.ReadBlockFromDiskConcurrent(blockRead, posFirst, firstBlock.GetHashPoW2()));
+}
+
+/* Writes block the caller once MAX_BLOCK_WRITER_QUEUE_BYTES are queued, until the writer catches up */
+BOOST_AUTO_TEST_CASE(blockstore_writer_back_pressure)
+{
+    CBlockStore store;
+    const int nFile = nTestFileBase + 2;
+    const size_t nRecordSize = MAX_BLOCK_WRITER_QUEUE_BYTES / 2 + 1;
+
+    FILE* writerFile = CBlockStoreTestAccess::StallWriter(store, nFile, false);
+    BOOST_REQUIRE(writerFile);
+
+    // The writer takes the first record and stalls on it, its bytes stay counted until it is written.
+    BOOST_CHECK(CBlockStoreTestAccess::EnqueueRecord(store, nFile, 0, nRecordSize, 'a'));
+    BOOST_CHECK(WaitFor([&]() { return CBlockStoreTestAccess::WriterBusy(store); }));
+
+    std::atomic<bool> fSecondQueued(false);
+    std::thread writer([&]()
+    {
+        BOOST_CHECK(CBlockStoreTestAccess::EnqueueRecord(store, nFile, nRecordSize, nRecordSize, 'b'));
+        fSecondQueued = true;
+    });
+    MilliSleep(200);
+    BOOST_CHECK(!fSecondQueued);
+    BOOST_CHECK_EQUAL(CBlockStoreTestAccess::QueuedBytes(store), nRecordSize);
+
+    CBlockStoreTestAccess::ResumeWriter(writerFile);
+    writer.join();
+    BOOST_CHECK(fSecondQueued);
+    BOOST_CHECK(store.SyncPendingWrites());
+    BOOST_CHECK_EQUAL(CBlockStoreTestAccess::QueuedBytes(store), 0);
+
+    std::vector<unsigned char> data = ReadTestFile(nFile);
+    BOOST_REQUIRE_EQUAL(data.size(), 2 * nRecordSize);
+    BOOST_CHECK(std::all_of(data.begin(), data.begin() + nRecordSize, [](unsigned char ch) { return ch == 'a'; }));
+    BOOST_CHECK(std::all_of(data.begin() + nRecordSize, data.end(), [](unsigned char ch) { return ch == 'b'; }));
+}
+
+/* SyncPendingWrites waits for everything queued and syncs every file written since the previous sync once */
+BOOST_AUTO_TEST_CASE(blockstore_writer_sync)
+{
+    CBlockStore store;
+    const int nFile = nTestFileBase + 3;
+
+    std::vector<CBlock> blocks;
+    std::vector<CDiskBlockPos> positions;
+    CDiskBlockPos pos(nFile, 0);
+    for (int i = 0; i < 20; ++i)
+    {
+        blocks.push_back(BuildTestBlock(1 + i % 4));
+        positions.push_back(WriteTestBlock(store, blocks.back(), pos));
+        pos.nPos = positions.back().nPos + ::GetSerializeSize(blocks.back(), SER_DISK, CLIENT_VERSION);
+    }
+    CDiskBlockPos posUndo(nFile, 0);
+    BOOST_CHECK(store.UndoWriteToDisk(BuildTestUndo(2), posUndo, InsecureRand256(), Params().MessageStart()));
+
+    BOOST_CHECK(store.SyncPendingWrites());
+    BOOST_CHECK_EQUAL(CBlockStoreTestAccess::QueuedBytes(store), 0);
+    BOOST_CHECK(!CBlockStoreTestAccess::WriterBusy(store));
+    BOOST_CHECK_EQUAL(CBlockStoreTestAccess::UnsyncedFiles(store), 0);
+    BOOST_CHECK_EQUAL(ReadTestFile(nFile).size(), pos.nPos);
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        BOOST_CHECK(!CBlockStoreTestAccess::HasPendingRecord(store, positions[i], false));
+        CBlock blockRead;
+        BOOST_CHECK(store.ReadBlockFromDiskConcurrent(blockRead, positions[i], blocks[i].GetHashPoW2()));
+    }
+
+    // Nothing written since, so nothing to do.
+    BOOST_CHECK(store.SyncPendingWrites());
+}
+
+/* A failed write is sticky; every following write and sync reports it, and validation aborts the node on it */
+BOOST_AUTO_TEST_CASE(blockstore_writer_failure)
+{
+    {
+        CBlockStore store;
+        const int nFile = nTestFileBase + 4;
+        // A directory where the block file should be, so the writer can't open it.
+        fs::create_directories(GetDataDir() / "blocks" / strprintf("blk%05u.dat", nFile));
+
+        // The failure only shows once the writer got to the record.
+        BOOST_CHECK(CBlockStoreTestAccess::EnqueueRecord(store, nFile, 0, 100, 'a'));
+        BOOST_CHECK(!store.SyncPendingWrites());
+        BOOST_CHECK(!CBlockStoreTestAccess::EnqueueRecord(store, nFile, 100, 100, 'b'));
+        CDiskBlockPos pos(nFile, 200);
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(!store.WriteBlockToDisk(BuildTestBlock(1), pos, Params().MessageStart()));
+        }
+        BOOST_CHECK(!store.SyncPendingWrites());
+        BOOST_CHECK_EQUAL(CBlockStoreTestAccess::QueuedBytes(store), 0);
+    }
+
+    // Flushing the chain state first syncs the writer, a failure there aborts the node.
+    CBlockStoreTestAccess::SetWriterFailed(blockStore, true);
+    CValidationState state;
+    BOOST_CHECK(!FlushStateToDisk(Params(), state, FLUSH_STATE_ALWAYS));
+    BOOST_CHECK(state.IsError());
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "Failed to write to block file");
+    CBlockStoreTestAccess::SetWriterFailed(blockStore, false);
+    SetMiscWarning("");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
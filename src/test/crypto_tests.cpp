@@ -10,6 +10,7 @@
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/scrypt/crypto_scrypt.h"
+#include "crypto/hash/sigma/sigma.h"
 #include "random.h"
 #include "util/strencodings.h"
 #include "test/test.h"
@@ -627,4 +628,142 @@ BOOST_AUTO_TEST_CASE(countbits_tests)
     }
 }
 
+// The scalar (reference) fast hash of data1|data2|data3, which the multi-buffer implementations have to reproduce for every lane.
+static uint256 ScalarFastHash(uint64_t nAlg, const unsigned char* data1, uint64_t data1Size, const unsigned char* data2, uint64_t data2Size, const unsigned char* data3, uint64_t data3Size)
+{
+    uint256 hash;
+    if (nAlg == 0)
+    {
+        sph_echo256_context ctx_echo;
+        sph_echo256_init(&ctx_echo);
+        sph_echo256(&ctx_echo, data1, data1Size);
+        sph_echo256(&ctx_echo, data2, data2Size);
+        sph_echo256(&ctx_echo, data3, data3Size);
+        sph_echo256_close(&ctx_echo, hash.begin());
+    }
+    else
+    {
+        shavite3_ref_hashState ctx_shavite;
+        shavite3_ref_Init(&ctx_shavite);
+        shavite3_ref_Update(&ctx_shavite, data1, data1Size);
+        shavite3_ref_Update(&ctx_shavite, data2, data2Size);
+        shavite3_ref_Update(&ctx_shavite, data3, data3Size);
+        shavite3_ref_Final(&ctx_shavite, hash.begin());
+    }
+    return hash;
+}
+
+typedef void (*MultiBufferHashLanes)(const unsigned char* const* data1, uint64_t data1Size, const unsigned char* const* data2, uint64_t data2Size, const unsigned char* const* data3, uint64_t data3Size, unsigned char* const* hashes);
+
+// Every message length up to two echo blocks (192 bytes) and then some, so every padding case of both algorithms is hit, each split differently over the three parts.
+static void TestMultiBufferHashLanes(const std::string& name, uint64_t nAlg, MultiBufferHashLanes hashLanes, uint64_t numLanes)
+{
+    for (uint64_t nLength = 0; nLength <= 2 * 192 + 20; ++nLength)
+    {
+        const uint64_t data1Size = InsecureRandRange(nLength + 1);
+        const uint64_t data2Size = InsecureRandRange(nLength - data1Size + 1);
+        const uint64_t data3Size = nLength - data1Size - data2Size;
+
+        std::vector<std::vector<unsigned char>> messages;
+        const unsigned char* data1[SIGMA_MAX_MULTI_LANES];
+        const unsigned char* data2[SIGMA_MAX_MULTI_LANES];
+        const unsigned char* data3[SIGMA_MAX_MULTI_LANES];
+        uint256 laneHashes[SIGMA_MAX_MULTI_LANES];
+        unsigned char* hashes[SIGMA_MAX_MULTI_LANES];
+        for (uint64_t nLane = 0; nLane < numLanes; ++nLane)
+        {
+            messages.push_back(InsecureRandBytes(nLength + 1));
+        }
+        for (uint64_t nLane = 0; nLane < numLanes; ++nLane)
+        {
+            data1[nLane] = messages[nLane].data();
+            data2[nLane] = data1[nLane] + data1Size;
+            data3[nLane] = data2[nLane] + data2Size;
+            hashes[nLane] = laneHashes[nLane].begin();
+        }
+        hashLanes(data1, data1Size, data2, data2Size, data3, data3Size, hashes);
+
+        for (uint64_t nLane = 0; nLane < numLanes; ++nLane)
+        {
+            BOOST_CHECK_MESSAGE(laneHashes[nLane] == ScalarFastHash(nAlg, data1[nLane], data1Size, data2[nLane], data2Size, data3[nLane], data3Size), strprintf("%s: length %d lane %d", name, nLength, nLane));
+        }
+    }
+}
+
+// sigmaRandomFastHashBatch with the given multi-buffer implementations selected: full and partial sets of lanes and lone leftovers, of both algorithms mixed.
+static void TestFastHashBatch(const std::string& name, MultiBufferHashLanes echoHashLanes, uint64_t numEchoLanes, MultiBufferHashLanes shaviteHashLanes, uint64_t numShaviteLanes)
+{
+    const auto savedEchoHashLanes = selected_echo256_multi_opt_HashLanes;
+    const auto savedShaviteHashLanes = selected_shavite3_256_multi_opt_HashLanes;
+    const uint64_t nSavedEchoLanes = gSelEchoMultiLanes;
+    const uint64_t nSavedShaviteLanes = gSelShaviteMultiLanes;
+    selected_echo256_multi_opt_HashLanes = echoHashLanes;
+    selected_shavite3_256_multi_opt_HashLanes = shaviteHashLanes;
+    gSelEchoMultiLanes = numEchoLanes;
+    gSelShaviteMultiLanes = numShaviteLanes;
+
+    const uint64_t data1Size = 80;
+    const uint64_t data2Size = 32;
+    const uint64_t data3Size = 47;
+    for (uint64_t numRequests : {1, 2, 3, 9, 17, 40})
+    {
+        std::vector<std::vector<unsigned char>> messages;
+        std::vector<uint256> outHashes(numRequests);
+        std::vector<sigma_fast_hash_request> requests;
+        for (uint64_t i = 0; i < numRequests; ++i)
+        {
+            messages.push_back(InsecureRandBytes(data1Size + data2Size + data3Size));
+        }
+        for (uint64_t i = 0; i < numRequests; ++i)
+        {
+            uint8_t* data = messages[i].data();
+            requests.push_back({InsecureRandBits(1), data, data + data1Size, data + data1Size + data2Size, &outHashes[i]});
+        }
+        sigmaRandomFastHashBatch(requests.data(), numRequests, data1Size, data2Size, data3Size);
+
+        for (const sigma_fast_hash_request& request : requests)
+        {
+            BOOST_CHECK_MESSAGE(*request.outHash == ScalarFastHash(request.nPseudoRandomAlg, request.data1, data1Size, request.data2, data2Size, request.data3, data3Size), strprintf("%s: batch of %d", name, numRequests));
+        }
+    }
+
+    selected_echo256_multi_opt_HashLanes = savedEchoHashLanes;
+    selected_shavite3_256_multi_opt_HashLanes = savedShaviteHashLanes;
+    gSelEchoMultiLanes = nSavedEchoLanes;
+    gSelShaviteMultiLanes = nSavedShaviteLanes;
+}
+
+// Every multi-buffer implementation that was compiled in and that the CPU can run.
+BOOST_AUTO_TEST_CASE(sigma_multi_buffer_fast_hash)
+{
+    #ifdef ARCH_CPU_X86_FAMILY
+    #if defined(COMPILER_HAS_AVX512BW_VAES)
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("vaes"))
+    {
+        TestMultiBufferHashLanes("echo256 avx512bw-vaes", 0, echo256_multi_opt_avx512bw_vaes_HashLanes, 8);
+        TestMultiBufferHashLanes("shavite3 avx512bw-vaes", 1, shavite3_256_multi_opt_avx512bw_vaes_HashLanes, 8);
+        TestFastHashBatch("avx512bw-vaes", echo256_multi_opt_avx512bw_vaes_HashLanes, 8, shavite3_256_multi_opt_avx512bw_vaes_HashLanes, 8);
+    }
+    #endif
+    #if defined(COMPILER_HAS_AVX2_VAES)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("vaes"))
+    {
+        TestMultiBufferHashLanes("echo256 avx2-vaes", 0, echo256_multi_opt_avx2_vaes_HashLanes, 4);
+        TestMultiBufferHashLanes("shavite3 avx2-vaes", 1, shavite3_256_multi_opt_avx2_vaes_HashLanes, 4);
+        TestFastHashBatch("avx2-vaes", echo256_multi_opt_avx2_vaes_HashLanes, 4, shavite3_256_multi_opt_avx2_vaes_HashLanes, 4);
+    }
+    #endif
+    #if defined(COMPILER_HAS_AVX2) && defined(COMPILER_HAS_AES)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("aes"))
+    {
+        TestMultiBufferHashLanes("shavite3 avx2-aes", 1, shavite3_256_multi_opt_avx2_aes_HashLanes, 2);
+        TestFastHashBatch("avx2-aes", nullptr, 1, shavite3_256_multi_opt_avx2_aes_HashLanes, 2);
+    }
+    #endif
+    #endif
+
+    // And the scalar fallback when there is no multi-buffer implementation at all.
+    TestFastHashBatch("none", nullptr, 1, nullptr, 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
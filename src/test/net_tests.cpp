@@ -10,9 +10,14 @@
 #include "streams.h"
 #include "net.h"
 #include "netbase.h"
+#include "scheduler.h"
 #include "chainparams.h"
 #include "util.h"
 
+#include <deque>
+#include <list>
+#include <thread>
+
 class CAddrManSerializationMock : public CAddrMan
 {
 public:
@@ -184,4 +189,440 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+// A node connected over loopback to a plain socket standing in for the remote peer.
+static std::unique_ptr<CNode> NewLoopbackNode(NodeId id, socket_t& peer)
+{
+    boost::asio::ip::tcp::acceptor acceptor(get_io_context(), boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    socket_t hSocket(get_io_context());
+    hSocket.connect(acceptor.local_endpoint());
+    acceptor.accept(peer);
+
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = htonl(INADDR_LOOPBACK);
+    CAddress addr = CAddress(CService(ipv4Addr, acceptor.local_endpoint().port()), NODE_NETWORK);
+    return std::unique_ptr<CNode>(new CNode(id, NODE_NETWORK, 0, std::move(hSocket), addr, 0, 0, CAddress(), "", false));
+}
+
+static CSerializedNetMsg TestNetMsg(const std::string& strCommand, size_t nSize, unsigned char nSeed)
+{
+    CSerializedNetMsg msg;
+    msg.command = strCommand;
+    msg.data.resize(nSize);
+    for (size_t i = 0; i < nSize; ++i)
+        msg.data[i] = (unsigned char)(nSeed + i * 7);
+    return msg;
+}
+
+// Read one message from the peer socket and check that it is the expected one.
+static void ReadTestNetMsg(socket_t& peer, const std::string& strCommand, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> header(CMessageHeader::HEADER_SIZE);
+    boost::asio::read(peer, boost::asio::buffer(header));
+    CDataStream ssHeader(SER_NETWORK, INIT_PROTO_VERSION);
+    ssHeader.write((const char*)header.data(), header.size());
+    CMessageHeader hdr(Params().MessageStart());
+    ssHeader >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), strCommand);
+    BOOST_REQUIRE_EQUAL(hdr.nMessageSize, data.size());
+
+    std::vector<unsigned char> received(hdr.nMessageSize);
+    boost::asio::read(peer, boost::asio::buffer(received));
+    BOOST_CHECK(received == data);
+    uint256 hash = Hash(received.data(), received.data() + received.size());
+    BOOST_CHECK(memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(cnode_send_gathers_queued_messages, TestingSetup)
+{
+    socket_t peer(get_io_context());
+    std::unique_ptr<CNode> pnode = NewLoopbackNode(0, peer);
+
+    // Nothing runs the io_context yet, so everything pushed queues up behind the first ResumeSend.
+    const size_t nMessages = MAX_SEND_GATHER_MESSAGES + 8;
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> sent;
+    for (size_t i = 0; i < nMessages; ++i)
+    {
+        // Every third message has no payload and only takes a buffer for its header.
+        CSerializedNetMsg msg = TestNetMsg(i % 3 ? "inv" : "verack", i % 3 ? 100 * i : 0, i);
+        sent.emplace_back(msg.command, msg.data);
+        connman->PushMessage(pnode.get(), std::move(msg));
+    }
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_CHECK_EQUAL(pnode->vSendMsg.size(), nMessages);
+        BOOST_CHECK(pnode->vSendInFlight.empty());
+        BOOST_CHECK(pnode->fResumeSendActive);
+    }
+
+    // The first ResumeSend gathers as many messages as go in a single write.
+    get_io_context().restart();
+    BOOST_REQUIRE_EQUAL(get_io_context().run_one(), 1U);
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_CHECK_EQUAL(pnode->vSendInFlight.size(), MAX_SEND_GATHER_MESSAGES);
+        BOOST_CHECK_EQUAL(pnode->vSendMsg.size(), nMessages - MAX_SEND_GATHER_MESSAGES);
+        size_t nBuffers = 0;
+        for (size_t i = 0; i < MAX_SEND_GATHER_MESSAGES; ++i)
+            nBuffers += sent[i].second.empty() ? 1 : 2;
+        BOOST_CHECK_EQUAL(pnode->vSendBuffers.size(), nBuffers);
+    }
+
+    // The rest follows with the next write, the peer gets every message whole and in order.
+    std::thread ioThread([]() { get_io_context().run(); });
+    for (const auto& [strCommand, data] : sent)
+        ReadTestNetMsg(peer, strCommand, data);
+    ioThread.join();
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_CHECK(pnode->vSendMsg.empty());
+        BOOST_CHECK(pnode->vSendInFlight.empty());
+        BOOST_CHECK(!pnode->fResumeSendActive);
+        BOOST_CHECK_EQUAL(pnode->nSendSize, 0U);
+        BOOST_CHECK_EQUAL(pnode->vSendHeaderPool.size(), MAX_SEND_GATHER_MESSAGES);
+    }
+
+    // Headers of written messages are reused, the next message is serialized straight into a pooled buffer.
+    const unsigned char* pchPooledHeader = WITH_LOCK(pnode->cs_vSend, return pnode->vSendHeaderPool.back().data());
+    CSerializedNetMsg ping = TestNetMsg("ping", 8, 1);
+    std::vector<unsigned char> pingData = ping.data;
+    connman->PushMessage(pnode.get(), std::move(ping));
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_CHECK_EQUAL(pnode->vSendHeaderPool.size(), MAX_SEND_GATHER_MESSAGES - 1);
+        BOOST_REQUIRE_EQUAL(pnode->vSendMsg.size(), 1U);
+        BOOST_CHECK(pnode->vSendMsg.back().header.data() == pchPooledHeader);
+        BOOST_CHECK_EQUAL(pnode->vSendMsg.back().header.size(), CMessageHeader::HEADER_SIZE);
+    }
+    get_io_context().restart();
+    ioThread = std::thread([]() { get_io_context().run(); });
+    ReadTestNetMsg(peer, "ping", pingData);
+    ioThread.join();
+}
+
+static void StartTestConnman(CConnman& connman, CScheduler& scheduler, int nNetThreads)
+{
+    ForceSetArg("-dnsseed", "0");
+    ForceSetArg("-connect", "0");
+    CConnman::Options options;
+    options.nMaxConnections = 8;
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    options.nNetThreads = nNetThreads;
+    std::string strError;
+    BOOST_REQUIRE(connman.Start(scheduler, strError, options));
+}
+
+// Poll until fn holds, the network threads do the actual work.
+static bool WaitFor(const std::function<bool()>& fn)
+{
+    for (int i = 0; i < 10000 && !fn(); ++i)
+        MilliSleep(1);
+    return fn();
+}
+
+// Close the socket of a loopback node on its strand and wait for the handlers of its outstanding operations to let go of it.
+static void CloseLoopbackNode(CNode& node)
+{
+    boost::asio::post(node.strand, [&node]() {
+        boost::system::error_code ec;
+        node.hSocket.close(ec);
+    });
+    BOOST_REQUIRE(WaitFor([&]() { return node.GetRefCount() == 0; }));
+}
+
+static std::vector<unsigned char> SerializeTestNetMsg(const CSerializedNetMsg& msg)
+{
+    uint256 hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<unsigned char> serialized;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serialized, 0, hdr};
+    serialized.insert(serialized.end(), msg.data.begin(), msg.data.end());
+    return serialized;
+}
+
+// Check a message the node received against the one the peer sent.
+static void CheckReceivedNetMsg(const CNetMessage& received, const CSerializedNetMsg& msg)
+{
+    BOOST_CHECK(received.complete());
+    BOOST_CHECK_EQUAL(received.hdr.GetCommand(), msg.command);
+    BOOST_REQUIRE_EQUAL(received.hdr.nMessageSize, msg.data.size());
+    BOOST_REQUIRE_EQUAL(received.vRecv.size(), msg.data.size());
+    BOOST_CHECK(msg.data.empty() || memcmp(&received.vRecv[0], msg.data.data(), msg.data.size()) == 0);
+    BOOST_CHECK(memcmp(received.GetMessageHash().begin(), received.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(connman_net_threads, TestingSetup)
+{
+    const int nNetThreads = 4;
+    StartTestConnman(*connman, *nodeScheduler, nNetThreads);
+
+    const int nNodes = 8;
+    const int nMessages = 50;
+    std::deque<socket_t> peers;
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < nNodes; ++i)
+    {
+        peers.emplace_back(get_io_context());
+        nodes.push_back(NewLoopbackNode(i, peers.back()));
+        connman->ResumeReceive(nodes.back().get());
+    }
+    auto testMsg = [](int nNode, int nMessage) { return TestNetMsg(nMessage % 2 ? "inv" : "tx", 37 * nMessage + nNode, nMessage); };
+
+    // Two threads push to interleaved nodes while the pool writes them out and the peers send in the other direction.
+    auto push = [&](int nFirst)
+    {
+        for (int m = 0; m < nMessages; ++m)
+        {
+            for (int i = nFirst; i < nNodes; i += 2)
+                connman->PushMessage(nodes[i].get(), testMsg(i, m));
+        }
+    };
+    std::thread pusher0(push, 0);
+    std::thread pusher1(push, 1);
+    uint64_t nBytesPeersSent = 0;
+    for (int i = 0; i < nNodes; ++i)
+    {
+        for (int m = 0; m < nMessages; ++m)
+        {
+            std::vector<unsigned char> serialized = SerializeTestNetMsg(testMsg(i, m));
+            boost::asio::write(peers[i], boost::asio::buffer(serialized));
+            nBytesPeersSent += serialized.size();
+        }
+    }
+    uint64_t nBytesNodesSent = 0;
+    for (int i = 0; i < nNodes; ++i)
+    {
+        for (int m = 0; m < nMessages; ++m)
+        {
+            CSerializedNetMsg msg = testMsg(i, m);
+            ReadTestNetMsg(peers[i], msg.command, msg.data);
+            nBytesNodesSent += CMessageHeader::HEADER_SIZE + msg.data.size();
+        }
+    }
+    pusher0.join();
+    pusher1.join();
+
+    // Every node got the messages of its peer, in order.
+    for (int i = 0; i < nNodes; ++i)
+    {
+        CNode& node = *nodes[i];
+        BOOST_REQUIRE(WaitFor([&]() { return WITH_LOCK(node.cs_vProcessMsg, return node.vProcessMsg.size()) == (size_t)nMessages; }));
+        LOCK(node.cs_vProcessMsg);
+        int m = 0;
+        for (const CNetMessage& received : node.vProcessMsg)
+            CheckReceivedNetMsg(received, testMsg(i, m++));
+    }
+
+    // The per thread counters add up to the totals.
+    BOOST_REQUIRE(WaitFor([&]() { return connman->GetTotalBytesSent() == nBytesNodesSent; }));
+    BOOST_CHECK_EQUAL(connman->GetTotalBytesRecv(), nBytesPeersSent);
+    std::vector<CConnman::NetThreadStats> stats = connman->GetNetThreadStats();
+    BOOST_REQUIRE_EQUAL(stats.size(), (size_t)nNetThreads);
+    uint64_t nThreadBytesSent = 0, nThreadBytesRecv = 0, nThreadSendOps = 0, nThreadRecvOps = 0;
+    for (const CConnman::NetThreadStats& threadStats : stats)
+    {
+        nThreadBytesSent += threadStats.nBytesSent;
+        nThreadBytesRecv += threadStats.nBytesRecv;
+        nThreadSendOps += threadStats.nSendOps;
+        nThreadRecvOps += threadStats.nRecvOps;
+    }
+    BOOST_CHECK_EQUAL(nThreadBytesSent, nBytesNodesSent);
+    BOOST_CHECK_EQUAL(nThreadBytesRecv, nBytesPeersSent);
+    BOOST_CHECK(nThreadSendOps > 0 && nThreadSendOps <= (uint64_t)(nNodes * nMessages));
+    BOOST_CHECK(nThreadRecvOps > 0);
+
+    for (auto& node : nodes)
+        CloseLoopbackNode(*node);
+    connman->Interrupt();
+    connman->Stop();
+}
+
+static std::unique_ptr<CNode> NewTestNode(NodeId id)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    return std::unique_ptr<CNode>(new CNode(id, NODE_NETWORK, 0, socket_t(get_io_context()), addr, 0, 0, CAddress(), "", false));
+}
+
+// Hand the node a processed message with a payload buffer of nSize bytes.
+static void RecycleTestRecvMsg(CNode& node, unsigned int nSize, bool fInData = true)
+{
+    std::list<CNetMessage> msgs;
+    msgs.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    msgs.back().in_data = fInData;
+    msgs.back().hdr.nMessageSize = nSize;
+    msgs.back().vRecv.resize(nSize);
+    node.RecycleRecvMsgs(msgs);
+    BOOST_CHECK(msgs.empty());
+}
+
+static std::vector<size_t> RecvMsgPoolSizes(CNode& node)
+{
+    LOCK(node.cs_vRecvMsgPool);
+    std::vector<size_t> sizes;
+    size_t nBytes = 0;
+    for (const auto& pool : node.vRecvMsgPool)
+    {
+        sizes.push_back(pool.size());
+        for (const CNetMessage& msg : pool)
+            nBytes += msg.vRecv.capacity();
+    }
+    BOOST_CHECK_EQUAL(node.nRecvMsgPoolBytes, nBytes);
+    return sizes;
+}
+
+static void FillRecvMsgPool(CNode& node)
+{
+    for (size_t nClass = 0; nClass < RECV_MSG_POOL_CLASSES; ++nClass)
+    {
+        for (size_t i = 0; i < RECV_MSG_POOL_CLASS_DEPTH[nClass]; ++i)
+            RecycleTestRecvMsg(node, RECV_MSG_POOL_CLASS_LIMIT[nClass]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cnode_recv_msg_pool_size_classes)
+{
+    std::unique_ptr<CNode> pnode = NewTestNode(0);
+
+    // Each message goes to the class of its payload size, messages beyond the largest class and unfinished ones aren't kept.
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[0]);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({1, 0, 0}));
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[0] + 1);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({1, 1, 0}));
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[1] + 1);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({1, 1, 1}));
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[2] + 1);
+    RecycleTestRecvMsg(*pnode, 100, false);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({1, 1, 1}));
+
+    // Each class keeps a limited number of messages.
+    for (int i = 0; i < 20; ++i)
+    {
+        RecycleTestRecvMsg(*pnode, 500);
+        RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[1]);
+        RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[2]);
+    }
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>(RECV_MSG_POOL_CLASS_DEPTH, RECV_MSG_POOL_CLASS_DEPTH + RECV_MSG_POOL_CLASSES));
+
+    // A received message takes a pooled one of the class its header announces, along with its buffer.
+    for (size_t nClass = 0; nClass < RECV_MSG_POOL_CLASSES; ++nClass)
+    {
+        std::vector<unsigned char> serialized = SerializeTestNetMsg(TestNetMsg("tx", RECV_MSG_POOL_CLASS_LIMIT[nClass] - 10, nClass));
+        std::vector<size_t> sizes = RecvMsgPoolSizes(*pnode);
+        bool fComplete;
+        BOOST_CHECK(pnode->ReceiveMsgBytes((const char*)serialized.data(), serialized.size(), fComplete));
+        BOOST_CHECK(fComplete);
+        --sizes[nClass];
+        BOOST_CHECK(RecvMsgPoolSizes(*pnode) == sizes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cnode_recv_msg_pool_shared_budget)
+{
+    const size_t nFullPoolBytes = 16 * 1000 + 4 * 64 * 1000 + 512 * 1000;
+    BOOST_REQUIRE_EQUAL(RECV_MSG_POOL_CLASS_DEPTH[0] * RECV_MSG_POOL_CLASS_LIMIT[0] + RECV_MSG_POOL_CLASS_DEPTH[1] * RECV_MSG_POOL_CLASS_LIMIT[1] + RECV_MSG_POOL_CLASS_DEPTH[2] * RECV_MSG_POOL_CLASS_LIMIT[2], nFullPoolBytes);
+
+    // Only so many nodes get to fill their pools before the budget shared by all of them runs out.
+    std::vector<std::unique_ptr<CNode>> nodes;
+    size_t nPooledBytes = 0;
+    for (size_t i = 0; i < RECV_MSG_POOL_MAX_BYTES / nFullPoolBytes + 2; ++i)
+    {
+        nodes.push_back(NewTestNode(i));
+        FillRecvMsgPool(*nodes.back());
+        RecvMsgPoolSizes(*nodes.back());
+        nPooledBytes += WITH_LOCK(nodes.back()->cs_vRecvMsgPool, return nodes.back()->nRecvMsgPoolBytes);
+    }
+    const std::vector<size_t> fullPoolSizes(RECV_MSG_POOL_CLASS_DEPTH, RECV_MSG_POOL_CLASS_DEPTH + RECV_MSG_POOL_CLASSES);
+    BOOST_CHECK(nPooledBytes <= RECV_MSG_POOL_MAX_BYTES);
+    BOOST_CHECK(nPooledBytes > RECV_MSG_POOL_MAX_BYTES - nFullPoolBytes);
+    BOOST_CHECK(RecvMsgPoolSizes(*nodes.front()) == fullPoolSizes);
+    BOOST_CHECK(RecvMsgPoolSizes(*nodes.back())[RECV_MSG_POOL_CLASSES - 1] == 0);
+
+    // A node that goes away gives its bytes back to the others.
+    nodes.front().reset();
+    FillRecvMsgPool(*nodes.back());
+    BOOST_CHECK(RecvMsgPoolSizes(*nodes.back()) == fullPoolSizes);
+
+    // So does a node taking a message out of its pool, which then goes to whoever recycles one next.
+    std::unique_ptr<CNode> pnode = NewTestNode(nodes.size());
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[1]);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({0, 0, 0}));
+    std::vector<unsigned char> serialized = SerializeTestNetMsg(TestNetMsg("inv", RECV_MSG_POOL_CLASS_LIMIT[1], 0));
+    bool fComplete;
+    BOOST_CHECK(nodes[1]->ReceiveMsgBytes((const char*)serialized.data(), serialized.size(), fComplete));
+    BOOST_CHECK_EQUAL(RecvMsgPoolSizes(*nodes[1])[1], RECV_MSG_POOL_CLASS_DEPTH[1] - 1);
+    RecycleTestRecvMsg(*pnode, RECV_MSG_POOL_CLASS_LIMIT[1]);
+    BOOST_CHECK(RecvMsgPoolSizes(*pnode) == std::vector<size_t>({0, 1, 0}));
+}
+
+// Messages the peer sends in pieces that split headers and payloads, with large payloads read straight into the message and
+// their tails as well as small messages going through the receive buffer, have to arrive exactly as sent.
+BOOST_FIXTURE_TEST_CASE(cnode_receive_split_messages, TestingSetup)
+{
+    StartTestConnman(*connman, *nodeScheduler, 2);
+    socket_t peer(get_io_context());
+    std::unique_ptr<CNode> pnode = NewLoopbackNode(0, peer);
+    connman->ResumeReceive(pnode.get());
+
+    const std::vector<size_t> sizes = {8, 0, 2000, 100 * 1000, 70 * 1000, 600 * 1000, RECV_IN_PLACE_MIN_BYTES, 37};
+    auto testMsg = [&](size_t i) { return TestNetMsg(i % 2 ? "inv" : "tx", sizes[i], i); };
+    uint64_t nBytesSent = 0;
+    auto send = [&](const unsigned char* pch, size_t nBytes)
+    {
+        boost::asio::write(peer, boost::asio::buffer(pch, nBytes));
+        nBytesSent += nBytes;
+    };
+    auto checkReceived = [&]()
+    {
+        BOOST_REQUIRE(WaitFor([&]() { return WITH_LOCK(pnode->cs_vProcessMsg, return pnode->vProcessMsg.size()) == sizes.size(); }));
+        std::list<CNetMessage> msgs;
+        {
+            LOCK(pnode->cs_vProcessMsg);
+            msgs.swap(pnode->vProcessMsg);
+            pnode->nProcessQueueSize = 0;
+        }
+        size_t i = 0;
+        for (const CNetMessage& received : msgs)
+            CheckReceivedNetMsg(received, testMsg(i++));
+        pnode->RecycleRecvMsgs(msgs);
+    };
+
+    // Each piece is written once the node took in the previous one, so a read never spans two of them: every header arrives in
+    // two reads, large payloads are read in place up to their last few KB which, like small payloads, go through the receive buffer.
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        std::vector<unsigned char> serialized = SerializeTestNetMsg(testMsg(i));
+        std::vector<size_t> pieces = {1, CMessageHeader::HEADER_SIZE - 1, std::min<size_t>(1000, sizes[i]), sizes[i] - std::min<size_t>(1000, sizes[i])};
+        size_t nPos = 0;
+        for (size_t nPiece : pieces)
+        {
+            if (nPiece == 0)
+                continue;
+            send(serialized.data() + nPos, nPiece);
+            nPos += nPiece;
+            BOOST_REQUIRE(WaitFor([&]() { return WITH_LOCK(pnode->cs_vRecv, return pnode->nRecvBytes) == nBytesSent; }));
+        }
+    }
+    checkReceived();
+    std::vector<size_t> poolSizes = RecvMsgPoolSizes(*pnode);
+    BOOST_CHECK(poolSizes[0] > 0 && poolSizes[1] > 0 && poolSizes[2] > 0);
+
+    // The same messages in one go, several to a read and landing in the pooled messages of the first round.
+    std::vector<unsigned char> stream;
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        std::vector<unsigned char> serialized = SerializeTestNetMsg(testMsg(i));
+        stream.insert(stream.end(), serialized.begin(), serialized.end());
+    }
+    send(stream.data(), stream.size());
+    checkReceived();
+
+    CloseLoopbackNode(*pnode);
+    connman->Interrupt();
+    connman->Stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -184,4 +184,63 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_legacy_hash_cache)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0fffff;
+    header.nNonce = InsecureRand32();
+    header.nVersionPoW2Witness = 4;
+    header.nTimePoW2Witness = header.nTime + 60;
+    header.hashMerkleRootPoW2Witness = InsecureRand256();
+    header.witnessHeaderPoW2Sig = InsecureRandBytes(65);
+
+    uint256 hashParentA = InsecureRand256();
+    uint256 hashParentB = InsecureRand256();
+    uint256 hashBlock = InsecureRand256();
+    CBlockIndex parentA, parentB;
+    parentA.phashBlock = &hashParentA;
+    parentB.phashBlock = &hashParentB;
+
+    // The witness block's legacy hash is computed once and then served from the cache.
+    CBlockIndex index(header);
+    index.phashBlock = &hashBlock;
+    index.SetPrev(&parentA);
+    header.hashPrevBlock = hashParentA;
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+
+    // Relinking an existing entry (PromoteBlockIndex linking a partial tree entry, LoadBlockIndexDB unlinking the start of the
+    // partial chain) recomputes it.
+    index.SetPrev(&parentB);
+    header.hashPrevBlock = hashParentB;
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+    index.SetPrev(nullptr);
+    header.hashPrevBlock.SetNull();
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+
+    // So does taking over the fields of the real header, as PromoteBlockIndex does for entries built from a checkpoint.
+    index.SetPrev(&parentA);
+    header.hashPrevBlock = hashParentA;
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+    ++header.nNonce;
+    header.hashMerkleRoot = InsecureRand256();
+    index.SetHeader(header);
+    BOOST_CHECK(index.GetBlockHashLegacy() == header.GetHashLegacy());
+
+    // Copies (clone chains) start out with the cached hash of their original, which still holds for them.
+    CBlockIndex copy(index);
+    BOOST_CHECK(copy.GetBlockHashLegacy() == header.GetHashLegacy());
+    copy.SetPrev(&parentB);
+    BOOST_CHECK(copy.GetBlockHashLegacy() != index.GetBlockHashLegacy());
+
+    // Blocks without a witness header use their index hash.
+    CBlockIndex powIndex;
+    powIndex.phashBlock = &hashBlock;
+    powIndex.SetPrev(&parentA);
+    BOOST_CHECK(powIndex.GetBlockHashLegacy() == hashBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
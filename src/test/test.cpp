@@ -86,6 +86,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
 
         ppow2witdbview = new CWitViewDB(1 << 20);
         ppow2witTip = std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(ppow2witdbview));
+        pow2WitnessCoinIndex.Invalidate();
         
         nodeScheduler = new CScheduler();
         nodeScheduler->m_service_thread = std::thread(&util::TraceThread, "scheduler", std::function<void()>([&] { nodeScheduler->serviceQueue(); }));
@@ -122,6 +123,7 @@ TestingSetup::~TestingSetup()
         delete nodeScheduler;
         
         ppow2witTip = nullptr;
+        pow2WitnessCoinIndex.Invalidate();
         delete ppow2witdbview;
 
         delete pcoinsTip;
@@ -0,0 +1,158 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "txdb.h"
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "crypto/hash/sigma/sigma.h"
+#include "pow/pow.h"
+#include "validation/validation.h"
+#include "test/test.h"
+
+#include <map>
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, BasicTestingSetup)
+
+typedef std::map<uint256, std::unique_ptr<CBlockIndex>> TestBlockIndexMap;
+
+static CBlockIndex* InsertTestBlockIndex(TestBlockIndexMap& blockIndex, const uint256& hash)
+{
+    if (hash.IsNull())
+        return nullptr;
+    auto& pindex = blockIndex[hash];
+    if (!pindex)
+    {
+        pindex.reset(new CBlockIndex());
+        pindex->phashBlock = &blockIndex.find(hash)->first;
+    }
+    return pindex.get();
+}
+
+static void CheckLoadedBlockIndex(const TestBlockIndexMap& expected, const TestBlockIndexMap& loaded)
+{
+    BOOST_REQUIRE_EQUAL(loaded.size(), expected.size());
+    for (const auto& [hash, pindexExpected] : expected)
+    {
+        auto it = loaded.find(hash);
+        BOOST_REQUIRE(it != loaded.end());
+        const CBlockIndex* pindex = it->second.get();
+        BOOST_CHECK_EQUAL((pindex->pprev ? pindex->pprev->GetBlockHashPoW2() : uint256()).ToString(), (pindexExpected->pprev ? pindexExpected->pprev->GetBlockHashPoW2() : uint256()).ToString());
+        BOOST_CHECK_EQUAL(pindex->nHeight, pindexExpected->nHeight);
+        BOOST_CHECK_EQUAL(pindex->nStatus, pindexExpected->nStatus);
+        BOOST_CHECK_EQUAL(pindex->nTx, pindexExpected->nTx);
+        BOOST_CHECK_EQUAL(pindex->nFile, pindexExpected->nFile);
+        BOOST_CHECK_EQUAL(pindex->nDataPos, pindexExpected->nDataPos);
+        BOOST_CHECK_EQUAL(pindex->nVersion, pindexExpected->nVersion);
+        BOOST_CHECK_EQUAL(pindex->hashMerkleRoot.ToString(), pindexExpected->hashMerkleRoot.ToString());
+        BOOST_CHECK_EQUAL(pindex->nTime, pindexExpected->nTime);
+        BOOST_CHECK_EQUAL(pindex->nBits, pindexExpected->nBits);
+        BOOST_CHECK_EQUAL(pindex->nNonce, pindexExpected->nNonce);
+    }
+}
+
+// Loading the block index over several threads has to give exactly what the serial load gives, including the links between entries.
+BOOST_AUTO_TEST_CASE(blockindex_load_threads)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+
+    // A main chain with a few short forks off it, so some entries are linked to parents that sort into other ranges.
+    TestBlockIndexMap expected;
+    std::vector<const CBlockIndex*> vWrite;
+    std::vector<CBlockIndex*> vMain;
+    for (int i = 0; i < 2000; ++i)
+    {
+        CBlockIndex* pprev = vMain.empty() ? nullptr : vMain[(i % 10 == 9) ? InsecureRandRange(vMain.size()) : vMain.size() - 1];
+
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = pprev ? pprev->GetBlockHashPoW2() : uint256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1500000000 + i;
+        header.nBits = 0x207fffff;
+        header.nNonce = i;
+
+        std::unique_ptr<CBlockIndex> pindex(new CBlockIndex(header));
+        pindex->pprev = pprev;
+        pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        pindex->nStatus = BLOCK_VALID_TREE | BLOCK_HAVE_DATA;
+        pindex->nTx = 1 + i % 7;
+        pindex->nFile = i / 500;
+        pindex->nDataPos = 8 + i * 250;
+        auto it = expected.emplace(header.GetHashPoW2(), std::move(pindex)).first;
+        it->second->phashBlock = &it->first;
+        if (i % 10 != 9)
+            vMain.push_back(it->second.get());
+        vWrite.push_back(it->second.get());
+    }
+    BOOST_REQUIRE(blocktree.UpdateBatchSync({}, 0, vWrite, {}));
+
+    for (int nThreads : {1, 2, 4, MAX_BLOCK_INDEX_LOAD_THREADS})
+    {
+        TestBlockIndexMap loaded;
+        BOOST_CHECK(blocktree.LoadBlockIndexGuts([&](const uint256& hash) { return InsertTestBlockIndex(loaded, hash); }, nThreads));
+        CheckLoadedBlockIndex(expected, loaded);
+    }
+}
+
+// A header from before SIGMA activation, so that checking it is a full (and quick) verification, that passes or fails the PoW check as asked.
+static CBlock FindLegacyPoWHeader(bool fValid)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.hashMerkleRoot = InsecureRand256();
+    block.nTime = defaultSigmaSettings.activationDate - 86400;
+    block.nBits = UintToArith256(Params().GetConsensus().powLimit).GetCompact();
+    block.nNonce = InsecureRand32();
+    while (CheckProofOfWork(&block, Params().GetConsensus()) != fValid)
+        ++block.nNonce;
+    return block;
+}
+
+BOOST_FIXTURE_TEST_CASE(powcache_db, TestingSetup)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    ppowcachedb = new CPoWCacheDB(1 << 20);
+
+    // Headers that pass a full check are recorded, ones that fail are not.
+    // Past the header check CheckBlock stops at the (empty) block size, so the reject reason tells which check failed.
+    CBlock valid = FindLegacyPoWHeader(true);
+    CBlock invalid = FindLegacyPoWHeader(false);
+    BOOST_CHECK(!ppowcachedb->HaveVerifiedPoW(valid.GetHashLegacy()));
+    CValidationState state;
+    BOOST_CHECK(!CheckBlock(valid, state, params, true, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-length");
+    BOOST_CHECK(ppowcachedb->HaveVerifiedPoW(valid.GetHashLegacy()));
+    state = CValidationState();
+    BOOST_CHECK(!CheckBlock(invalid, state, params, true, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK(!ppowcachedb->HaveVerifiedPoW(invalid.GetHashLegacy()));
+
+    // The index survives a restart.
+    delete ppowcachedb;
+    ppowcachedb = new CPoWCacheDB(1 << 20);
+    BOOST_CHECK(ppowcachedb->HaveVerifiedPoW(valid.GetHashLegacy()));
+    BOOST_CHECK(!ppowcachedb->HaveVerifiedPoW(invalid.GetHashLegacy()));
+
+    // A header found in the index is not checked again; recording one that would fail shows the index is what accepts it.
+    CBlock recorded = FindLegacyPoWHeader(false);
+    BOOST_CHECK(ppowcachedb->WriteVerifiedPoW(recorded.GetHashLegacy()));
+    state = CValidationState();
+    BOOST_CHECK(!CheckBlock(recorded, state, params, true, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-length");
+
+    // Only an explicit wipe clears it.
+    delete ppowcachedb;
+    ppowcachedb = new CPoWCacheDB(1 << 20, false, true);
+    BOOST_CHECK(!ppowcachedb->HaveVerifiedPoW(valid.GetHashLegacy()));
+
+    delete ppowcachedb;
+    ppowcachedb = nullptr;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,13 @@
 #include "util/moneystr.h"
 #include "test/test.h"
 
+#ifdef ENABLE_WALLET
+#include "script/ismine.h"
+#include "unity/unity_history.h"
+#include "wallet/wallet.h"
+#endif
+
+#include <limits>
 #include <stdint.h>
 #include <vector>
 
@@ -71,6 +78,147 @@ BOOST_AUTO_TEST_CASE(unity_android_wallet_import)
 #endif
 #endif
 
+#ifdef ENABLE_WALLET
+static bool AnyOutputsAreMine(const CWalletTx& wtx, const std::vector<CAccount*>& forAccounts)
+{
+    for (const CTxOut& txout : wtx.tx->vout)
+    {
+        for (const CAccount* account : forAccounts)
+        {
+            if (::IsMine(*account, txout) != ISMINE_NO)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Stand ins for the unity record builders: a record for every transaction paying the account or its children, and a number of
+// mutations that varies per transaction so that pages also start and end in the middle of a transaction.
+static CUnityHistoryIndex::RecordBuilders TestRecordBuilders(CWallet& wallet)
+{
+    CUnityHistoryIndex::RecordBuilders builders;
+    builders.getAccountsForAccount = [&wallet](CAccount* forAccount)
+    {
+        std::vector<CAccount*> forAccounts(1, forAccount);
+        for (const auto& [accountUUID, account] : wallet.mapAccounts)
+        {
+            (unused) accountUUID;
+            if (account->getParentUUID() == forAccount->getUUID())
+                forAccounts.push_back(account);
+        }
+        return forAccounts;
+    };
+    builders.getStatusForTransaction = [](const CWalletTx* wtx)
+    {
+        return wtx->GetDepthInMainChain() > 0 ? TransactionStatus::CONFIRMED : TransactionStatus::UNCONFIRMED;
+    };
+    builders.calculateTransactionRecord = [](const CWalletTx& wtx, std::vector<CAccount*>& forAccounts, bool& anyInputsOrOutputsAreMine)
+    {
+        anyInputsOrOutputsAreMine = AnyOutputsAreMine(wtx, forAccounts);
+        return TransactionRecord(wtx.GetHash().ToString(), wtx.nTimeSmart, 0, 0, TransactionStatus::UNCONFIRMED, wtx.nHeight, wtx.nBlockTime, 0, {}, {});
+    };
+    builders.addMutationsForTransaction = [getAccounts = builders.getAccountsForAccount](const CWalletTx* wtx, std::vector<MutationRecord>& mutations, CAccount* forAccount)
+    {
+        if (!AnyOutputsAreMine(*wtx, getAccounts(forAccount)))
+            return;
+        for (uint64_t i = 0; i <= wtx->GetHash().GetUint64(0) % 3; ++i)
+            mutations.emplace_back(i, wtx->nTimeSmart, wtx->GetHash().ToString(), "", TransactionStatus::UNCONFIRMED, 0);
+    };
+    return builders;
+}
+
+template <typename Record>
+static std::vector<std::string> RecordHashes(const std::vector<Record>& records)
+{
+    std::vector<std::string> hashes;
+    for (const Record& record : records)
+        hashes.push_back(record.txHash);
+    return hashes;
+}
+
+template <typename Record>
+static std::vector<std::string> PageHashes(const std::vector<Record>& records, size_t nOffset, size_t nCount)
+{
+    std::vector<std::string> hashes = RecordHashes(records);
+    hashes.erase(hashes.begin(), hashes.begin() + std::min(nOffset, hashes.size()));
+    hashes.resize(std::min(nCount, hashes.size()));
+    return hashes;
+}
+
+// Every page served from a warm cache has to match the same slice of the history built from scratch.
+static void CheckHistoryPages(CUnityHistoryIndex& index, CWallet& wallet, CAccount* forAccount)
+{
+    const size_t nAll = std::numeric_limits<size_t>::max();
+    CUnityHistoryIndex freshIndex(TestRecordBuilders(wallet));
+    std::vector<TransactionRecord> transactions = freshIndex.GetTransactionHistory(&wallet, forAccount, 0, nAll);
+    std::vector<MutationRecord> mutations = freshIndex.GetMutationHistory(&wallet, forAccount, 0, nAll);
+    BOOST_REQUIRE(!transactions.empty());
+    BOOST_REQUIRE(mutations.size() > transactions.size());
+    for (size_t i = 1; i < transactions.size(); ++i)
+        BOOST_CHECK(transactions[i - 1].timeStamp >= transactions[i].timeStamp);
+
+    for (size_t nOffset : {size_t(0), size_t(1), size_t(10), size_t(55), transactions.size() - 1, transactions.size(), mutations.size() - 1, mutations.size() + 50})
+    {
+        for (size_t nCount : {size_t(0), size_t(1), size_t(7), size_t(1000)})
+        {
+            BOOST_CHECK(RecordHashes(index.GetTransactionHistory(&wallet, forAccount, nOffset, nCount)) == PageHashes(transactions, nOffset, nCount));
+            BOOST_CHECK(RecordHashes(index.GetMutationHistory(&wallet, forAccount, nOffset, nCount)) == PageHashes(mutations, nOffset, nCount));
+        }
+    }
+    BOOST_CHECK(RecordHashes(index.GetTransactionHistory(&wallet, forAccount, 0, nAll)) == RecordHashes(transactions));
+    BOOST_CHECK(RecordHashes(index.GetMutationHistory(&wallet, forAccount, 0, nAll)) == RecordHashes(mutations));
+}
 
+BOOST_FIXTURE_TEST_CASE(unity_history_paging_and_invalidation, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+    CKey childKey;
+    childKey.MakeNewKey(true);
+    CScript childScriptPubKey = GetScriptForRawPubKey(childKey.GetPubKey());
+    std::shared_ptr<CReserveKeyOrScript> childScript = std::make_shared<CReserveKeyOrScript>(childScriptPubKey);
+
+    CWallet wallet;
+    CAccount* account;
+    CAccount* holderAccount;
+    {
+        LOCK(wallet.cs_wallet);
+        account = wallet.GenerateNewLegacyAccount("My account");
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey(), *account, KEYCHAIN_EXTERNAL);
+        holderAccount = wallet.GenerateNewLegacyAccount("Holder account");
+        wallet.AddKeyPubKey(childKey, childKey.GetPubKey(), *holderAccount, KEYCHAIN_EXTERNAL);
+    }
+    CreateAndProcessBlock({}, childScript);
+    CreateAndProcessBlock({}, childScript);
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+
+    LOCK(wallet.cs_wallet);
+    CUnityHistoryIndex index(TestRecordBuilders(wallet));
+    const size_t nAccountTransactions = index.GetTransactionHistory(&wallet, account, 0, std::numeric_limits<size_t>::max()).size();
+    BOOST_CHECK_EQUAL(nAccountTransactions, coinbaseTxns.size());
+    CheckHistoryPages(index, wallet, account);
+    CheckHistoryPages(index, wallet, holderAccount);
+
+    // A new wallet transaction is picked up from the wallet signals.
+    CreateAndProcessBlock({}, reservedScript);
+    wallet.ScanForWalletTransactions(chainActive.Tip());
+    BOOST_CHECK_EQUAL(index.GetTransactionHistory(&wallet, account, 0, std::numeric_limits<size_t>::max()).size(), nAccountTransactions + 1);
+    CheckHistoryPages(index, wallet, account);
+
+    // Replace the holder of the child key by a child of the account, which leaves the number of accounts unchanged but moves
+    // the transactions paying the child key into the history of the account.
+    wallet.mapAccounts.erase(holderAccount->getUUID());
+    wallet.keyIndex.RemoveAccount(holderAccount);
+    CAccount* childAccount = new CAccount();
+    account->AddChild(childAccount);
+    wallet.addAccount(childAccount, "Child account", false);
+    wallet.AddKeyPubKey(childKey, childKey.GetPubKey(), *childAccount, KEYCHAIN_EXTERNAL);
+    BOOST_CHECK_EQUAL(index.GetTransactionHistory(&wallet, account, 0, std::numeric_limits<size_t>::max()).size(), nAccountTransactions + 3);
+    CheckHistoryPages(index, wallet, account);
+    delete holderAccount;
+}
+#endif
 
 BOOST_AUTO_TEST_SUITE_END()
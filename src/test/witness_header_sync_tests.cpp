@@ -0,0 +1,173 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "validation/witnessvalidation.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "test/test.h"
+#include "tinyformat.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witness_header_sync_tests, BasicTestingSetup)
+
+static const uint64_t nTestHeight = 200000;
+
+static CTxOut MakeWitnessOutput(CAmount nValue, uint64_t nLockFrom, uint64_t nLockUntil, unsigned char nKey)
+{
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, nKey)));
+    witnessDetails.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, nKey + 1)));
+    witnessDetails.lockFromBlock = nLockFrom;
+    witnessDetails.lockUntilBlock = nLockUntil;
+    return CTxOut(nValue, witnessDetails);
+}
+
+static CTxIn MakeInput(const COutPoint& prevOut)
+{
+    CTxIn txin;
+    txin.SetPrevOut(prevOut);
+    return txin;
+}
+
+static COutPoint TestOutPoint(int nTx, uint32_t n)
+{
+    return COutPoint(uint256S(strprintf("%064x", nTx)), n);
+}
+
+static std::map<COutPoint, Coin> MakeWitnessCoins()
+{
+    std::map<COutPoint, Coin> witnessCoins;
+    for (int i = 1; i <= 6; ++i)
+        witnessCoins[TestOutPoint(i, i % 2)] = Coin(MakeWitnessOutput(i * 10000 * COIN, i == 3 ? 0 : 1000 + i, 300000 + i, i), 1000 + i, 1, false, true);
+    return witnessCoins;
+}
+
+// Block that spends and creates witness coins both in its PoW portion and in its witness coinbase.
+static CBlock MakeWitnessBlock()
+{
+    CBlock block;
+
+    CMutableTransaction coinbase(CTransaction::CURRENT_VERSION);
+    coinbase.vin.push_back(CTxIn());
+    coinbase.vin[0].SetPrevOutNull();
+    coinbase.vout.push_back(CTxOut(COIN, CTxOutStandardKeyHash()));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    CMutableTransaction renewal(CTransaction::CURRENT_VERSION);
+    renewal.vin.push_back(MakeInput(TestOutPoint(1, 1)));
+    renewal.vout.push_back(MakeWitnessOutput(15000 * COIN, 0, 350000, 1));
+    renewal.vout.push_back(CTxOut(COIN, CTxOutStandardKeyHash()));
+    block.vtx.push_back(MakeTransactionRef(std::move(renewal)));
+
+    CMutableTransaction witnessCoinbase(CTransaction::CURRENT_VERSION);
+    witnessCoinbase.vin.push_back(CTxIn());
+    witnessCoinbase.vin[0].SetPrevOutNull();
+    witnessCoinbase.vin.push_back(MakeInput(TestOutPoint(4, 0)));
+    witnessCoinbase.vout.push_back(MakeWitnessOutput(40000 * COIN, 1004, 300004, 4));
+    block.vtx.push_back(MakeTransactionRef(std::move(witnessCoinbase)));
+
+    block.nVersionPoW2Witness = 1;
+    return block;
+}
+
+static SimplifiedWitnessUTXOSet SimplifiedSetAfter(const CBlock& block, std::map<COutPoint, Coin> witnessCoins)
+{
+    CWitnessCoinDelta delta;
+    ComputeWitnessCoinDelta(block, nTestHeight, witnessCoins, delta);
+    delta.Apply(witnessCoins);
+    return GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+}
+
+BOOST_AUTO_TEST_CASE(witness_utxo_delta_roundtrip)
+{
+    std::map<COutPoint, Coin> witnessCoins = MakeWitnessCoins();
+    CBlock block = MakeWitnessBlock();
+    CBlock blockWithoutWitness = block;
+    blockWithoutWitness.vtx.pop_back();
+    blockWithoutWitness.nVersionPoW2Witness = 0;
+
+    std::vector<unsigned char> witnessUTXODelta;
+    BOOST_REQUIRE(GenerateSimplifiedWitnessUTXODeltaForBlock(block, nTestHeight, witnessCoins, witnessUTXODelta));
+
+    const SimplifiedWitnessUTXOSet original = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+    SimplifiedWitnessUTXOSet simplifiedWitnessUTXO = original;
+    SimplifiedWitnessUTXOSet selectionSet;
+    int nWitnessActions = 0;
+    auto checkWitnessSelection = [&](const SimplifiedWitnessUTXOSet& set)
+    {
+        selectionSet = set;
+        ++nWitnessActions;
+        return true;
+    };
+    std::vector<unsigned char> undoWitnessUTXODelta;
+    BOOST_REQUIRE(ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta, checkWitnessSelection));
+
+    // The witness is selected from the set with only the PoW portion of the block applied.
+    BOOST_CHECK_EQUAL(nWitnessActions, 1);
+    BOOST_CHECK(selectionSet == SimplifiedSetAfter(blockWithoutWitness, witnessCoins));
+    BOOST_CHECK(simplifiedWitnessUTXO == SimplifiedSetAfter(block, witnessCoins));
+    BOOST_CHECK(simplifiedWitnessUTXO != original);
+
+    BOOST_REQUIRE(UndoSimplifiedWitnessUTXODelta(simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+}
+
+BOOST_AUTO_TEST_CASE(witness_utxo_delta_without_witness)
+{
+    std::map<COutPoint, Coin> witnessCoins = MakeWitnessCoins();
+    CBlock block = MakeWitnessBlock();
+    block.vtx.pop_back();
+    block.nVersionPoW2Witness = 0;
+
+    std::vector<unsigned char> witnessUTXODelta;
+    BOOST_REQUIRE(GenerateSimplifiedWitnessUTXODeltaForBlock(block, nTestHeight, witnessCoins, witnessUTXODelta));
+
+    const SimplifiedWitnessUTXOSet original = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+    std::vector<unsigned char> undoWitnessUTXODelta;
+
+    // A delta without a witness action can't be used to verify a witness with.
+    SimplifiedWitnessUTXOSet simplifiedWitnessUTXO = original;
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta, [](const SimplifiedWitnessUTXOSet&) { return true; }));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+
+    BOOST_REQUIRE(ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == SimplifiedSetAfter(block, witnessCoins));
+}
+
+BOOST_AUTO_TEST_CASE(witness_utxo_delta_invalid)
+{
+    std::map<COutPoint, Coin> witnessCoins = MakeWitnessCoins();
+    CBlock block = MakeWitnessBlock();
+    std::vector<unsigned char> witnessUTXODelta;
+    BOOST_REQUIRE(GenerateSimplifiedWitnessUTXODeltaForBlock(block, nTestHeight, witnessCoins, witnessUTXODelta));
+
+    const SimplifiedWitnessUTXOSet original = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+    SimplifiedWitnessUTXOSet simplifiedWitnessUTXO = original;
+    std::vector<unsigned char> undoWitnessUTXODelta;
+
+    // Missing, truncated or unknown format deltas, and witnesses that don't check out, all leave the set untouched.
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(std::vector<unsigned char>(), nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+
+    std::vector<unsigned char> truncatedDelta(witnessUTXODelta.begin(), witnessUTXODelta.end() - 1);
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(truncatedDelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+
+    std::vector<unsigned char> unknownFormatDelta = witnessUTXODelta;
+    ++unknownFormatDelta[0];
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(unknownFormatDelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta, [](const SimplifiedWitnessUTXOSet&) { return false; }));
+    BOOST_CHECK(simplifiedWitnessUTXO == original);
+
+    // Applying a delta twice fails as the coins it creates already exist.
+    BOOST_REQUIRE(ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    SimplifiedWitnessUTXOSet applied = simplifiedWitnessUTXO;
+    BOOST_CHECK(!ApplySimplifiedWitnessUTXODelta(witnessUTXODelta, nTestHeight, simplifiedWitnessUTXO, undoWitnessUTXODelta));
+    BOOST_CHECK(simplifiedWitnessUTXO == applied);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
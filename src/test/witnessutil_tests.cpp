@@ -0,0 +1,148 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "witnessutil.h"
+#include "amount.h"
+#include "txdb.h"
+#include "validation/validation.h"
+#include "test/test.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnessutil_tests, BasicTestingSetup)
+
+static int64_t TestRawWeight(int64_t nHeight)
+{
+    return GetPoW2RawWeightForAmount(20000 * COIN, nHeight, 365 * 576);
+}
+
+// The era must change exactly where the weight formula does, anything incrementally maintained relies on this.
+BOOST_AUTO_TEST_CASE(raw_weight_era_matches_formula)
+{
+    for (int64_t nThreshold : {gPoW2RawWeightQuantityChangeHeight, gPoW2RawWeightModifierChangeHeight})
+    {
+        BOOST_CHECK_EQUAL(GetPoW2RawWeightEra(nThreshold), GetPoW2RawWeightEra(nThreshold - 1));
+        BOOST_CHECK_EQUAL(TestRawWeight(nThreshold), TestRawWeight(nThreshold - 1));
+        BOOST_CHECK_EQUAL(GetPoW2RawWeightEra(nThreshold + 1), GetPoW2RawWeightEra(nThreshold) + 1);
+        BOOST_CHECK(TestRawWeight(nThreshold + 1) != TestRawWeight(nThreshold));
+    }
+
+    // Within an era the weight doesn't depend on the height.
+    const std::vector<std::pair<int64_t, int64_t>> eras = {
+        {1, gPoW2RawWeightQuantityChangeHeight},
+        {gPoW2RawWeightQuantityChangeHeight + 1, gPoW2RawWeightModifierChangeHeight},
+        {gPoW2RawWeightModifierChangeHeight + 1, 10 * gPoW2RawWeightModifierChangeHeight},
+    };
+    for (const auto& [nFirst, nLast] : eras)
+    {
+        BOOST_CHECK_EQUAL(GetPoW2RawWeightEra(nFirst), GetPoW2RawWeightEra(nLast));
+        BOOST_CHECK_EQUAL(TestRawWeight(nFirst), TestRawWeight(nLast));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(network_weight_series_by_hash)
+{
+    CNetworkWeightSeries series;
+    const uint256 hashA = uint256S("0a");
+    const uint256 hashB = uint256S("0b");
+    int64_t nNumWitnessAddresses = 0;
+    int64_t nTotalWeight = 0;
+
+    // Without the on disk memo only the most recently recorded block of a height is known.
+    series.Record(hashA, 10, 5, 500);
+    BOOST_CHECK(series.Lookup(hashA, 10, nNumWitnessAddresses, nTotalWeight));
+    BOOST_CHECK_EQUAL(nNumWitnessAddresses, 5);
+    BOOST_CHECK_EQUAL(nTotalWeight, 500);
+    BOOST_CHECK(!series.Lookup(hashB, 10, nNumWitnessAddresses, nTotalWeight));
+    BOOST_CHECK(!series.Lookup(hashA, 11, nNumWitnessAddresses, nTotalWeight));
+
+    // With it a block displaced by another at the same height (a reorg), or lost to a restart, is still served.
+    pwitnessweightdb = new CWitnessWeightDB(1 << 20, true);
+    series.Record(hashA, 10, 5, 500);
+    series.Record(hashB, 10, 6, 600);
+    BOOST_CHECK(series.Lookup(hashA, 10, nNumWitnessAddresses, nTotalWeight));
+    BOOST_CHECK_EQUAL(nNumWitnessAddresses, 5);
+    BOOST_CHECK_EQUAL(nTotalWeight, 500);
+    series.Clear();
+    BOOST_CHECK(series.Lookup(hashB, 10, nNumWitnessAddresses, nTotalWeight));
+    BOOST_CHECK_EQUAL(nNumWitnessAddresses, 6);
+    BOOST_CHECK_EQUAL(nTotalWeight, 600);
+    delete pwitnessweightdb;
+    pwitnessweightdb = nullptr;
+}
+
+// Any index of a block, including copies such as those of a clone chain, is served from the series.
+BOOST_AUTO_TEST_CASE(network_weight_for_index_copy)
+{
+    const uint256 hashBlock = uint256S("0c");
+    pow2NetworkWeightSeries.Record(hashBlock, 20, 7, 700);
+
+    CBlockIndex indexCopy;
+    indexCopy.phashBlock = &hashBlock;
+    indexCopy.nHeight = 20;
+    int64_t nNumWitnessAddresses = 0;
+    int64_t nTotalWeight = 0;
+    BOOST_CHECK(GetPow2NetworkWeight(&indexCopy, Params(), nNumWitnessAddresses, nTotalWeight, chainActive));
+    BOOST_CHECK_EQUAL(nNumWitnessAddresses, 7);
+    BOOST_CHECK_EQUAL(nTotalWeight, 700);
+
+    pow2NetworkWeightSeries.Clear();
+}
+
+// A range is served from the series under a single lock, blocks it holds for a different hash (a fork) are not used for chainActive.
+BOOST_AUTO_TEST_CASE(network_weight_range)
+{
+    const int nChainLength = 8;
+    std::vector<uint256> hashes(nChainLength);
+    std::vector<CBlockIndex> indexes(nChainLength);
+    for (int i = 0; i < nChainLength; ++i)
+    {
+        hashes[i] = ArithToUint256(arith_uint256(i + 1));
+        indexes[i].phashBlock = &hashes[i];
+        indexes[i].nHeight = i;
+        indexes[i].pprev = i > 0 ? &indexes[i - 1] : nullptr;
+        pow2NetworkWeightSeries.Record(hashes[i], i, i, 100 * i);
+    }
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&indexes[nChainLength - 1]);
+    }
+
+    std::vector<CNetworkWeightPoint> points;
+    BOOST_CHECK(GetPow2NetworkWeightRange(2, 5, Params(), points));
+    BOOST_REQUIRE_EQUAL(points.size(), 4U);
+    for (const auto& point : points)
+    {
+        BOOST_CHECK(point.blockHash == hashes[point.nHeight]);
+        BOOST_CHECK_EQUAL(point.nNumWitnessAddresses, (int64_t)point.nHeight);
+        BOOST_CHECK_EQUAL(point.nTotalWeight, 100 * (int64_t)point.nHeight);
+    }
+
+    // Clamped to the tip, and empty past it.
+    BOOST_CHECK(GetPow2NetworkWeightRange(6, 100, Params(), points));
+    BOOST_CHECK_EQUAL(points.size(), 2U);
+    BOOST_CHECK(!GetPow2NetworkWeightRange(nChainLength, 100, Params(), points));
+    BOOST_CHECK(points.empty());
+
+    // The in memory lookup only matches the exact block recorded for a height.
+    points.resize(2);
+    points[0].nHeight = 3;
+    points[0].blockHash = hashes[3];
+    points[1].nHeight = 4;
+    points[1].blockHash = hashes[3];
+    std::vector<bool> found;
+    pow2NetworkWeightSeries.LookupRange(points, found);
+    BOOST_REQUIRE_EQUAL(found.size(), 2U);
+    BOOST_CHECK(found[0]);
+    BOOST_CHECK_EQUAL(points[0].nTotalWeight, 300);
+    BOOST_CHECK(!found[1]);
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(nullptr);
+    }
+    pow2NetworkWeightSeries.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
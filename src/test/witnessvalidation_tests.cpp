@@ -0,0 +1,542 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "validation/witnessvalidation.h"
+#include "chain.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "test/test.h"
+#include "tinyformat.h"
+#include "validation/validation.h"
+#include "witnessutil.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(witnessvalidation_tests, BasicTestingSetup)
+
+static const int64_t nTestHeight = 200000;
+
+static CTxOut MakeWitnessOutput(CAmount nValue, unsigned char nKey)
+{
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, nKey)));
+    witnessDetails.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, nKey + 1)));
+    witnessDetails.lockFromBlock = nTestHeight - 1000;
+    witnessDetails.lockUntilBlock = nTestHeight + 100000;
+    return CTxOut(nValue, witnessDetails);
+}
+
+static COutPoint TestOutPoint(int nTx, uint32_t n)
+{
+    return COutPoint(uint256S(strprintf("%064x", nTx)), n);
+}
+
+static Coin MakeWitnessCoin(int nKey)
+{
+    return Coin(MakeWitnessOutput(nKey * 10000 * COIN, nKey), nTestHeight - 1000 + nKey, 1, false, true);
+}
+
+static bool SameWitnessCoins(const std::map<COutPoint, Coin>& a, const std::map<COutPoint, Coin>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y)
+    {
+        return x.first == y.first && x.second.out == y.second.out && x.second.nHeight == y.second.nHeight && x.second.nTxIndex == y.second.nTxIndex;
+    });
+}
+
+static bool SameRouletteColumns(const CWitnessRouletteColumns& a, const CWitnessRouletteColumns& b)
+{
+    return a.outpoint == b.outpoint && a.coinHeight == b.coinHeight && a.weight == b.weight && a.lockUntilBlock == b.lockUntilBlock && a.nPreviousHeight == b.nPreviousHeight && a.nTotalWeightRaw == b.nTotalWeightRaw;
+}
+
+// A linear chain of indexes at heights 0..count-1, along with the witness set at each height and the delta of each block.
+struct TestWitnessChain
+{
+    std::vector<uint256> hashes;
+    std::vector<std::unique_ptr<CBlockIndex>> indexes;
+    std::vector<std::map<COutPoint, Coin>> witnessCoins;
+    std::vector<std::shared_ptr<const CWitnessCoinDelta>> deltas;
+
+    TestWitnessChain(int count, CBlockIndex* pFork=nullptr, int nSalt=0)
+    {
+        hashes.resize(count);
+        int nBaseHeight = pFork ? pFork->nHeight + 1 : 0;
+        std::map<COutPoint, Coin> coins;
+        for (int i = 0; i < count; ++i)
+        {
+            hashes[i] = uint256S(strprintf("%064x", 0x1000 * (nSalt + 1) + i));
+            indexes.emplace_back(new CBlockIndex());
+            CBlockIndex* pIndex = indexes.back().get();
+            pIndex->phashBlock = &hashes[i];
+            pIndex->nHeight = nBaseHeight + i;
+            pIndex->pprev = i > 0 ? indexes[i - 1].get() : pFork;
+            pIndex->BuildSkip();
+
+            // Every block adds a coin, and every other block spends the oldest remaining one.
+            auto delta = std::make_shared<CWitnessCoinDelta>();
+            delta->nHeight = pIndex->nHeight;
+            delta->added[TestOutPoint(0x100 * (nSalt + 1) + i, 0)] = MakeWitnessCoin(i + 1);
+            if (i % 2 == 1 && !coins.empty())
+                delta->removed.insert(*coins.begin());
+            delta->Apply(coins);
+            deltas.push_back(delta);
+            witnessCoins.push_back(coins);
+        }
+    }
+
+    CWitnessStateSnapshot SnapshotAt(int nTip, int nDepth) const
+    {
+        CWitnessStateSnapshot snapshot;
+        snapshot.pTip = indexes[nTip].get();
+        snapshot.tipHash = hashes[nTip];
+        snapshot.nTipHeight = indexes[nTip]->nHeight;
+        snapshot.witnessCoins = std::make_shared<const std::map<COutPoint, Coin>>(witnessCoins[nTip]);
+        for (int i = nTip; i > nTip - nDepth; --i)
+            snapshot.recentDeltas.push_back(deltas[i]);
+        return snapshot;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(snapshot_rewind_recent_ancestors)
+{
+    TestWitnessChain chain(10);
+    CWitnessStateSnapshot snapshot = chain.SnapshotAt(9, 4);
+
+    // Rewinding step by step (as getwitnessinfo does for a range) and in one go both arrive at the set of the ancestor.
+    std::map<COutPoint, Coin> coins = *snapshot.witnessCoins;
+    int64_t nHeight = snapshot.nTipHeight;
+    for (int i = 8; i >= 5; --i)
+    {
+        BOOST_REQUIRE(snapshot.RewindWitnessCoins(coins, nHeight, chain.indexes[i].get()));
+        BOOST_CHECK_EQUAL(nHeight, i);
+        BOOST_CHECK(SameWitnessCoins(coins, chain.witnessCoins[i]));
+    }
+    coins = *snapshot.witnessCoins;
+    nHeight = snapshot.nTipHeight;
+    BOOST_REQUIRE(snapshot.RewindWitnessCoins(coins, nHeight, chain.indexes[5].get()));
+    BOOST_CHECK(SameWitnessCoins(coins, chain.witnessCoins[5]));
+
+    // Beyond the retained deltas, or back up towards the tip, the set is left untouched.
+    BOOST_CHECK(!snapshot.RewindWitnessCoins(coins, nHeight, chain.indexes[4].get()));
+    BOOST_CHECK(!snapshot.RewindWitnessCoins(coins, nHeight, chain.indexes[7].get()));
+    BOOST_CHECK_EQUAL(nHeight, 5);
+    BOOST_CHECK(SameWitnessCoins(coins, chain.witnessCoins[5]));
+
+    // As is the case for blocks that aren't ancestors of the tip.
+    TestWitnessChain fork(3, chain.indexes[5].get(), 1);
+    coins = *snapshot.witnessCoins;
+    nHeight = snapshot.nTipHeight;
+    BOOST_CHECK(!snapshot.RewindWitnessCoins(coins, nHeight, fork.indexes[1].get()));
+    BOOST_CHECK_EQUAL(nHeight, 9);
+    BOOST_CHECK(SameWitnessCoins(coins, chain.witnessCoins[9]));
+}
+
+BOOST_AUTO_TEST_CASE(witness_info_from_witness_coins)
+{
+    std::map<COutPoint, Coin> previousWitnessCoins;
+    for (int i = 1; i <= 5; ++i)
+        previousWitnessCoins[TestOutPoint(i, 0)] = MakeWitnessCoin(i);
+
+    CBlock block;
+    CMutableTransaction coinbase(CTransaction::CURRENT_VERSION);
+    coinbase.vin.push_back(CTxIn());
+    coinbase.vin[0].SetPrevOutNull();
+    coinbase.vout.push_back(CTxOut(COIN, CTxOutStandardKeyHash()));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    CMutableTransaction renewal(CTransaction::CURRENT_VERSION);
+    renewal.vin.push_back(CTxIn());
+    renewal.vin[0].SetPrevOut(TestOutPoint(2, 0));
+    renewal.vout.push_back(MakeWitnessOutput(25000 * COIN, 2));
+    block.vtx.push_back(MakeTransactionRef(std::move(renewal)));
+
+    CMutableTransaction witnessCoinbase(CTransaction::CURRENT_VERSION);
+    witnessCoinbase.vin.push_back(CTxIn());
+    witnessCoinbase.vin[0].SetPrevOutNull();
+    witnessCoinbase.vin.push_back(CTxIn());
+    witnessCoinbase.vin[1].SetPrevOut(TestOutPoint(4, 0));
+    witnessCoinbase.vout.push_back(MakeWitnessOutput(40000 * COIN, 4));
+    block.vtx.push_back(MakeTransactionRef(std::move(witnessCoinbase)));
+    block.nVersionPoW2Witness = 1;
+
+    CGetWitnessInfo witnessInfo;
+    GetWitnessInfoFromWitnessCoins(previousWitnessCoins, nTestHeight - 1, block, witnessInfo, nTestHeight);
+
+    // Only the PoW portion of the block counts, the witness coinbase is what the selection is for.
+    CBlock powBlock = block;
+    powBlock.vtx.pop_back();
+    CWitnessCoinDelta delta;
+    std::map<COutPoint, Coin> expectedWitnessCoins = previousWitnessCoins;
+    ComputeWitnessCoinDelta(powBlock, nTestHeight, previousWitnessCoins, delta);
+    delta.Apply(expectedWitnessCoins);
+    BOOST_CHECK(SameWitnessCoins(witnessInfo.allWitnessCoins, expectedWitnessCoins));
+    BOOST_CHECK(witnessInfo.allWitnessCoins.count(TestOutPoint(4, 0)));
+    BOOST_CHECK(!witnessInfo.allWitnessCoins.count(TestOutPoint(2, 0)));
+
+    BOOST_CHECK_EQUAL(witnessInfo.witnessSelectionPoolUnfiltered.size(), expectedWitnessCoins.size());
+    uint64_t nTotalWeight = 0;
+    for (const auto& item : witnessInfo.witnessSelectionPoolUnfiltered)
+        nTotalWeight += item.nWeight;
+    BOOST_CHECK_EQUAL(witnessInfo.nTotalWeightRaw, nTotalWeight);
+}
+
+// Reference for the witness coin index, the witness set as the clone chain path obtains it.
+// i.e. by connecting each block on the way to the tip into a coins view with a chained witness view.
+static std::map<COutPoint, Coin> ReplayWitnessCoins(const std::vector<std::pair<const CBlock*, uint32_t>>& blocks)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache viewBase(&viewDummy);
+    viewBase.SetSiblingView(std::make_shared<CCoinsViewCache>(&viewDummy));
+    CCoinsViewCache view(&viewBase);
+    for (const auto& [pBlock, nHeight] : blocks)
+    {
+        for (unsigned int txIndex = 0; txIndex < pBlock->vtx.size(); ++txIndex)
+            UpdateCoins(*pBlock->vtx[txIndex], view, nHeight, txIndex);
+    }
+    std::map<COutPoint, Coin> witnessCoins;
+    view.pChainedWitView->GetAllCoins(witnessCoins);
+    return witnessCoins;
+}
+
+static CTxOut MakeWitnessOutputLockedAt(CAmount nValue, unsigned char nKey, uint64_t nLockFrom, uint64_t nLockUntil)
+{
+    CTxOut out = MakeWitnessOutput(nValue, nKey);
+    out.output.witnessDetails.lockFromBlock = nLockFrom;
+    out.output.witnessDetails.lockUntilBlock = nLockUntil;
+    return out;
+}
+
+// Synthetic block at nHeight with a unique coinbase, the given transactions and (optionally) a witness coinbase that renews 'witnessInput'.
+static CBlock MakeIndexTestBlock(uint32_t nHeight, std::vector<CMutableTransaction> txns, const COutPoint* witnessInput=nullptr, const CTxOut* witnessOutput=nullptr)
+{
+    CBlock block;
+    CMutableTransaction coinbase(CTransaction::CURRENT_VERSION);
+    coinbase.vin.push_back(CTxIn());
+    coinbase.vin[0].SetPrevOutNull();
+    coinbase.vout.push_back(CTxOut(nHeight * COIN, CTxOutStandardKeyHash()));
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    for (auto& tx : txns)
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    if (witnessInput)
+    {
+        CMutableTransaction witnessCoinbase(CTransaction::CURRENT_VERSION);
+        witnessCoinbase.vin.push_back(CTxIn());
+        witnessCoinbase.vin[0].SetPrevOutNull();
+        witnessCoinbase.vin.push_back(CTxIn());
+        witnessCoinbase.vin[1].SetPrevOut(*witnessInput);
+        witnessCoinbase.vout.push_back(*witnessOutput);
+        block.vtx.push_back(MakeTransactionRef(std::move(witnessCoinbase)));
+        block.nVersionPoW2Witness = 1;
+    }
+    return block;
+}
+
+static CMutableTransaction MakeIndexTestTransaction(const std::vector<COutPoint>& inputs, const std::vector<CTxOut>& outputs)
+{
+    CMutableTransaction tx(CTransaction::CURRENT_VERSION);
+    for (const auto& input : inputs)
+    {
+        tx.vin.push_back(CTxIn());
+        tx.vin.back().SetPrevOut(input);
+    }
+    tx.vout = outputs;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(witness_coin_index_matches_replay, TestingSetup)
+{
+    LOCK(cs_main);
+
+    // The index only publishes witness sets from phase 2 on, so the synthetic chain is placed past it; its base stands in for the genesis tip the index is synced to.
+    BOOST_REQUIRE(GetWitnessStateSnapshot(false));
+    const uint32_t nBaseHeight = Params().GetConsensus().pow2Phase2FirstBlockHeight + 1000;
+    const uint32_t nLockUntil = nBaseHeight + 100000;
+    CBlockIndex baseIndex;
+    baseIndex.phashBlock = chainActive.Tip()->phashBlock;
+    baseIndex.nHeight = nBaseHeight;
+
+    // A1 creates witnesses; A2 witnesses with one of them (witness coinbase spend) and withdraws another whose lock has expired.
+    // A3 creates a witness and splits another, A4 witnesses with the new one. The fork B3-B6 off A2 withdraws, creates and witnesses differently and then withdraws the witness renewed in A2.
+    std::vector<CBlock> blocksA;
+    std::vector<CBlock> blocksB;
+    CMutableTransaction creation = MakeIndexTestTransaction({TestOutPoint(0xf0, 0)}, {MakeWitnessOutputLockedAt(10000 * COIN, 1, 0, nLockUntil), MakeWitnessOutputLockedAt(20000 * COIN, 2, 0, nBaseHeight + 1), MakeWitnessOutputLockedAt(30000 * COIN, 3, 0, nLockUntil)});
+    const uint256 creationHash = creation.GetHash();
+    blocksA.push_back(MakeIndexTestBlock(nBaseHeight + 1, {creation}));
+    CTxOut renewedW1 = MakeWitnessOutputLockedAt(10000 * COIN + COIN, 1, nBaseHeight + 1, nLockUntil);
+    COutPoint outW1(creationHash, 0);
+    blocksA.push_back(MakeIndexTestBlock(nBaseHeight + 2, {MakeIndexTestTransaction({COutPoint(creationHash, 1)}, {CTxOut(20000 * COIN, CTxOutStandardKeyHash())})}, &outW1, &renewedW1));
+    CMutableTransaction creationW4 = MakeIndexTestTransaction({TestOutPoint(0xf1, 0)}, {MakeWitnessOutputLockedAt(40000 * COIN, 4, 0, nLockUntil)});
+    CMutableTransaction splitW3 = MakeIndexTestTransaction({COutPoint(creationHash, 2)}, {MakeWitnessOutputLockedAt(15000 * COIN, 3, nBaseHeight + 1, nLockUntil), MakeWitnessOutputLockedAt(15000 * COIN, 3, nBaseHeight + 1, nLockUntil)});
+    blocksA.push_back(MakeIndexTestBlock(nBaseHeight + 3, {creationW4, splitW3}));
+    CTxOut renewedW4 = MakeWitnessOutputLockedAt(40000 * COIN + COIN, 4, nBaseHeight + 3, nLockUntil);
+    COutPoint outW4(creationW4.GetHash(), 0);
+    blocksA.push_back(MakeIndexTestBlock(nBaseHeight + 4, {}, &outW4, &renewedW4));
+    blocksA.push_back(MakeIndexTestBlock(nBaseHeight + 5, {}));
+
+    CMutableTransaction withdrawW3 = MakeIndexTestTransaction({COutPoint(creationHash, 2)}, {CTxOut(30000 * COIN, CTxOutStandardKeyHash())});
+    CMutableTransaction creationW5 = MakeIndexTestTransaction({TestOutPoint(0xf2, 0)}, {MakeWitnessOutputLockedAt(50000 * COIN, 5, 0, nLockUntil)});
+    blocksB.push_back(MakeIndexTestBlock(nBaseHeight + 3, {withdrawW3, creationW5}));
+    CTxOut renewedW5 = MakeWitnessOutputLockedAt(50000 * COIN + COIN, 5, nBaseHeight + 3, nLockUntil);
+    COutPoint outW5(creationW5.GetHash(), 0);
+    blocksB.push_back(MakeIndexTestBlock(nBaseHeight + 4, {}, &outW5, &renewedW5));
+    blocksB.push_back(MakeIndexTestBlock(nBaseHeight + 5, {MakeIndexTestTransaction({COutPoint(blocksA[1].vtx.back()->GetHash(), 0)}, {CTxOut(10000 * COIN, CTxOutStandardKeyHash())})}));
+    blocksB.push_back(MakeIndexTestBlock(nBaseHeight + 6, {}));
+
+    // Indexes for both branches, the fork shares A1 and A2.
+    std::vector<uint256> hashesA(blocksA.size());
+    std::vector<uint256> hashesB(blocksB.size());
+    std::vector<CBlockIndex> indexesA(blocksA.size());
+    std::vector<CBlockIndex> indexesB(blocksB.size());
+    for (unsigned int i = 0; i < blocksA.size(); ++i)
+    {
+        hashesA[i] = uint256S(strprintf("%064x", 0xa0 + i));
+        indexesA[i].phashBlock = &hashesA[i];
+        indexesA[i].nHeight = nBaseHeight + 1 + i;
+        indexesA[i].pprev = i == 0 ? &baseIndex : &indexesA[i - 1];
+    }
+    for (unsigned int i = 0; i < blocksB.size(); ++i)
+    {
+        hashesB[i] = uint256S(strprintf("%064x", 0xb0 + i));
+        indexesB[i].phashBlock = &hashesB[i];
+        indexesB[i].nHeight = nBaseHeight + 3 + i;
+        indexesB[i].pprev = i == 0 ? &indexesA[1] : &indexesB[i - 1];
+    }
+
+    std::vector<std::pair<const CBlock*, uint32_t>> connected;
+    auto checkTip = [&](const CBlockIndex* pTip)
+    {
+        auto witnessSnapshot = GetWitnessStateSnapshot(false);
+        BOOST_REQUIRE(witnessSnapshot);
+        BOOST_CHECK(witnessSnapshot->pTip == pTip);
+        const std::map<COutPoint, Coin> expected = ReplayWitnessCoins(connected);
+        BOOST_CHECK(SameWitnessCoins(*witnessSnapshot->witnessCoins, expected));
+
+        // The incrementally maintained weight must match one computed from scratch.
+        int64_t nTotalWeight = 0;
+        for (const auto& [outPoint, coin] : expected)
+        {
+            uint64_t nUnused1, nUnused2;
+            nTotalWeight += GetPoW2RawWeightForAmount(coin.out.nValue, pTip->nHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+        }
+        BOOST_CHECK_EQUAL(witnessSnapshot->nNumWitnessAddresses, (int64_t)expected.size());
+        BOOST_CHECK_EQUAL(witnessSnapshot->nTotalWeight, nTotalWeight);
+
+        // As must the roulette candidates.
+        CWitnessRouletteColumns expectedColumns;
+        BuildWitnessRouletteColumns(expected, pTip->nHeight, expectedColumns);
+        BOOST_CHECK(SameRouletteColumns(*witnessSnapshot->rouletteColumns, expectedColumns));
+    };
+    auto connect = [&](const CBlock& block, const CBlockIndex& index)
+    {
+        pow2WitnessCoinIndex.BlockConnected(block, &index);
+        connected.emplace_back(&block, index.nHeight);
+        checkTip(&index);
+    };
+    auto disconnect = [&](const CBlockIndex& index)
+    {
+        pow2WitnessCoinIndex.BlockDisconnected(&index);
+        connected.pop_back();
+        checkTip(index.pprev);
+    };
+
+    for (unsigned int i = 0; i < blocksA.size(); ++i)
+        connect(blocksA[i], indexesA[i]);
+
+    // Every recent ancestor can be rewound to from the tip snapshot.
+    {
+        auto witnessSnapshot = GetWitnessStateSnapshot(false);
+        std::map<COutPoint, Coin> witnessCoins = *witnessSnapshot->witnessCoins;
+        int64_t nHeight = witnessSnapshot->nTipHeight;
+        for (int i = blocksA.size() - 2; i >= 0; --i)
+        {
+            BOOST_REQUIRE(witnessSnapshot->RewindWitnessCoins(witnessCoins, nHeight, &indexesA[i]));
+            std::vector<std::pair<const CBlock*, uint32_t>> prefix(connected.begin(), connected.begin() + i + 1);
+            BOOST_CHECK(SameWitnessCoins(witnessCoins, ReplayWitnessCoins(prefix)));
+        }
+    }
+
+    // Reorg onto the longer fork and back again, reusing the retained deltas of A3-A5 on the way back.
+    for (int i = blocksA.size() - 1; i >= 2; --i)
+        disconnect(indexesA[i]);
+    for (unsigned int i = 0; i < blocksB.size(); ++i)
+        connect(blocksB[i], indexesB[i]);
+    for (int i = blocksB.size() - 1; i >= 0; --i)
+        disconnect(indexesB[i]);
+    for (unsigned int i = 2; i < blocksA.size(); ++i)
+        connect(blocksA[i], indexesA[i]);
+
+    pow2WitnessCoinIndex.Invalidate();
+    pow2NetworkWeightSeries.Clear();
+}
+
+// Random witness set at nTestHeight; coins of up to 40000 blocks old with locks ranging from about to expire to years out, so that the age, expiry and lock filters all come into play.
+// With fGenesisLike a handful of coins below the minimum amount are given a lockFromBlock of 1, which makes them zero weight candidates.
+static std::map<COutPoint, Coin> MakeRandomWitnessCoins(FastRandomContext& rand, int nWitnesses, bool fGenesisLike, int nSalt=0)
+{
+    std::map<COutPoint, Coin> witnessCoins;
+    while ((int)witnessCoins.size() < nWitnesses)
+    {
+        uint32_t nHeight = nTestHeight - 1 - rand.randrange(40000);
+        uint64_t nLockUntil = nHeight + 30 * 576 + rand.randrange(3 * 365 * 576);
+        CAmount nValue = (gMinimumWitnessAmount + rand.randrange(50000)) * COIN;
+        uint64_t nLockFrom = nHeight;
+        if (fGenesisLike && witnessCoins.size() % 10 == 0)
+        {
+            nValue = COIN;
+            nLockFrom = 1;
+        }
+        COutPoint outPoint = TestOutPoint(nSalt * 100000 + witnessCoins.size(), rand.randrange(4));
+        witnessCoins[outPoint] = Coin(MakeWitnessOutputLockedAt(nValue, witnessCoins.size() % 200, nLockFrom, nLockUntil), nHeight, 1, false, true);
+    }
+    return witnessCoins;
+}
+
+// Historical (RouletteItem based) witness selection, kept here as the reference that SelectWitnessFromRouletteColumns must agree with.
+static bool SelectWitnessFromRouletteItems(const std::map<COutPoint, Coin>& witnessCoins, uint64_t nBlockHeight, const uint256& blockHash, uint32_t numGenesisWitnesses, uint32_t genesisWitnessWeightDivisor, std::vector<RouletteItem>& pool, size_t& nSelected, uint64_t& nTotalWeightEligibleAdjusted)
+{
+    uint64_t nPreviousHeight = nBlockHeight - 1;
+    std::vector<RouletteItem> unfiltered;
+    uint64_t nTotalWeightRaw = 0;
+    for (const auto& [outPoint, coin] : witnessCoins)
+    {
+        uint64_t nAge = nBlockHeight - coin.nHeight;
+        if (coin.out.nValue >= ((nPreviousHeight+1 > 100000 ? gMinimumWitnessAmount : gMinimumWitnessAmountOld)*COIN))
+        {
+            uint64_t nUnused1, nUnused2;
+            int64_t nWeight = GetPoW2RawWeightForAmount(coin.out.nValue, nPreviousHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+            if (nWeight < (nPreviousHeight+1 > 100000 ? gMinimumWitnessWeight : gMinimumWitnessWeightOld))
+                continue;
+            unfiltered.push_back(RouletteItem(outPoint, coin, nWeight, nAge));
+            nTotalWeightRaw += nWeight;
+        }
+        else if (coin.out.output.witnessDetails.lockFromBlock == 1)
+        {
+            unfiltered.push_back(RouletteItem(outPoint, coin, 0, nAge));
+        }
+    }
+
+    uint64_t nMinAge = gMinimumParticipationAge;
+    while (true)
+    {
+        pool = unfiltered;
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), pool.end());
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, nTotalWeightRaw); }), pool.end());
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight) <= nMinAge); }), pool.end());
+        if (pool.size() >= 100 || nMinAge == 0 || (nMinAge <= 10 && pool.size() > 5))
+            break;
+        nMinAge -= 5;
+    }
+    if (pool.empty())
+        return false;
+    std::sort(pool.begin(), pool.end());
+
+    uint64_t nTotalWeightEligibleRaw = 0;
+    for (auto& item : pool)
+        nTotalWeightEligibleRaw += item.nWeight;
+    uint64_t genesisWeight = 0;
+    if (numGenesisWitnesses > 0)
+    {
+        genesisWeight = std::max(nTotalWeightEligibleRaw / genesisWitnessWeightDivisor, nBlockHeight > 300 ? (uint64_t)1 : (uint64_t)1000);
+        nTotalWeightEligibleRaw += numGenesisWitnesses*genesisWeight;
+    }
+    uint64_t nMaxIndividualWeight = std::max(nTotalWeightEligibleRaw / 100, (uint64_t)1);
+    nTotalWeightEligibleAdjusted = 0;
+    for (auto& item : pool)
+    {
+        if (item.nWeight == 0)
+            item.nWeight = genesisWeight;
+        if (item.nWeight > nMaxIndividualWeight)
+            item.nWeight = nMaxIndividualWeight;
+        nTotalWeightEligibleAdjusted += item.nWeight;
+        item.nCumulativeWeight = nTotalWeightEligibleAdjusted;
+    }
+
+    arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
+    if (rouletteSelectionSeed > arith_uint256(nTotalWeightEligibleAdjusted))
+        rouletteSelectionSeed = rouletteSelectionSeed - (arith_uint256(nTotalWeightEligibleAdjusted) * arith_uint256(rouletteSelectionSeed/arith_uint256(nTotalWeightEligibleAdjusted)));
+    nSelected = std::lower_bound(pool.begin(), pool.end(), rouletteSelectionSeed.GetLow64()) - pool.begin();
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(roulette_columns_select_as_roulette_items)
+{
+    FastRandomContext rand(true);
+    // Fewer than 100 candidates exercise the low participation fallback, the larger sets the regular path.
+    for (int nWitnesses : {8, 60, 150, 2000})
+    {
+        for (bool fGenesisLike : {false, true})
+        {
+            const std::map<COutPoint, Coin> witnessCoins = MakeRandomWitnessCoins(rand, nWitnesses, fGenesisLike);
+            CWitnessRouletteColumns columns;
+            BuildWitnessRouletteColumns(witnessCoins, nTestHeight - 1, columns);
+
+            for (int i = 0; i < 20; ++i)
+            {
+                const uint256 blockHash = rand.rand256();
+                const uint32_t numGenesisWitnesses = fGenesisLike ? 3 : 0;
+                std::vector<RouletteItem> pool;
+                size_t nSelected = 0;
+                uint64_t nTotalWeightEligibleAdjusted = 0;
+                bool fExpected = SelectWitnessFromRouletteItems(witnessCoins, nTestHeight, blockHash, numGenesisWitnesses, 10, pool, nSelected, nTotalWeightEligibleAdjusted);
+
+                CWitnessRouletteSelection selection;
+                BOOST_REQUIRE_EQUAL(SelectWitnessFromRouletteColumns(blockHash, nTestHeight, numGenesisWitnesses, 10, columns, selection), fExpected);
+                if (!fExpected)
+                    continue;
+                BOOST_REQUIRE_EQUAL(selection.eligible.size(), pool.size());
+                BOOST_CHECK_EQUAL(selection.nSelectedEligibleIndex, nSelected);
+                BOOST_CHECK(columns.outpoint[selection.nSelectedCandidate] == pool[nSelected].outpoint);
+                BOOST_CHECK_EQUAL(selection.nTotalWeightEligibleAdjusted, nTotalWeightEligibleAdjusted);
+                for (size_t j = 0; j < pool.size(); ++j)
+                {
+                    BOOST_CHECK(columns.outpoint[selection.eligible[j]] == pool[j].outpoint);
+                    BOOST_CHECK_EQUAL(selection.adjustedWeight(j), pool[j].nWeight);
+                    BOOST_CHECK_EQUAL(selection.cumulativeWeight[j], pool[j].nCumulativeWeight);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(roulette_columns_follow_witness_coin_deltas)
+{
+    FastRandomContext rand(true);
+    std::map<COutPoint, Coin> witnessCoins = MakeRandomWitnessCoins(rand, 500, true);
+    const std::map<COutPoint, Coin> originalWitnessCoins = witnessCoins;
+    CWitnessRouletteColumns columns;
+    BuildWitnessRouletteColumns(witnessCoins, nTestHeight - 1, columns);
+
+    // Remove every seventh coin and add a fresh batch, some of which sort before, between and after the existing candidates.
+    CWitnessCoinDelta delta;
+    int nCoin = 0;
+    for (const auto& [outPoint, coin] : witnessCoins)
+    {
+        if (nCoin++ % 7 == 0)
+            delta.removed[outPoint] = coin;
+    }
+    for (const auto& [outPoint, coin] : MakeRandomWitnessCoins(rand, 60, true, 1))
+        delta.added[outPoint] = coin;
+    delta.Apply(witnessCoins);
+
+    CWitnessRouletteColumns expectedColumns;
+    BuildWitnessRouletteColumns(witnessCoins, nTestHeight - 1, expectedColumns);
+    CWitnessRouletteColumns updatedColumns;
+    UpdateWitnessRouletteColumns(columns, delta, false, witnessCoins, nTestHeight - 1, updatedColumns);
+    BOOST_CHECK(SameRouletteColumns(updatedColumns, expectedColumns));
+
+    CWitnessRouletteColumns undoneColumns;
+    UpdateWitnessRouletteColumns(updatedColumns, delta, true, originalWitnessCoins, nTestHeight - 1, undoneColumns);
+    BOOST_CHECK(SameRouletteColumns(undoneColumns, columns));
+
+    // Moving to a height with different weight rules rebuilds the candidates from the witness set.
+    const uint64_t nPreviousHeightOtherEra = gPoW2RawWeightQuantityChangeHeight;
+    BOOST_REQUIRE(GetPoW2RawWeightEra(nPreviousHeightOtherEra) != GetPoW2RawWeightEra(nTestHeight - 1));
+    BuildWitnessRouletteColumns(witnessCoins, nPreviousHeightOtherEra, expectedColumns);
+    UpdateWitnessRouletteColumns(columns, delta, false, witnessCoins, nPreviousHeightOtherEra, updatedColumns);
+    BOOST_CHECK(SameRouletteColumns(updatedColumns, expectedColumns));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
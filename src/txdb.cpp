@@ -20,9 +20,16 @@
 #include <witnessutil.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 #include <validation/witnessvalidation.h> //For ppow2witTip (remove in future)
+#include "unity/appmanager.h" //For ShutdownRequested
 
 // Old v0 format, deprecated v1
 static const char DB_COINS = 'c';
@@ -38,6 +45,10 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_VERIFIED_POW = 'v';
+static const char DB_NETWORK_WEIGHT = 'w';
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BLOCK_FILTER_FILE_POS = 'P';
 
 static const char DB_VERSION     = '1';
 static const char DB_POW2_PHASE2 = '2';
@@ -494,44 +505,157 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue)
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace
+{
+//! A block index entry as read from the database, before it is linked into mapBlockIndex.
+struct CLoadedBlockIndex
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    uint256 hash;
+    uint256 hashPrev;
+    CBlockIndex* pindex;
+};
+}
 
-    pcursor->Seek(std::pair(DB_BLOCK_INDEX, uint256()));
+// Read the block index entries whose hash starts with a byte in [nBegin, nEnd), in database order.
+// Gives up (returning false) as soon as another range failed or a shutdown was requested.
+static bool ReadBlockIndexRange(CDBIterator& cursor, unsigned int nBegin, unsigned int nEnd, std::vector<CLoadedBlockIndex>& entries, const std::atomic<bool>& fAbort)
+{
+    uint256 hashBegin;
+    *hashBegin.begin() = nBegin;
+    cursor.Seek(std::pair(DB_BLOCK_INDEX, hashBegin));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid())
+    while (cursor.Valid())
     {
-        boost::this_thread::interruption_point();
+        if (fAbort || ShutdownRequested())
+            return false;
+
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
+        if (!cursor.GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+            break;
+
+        CDiskBlockIndex diskindex;
+        if (!cursor.GetValue(diskindex))
+            return error("LoadBlockIndex() : failed to read value");
+        entries.push_back({diskindex.GetBlockHashPoW2(), diskindex.hashPrev, new CBlockIndex(diskindex)});
+        cursor.Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
+{
+    // Reading, deserializing and hashing the entries is independent per entry, so split the keyspace by the first byte of the block hash
+    // (uniformly distributed, unlike the trailing bytes which the proof of work keeps at zero) into ranges that several threads read.
+    // Linking the entries together through mapBlockIndex is done on this thread, range by range in the same database order as before.
+    // The readers stay at most nMaxRangesAhead ranges ahead of the link and each decoded copy is freed once it is linked,
+    // so at any time only a few of the 256 ranges are held twice in memory.
+    if (nThreads <= 0)
+        nThreads = std::clamp(GetNumCores(), 1, MAX_BLOCK_INDEX_LOAD_THREADS);
+    const int nRanges = 256;
+    const int nMaxRangesAhead = 2 * nThreads;
+
+    std::vector<std::vector<CLoadedBlockIndex>> vRanges(nRanges);
+    std::vector<char> vRangeDone(nRanges, false);
+    std::vector<char> vRangeOK(nRanges, false);
+    std::mutex csRanges;
+    std::condition_variable condRanges;
+    int nNextRange = 0;
+    int nLinkRange = 0;
+    std::atomic<bool> fAbort(false);
+
+    std::vector<std::thread> threads;
+    auto stopReaders = [&]()
+    {
+        {
+            std::lock_guard<std::mutex> lock(csRanges);
+            fAbort = true;
+        }
+        condRanges.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+        for (auto& entries : vRanges)
+        {
+            for (const auto& entry : entries)
+                delete entry.pindex;
+            entries.clear();
+        }
+    };
+
+    for (int i = 0; i < nThreads; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            std::unique_ptr<CDBIterator> pcursor(NewIterator());
+            while (true)
+            {
+                int nRange;
+                {
+                    std::unique_lock<std::mutex> lock(csRanges);
+                    condRanges.wait(lock, [&]() { return fAbort || nNextRange >= nRanges || nNextRange < nLinkRange + nMaxRangesAhead; });
+                    if (fAbort || nNextRange >= nRanges)
+                        return;
+                    nRange = nNextRange++;
+                }
+                std::vector<CLoadedBlockIndex> entries;
+                bool fRangeOK = ReadBlockIndexRange(*pcursor, nRange, nRange + 1, entries, fAbort);
+                {
+                    std::lock_guard<std::mutex> lock(csRanges);
+                    vRanges[nRange].swap(entries);
+                    vRangeOK[nRange] = fRangeOK;
+                    vRangeDone[nRange] = true;
+                    if (!fRangeOK)
+                        fAbort = true;
+                }
+                condRanges.notify_all();
+                for (const auto& entry : entries)
+                    delete entry.pindex;
+            }
+        });
+    }
+
+    bool fOK = true;
+    std::vector<CLoadedBlockIndex> entries;
+    try
+    {
+        for (int nRange = 0; nRange < nRanges && fOK; ++nRange)
+        {
+            entries.clear();
+            {
+                std::unique_lock<std::mutex> lock(csRanges);
+                condRanges.wait(lock, [&]() { return vRangeDone[nRange] || fAbort; });
+                fOK = vRangeDone[nRange] && vRangeOK[nRange];
+                if (fOK)
+                    entries.swap(vRanges[nRange]);
+            }
+
+            for (auto& [hash, hashPrev, pindexLoaded] : entries)
+            {
+                boost::this_thread::interruption_point();
+
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHashPoW2());
+                CBlockIndex* pindexNew = insertBlockIndex(hash);
                 // this insertBlockIndex can create an index block that is never loaded with data
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
+                pindexNew->pprev          = insertBlockIndex(hashPrev);
+                pindexNew->nHeight        = pindexLoaded->nHeight;
+                pindexNew->nFile          = pindexLoaded->nFile;
+                pindexNew->nDataPos       = pindexLoaded->nDataPos;
+                pindexNew->nUndoPos       = pindexLoaded->nUndoPos;
+                pindexNew->nVersion       = pindexLoaded->nVersion;
+                pindexNew->hashMerkleRoot = pindexLoaded->hashMerkleRoot;
+                pindexNew->nTime          = pindexLoaded->nTime;
+                pindexNew->nBits          = pindexLoaded->nBits;
+                pindexNew->nNonce         = pindexLoaded->nNonce;
+                pindexNew->nStatus        = pindexLoaded->nStatus;
                 // nStatus later used to check if a block index was created during loading but never filled
                 assert(pindexNew->nStatus != 0);
-                pindexNew->nTx            = diskindex.nTx;
+                pindexNew->nTx            = pindexLoaded->nTx;
 
-                pindexNew->nVersionPoW2Witness = diskindex.nVersionPoW2Witness;
-                pindexNew->nTimePoW2Witness = diskindex.nTimePoW2Witness;
-                pindexNew->hashMerkleRootPoW2Witness = diskindex.hashMerkleRootPoW2Witness;
-                pindexNew->witnessHeaderPoW2Sig = diskindex.witnessHeaderPoW2Sig;
+                pindexNew->nVersionPoW2Witness = pindexLoaded->nVersionPoW2Witness;
+                pindexNew->nTimePoW2Witness = pindexLoaded->nTimePoW2Witness;
+                pindexNew->hashMerkleRootPoW2Witness = pindexLoaded->hashMerkleRootPoW2Witness;
+                pindexNew->witnessHeaderPoW2Sig = pindexLoaded->witnessHeaderPoW2Sig;
                 #ifdef WITNESS_HEADER_SYNC
-                pindexNew->witnessUTXODelta = diskindex.witnessUTXODelta;
+                pindexNew->witnessUTXODelta = pindexLoaded->witnessUTXODelta;
                 #endif
 
                 /** Scrypt is used for block proof-of-work, but for purposes of performance the index internally uses sha256.
@@ -539,16 +663,27 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
                 //if (!CheckProofOfWork(pindexNew, Params().GetConsensus()))
                     //return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
 
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
+                delete pindexLoaded;
+                pindexLoaded = nullptr;
             }
-        } else {
-            break;
+
+            {
+                std::lock_guard<std::mutex> lock(csRanges);
+                nLinkRange = nRange + 1;
+            }
+            condRanges.notify_all();
         }
     }
+    catch (...)
+    {
+        for (const auto& entry : entries)
+            delete entry.pindex;
+        stopReaders();
+        throw;
+    }
+    stopReaders();
 
-    return true;
+    return fOK;
 }
 
 namespace
@@ -753,3 +888,55 @@ bool CCoinsViewDB::WriteVersion()
     return true;
 }
 
+CPoWCacheDB::CPoWCacheDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "powcache", nCacheSize, fMemory, fWipe) {
+}
+
+bool CPoWCacheDB::HaveVerifiedPoW(const uint256& hashLegacy) {
+    return Exists(std::pair(DB_VERIFIED_POW, hashLegacy));
+}
+
+bool CPoWCacheDB::WriteVerifiedPoW(const uint256& hashLegacy) {
+    // Not synced, losing the last few entries on a crash only means verifying those headers again.
+    return Write(std::pair(DB_VERIFIED_POW, hashLegacy), '1');
+}
+
+CWitnessWeightDB::CWitnessWeightDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "witnessweight", nCacheSize, fMemory, fWipe) {
+}
+
+bool CWitnessWeightDB::ReadNetworkWeight(const uint256& blockHash, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight) {
+    std::pair<int64_t, int64_t> numAndWeight;
+    if (!Read(std::pair(DB_NETWORK_WEIGHT, blockHash), numAndWeight))
+        return false;
+    nNumWitnessAddresses = numAndWeight.first;
+    nTotalWeight = numAndWeight.second;
+    return true;
+}
+
+bool CWitnessWeightDB::WriteNetworkWeight(const uint256& blockHash, int64_t nNumWitnessAddresses, int64_t nTotalWeight) {
+    // Not synced, anything lost on a crash is simply recomputed.
+    return Write(std::pair(DB_NETWORK_WEIGHT, blockHash), std::pair(nNumWitnessAddresses, nTotalWeight));
+}
+
+CBlockFilterIndexDB::CBlockFilterIndexDB(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(path, nCacheSize, fMemory, fWipe) {
+}
+
+bool CBlockFilterIndexDB::ReadFilterEntry(const uint256& blockHash, CBlockFilterIndexEntry& entry) const {
+    return Read(std::pair(DB_BLOCK_FILTER, blockHash), entry);
+}
+
+bool CBlockFilterIndexDB::ReadBestBlock(uint256& blockHash) const {
+    return Read(DB_BEST_BLOCK, blockHash);
+}
+
+bool CBlockFilterIndexDB::ReadNextFilePos(CDiskBlockPos& pos) const {
+    return Read(DB_BLOCK_FILTER_FILE_POS, pos);
+}
+
+bool CBlockFilterIndexDB::WriteCommit(const std::map<uint256, CBlockFilterIndexEntry>& entries, const uint256& bestBlockHash, const CDiskBlockPos& nextFilePos) {
+    CDBBatch batch(*this);
+    for (const auto& [blockHash, entry] : entries)
+        batch.Write(std::pair(DB_BLOCK_FILTER, blockHash), entry);
+    batch.Write(DB_BEST_BLOCK, bestBlockHash);
+    batch.Write(DB_BLOCK_FILTER_FILE_POS, nextFilePos);
+    return WriteBatch(batch, true);
+}
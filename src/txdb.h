@@ -45,6 +45,14 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Memory allocated to the verified PoW index cache (MiB)
+static const int64_t nPoWCacheDBCache = 1;
+//! Memory allocated to the network weight series cache (MiB)
+static const int64_t nWitnessWeightDBCache = 1;
+//! Cache for the -blockfilterindex DB (MiB)
+static const int64_t nBlockFilterIndexDBCache = 8;
+//! Maximum number of threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -187,7 +195,72 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list, uint64_t nHeight);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Read every block index entry and link it through insertBlockIndex, using nThreads reader threads (0 picks one per core, up to MAX_BLOCK_INDEX_LOAD_THREADS).
+    bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads = 0);
+};
+
+/** Persistent index of block headers whose (expensive) SIGMA proof of work has already been fully verified.
+ *  Keyed by the legacy header hash, which commits to all the data the PoW check depends on; so unlike the block
+ *  tree this is deliberately not wiped on reindex. */
+class CPoWCacheDB : public CDBWrapper
+{
+public:
+    CPoWCacheDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CPoWCacheDB(const CPoWCacheDB&);
+    void operator=(const CPoWCacheDB&);
+public:
+    bool HaveVerifiedPoW(const uint256& hashLegacy);
+    bool WriteVerifiedPoW(const uint256& hashLegacy);
+};
+
+/** Persistent memo of the PoW² network weight (number of witness addresses and total raw weight) as of each block.
+ *  Keyed by block hash, the network weight is a pure function of the chain up to and including that block; so this is also not wiped on reindex. */
+class CWitnessWeightDB : public CDBWrapper
+{
+public:
+    CWitnessWeightDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CWitnessWeightDB(const CWitnessWeightDB&);
+    void operator=(const CWitnessWeightDB&);
+public:
+    bool ReadNetworkWeight(const uint256& blockHash, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight);
+    bool WriteNetworkWeight(const uint256& blockHash, int64_t nNumWitnessAddresses, int64_t nTotalWeight);
+};
+
+/** Location and commitments of a single block filter in the block filter index */
+struct CBlockFilterIndexEntry
+{
+    uint256 filterHash;
+    uint256 header;
+    CDiskBlockPos pos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(filterHash);
+        READWRITE(header);
+        READWRITE(pos);
+    }
+};
+
+/** Access to the -blockfilterindex database (blockfilter/db).
+ *  Entries are keyed by block hash, so filters for blocks that are (later) disconnected remain valid.
+ *  Like the other indexes it is wiped and rebuilt on -reindex. */
+class CBlockFilterIndexDB : public CDBWrapper
+{
+public:
+    CBlockFilterIndexDB(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CBlockFilterIndexDB(const CBlockFilterIndexDB&);
+    void operator=(const CBlockFilterIndexDB&);
+public:
+    bool ReadFilterEntry(const uint256& blockHash, CBlockFilterIndexEntry& entry) const;
+    bool ReadBestBlock(uint256& blockHash) const;
+    bool ReadNextFilePos(CDiskBlockPos& pos) const;
+    //! Atomically (and synced) persist a batch of new entries together with the new best block and flat file position.
+    bool WriteCommit(const std::map<uint256, CBlockFilterIndexEntry>& entries, const uint256& bestBlockHash, const CDiskBlockPos& nextFilePos);
 };
 
 #endif
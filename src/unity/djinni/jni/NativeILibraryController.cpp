@@ -483,6 +483,26 @@ CJNIEXPORT jobject JNICALL Java_unity_1wallet_jniunifiedbackend_ILibraryControll
     } JNI_TRANSLATE_EXCEPTIONS_RETURN(jniEnv, 0 /* value doesn't matter */)
 }
 
+CJNIEXPORT jobject JNICALL Java_unity_1wallet_jniunifiedbackend_ILibraryController_00024CppProxy_getMutationHistoryPage(JNIEnv* jniEnv, jobject /*this*/, jint j_offset, jint j_count)
+{
+    try {
+        DJINNI_FUNCTION_PROLOGUE0(jniEnv);
+        auto r = ::ILibraryController::getMutationHistoryPage(::djinni::I32::toCpp(jniEnv, j_offset),
+                                                              ::djinni::I32::toCpp(jniEnv, j_count));
+        return ::djinni::release(::djinni::List<::djinni_generated::NativeMutationRecord>::fromCpp(jniEnv, r));
+    } JNI_TRANSLATE_EXCEPTIONS_RETURN(jniEnv, 0 /* value doesn't matter */)
+}
+
+CJNIEXPORT jobject JNICALL Java_unity_1wallet_jniunifiedbackend_ILibraryController_00024CppProxy_getTransactionHistoryPage(JNIEnv* jniEnv, jobject /*this*/, jint j_offset, jint j_count)
+{
+    try {
+        DJINNI_FUNCTION_PROLOGUE0(jniEnv);
+        auto r = ::ILibraryController::getTransactionHistoryPage(::djinni::I32::toCpp(jniEnv, j_offset),
+                                                                 ::djinni::I32::toCpp(jniEnv, j_count));
+        return ::djinni::release(::djinni::List<::djinni_generated::NativeTransactionRecord>::fromCpp(jniEnv, r));
+    } JNI_TRANSLATE_EXCEPTIONS_RETURN(jniEnv, 0 /* value doesn't matter */)
+}
+
 CJNIEXPORT jboolean JNICALL Java_unity_1wallet_jniunifiedbackend_ILibraryController_00024CppProxy_HaveUnconfirmedFunds(JNIEnv* jniEnv, jobject /*this*/)
 {
     try {
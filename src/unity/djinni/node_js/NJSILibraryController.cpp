@@ -1956,6 +1956,152 @@ Napi::Value NJSILibraryController::getTransactionHistory(const Napi::CallbackInf
         return Napi::Value();
     }
 }
+Napi::Value NJSILibraryController::getMutationHistoryPage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+
+    //Check if method called with right number of arguments
+    if(info.Length() != 2)
+    {
+        Napi::Error::New(env, "NJSILibraryController::getMutationHistoryPage needs 2 arguments").ThrowAsJavaScriptException();
+    }
+
+    //Check if parameters have correct types
+    auto arg_0 = info[0].ToNumber().Int32Value();
+    auto arg_1 = info[1].ToNumber().Int32Value();
+
+    try
+    {
+        auto result = ILibraryController::getMutationHistoryPage(arg_0,arg_1);
+
+        //Wrap result in node object
+        auto arg_2 = Napi::Array::New(env);
+        for(size_t arg_2_id = 0; arg_2_id < result.size(); arg_2_id++)
+        {
+            auto arg_2_elem = Napi::Object::New(env);
+            auto arg_2_elem_1 = Napi::Value::From(env, result[arg_2_id].change);
+            arg_2_elem.Set("change", arg_2_elem_1);
+            auto arg_2_elem_2 = Napi::Value::From(env, result[arg_2_id].timestamp);
+            arg_2_elem.Set("timestamp", arg_2_elem_2);
+            auto arg_2_elem_3 = Napi::String::New(env, result[arg_2_id].txHash);
+            arg_2_elem.Set("txHash", arg_2_elem_3);
+            auto arg_2_elem_4 = Napi::String::New(env, result[arg_2_id].recipient_addresses);
+            arg_2_elem.Set("recipient_addresses", arg_2_elem_4);
+            auto arg_2_elem_5 = Napi::Value::From(env, (int)result[arg_2_id].status);
+            arg_2_elem.Set("status", arg_2_elem_5);
+            auto arg_2_elem_6 = Napi::Value::From(env, result[arg_2_id].depth);
+            arg_2_elem.Set("depth", arg_2_elem_6);
+
+            arg_2.Set((int)arg_2_id,arg_2_elem);
+        }
+
+
+        return arg_2;
+    }
+    catch (std::exception& e)
+    {
+        Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+        return Napi::Value();
+    }
+    catch (...)
+    {
+        Napi::Error::New(env, "core exception thrown").ThrowAsJavaScriptException();
+        return Napi::Value();
+    }
+}
+Napi::Value NJSILibraryController::getTransactionHistoryPage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+
+    //Check if method called with right number of arguments
+    if(info.Length() != 2)
+    {
+        Napi::Error::New(env, "NJSILibraryController::getTransactionHistoryPage needs 2 arguments").ThrowAsJavaScriptException();
+    }
+
+    //Check if parameters have correct types
+    auto arg_0 = info[0].ToNumber().Int32Value();
+    auto arg_1 = info[1].ToNumber().Int32Value();
+
+    try
+    {
+        auto result = ILibraryController::getTransactionHistoryPage(arg_0,arg_1);
+
+        //Wrap result in node object
+        auto arg_2 = Napi::Array::New(env);
+        for(size_t arg_2_id = 0; arg_2_id < result.size(); arg_2_id++)
+        {
+            auto arg_2_elem = Napi::Object::New(env);
+            auto arg_2_elem_1 = Napi::String::New(env, result[arg_2_id].txHash);
+            arg_2_elem.Set("txHash", arg_2_elem_1);
+            auto arg_2_elem_2 = Napi::Value::From(env, result[arg_2_id].timeStamp);
+            arg_2_elem.Set("timeStamp", arg_2_elem_2);
+            auto arg_2_elem_3 = Napi::Value::From(env, result[arg_2_id].amount);
+            arg_2_elem.Set("amount", arg_2_elem_3);
+            auto arg_2_elem_4 = Napi::Value::From(env, result[arg_2_id].fee);
+            arg_2_elem.Set("fee", arg_2_elem_4);
+            auto arg_2_elem_5 = Napi::Value::From(env, (int)result[arg_2_id].status);
+            arg_2_elem.Set("status", arg_2_elem_5);
+            auto arg_2_elem_6 = Napi::Value::From(env, result[arg_2_id].height);
+            arg_2_elem.Set("height", arg_2_elem_6);
+            auto arg_2_elem_7 = Napi::Value::From(env, result[arg_2_id].blockTime);
+            arg_2_elem.Set("blockTime", arg_2_elem_7);
+            auto arg_2_elem_8 = Napi::Value::From(env, result[arg_2_id].depth);
+            arg_2_elem.Set("depth", arg_2_elem_8);
+            auto arg_2_elem_9 = Napi::Array::New(env);
+            for(size_t arg_2_elem_9_id = 0; arg_2_elem_9_id < result[arg_2_id].inputs.size(); arg_2_elem_9_id++)
+            {
+                auto arg_2_elem_9_elem = Napi::Object::New(env);
+                auto arg_2_elem_9_elem_1 = Napi::String::New(env, result[arg_2_id].inputs[arg_2_elem_9_id].address);
+                arg_2_elem_9_elem.Set("address", arg_2_elem_9_elem_1);
+                auto arg_2_elem_9_elem_2 = Napi::String::New(env, result[arg_2_id].inputs[arg_2_elem_9_id].label);
+                arg_2_elem_9_elem.Set("label", arg_2_elem_9_elem_2);
+                auto arg_2_elem_9_elem_3 = Napi::String::New(env, result[arg_2_id].inputs[arg_2_elem_9_id].desc);
+                arg_2_elem_9_elem.Set("desc", arg_2_elem_9_elem_3);
+                auto arg_2_elem_9_elem_4 = Napi::Value::From(env, result[arg_2_id].inputs[arg_2_elem_9_id].isMine);
+                arg_2_elem_9_elem.Set("isMine", arg_2_elem_9_elem_4);
+
+                arg_2_elem_9.Set((int)arg_2_elem_9_id,arg_2_elem_9_elem);
+            }
+
+            arg_2_elem.Set("inputs", arg_2_elem_9);
+            auto arg_2_elem_10 = Napi::Array::New(env);
+            for(size_t arg_2_elem_10_id = 0; arg_2_elem_10_id < result[arg_2_id].outputs.size(); arg_2_elem_10_id++)
+            {
+                auto arg_2_elem_10_elem = Napi::Object::New(env);
+                auto arg_2_elem_10_elem_1 = Napi::Value::From(env, result[arg_2_id].outputs[arg_2_elem_10_id].amount);
+                arg_2_elem_10_elem.Set("amount", arg_2_elem_10_elem_1);
+                auto arg_2_elem_10_elem_2 = Napi::String::New(env, result[arg_2_id].outputs[arg_2_elem_10_id].address);
+                arg_2_elem_10_elem.Set("address", arg_2_elem_10_elem_2);
+                auto arg_2_elem_10_elem_3 = Napi::String::New(env, result[arg_2_id].outputs[arg_2_elem_10_id].label);
+                arg_2_elem_10_elem.Set("label", arg_2_elem_10_elem_3);
+                auto arg_2_elem_10_elem_4 = Napi::String::New(env, result[arg_2_id].outputs[arg_2_elem_10_id].desc);
+                arg_2_elem_10_elem.Set("desc", arg_2_elem_10_elem_4);
+                auto arg_2_elem_10_elem_5 = Napi::Value::From(env, result[arg_2_id].outputs[arg_2_elem_10_id].isMine);
+                arg_2_elem_10_elem.Set("isMine", arg_2_elem_10_elem_5);
+
+                arg_2_elem_10.Set((int)arg_2_elem_10_id,arg_2_elem_10_elem);
+            }
+
+            arg_2_elem.Set("outputs", arg_2_elem_10);
+
+            arg_2.Set((int)arg_2_id,arg_2_elem);
+        }
+
+
+        return arg_2;
+    }
+    catch (std::exception& e)
+    {
+        Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+        return Napi::Value();
+    }
+    catch (...)
+    {
+        Napi::Error::New(env, "core exception thrown").ThrowAsJavaScriptException();
+        return Napi::Value();
+    }
+}
 Napi::Value NJSILibraryController::HaveUnconfirmedFunds(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
@@ -2075,6 +2221,8 @@ Napi::Object NJSILibraryController::Init(Napi::Env env, Napi::Object exports) {
     InstanceMethod("getClientInfo", &NJSILibraryController::getClientInfo),
     InstanceMethod("getMutationHistory", &NJSILibraryController::getMutationHistory),
     InstanceMethod("getTransactionHistory", &NJSILibraryController::getTransactionHistory),
+    InstanceMethod("getMutationHistoryPage", &NJSILibraryController::getMutationHistoryPage),
+    InstanceMethod("getTransactionHistoryPage", &NJSILibraryController::getTransactionHistoryPage),
     InstanceMethod("HaveUnconfirmedFunds", &NJSILibraryController::HaveUnconfirmedFunds),
     InstanceMethod("GetBalance", &NJSILibraryController::GetBalance),
     });
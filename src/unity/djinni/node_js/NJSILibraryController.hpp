@@ -209,6 +209,18 @@ private:
      */
     Napi::Value getTransactionHistory(const Napi::CallbackInfo& info);
 
+    /**
+     * Get a page of wallet mutations, newest first, skipping the first 'offset' mutations and returning at most 'count'
+     *NB! This is SPV specific, non SPV wallets should use account specific getMutationHistory on an accounts controller instead
+     */
+    Napi::Value getMutationHistoryPage(const Napi::CallbackInfo& info);
+
+    /**
+     * Get a page of the transactions the wallet has been involved in, newest first, skipping the first 'offset' transactions and returning at most 'count'
+     *NB! This is SPV specific, non SPV wallets should use account specific getTransactionHistory on an accounts controller instead
+     */
+    Napi::Value getTransactionHistoryPage(const Napi::CallbackInfo& info);
+
     /**
      * Check if the wallet has any transactions that are still pending confirmation, to be used to determine if e.g. it is safe to perform a link or whether we should wait.
      *NB! This is SPV specific, non SPV wallets should use HaveUnconfirmedFunds on wallet controller instead
@@ -425,6 +425,24 @@ static_assert(__has_feature(objc_arc), "Djinni requires ARC to be enabled for th
     } DJINNI_TRANSLATE_EXCEPTIONS()
 }
 
++ (nonnull NSArray<DBMutationRecord *> *)getMutationHistoryPage:(int32_t)offset
+                                                          count:(int32_t)count {
+    try {
+        auto objcpp_result_ = ::ILibraryController::getMutationHistoryPage(::djinni::I32::toCpp(offset),
+                                                                           ::djinni::I32::toCpp(count));
+        return ::djinni::List<::djinni_generated::MutationRecord>::fromCpp(objcpp_result_);
+    } DJINNI_TRANSLATE_EXCEPTIONS()
+}
+
++ (nonnull NSArray<DBTransactionRecord *> *)getTransactionHistoryPage:(int32_t)offset
+                                                                count:(int32_t)count {
+    try {
+        auto objcpp_result_ = ::ILibraryController::getTransactionHistoryPage(::djinni::I32::toCpp(offset),
+                                                                              ::djinni::I32::toCpp(count));
+        return ::djinni::List<::djinni_generated::TransactionRecord>::fromCpp(objcpp_result_);
+    } DJINNI_TRANSLATE_EXCEPTIONS()
+}
+
 + (BOOL)HaveUnconfirmedFunds {
     try {
         auto objcpp_result_ = ::ILibraryController::HaveUnconfirmedFunds();
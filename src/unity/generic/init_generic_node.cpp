@@ -5,6 +5,7 @@
 
 #include "init.h"
 #include "chainparams.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "generation/miner.h"
 #include "httprpc.h"
@@ -88,6 +89,8 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", helptr("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(helptr("Maintain a persistent index of compact block filters, used by the getblockfilter rpc call (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindexthreads=<n>", strprintf(helptr("Number of threads used to build block filters while the index catches up with the chain (0 = one per core, default: %d)"), DEFAULT_BLOCKFILTERINDEX_THREADS));
     strUsage += HelpMessageOpt("-txindex", strprintf(helptr("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(helptr("Connection options:"));
@@ -106,6 +109,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(helptr("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(helptr("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(helptr("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-netthreads=<n>", strprintf(helptr("Number of threads servicing peer socket I/O, 0 for one per core (default: %u)"), DEFAULT_NET_THREADS));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(helptr("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(helptr("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", helptr("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
@@ -173,6 +177,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-gen", strprintf(helptr("Generate coins (default: %u)"), DEFAULT_GENERATE));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(helptr("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-genarenaproclimit=<n>", strprintf(helptr("Set the number of threads for arena setup potrion of coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
+    strUsage += HelpMessageOpt("-minerarenahugepages", strprintf(helptr("Back the mining arena with huge pages (1gb/2mb pages if reserved, otherwise transparent huge pages) (default: %u)"), DEFAULT_GENERATE_ARENA_HUGEPAGES));
+    strUsage += HelpMessageOpt("-minerarenanuma", strprintf(helptr("Split the mining arena over NUMA nodes and spread mining threads over them on multi socket machines (default: %u)"), DEFAULT_GENERATE_ARENA_NUMA));
+    strUsage += HelpMessageOpt("-minerarenadoublebuffer", strprintf(helptr("Keep a second mining arena so the arena for a new block can be built while the previous one is still being mined, uses twice the -genmemlimit memory (default: %u)"), DEFAULT_GENERATE_ARENA_DOUBLEBUFFER));
     strUsage += HelpMessageOpt("-help-debug", helptr("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(helptr("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(helptr("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
@@ -0,0 +1,215 @@
+// Copyright (c) 2020-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+//Workaround braindamaged 'hack' in libtool.m4 that defines DLL_EXPORT when building a dll via libtool (this in turn imports unwanted symbols from e.g. pthread that breaks static pthread linkage)
+#ifdef DLL_EXPORT
+#undef DLL_EXPORT
+#endif
+
+#include "unity_history.h"
+
+#include "wallet/wallet.h"
+
+CUnityHistoryIndex::~CUnityHistoryIndex()
+{
+    for (auto& connection : walletConnections)
+        connection.disconnect();
+}
+
+CUnityHistoryIndex::RecordState CUnityHistoryIndex::GetRecordState(const CWalletTx& wtx) const
+{
+    return { builders.getStatusForTransaction(&wtx), wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0 };
+}
+
+void CUnityHistoryIndex::MarkDirty(const uint256& hash)
+{
+    LOCK(cs_dirty);
+    setDirty.insert(hash);
+}
+
+void CUnityHistoryIndex::MarkAllDirty()
+{
+    LOCK(cs_dirty);
+    fAllDirty = true;
+}
+
+void CUnityHistoryIndex::RebuildOrder()
+{
+    setOrdered.clear();
+    mapOrderTime.clear();
+    for (const auto& [hash, wtx] : pwallet->mapWallet)
+    {
+        setOrdered.emplace(wtx.nTimeSmart, hash);
+        mapOrderTime[hash] = wtx.nTimeSmart;
+    }
+}
+
+void CUnityHistoryIndex::Sync(CWallet* wallet)
+{
+    AssertLockHeld(wallet->cs_wallet);
+
+    if (wallet != pwallet)
+    {
+        for (auto& connection : walletConnections)
+            connection.disconnect();
+        walletConnections.clear();
+
+        pwallet = wallet;
+        walletConnections.push_back(pwallet->NotifyTransactionChanged.connect([this](CWallet*, const uint256& hash, ChangeType, bool)
+        {
+            MarkDirty(hash);
+        }));
+        // Labels of inputs and outputs come from the address book.
+        walletConnections.push_back(pwallet->NotifyAddressBookChanged.connect([this](CWallet*, const std::string&, const std::string&, bool, const std::string&, ChangeType)
+        {
+            MarkAllDirty();
+        }));
+        mapAccountHistory.clear();
+        RebuildOrder();
+        LOCK(cs_dirty);
+        setDirty.clear();
+        fAllDirty = false;
+    }
+
+    std::set<uint256> setUpdate;
+    {
+        LOCK(cs_dirty);
+        setUpdate.swap(setDirty);
+        if (fAllDirty)
+            mapAccountHistory.clear();
+        fAllDirty = false;
+    }
+
+    // Accounts are addressed by uuid, but their children are part of their history so any change of accounts invalidates every history.
+    // The account count would miss an account removed and another added in between two calls, the key index counts every change.
+    if (pwallet->keyIndex.GetAccountGeneration() != nAccountGeneration)
+    {
+        mapAccountHistory.clear();
+        nAccountGeneration = pwallet->keyIndex.GetAccountGeneration();
+    }
+
+    for (const uint256& hash : setUpdate)
+    {
+        for (auto& [accountUUID, history] : mapAccountHistory)
+        {
+            (unused) accountUUID;
+            history.transactions.erase(hash);
+            history.mutations.erase(hash);
+        }
+        auto orderIter = mapOrderTime.find(hash);
+        if (orderIter != mapOrderTime.end())
+        {
+            setOrdered.erase(OrderKey(orderIter->second, hash));
+            mapOrderTime.erase(orderIter);
+        }
+        auto walletIter = pwallet->mapWallet.find(hash);
+        if (walletIter != pwallet->mapWallet.end())
+        {
+            setOrdered.emplace(walletIter->second.nTimeSmart, hash);
+            mapOrderTime[hash] = walletIter->second.nTimeSmart;
+        }
+    }
+
+    // Transactions removed from the wallet (ZapSelectTx) aren't signalled.
+    if (mapOrderTime.size() != pwallet->mapWallet.size())
+        RebuildOrder();
+}
+
+void CUnityHistoryIndex::ForEachTransaction(const std::function<bool(const uint256& hash, const CWalletTx& wtx)>& fn) const
+{
+    for (const auto& [nTime, hash] : setOrdered)
+    {
+        (unused) nTime;
+        auto walletIter = pwallet->mapWallet.find(hash);
+        if (walletIter == pwallet->mapWallet.end())
+            continue;
+        if (!fn(hash, walletIter->second))
+            break;
+    }
+}
+
+std::vector<TransactionRecord> CUnityHistoryIndex::GetTransactionHistory(CWallet* wallet, CAccount* forAccount, size_t nOffset, size_t nCount)
+{
+    std::vector<TransactionRecord> ret;
+    if (nCount == 0)
+        return ret;
+
+    Sync(wallet);
+    AccountHistory& history = mapAccountHistory[forAccount->getUUID()];
+    std::vector<CAccount*> forAccounts = builders.getAccountsForAccount(forAccount);
+
+    auto buildRecord = [&](const CWalletTx& wtx, CachedTransaction& cached)
+    {
+        bool anyInputsOrOutputsAreMine = false;
+        TransactionRecord record = builders.calculateTransactionRecord(wtx, forAccounts, anyInputsOrOutputsAreMine);
+        cached.state = GetRecordState(wtx);
+        cached.record.reset();
+        if (anyInputsOrOutputsAreMine)
+            cached.record = std::move(record);
+    };
+
+    ForEachTransaction([&](const uint256& hash, const CWalletTx& wtx)
+    {
+        auto cacheIter = history.transactions.find(hash);
+        if (cacheIter == history.transactions.end())
+        {
+            cacheIter = history.transactions.emplace(hash, CachedTransaction()).first;
+            buildRecord(wtx, cacheIter->second);
+        }
+        CachedTransaction& cached = cacheIter->second;
+        if (!cached.record)
+            return true;
+        // Whether the transaction involves the account doesn't depend on its state, so skipping it doesn't need an up to date record.
+        if (nOffset > 0)
+        {
+            --nOffset;
+            return true;
+        }
+        if (cached.state != GetRecordState(wtx))
+            buildRecord(wtx, cached);
+        ret.push_back(*cached.record);
+        ret.back().depth = wtx.GetDepthInMainChain();
+        return ret.size() < nCount;
+    });
+    return ret;
+}
+
+std::vector<MutationRecord> CUnityHistoryIndex::GetMutationHistory(CWallet* wallet, CAccount* forAccount, size_t nOffset, size_t nCount)
+{
+    std::vector<MutationRecord> ret;
+    if (nCount == 0)
+        return ret;
+
+    Sync(wallet);
+    AccountHistory& history = mapAccountHistory[forAccount->getUUID()];
+
+    ForEachTransaction([&](const uint256& hash, const CWalletTx& wtx)
+    {
+        // Unlike for transaction records the number of mutations can change with the state (orphaned or maturing coinbases), so always check it.
+        RecordState state = GetRecordState(wtx);
+        auto cacheIter = history.mutations.find(hash);
+        if (cacheIter == history.mutations.end() || cacheIter->second.state != state)
+        {
+            std::vector<MutationRecord> mutations;
+            builders.addMutationsForTransaction(&wtx, mutations, forAccount);
+            cacheIter = history.mutations.insert_or_assign(hash, CachedMutations{state, std::move(mutations)}).first;
+        }
+        const std::vector<MutationRecord>& mutations = cacheIter->second.mutations;
+        if (nOffset >= mutations.size())
+        {
+            nOffset -= mutations.size();
+            return true;
+        }
+        int nDepth = wtx.GetDepthInMainChain();
+        for (auto iter = mutations.begin() + nOffset; iter != mutations.end() && ret.size() < nCount; ++iter)
+        {
+            ret.push_back(*iter);
+            ret.back().depth = nDepth;
+        }
+        nOffset = 0;
+        return ret.size() < nCount;
+    });
+    return ret;
+}
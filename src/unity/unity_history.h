@@ -0,0 +1,111 @@
+// Copyright (c) 2020-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef UNITY_HISTORY_H
+#define UNITY_HISTORY_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include "mutation_record.hpp"
+#include "transaction_record.hpp"
+
+#include <boost/signals2/connection.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <functional>
+#include <list>
+#include <map>
+#include <optional>
+#include <utility>
+#include <set>
+#include <vector>
+
+class CAccount;
+class CWallet;
+class CWalletTx;
+
+/**
+ * Time ordered index over the wallet transactions with per account caches of the transaction and mutation records built from them.
+ *
+ * The frontends show the history a page at a time, so instead of building the record of every wallet transaction and sorting them all on
+ * every call only the records of the transactions walked to fill the requested page are built, and they are kept for the next call.
+ * A cached record is rebuilt when the transaction changes (NotifyTransactionChanged) or moves to another TransactionStatus (or out of
+ * coinbase maturity), plain depth changes are applied to the cached record as it is handed out.
+ *
+ * All calls expect cs_main and the wallets cs_wallet to be held.
+ */
+class CUnityHistoryIndex
+{
+public:
+    //! The unity functions the records are built with, handed in so that the index doesn't pull in the rest of the library.
+    struct RecordBuilders
+    {
+        std::function<std::vector<CAccount*>(CAccount* forAccount)> getAccountsForAccount;
+        std::function<TransactionStatus(const CWalletTx* wtx)> getStatusForTransaction;
+        std::function<TransactionRecord(const CWalletTx& wtx, std::vector<CAccount*>& forAccounts, bool& anyInputsOrOutputsAreMine)> calculateTransactionRecord;
+        std::function<void(const CWalletTx* wtx, std::vector<MutationRecord>& mutations, CAccount* forAccount)> addMutationsForTransaction;
+    };
+
+    explicit CUnityHistoryIndex(RecordBuilders builders) : builders(std::move(builders)) {}
+    ~CUnityHistoryIndex();
+
+    //! Records newest first, skipping the first nOffset records and returning at most nCount.
+    std::vector<TransactionRecord> GetTransactionHistory(CWallet* wallet, CAccount* forAccount, size_t nOffset, size_t nCount);
+    std::vector<MutationRecord> GetMutationHistory(CWallet* wallet, CAccount* forAccount, size_t nOffset, size_t nCount);
+
+private:
+    //! The parts of a transactions state (other than depth itself) that its records depend on.
+    struct RecordState
+    {
+        TransactionStatus status;
+        bool fImmature;
+        bool operator==(const RecordState& other) const { return status == other.status && fImmature == other.fImmature; }
+        bool operator!=(const RecordState& other) const { return !(*this == other); }
+    };
+    struct CachedTransaction
+    {
+        RecordState state;
+        //! Unset if none of the inputs or outputs of the transaction belong to the account (or its children).
+        std::optional<TransactionRecord> record;
+    };
+    struct CachedMutations
+    {
+        RecordState state;
+        std::vector<MutationRecord> mutations;
+    };
+    struct AccountHistory
+    {
+        std::map<uint256, CachedTransaction> transactions;
+        std::map<uint256, CachedMutations> mutations;
+    };
+    typedef std::pair<int64_t, uint256> OrderKey;
+
+    RecordState GetRecordState(const CWalletTx& wtx) const;
+    void MarkDirty(const uint256& hash);
+    void MarkAllDirty();
+    void Sync(CWallet* wallet);
+    void RebuildOrder();
+    //! Walk the wallet transactions newest first until fn returns false.
+    void ForEachTransaction(const std::function<bool(const uint256& hash, const CWalletTx& wtx)>& fn) const;
+
+    const RecordBuilders builders;
+
+    // Guards the dirty state only, which the wallet signals fill; everything else is only touched with cs_wallet held.
+    Mutex cs_dirty;
+    std::set<uint256> setDirty;
+    bool fAllDirty = false;
+
+    CWallet* pwallet = nullptr;
+    std::list<boost::signals2::connection> walletConnections;
+    uint64_t nAccountGeneration = 0;
+
+    std::set<OrderKey, std::greater<OrderKey>> setOrdered;
+    std::map<uint256, int64_t> mapOrderTime;
+    std::map<boost::uuids::uuid, AccountHistory> mapAccountHistory;
+};
+
+extern CUnityHistoryIndex unityHistoryIndex;
+
+#endif
@@ -10,6 +10,7 @@
 
 // Unity specific includes
 #include "unity_impl.h"
+#include "unity_history.h"
 #include "libinit.h"
 
 // Standard munt headers
@@ -330,6 +331,8 @@ TransactionRecord calculateTransactionRecordForWalletTransaction(const CWalletTx
                              inputs, outputs);
 }
 
+CUnityHistoryIndex unityHistoryIndex({GetAccountsForAccount, getStatusForTransaction, calculateTransactionRecordForWalletTransaction, addMutationsForTransaction});
+
 // rate limited balance change notifier
 static CRateLimit<int>* balanceChangeNotifier=nullptr;
 
@@ -1434,23 +1437,10 @@ PaymentResultStatus ILibraryController::performPaymentToRecipient(const UriRecip
     return PaymentResultStatus::SUCCESS;
 }
 
-std::vector<TransactionRecord> getTransactionHistoryForAccount(CAccount* forAccount)
+std::vector<TransactionRecord> getTransactionHistoryForAccount(CAccount* forAccount, size_t offset, size_t count)
 {
-    std::vector<TransactionRecord> ret;    
     LOCK2(cs_main, pactiveWallet->cs_wallet);
-
-    std::vector<CAccount*> forAccounts = GetAccountsForAccount(forAccount);    
-    for (const auto& [hash, wtx] : pactiveWallet->mapWallet)
-    {
-        bool anyInputsOrOutputsAreMine = false;
-        TransactionRecord tx = calculateTransactionRecordForWalletTransaction(wtx, forAccounts, anyInputsOrOutputsAreMine);
-        if (anyInputsOrOutputsAreMine)
-        {
-            ret.push_back(tx);
-        }
-    }
-    std::sort(ret.begin(), ret.end(), [&](TransactionRecord& x, TransactionRecord& y){ return (x.timeStamp > y.timeStamp); });
-    return ret;
+    return unityHistoryIndex.GetTransactionHistory(pactiveWallet, forAccount, offset, count);
 }
 
 std::vector<TransactionRecord> ILibraryController::getTransactionHistory()
@@ -1461,6 +1451,14 @@ std::vector<TransactionRecord> ILibraryController::getTransactionHistory()
     return getTransactionHistoryForAccount(pactiveWallet->activeAccount);
 }
 
+std::vector<TransactionRecord> ILibraryController::getTransactionHistoryPage(int32_t offset, int32_t count)
+{
+    if (!pactiveWallet || offset < 0 || count <= 0)
+        return std::vector<TransactionRecord>();
+
+    return getTransactionHistoryForAccount(pactiveWallet->activeAccount, offset, count);
+}
+
 TransactionRecord ILibraryController::getTransaction(const std::string& txHash)
 {
     if (!pactiveWallet)
@@ -1510,27 +1508,10 @@ std::string ILibraryController::resendTransaction(const std::string& txHash)
     return strHex;
 }
 
-std::vector<MutationRecord> getMutationHistoryForAccount(CAccount* forAccount)
+std::vector<MutationRecord> getMutationHistoryForAccount(CAccount* forAccount, size_t offset, size_t count)
 {
-    std::vector<MutationRecord> ret;
-
     LOCK2(cs_main, pactiveWallet->cs_wallet);
-
-    // wallet transactions in reverse chronological ordering
-    std::vector<const CWalletTx*> vWtx;
-    for (const auto& [hash, wtx] : pactiveWallet->mapWallet)
-    {
-        vWtx.push_back(&wtx);
-    }
-    std::sort(vWtx.begin(), vWtx.end(), [&](const CWalletTx* x, const CWalletTx* y){ return (x->nTimeSmart > y->nTimeSmart); });
-
-    // build mutation list based on transactions
-    for (const CWalletTx* wtx : vWtx)
-    {
-        addMutationsForTransaction(wtx, ret, forAccount);
-    }
-
-    return ret;
+    return unityHistoryIndex.GetMutationHistory(pactiveWallet, forAccount, offset, count);
 }
 
 std::vector<MutationRecord> ILibraryController::getMutationHistory()
@@ -1540,6 +1521,13 @@ std::vector<MutationRecord> ILibraryController::getMutationHistory()
     return getMutationHistoryForAccount(pactiveWallet->activeAccount);
 }
 
+std::vector<MutationRecord> ILibraryController::getMutationHistoryPage(int32_t offset, int32_t count)
+{
+    if (!pactiveWallet || offset < 0 || count <= 0)
+        return std::vector<MutationRecord>();
+    return getMutationHistoryForAccount(pactiveWallet->activeAccount, offset, count);
+}
+
 std::vector<AddressRecord> ILibraryController::getAddressBookRecords()
 {
     std::vector<AddressRecord> ret;
@@ -9,6 +9,9 @@
 #include "i_library_controller.hpp"
 #include "wallet/wallet.h"
 #include "transaction_record.hpp"
+#include "mutation_record.hpp"
+
+#include <limits>
 
 const int RECOMMENDED_CONFIRMATIONS = 3;
 const int BALANCE_NOTIFY_THRESHOLD_MS = 4000;
@@ -16,9 +19,11 @@ const int NEW_MUTATIONS_NOTIFY_THRESHOLD_MS = 10000;
 
 extern std::shared_ptr<ILibraryListener> signalHandler;
 
+extern std::vector<CAccount*> GetAccountsForAccount(CAccount* forAccount);
+extern TransactionStatus getStatusForTransaction(const CWalletTx* wtx);
 extern TransactionRecord calculateTransactionRecordForWalletTransaction(const CWalletTx& wtx, std::vector<CAccount*>& forAccounts, bool& anyInputsOrOutputsAreMine);
-extern std::vector<TransactionRecord> getTransactionHistoryForAccount(CAccount* forAccount);
-extern std::vector<MutationRecord> getMutationHistoryForAccount(CAccount* forAccount);
+extern std::vector<TransactionRecord> getTransactionHistoryForAccount(CAccount* forAccount, size_t offset = 0, size_t count = std::numeric_limits<size_t>::max());
+extern std::vector<MutationRecord> getMutationHistoryForAccount(CAccount* forAccount, size_t offset = 0, size_t count = std::numeric_limits<size_t>::max());
 extern void addMutationsForTransaction(const CWalletTx* wtx, std::vector<MutationRecord>& mutations, CAccount* forAccount);
 
 extern boost::asio::io_context ioctx;
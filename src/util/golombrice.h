@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// File contains modifications by: The Centure developers
+// All modifications:
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef CORE_UTIL_GOLOMBRICE_H
+#define CORE_UTIL_GOLOMBRICE_H
+
+#include <crypto/common.h>
+#include <span.h>
+#include <streams.h>
+
+#include <algorithm>
+#include <ios>
+#include <stdint.h>
+
+template <typename OStream>
+void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t P, uint64_t x)
+{
+    // Write quotient as unary-encoded: q 1's followed by one 0.
+    uint64_t q = x >> P;
+    while (q > 0) {
+        int nbits = q <= 64 ? static_cast<int>(q) : 64;
+        bitwriter.Write(~0ULL, nbits);
+        q -= nbits;
+    }
+    bitwriter.Write(0, 1);
+
+    // Write the remainder in P bits. Since the remainder is just the bottom
+    // P bits of x, there is no need to mask first.
+    bitwriter.Write(x, P);
+}
+
+template <typename IStream>
+uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t P)
+{
+    // Read unary-encoded quotient: q 1's followed by one 0.
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1) {
+        ++q;
+    }
+
+    uint64_t r = bitreader.Read(P);
+
+    return (q << P) + r;
+}
+
+/**
+ * Golomb-Rice decoder for the static/ranged filter matching hot path.
+ * BitStreamReader hands out the unary quotient one bit per call, instead this keeps up to 64 bits of the stream left aligned in a word
+ * (refilled 8 bytes at a time) so that a whole quotient is a single leading ones count and the remainder a single shift.
+ * Produces exactly the values GolombRiceDecode does and likewise throws std::ios_base::failure on truncated input.
+ */
+class GolombRiceWordDecoder
+{
+public:
+    explicit GolombRiceWordDecoder(Span<const unsigned char> data) : m_pos(data.data()), m_end(data.data() + data.size()) {}
+
+    uint64_t Decode(uint8_t P)
+    {
+        uint64_t q = 0;
+        while (true) {
+            Refill();
+            if (m_nBits == 0) {
+                throw std::ios_base::failure("GolombRiceWordDecoder: end of data");
+            }
+            // Bits past m_nBits are either zero or already the correct upcoming stream bits, so only a count that stops inside the valid bits ends the quotient.
+            unsigned int nOnes = 64 - CountBits(~m_buffer);
+            if (nOnes < m_nBits) {
+                q += nOnes;
+                Consume(nOnes + 1);
+                break;
+            }
+            q += m_nBits;
+            Consume(m_nBits);
+        }
+
+        uint64_t r = 0;
+        unsigned int nRemaining = P;
+        while (nRemaining > 0) {
+            Refill();
+            if (m_nBits == 0) {
+                throw std::ios_base::failure("GolombRiceWordDecoder: end of data");
+            }
+            unsigned int nRead = std::min({nRemaining, m_nBits, 56u});
+            r = (r << nRead) | (m_buffer >> (64 - nRead));
+            Consume(nRead);
+            nRemaining -= nRead;
+        }
+
+        return (q << P) + r;
+    }
+
+private:
+    void Refill()
+    {
+        if (m_nBits > 56) {
+            return;
+        }
+        if (m_end - m_pos >= 8) {
+            // Take as many whole bytes as fit, the partial byte that also lands in the word is taken again (or'd in identically) next time.
+            m_buffer |= ReadBE64(m_pos) >> m_nBits;
+            unsigned int nBytes = (63 - m_nBits) >> 3;
+            m_pos += nBytes;
+            m_nBits += nBytes * 8;
+        } else {
+            while (m_nBits <= 56 && m_pos < m_end) {
+                m_buffer |= static_cast<uint64_t>(*m_pos++) << (56 - m_nBits);
+                m_nBits += 8;
+            }
+        }
+    }
+
+    void Consume(unsigned int n)
+    {
+        m_buffer = n < 64 ? m_buffer << n : 0;
+        m_nBits -= n;
+    }
+
+    const unsigned char* m_pos;
+    const unsigned char* m_end;
+    uint64_t m_buffer = 0;
+    unsigned int m_nBits = 0;
+};
+
+#endif // CORE_UTIL_GOLOMBRICE_H
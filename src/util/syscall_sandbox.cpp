@@ -855,6 +855,9 @@ void SetSyscallSandboxPolicy(SyscallSandboxPolicy syscall_policy)
         seccomp_policy_builder.AllowFileSystem();
         seccomp_policy_builder.AllowNetwork();
         break;
+    case SyscallSandboxPolicy::BLOCK_WRITER: // Thread: blockwriter
+        seccomp_policy_builder.AllowFileSystem();
+        break;
     case SyscallSandboxPolicy::MESSAGE_HANDLER: // Thread: msghand
         seccomp_policy_builder.AllowFileSystem();
         break;
@@ -13,6 +13,7 @@ enum class SyscallSandboxPolicy {
     INITIALIZATION_MAP_PORT,
 
     // 2. Steady state (non-initialization, non-shutdown)
+    BLOCK_WRITER,
     MESSAGE_HANDLER,
     NET,
     NET_ADD_CONNECTION,
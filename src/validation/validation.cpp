@@ -206,6 +206,8 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CPoWCacheDB *ppowcachedb = NULL;
+CWitnessWeightDB *pwitnessweightdb = NULL;
 
 bool CheckFinalTx(const CTransaction &tx, const CChain& chain, int flags)
 {
@@ -669,7 +671,9 @@ bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
     LogPrintf("*** %s\n", strMessage);
     uiInterface.ThreadSafeMessageBox(userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage, "", CClientUIInterface::MSG_ERROR);
     LogPrintf("shutdown: triggering shutdown from AbortNode");
-    AppLifecycleManager::gApp->shutdown();
+    // No app instance when validation runs outside of one (unit tests)
+    if (AppLifecycleManager::gApp)
+        AppLifecycleManager::gApp->shutdown();
     return false;
 }
 
@@ -799,10 +803,14 @@ DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex,
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+bool static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    // Everything queued for the block writer has to be on disk before the block index may refer to it.
+    if (!blockStore.SyncPendingWrites())
+        return false;
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = blockStore.GetBlockFile(posOld);
@@ -818,6 +826,10 @@ void static FlushBlockFile(bool fFinalize = false)
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
         FileCommit(fileOld);
     }
+
+    if (fFinalize)
+        blockStore.FinalizeBlockFile(nLastBlockFile);
+    return true;
 }
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
@@ -1469,7 +1481,8 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
         // First make sure all block and undo data is flushed to disk.
-        FlushBlockFile();
+        if (!FlushBlockFile())
+            return AbortNode(state, "Failed to write to block file");
         // Then update all block file information (which may refer to block and undo files).
         {
             std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -1704,6 +1717,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    pow2WitnessCoinIndex.BlockDisconnected(pindexDelete);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     GetMainSignals().BlockDisconnected(pblock);
@@ -1847,6 +1861,18 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+#ifdef WITNESS_HEADER_SYNC
+    // Only deltas we generated ourselves are stored (and served to SPV peers along with the header), replace anything that doesn't match.
+    {
+        std::vector<unsigned char> witnessUTXODelta;
+        if (pow2WitnessCoinIndex.GenerateSimplifiedWitnessUTXODelta(blockConnecting, pindexNew, witnessUTXODelta) && witnessUTXODelta != pindexNew->witnessUTXODelta)
+        {
+            pindexNew->witnessUTXODelta = std::move(witnessUTXODelta);
+            setDirtyBlockIndex.insert(pindexNew);
+        }
+    }
+#endif
+    pow2WitnessCoinIndex.BlockConnected(blockConnecting, pindexNew);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -2386,17 +2412,9 @@ static bool PromoteBlockIndex(CBlockIndex* pindexNew, const CBlockHeader& header
         return false;
 
     // Partial block might not have been fully initalized if it was constructed from a checkpoint, do so here
-    pindexNew->nVersionPoW2Witness = header.nVersionPoW2Witness;
-    pindexNew->nTimePoW2Witness = header.nTimePoW2Witness;
-    pindexNew->hashMerkleRootPoW2Witness = header.hashMerkleRootPoW2Witness;
-    pindexNew->witnessHeaderPoW2Sig = header.witnessHeaderPoW2Sig;
-    pindexNew->nVersion       = header.nVersion;
-    pindexNew->hashMerkleRoot = header.hashMerkleRoot;
-    pindexNew->nTime          = header.nTime;
-    pindexNew->nBits          = header.nBits;
-    pindexNew->nNonce         = header.nNonce;
-
-    pindexNew->pprev = pindexPrev;
+    pindexNew->SetHeader(header);
+
+    pindexNew->SetPrev(pindexPrev);
     pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
     pindexNew->BuildSkip();
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
@@ -2512,7 +2530,8 @@ static bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned i
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+            return state.Error("Failed to write to block file");
         nLastBlockFile = nFile;
     }
 
@@ -2529,11 +2548,8 @@ static bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned i
             if (fPruneMode)
                 fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
-                FILE *file = blockStore.GetBlockFile(pos);
-                if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
-                }
+                LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
+                blockStore.PreallocateBlockFile(pos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
             }
             else
                 return state.Error("out of disk space");
@@ -2561,11 +2577,8 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
         if (fPruneMode)
             fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
-            FILE *file = blockStore.GetUndoFile(pos);
-            if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
-            }
+            LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
+            blockStore.PreallocateUndoFile(pos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
         }
         else
             return state.Error("out of disk space");
@@ -2585,6 +2598,13 @@ static bool CheckBlockHeader(const CBlock& block, CValidationState& state, const
         if (checkedPoWCache.contains(blockHash))
             return checkedPoWCache.get(blockHash);
 
+        // Verified in a previous session (or earlier during this reindex)
+        if (ppowcachedb && ppowcachedb->HaveVerifiedPoW(blockHash))
+        {
+            checkedPoWCache.insert(blockHash, true);
+            return true;
+        }
+
         //fixme: (HIGH) (SYNC) (SPV)
         //Temporary performance boost (at the cost of possible bandwidth attacks) until we can implement witness based syncing
         if (fSPV)
@@ -2602,13 +2622,17 @@ static bool CheckBlockHeader(const CBlock& block, CValidationState& state, const
         }
 
         // Nested if statement for easier breakpoint management
-        if (!CheckProofOfWork(&block, consensusParams))
+        bool fFullyVerified = false;
+        if (!CheckProofOfWork(&block, consensusParams, &fFullyVerified))
         {
             checkedPoWCache.insert(blockHash, false);
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
         }
         
         checkedPoWCache.insert(blockHash, true);
+        // Only persist complete checks, partial (or skipped) checks are redone after a restart.
+        if (fFullyVerified && ppowcachedb)
+            ppowcachedb->WriteVerifiedPoW(blockHash);
     }
     
     return true;
@@ -2933,6 +2957,9 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 
     CBlockIndex* pindexPrev = nullptr;
     bool promoteToFullTree = false;
+#ifdef WITNESS_HEADER_SYNC
+    bool fDropWitnessUTXODelta = false;
+#endif
 
     // Check for duplicate
     uint256 hash = block.GetHashPoW2();
@@ -2947,6 +2974,14 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
                 *ppindex = pindex;
             if (pindex->nStatus & BLOCK_FAILED_MASK)
                 return state.Invalid(error("%s: block %s is marked invalid", __func__, hash.ToString()), 0, "duplicate");
+#ifdef WITNESS_HEADER_SYNC
+            // The peer we got the header from first might not have had a delta for it yet.
+            if (fSPV && pindex->witnessUTXODelta.empty() && !block.witnessUTXODelta.empty())
+            {
+                pindex->witnessUTXODelta = block.witnessUTXODelta;
+                setDirtyBlockIndex.insert(pindex);
+            }
+#endif
             if (!pindex->IsValid(BLOCK_VALID_TREE) && pindex->IsPartialValid(BLOCK_PARTIAL_TREE))
             {
                 // check if the block can be promoted to the full tree
@@ -2987,6 +3022,25 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         if (!fAssumePOWGood && IsPartialSyncActive() && pindexPrev->nHeight < Checkpoints::LastCheckPointHeight() && (GetRandInt(400) != 10))
             fAssumePOWGood = true;
 
+#ifdef WITNESS_HEADER_SYNC
+        // SPV: verify the witness of the header against the simplified witness set instead of sampling its PoW.
+        // The delta isn't committed to by the header, so a bad one (or a witness that doesn't check out against it) only means we fall back to the PoW checks;
+        // for the same reason verification only stands in for the sampled checks below the last checkpoint, everything past it is still fully checked.
+        if (fSPV && pindex == nullptr)
+        {
+            bool fWitnessVerified = false;
+            if (!ConnectSimplifiedWitnessUTXOHeader(block, pindexPrev, fWitnessVerified))
+            {
+                LogPrint(BCLog::WITNESS, "%s: witness UTXO delta of %s does not check out, ignoring it\n", __func__, hash.ToString());
+                fDropWitnessUTXODelta = true;
+            }
+            else if (fWitnessVerified && pindexPrev->nHeight < Checkpoints::LastCheckPointHeight())
+            {
+                fAssumePOWGood = true;
+            }
+        }
+#endif
+
         // CheckBlockHeader can take long so temporarily relinquish the lock to avoid freezing the UI
         LEAVE_CRITICAL_SECTION(cs_main);
         bool blockHeaderIsValid = CheckBlockHeader(block, state, chainparams.GetConsensus(), !fAssumePOWGood);
@@ -3008,7 +3062,14 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     if (promoteToFullTree)
         PromoteBlockIndex(pindex, block, pindexPrev);
     else if (pindex == nullptr)
+    {
         pindex = AddToBlockIndex(chainparams, block);
+#ifdef WITNESS_HEADER_SYNC
+        // Full nodes generate their own delta as they connect the block (see ConnectTip).
+        if (!fSPV || fDropWitnessUTXODelta)
+            pindex->witnessUTXODelta.clear();
+#endif
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3036,9 +3097,88 @@ static void CheckAndNotifyHeaderTip()
         headerTipSignal(pPreviousHeaderTip);
 }
 
+// Verify the PoW of a batch of headers concurrently (outside of cs_main) and seed checkedPoWCache with the headers that pass.
+// This is purely an optimisation, CheckBlockHeader still performs (and caches) the check itself for anything not verified here.
+static void PreCheckBlockHeadersPoW(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    std::vector<CBlockHeader> candidates;
+    std::vector<uint256> candidateHashes;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(headers[0].hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+            return;
+
+        int nHeight = mi->second->nHeight;
+        uint256 hashPrev = headers[0].hashPrevBlock;
+        for (const CBlockHeader& header : headers)
+        {
+            if (header.hashPrevBlock != hashPrev)
+                break;
+            hashPrev = header.GetHashPoW2();
+            ++nHeight;
+
+            // Skip headers that AcceptBlockHeader/CheckBlockHeader would not check anyway.
+            if (mapBlockIndex.count(hashPrev) > 0)
+                continue;
+            if ((fSPV || IsPartialSyncActive()) && nHeight < Checkpoints::LastCheckPointHeight())
+                continue;
+            uint256 hashLegacy = header.GetHashLegacy();
+            if (checkedPoWCache.contains(hashLegacy))
+                continue;
+            candidates.push_back(header);
+            candidateHashes.push_back(hashLegacy);
+        }
+    }
+
+    // The PoW cache database is only consulted once cs_main has been released, it is a disk read per header.
+    std::vector<uint256> hashesVerified;
+    std::vector<CBlockHeader> headersToCheck;
+    std::vector<uint256> hashesToCheck;
+    for (unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        if (ppowcachedb && ppowcachedb->HaveVerifiedPoW(candidateHashes[i]))
+        {
+            hashesVerified.push_back(candidateHashes[i]);
+        }
+        else
+        {
+            headersToCheck.push_back(candidates[i]);
+            hashesToCheck.push_back(candidateHashes[i]);
+        }
+    }
+
+    std::vector<uint8_t> results;
+    if (headersToCheck.size() >= 2)
+        CheckProofOfWorkBatch(headersToCheck, chainparams.GetConsensus(), results);
+    results.resize(headersToCheck.size(), POW_CHECK_FAILED);
+
+    {
+        LOCK(cs_main);
+        for (const uint256& hashLegacy : hashesVerified)
+            checkedPoWCache.insert(hashLegacy, true);
+        for (unsigned int i = 0; i < hashesToCheck.size(); ++i)
+        {
+            if (results[i] != POW_CHECK_FAILED)
+                checkedPoWCache.insert(hashesToCheck[i], true);
+        }
+    }
+    if (ppowcachedb)
+    {
+        for (unsigned int i = 0; i < hashesToCheck.size(); ++i)
+        {
+            if (results[i] == POW_CHECK_FULLY_VERIFIED)
+                ppowcachedb->WriteVerifiedPoW(hashesToCheck[i]);
+        }
+    }
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, bool fAssumePOWGood)
 {
+    if (!fAssumePOWGood && headers.size() > 1)
+        PreCheckBlockHeadersPoW(headers, chainparams);
+
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -3489,7 +3629,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         // a) beyond pindex->pprev in which case it connects to the main chain.
         // b)  to the genesis
         if (pindex->pprev && !pindex->pprev->pprev && pindex->pprev->GetBlockHashPoW2() != Params().GenesisBlock().GetHashPoW2()) {
-            pindex->pprev = 0;
+            pindex->SetPrev(nullptr);
         }
 
         // if we are not in full sync mode any index block not in the partial chain is useless and can and should be removed
@@ -3889,6 +4029,8 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    pow2NetworkWeightSeries.Clear();
+    pow2WitnessCoinIndex.Invalidate();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     partialChain.SetTip(nullptr);
@@ -4375,14 +4517,10 @@ void ComputeNewFilterRanges(uint64_t nWalletBirthBlockHard, uint64_t& nWalletBir
         LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
 
         GCSFilter::ElementSet elementSet;
-        for (const auto& [accountUUID, forAccount] : pactiveWallet->mapAccounts)
+        pactiveWallet->keyIndex.ForEachKey([&](const CKeyID& key)
         {
-            (unused) accountUUID;
-            std::set<CKeyID> setAddresses;
-            forAccount->GetKeys(setAddresses);
-            for (const auto& key : setAddresses)
-                elementSet.insert(std::vector<unsigned char>(key.begin(), key.end()));
-        }
+            elementSet.insert(std::vector<unsigned char>(key.begin(), key.end()));
+        });
         std::vector<std::tuple<uint64_t, uint64_t>> blockFilterRanges;
         getBlockFilterBirthAndRanges(nWalletBirthBlockHard, nWalletBirthBlockSoft, elementSet, blockFilterRanges);
         {
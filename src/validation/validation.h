@@ -55,6 +55,8 @@
 #endif
 class CBlockIndex;
 class CBlockTreeDB;
+class CPoWCacheDB;
+class CWitnessWeightDB;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -564,6 +566,12 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the persistent index of headers with verified PoW (thread safe) */
+extern CPoWCacheDB *ppowcachedb;
+
+/** Global variable that points to the persistent memo of network weight per block (thread safe) */
+extern CWitnessWeightDB *pwitnessweightdb;
+
 struct CBlockIndexWorkComparator
 {
     bool operator()(CBlockIndex *pa, CBlockIndex *pb) const {
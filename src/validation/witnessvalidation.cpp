@@ -20,6 +20,8 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread.hpp>
 
+#include <deque>
+
 #include "alert.h"
 
 
@@ -29,6 +31,9 @@ std::shared_ptr<CCoinsViewCache> ppow2witTip = NULL;
 #ifdef WITNESS_HEADER_SYNC
 SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXO;
 #endif
+CWitnessCoinIndex pow2WitnessCoinIndex;
+// Accessed only via std::atomic_load/std::atomic_store
+static std::shared_ptr<const CWitnessStateSnapshot> witnessStateSnapshot;
 
 //fixme: (PHASE5) Can remove this.
 int GetPoW2WitnessCoinbaseIndex(const CBlock& block)
@@ -248,18 +253,476 @@ uint64_t estimatedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeig
     #undef BASE
 }
 
+void CWitnessCoinDelta::Apply(std::map<COutPoint, Coin>& witnessCoins) const
+{
+    for (const auto& [outPoint, coin] : removed)
+        witnessCoins.erase(outPoint);
+    for (const auto& [outPoint, coin] : added)
+        witnessCoins[outPoint] = coin;
+}
 
-bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain_, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride)
+void CWitnessCoinDelta::Undo(std::map<COutPoint, Coin>& witnessCoins) const
 {
-    DO_BENCHMARK("WIT: getAllUnspentWitnessCoins", BCLog::BENCH|BCLog::WITNESS);
+    for (const auto& [outPoint, coin] : added)
+        witnessCoins.erase(outPoint);
+    for (const auto& [outPoint, coin] : removed)
+        witnessCoins[outPoint] = coin;
+}
+
+void ComputeWitnessCoinDelta(const CBlock& block, uint64_t nHeight, const std::map<COutPoint, Coin>& witnessCoins, CWitnessCoinDelta& delta)
+{
+    delta.nHeight = nHeight;
+    delta.added.clear();
+    delta.removed.clear();
+
+    // Genesis block only ever connects its coinbase and only under specific circumstances (see ConnectBlock)
+    if (nHeight == 0)
+    {
+        if (block.vtx.size() != 1 || block.vtx[0]->vout.size() <= 1)
+            return;
+    }
+
+    // Index based outpoints are resolved against a reference map that we only build if the block actually contains any.
+    std::map<COutPoint, COutPoint> coinRefs;
+    bool fHaveCoinRefs = false;
+    auto resolveOutPoint = [&](const COutPoint& prevOut) -> COutPoint
+    {
+        if (prevOut.isHash)
+            return prevOut;
+        if (!fHaveCoinRefs)
+        {
+            for (const auto& [outPoint, coin] : witnessCoins)
+                coinRefs[COutPoint(coin.nHeight, coin.nTxIndex, outPoint.n)] = outPoint;
+            for (const auto& [outPoint, coin] : delta.added)
+                coinRefs[COutPoint(coin.nHeight, coin.nTxIndex, outPoint.n)] = outPoint;
+            fHaveCoinRefs = true;
+        }
+        auto refIter = coinRefs.find(prevOut);
+        if (refIter == coinRefs.end())
+            return prevOut;
+        return refIter->second;
+    };
+
+    for (unsigned int txIndex = 0; txIndex < block.vtx.size(); ++txIndex)
+    {
+        const CTransaction& tx = *block.vtx[txIndex];
+        if (!tx.IsCoinBase() || tx.IsPoW2WitnessCoinBase())
+        {
+            for (const CTxIn& txin : tx.vin)
+            {
+                if (txin.GetPrevOut().IsNull())
+                    continue;
+                COutPoint outPoint = resolveOutPoint(txin.GetPrevOut());
+                if (!outPoint.isHash)
+                    continue;
+                if (delta.added.erase(outPoint) > 0)
+                    continue;
+                auto coinIter = witnessCoins.find(outPoint);
+                if (coinIter != witnessCoins.end())
+                    delta.removed[outPoint] = coinIter->second;
+            }
+        }
+
+        const uint256& txid = tx.GetHash();
+        for (unsigned int i = 0; i < tx.vout.size(); ++i)
+        {
+            if (IsPow2WitnessOutput(tx.vout[i]))
+            {
+                Coin coin(tx.vout[i], nHeight, txIndex, tx.IsCoinBase(), !IsOldTransactionVersion(tx.nVersion));
+                if (fHaveCoinRefs)
+                    coinRefs[COutPoint(nHeight, txIndex, i)] = COutPoint(txid, i);
+                delta.added[COutPoint(txid, i)] = coin;
+            }
+        }
+    }
+}
+
+static int64_t GetWitnessCoinRawWeight(const Coin& coin, int64_t nHeight)
+{
+    uint64_t nUnused1, nUnused2;
+    return GetPoW2RawWeightForAmount(coin.out.nValue, nHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+}
+
+// Roulette weight of a witness coin for the block after nPreviousHeight; returns false if the coin doesn't meet the basic criteria of minimum weight/amount.
+static bool GetWitnessRouletteWeight(const Coin& coin, uint64_t nPreviousHeight, uint64_t& nWeight)
+{
+    if (coin.out.nValue >= ((nPreviousHeight+1 > 100000 ? gMinimumWitnessAmount : gMinimumWitnessAmountOld)*COIN))
+    {
+        uint64_t nUnused1, nUnused2;
+        int64_t nRawWeight = GetPoW2RawWeightForAmount(coin.out.nValue, nPreviousHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+        if (nRawWeight < (nPreviousHeight+1 > 100000 ? gMinimumWitnessWeight : gMinimumWitnessWeightOld))
+            return false;
+        nWeight = nRawWeight;
+        return true;
+    }
+    else if (coin.out.output.witnessDetails.lockFromBlock == 1)
+    {
+        nWeight = 0;
+        return true;
+    }
+    return false;
+}
+
+// Candidates determined for one previous height are valid for another as long as neither the weight formula nor the minimums differ between them.
+static bool SameWitnessRouletteRules(uint64_t nPreviousHeightA, uint64_t nPreviousHeightB)
+{
+    return GetPoW2RawWeightEra(nPreviousHeightA) == GetPoW2RawWeightEra(nPreviousHeightB) && (nPreviousHeightA+1 > 100000) == (nPreviousHeightB+1 > 100000);
+}
+
+static bool AddWitnessRouletteCandidate(CWitnessRouletteColumns& columns, const COutPoint& outPoint, const Coin& coin)
+{
+    uint64_t nWeight;
+    if (!GetWitnessRouletteWeight(coin, columns.nPreviousHeight, nWeight))
+        return false;
+    CTxOutPoW2Witness details;
+    GetPow2WitnessOutput(coin.out, details);
+    columns.push_back(outPoint, coin.nHeight, nWeight, details.lockUntilBlock);
+    return true;
+}
+
+void BuildWitnessRouletteColumns(const std::map<COutPoint, Coin>& witnessCoins, uint64_t nPreviousHeight, CWitnessRouletteColumns& columns)
+{
+    columns.clear();
+    columns.nPreviousHeight = nPreviousHeight;
+    columns.reserve(witnessCoins.size());
+    for (const auto& [outPoint, coin] : witnessCoins)
+        AddWitnessRouletteCandidate(columns, outPoint, coin);
+}
+
+void UpdateWitnessRouletteColumns(const CWitnessRouletteColumns& previous, const CWitnessCoinDelta& delta, bool fUndo, const std::map<COutPoint, Coin>& witnessCoins, uint64_t nPreviousHeight, CWitnessRouletteColumns& columns)
+{
+    if (!SameWitnessRouletteRules(previous.nPreviousHeight, nPreviousHeight))
+    {
+        BuildWitnessRouletteColumns(witnessCoins, nPreviousHeight, columns);
+        return;
+    }
+
+    // Merge the (outpoint ordered) candidates with the (likewise ordered) coins the delta adds, dropping those it removes.
+    const auto& erased = fUndo ? delta.added : delta.removed;
+    const auto& inserted = fUndo ? delta.removed : delta.added;
+    columns.clear();
+    columns.nPreviousHeight = nPreviousHeight;
+    columns.reserve(previous.size() + inserted.size());
+    auto insertIter = inserted.begin();
+    for (size_t i = 0; i < previous.size(); ++i)
+    {
+        const COutPoint& outPoint = previous.outpoint[i];
+        for (; insertIter != inserted.end() && insertIter->first < outPoint; ++insertIter)
+            AddWitnessRouletteCandidate(columns, insertIter->first, insertIter->second);
+        if (erased.count(outPoint) > 0 || (insertIter != inserted.end() && insertIter->first == outPoint))
+            continue;
+        columns.push_back(outPoint, previous.coinHeight[i], previous.weight[i], previous.lockUntilBlock[i]);
+    }
+    for (; insertIter != inserted.end(); ++insertIter)
+        AddWitnessRouletteCandidate(columns, insertIter->first, insertIter->second);
+}
+
+// In phase 3 the witness set for a witnessed block is that of its PoW block (sans witness coinbase), which the index does not track.
+static bool IsPhase3WitnessedIndex(const CBlockIndex* pIndex)
+{
+    return pIndex->nHeight > 0 && pIndex->nVersionPoW2Witness != 0 && !IsPow2Phase4Active(pIndex->pprev);
+}
+
+void CWitnessCoinIndex::RecalculateTipNetworkWeight(int64_t nTipHeight)
+{
+    nTipNumWitnessAddresses = tipWitnessCoins->size();
+    nTipNetworkWeight = 0;
+    for (const auto& [outPoint, coin] : *tipWitnessCoins)
+        nTipNetworkWeight += GetWitnessCoinRawWeight(coin, nTipHeight);
+}
+
+void CWitnessCoinIndex::RecordTipNetworkWeight(const CBlockIndex* pTip)
+{
+    if (IsPhase3WitnessedIndex(pTip))
+        return;
+    if ((uint64_t)pTip->nHeight < Params().GetConsensus().pow2Phase2FirstBlockHeight)
+        pow2NetworkWeightSeries.Record(pTip->GetBlockHashPoW2(), pTip->nHeight, 0, 0);
+    else
+        pow2NetworkWeightSeries.Record(pTip->GetBlockHashPoW2(), pTip->nHeight, nTipNumWitnessAddresses, nTipNetworkWeight);
+}
+
+void CWitnessCoinIndex::PublishSnapshot(const CBlockIndex* pTip)
+{
+    std::shared_ptr<CWitnessStateSnapshot> snapshot;
+    if (pTip && !IsPhase3WitnessedIndex(pTip))
+    {
+        snapshot = std::make_shared<CWitnessStateSnapshot>();
+        snapshot->pTip = pTip;
+        snapshot->tipHash = pTip->GetBlockHashPoW2();
+        snapshot->nTipHeight = pTip->nHeight;
+        if ((uint64_t)pTip->nHeight >= Params().GetConsensus().pow2Phase2FirstBlockHeight)
+        {
+            snapshot->witnessCoins = tipWitnessCoins;
+            snapshot->nNumWitnessAddresses = nTipNumWitnessAddresses;
+            snapshot->nTotalWeight = nTipNetworkWeight;
+            snapshot->rouletteColumns = tipRouletteColumns;
+        }
+        for (const CBlockIndex* pIter = pTip; pIter && pIter->phashBlock && (int64_t)snapshot->recentDeltas.size() < WITNESS_COIN_INDEX_DELTA_DEPTH; pIter = pIter->pprev)
+        {
+            auto deltaIter = blockDeltas.find(pIter->GetBlockHashPoW2());
+            if (deltaIter == blockDeltas.end())
+                break;
+            snapshot->recentDeltas.push_back(deltaIter->second);
+        }
+    }
+    std::atomic_store(&witnessStateSnapshot, std::shared_ptr<const CWitnessStateSnapshot>(std::move(snapshot)));
+}
+
+std::shared_ptr<const CWitnessStateSnapshot> GetWitnessStateSnapshot(bool fBuildIfUnpublished)
+{
+    auto witnessSnapshot = std::atomic_load(&witnessStateSnapshot);
+    if (witnessSnapshot)
+        return witnessSnapshot;
 
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
-    #else
+    // Nothing published yet (or the index lost sync), bring the index up to date which publishes a fresh snapshot.
     LOCK(cs_main);
-    #endif
+    pow2WitnessCoinIndex.SyncWithTip();
+    witnessSnapshot = std::atomic_load(&witnessStateSnapshot);
+    if (witnessSnapshot || !fBuildIfUnpublished || !chainActive.Tip())
+        return witnessSnapshot;
+
+    const CBlockIndex* pTip = chainActive.Tip();
+    auto oneOffSnapshot = std::make_shared<CWitnessStateSnapshot>();
+    oneOffSnapshot->pTip = pTip;
+    oneOffSnapshot->tipHash = pTip->GetBlockHashPoW2();
+    oneOffSnapshot->nTipHeight = pTip->nHeight;
+    if (!getAllUnspentWitnessCoins(chainActive, Params(), pTip, oneOffSnapshot->witnessCoins))
+        return nullptr;
+    oneOffSnapshot->nNumWitnessAddresses = oneOffSnapshot->witnessCoins->size();
+    for (const auto& [outPoint, coin] : *oneOffSnapshot->witnessCoins)
+        oneOffSnapshot->nTotalWeight += GetWitnessCoinRawWeight(coin, pTip->nHeight);
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    BuildWitnessRouletteColumns(*oneOffSnapshot->witnessCoins, pTip->nHeight, *rouletteColumns);
+    oneOffSnapshot->rouletteColumns = std::move(rouletteColumns);
+    return oneOffSnapshot;
+}
+
+bool CWitnessStateSnapshot::RewindWitnessCoins(std::map<COutPoint, Coin>& witnessCoins_, int64_t& nHeight, const CBlockIndex* pTarget) const
+{
+    if (pTarget->nHeight > nHeight || nHeight > nTipHeight || nTipHeight - pTarget->nHeight > (int64_t)recentDeltas.size())
+        return false;
+    if (IsPhase3WitnessedIndex(pTarget) || pTip->GetAncestor(pTarget->nHeight) != pTarget)
+        return false;
+    for (; nHeight > pTarget->nHeight; --nHeight)
+        recentDeltas[nTipHeight - nHeight]->Undo(witnessCoins_);
+    return true;
+}
+
+bool CWitnessCoinIndex::SyncWithTip()
+{
+    AssertLockHeld(cs_main);
+
+    CBlockIndex* pTip = chainActive.Tip();
+    if (!pTip || !ppow2witTip)
+        return false;
+    if (fSynced && tipHash == pTip->GetBlockHashPoW2())
+        return true;
+
+    // The witness view is only usable as a base if it reflects the current tip.
+    if (pcoinsTip->GetBestBlock() != pTip->GetBlockHashPoW2())
+        return false;
+
+    DO_BENCHMARK("WIT: CWitnessCoinIndex::SyncWithTip", BCLog::BENCH|BCLog::WITNESS);
+    auto witnessCoins = std::make_shared<std::map<COutPoint, Coin>>();
+    ppow2witTip->GetAllCoins(*witnessCoins);
+    tipWitnessCoins = std::move(witnessCoins);
+    tipHash = pTip->GetBlockHashPoW2();
+    RecalculateTipNetworkWeight(pTip->nHeight);
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    BuildWitnessRouletteColumns(*tipWitnessCoins, pTip->nHeight, *rouletteColumns);
+    tipRouletteColumns = std::move(rouletteColumns);
+    fSynced = true;
+    PublishSnapshot(pTip);
+    return true;
+}
+
+void CWitnessCoinIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fSynced || !pindex->pprev || tipHash != pindex->pprev->GetBlockHashPoW2())
+    {
+        // Rebuild straight away (rather than on first use) so that the network weight series keeps up with the chain.
+        Invalidate();
+        if (SyncWithTip())
+            RecordTipNetworkWeight(pindex);
+        return;
+    }
+
+    auto delta = std::make_shared<CWitnessCoinDelta>();
+    ComputeWitnessCoinDelta(block, pindex->nHeight, *tipWitnessCoins, *delta);
+    blockDeltas[pindex->GetBlockHashPoW2()] = delta;
+    // Snapshots of the previous tip may still be in use, so the new set is a copy rather than an in place update.
+    auto witnessCoins = std::make_shared<std::map<COutPoint, Coin>>(*tipWitnessCoins);
+    delta->Apply(*witnessCoins);
+    tipWitnessCoins = std::move(witnessCoins);
+    tipHash = pindex->GetBlockHashPoW2();
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    UpdateWitnessRouletteColumns(*tipRouletteColumns, *delta, false, *tipWitnessCoins, pindex->nHeight, *rouletteColumns);
+    tipRouletteColumns = std::move(rouletteColumns);
+
+    if (GetPoW2RawWeightEra(pindex->nHeight) != GetPoW2RawWeightEra(pindex->pprev->nHeight))
+    {
+        RecalculateTipNetworkWeight(pindex->nHeight);
+    }
+    else
+    {
+        for (const auto& [outPoint, coin] : delta->removed)
+            nTipNetworkWeight -= GetWitnessCoinRawWeight(coin, pindex->nHeight);
+        for (const auto& [outPoint, coin] : delta->added)
+            nTipNetworkWeight += GetWitnessCoinRawWeight(coin, pindex->nHeight);
+        nTipNumWitnessAddresses = tipWitnessCoins->size();
+    }
+    RecordTipNetworkWeight(pindex);
+    PublishSnapshot(pindex);
+
+    for (auto iter = blockDeltas.begin(); iter != blockDeltas.end();)
+    {
+        if ((int64_t)iter->second->nHeight + WITNESS_COIN_INDEX_DELTA_DEPTH < pindex->nHeight)
+            iter = blockDeltas.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+void CWitnessCoinIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fSynced || tipHash != pindex->GetBlockHashPoW2() || !pindex->pprev)
+    {
+        Invalidate();
+        return;
+    }
+
+    // Blocks connected before we started tracking have no delta, in which case we simply rebuild on next use.
+    auto deltaIter = blockDeltas.find(tipHash);
+    if (deltaIter == blockDeltas.end())
+    {
+        Invalidate();
+        return;
+    }
+    // NB! The delta is deliberately retained so that the block can be cheaply examined again as part of a fork.
+    auto witnessCoins = std::make_shared<std::map<COutPoint, Coin>>(*tipWitnessCoins);
+    deltaIter->second->Undo(*witnessCoins);
+    tipWitnessCoins = std::move(witnessCoins);
+    tipHash = pindex->pprev->GetBlockHashPoW2();
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    UpdateWitnessRouletteColumns(*tipRouletteColumns, *deltaIter->second, true, *tipWitnessCoins, pindex->pprev->nHeight, *rouletteColumns);
+    tipRouletteColumns = std::move(rouletteColumns);
+
+    if (GetPoW2RawWeightEra(pindex->nHeight) != GetPoW2RawWeightEra(pindex->pprev->nHeight))
+    {
+        RecalculateTipNetworkWeight(pindex->pprev->nHeight);
+    }
+    else
+    {
+        for (const auto& [outPoint, coin] : deltaIter->second->added)
+            nTipNetworkWeight -= GetWitnessCoinRawWeight(coin, pindex->pprev->nHeight);
+        for (const auto& [outPoint, coin] : deltaIter->second->removed)
+            nTipNetworkWeight += GetWitnessCoinRawWeight(coin, pindex->pprev->nHeight);
+        nTipNumWitnessAddresses = tipWitnessCoins->size();
+    }
+    PublishSnapshot(pindex->pprev);
+}
+
+void CWitnessCoinIndex::Invalidate()
+{
+    fSynced = false;
+    tipHash = uint256();
+    tipWitnessCoins = std::make_shared<const std::map<COutPoint, Coin>>();
+    tipRouletteColumns = std::make_shared<const CWitnessRouletteColumns>();
+    nTipNumWitnessAddresses = 0;
+    nTipNetworkWeight = 0;
+    std::atomic_store(&witnessStateSnapshot, std::shared_ptr<const CWitnessStateSnapshot>());
+}
+
+bool CWitnessCoinIndex::GetWitnessCoinsForIndex(const CBlockIndex* pindex, const CChainParams& chainParams, std::map<COutPoint, Coin>& witnessCoins)
+{
+    AssertLockHeld(cs_main);
+
+    if (!SyncWithTip())
+        return false;
+
+    const CBlockIndex* pTip = chainActive.Tip();
+    if (pindex == pTip)
+    {
+        witnessCoins = *tipWitnessCoins;
+        return true;
+    }
+
+    // Gather the blocks between the active chain and 'pindex' (if pindex is on a fork)
+    std::vector<const CBlockIndex*> vForkBlocks;
+    const CBlockIndex* pFork = pindex;
+    while (pFork && !chainActive.Contains(pFork))
+    {
+        if ((int64_t)vForkBlocks.size() >= WITNESS_COIN_INDEX_DELTA_DEPTH || !pFork->phashBlock)
+            return false;
+        vForkBlocks.push_back(pFork);
+        pFork = pFork->pprev;
+    }
+    if (!pFork || pTip->nHeight - pFork->nHeight > WITNESS_COIN_INDEX_DELTA_DEPTH)
+        return false;
+
+    // Rewind from the tip to the fork point
+    witnessCoins = *tipWitnessCoins;
+    for (const CBlockIndex* pIter = pTip; pIter != pFork; pIter = pIter->pprev)
+    {
+        auto deltaIter = blockDeltas.find(pIter->GetBlockHashPoW2());
+        if (deltaIter == blockDeltas.end())
+            return false;
+        deltaIter->second->Undo(witnessCoins);
+    }
+
+    // Then forward along the fork, computing (and retaining) deltas for any fork blocks we haven't seen connected before
+    for (auto iter = vForkBlocks.rbegin(); iter != vForkBlocks.rend(); ++iter)
+    {
+        const CBlockIndex* pIter = *iter;
+        auto deltaIter = blockDeltas.find(pIter->GetBlockHashPoW2());
+        if (deltaIter == blockDeltas.end())
+        {
+            if (!(pIter->nStatus & BLOCK_HAVE_DATA))
+                return false;
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pIter, chainParams))
+                return false;
+            auto delta = std::make_shared<CWitnessCoinDelta>();
+            ComputeWitnessCoinDelta(block, pIter->nHeight, witnessCoins, *delta);
+            deltaIter = blockDeltas.emplace(pIter->GetBlockHashPoW2(), std::move(delta)).first;
+        }
+        deltaIter->second->Apply(witnessCoins);
+    }
+    return true;
+}
 
-    assert(pPreviousIndexChain_);
+// Strip any witness information from a block, leaving only the PoW portion of the block.
+static void StripWitnessFromBlock(CBlock& block)
+{
+    if (block.nVersionPoW2Witness != 0)
+    {
+        for (unsigned int i = 1; i < block.vtx.size(); i++)
+        {
+            if (block.vtx[i]->IsCoinBase() && block.vtx[i]->IsPoW2WitnessCoinBase())
+            {
+                while (block.vtx.size() > i)
+                {
+                    block.vtx.pop_back();
+                }
+                break;
+            }
+        }
+        block.nVersionPoW2Witness = 0;
+        block.nTimePoW2Witness = 0;
+        block.hashMerkleRootPoW2Witness = uint256();
+        block.witnessHeaderPoW2Sig.clear();
+    }
+}
+
+// Slow path for getAllUnspentWitnessCoins, for when the witness coin index is unable to answer (deep forks, phase 3 PoW blocks, missing block data)
+static bool getAllUnspentWitnessCoinsFromCloneChain(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain_, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride)
+{
+    DO_BENCHMARK("WIT: getAllUnspentWitnessCoinsFromCloneChain", BCLog::BENCH|BCLog::WITNESS);
+    AssertLockHeld(cs_main);
 
     allWitnessCoins.clear();
     //fixme: (PHASE5) Add more error handling to this function.
@@ -295,7 +758,7 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
         {
             CBlockIndex* pPreviousIndexChainPoW = new CBlockIndex(*GetPoWBlockForPoSBlock(pPreviousIndexChain));
             assert(pPreviousIndexChainPoW);
-            pPreviousIndexChainPoW->pprev = pPreviousIndexChain->pprev;
+            pPreviousIndexChainPoW->SetPrev(pPreviousIndexChain->pprev);
             ForceActivateChainWithBlockAsTip(pPreviousIndexChain->pprev, nullptr, state, chainParams, tempChain, viewNew, pPreviousIndexChainPoW);
             pPreviousIndexChain = tempChain.Tip();
         }
@@ -305,24 +768,7 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
     if (newBlock)
     {
         // Strip any witness information from the block we have been given we want a non-witness block as the tip in order to calculate the witness for it.
-        if (newBlock->nVersionPoW2Witness != 0)
-        {
-            for (unsigned int i = 1; i < newBlock->vtx.size(); i++)
-            {
-                if (newBlock->vtx[i]->IsCoinBase() && newBlock->vtx[i]->IsPoW2WitnessCoinBase())
-                {
-                    while (newBlock->vtx.size() > i)
-                    {
-                        newBlock->vtx.pop_back();
-                    }
-                    break;
-                }
-            }
-            newBlock->nVersionPoW2Witness = 0;
-            newBlock->nTimePoW2Witness = 0;
-            newBlock->hashMerkleRootPoW2Witness = uint256();
-            newBlock->witnessHeaderPoW2Sig.clear();
-        }
+        StripWitnessFromBlock(*newBlock);
 
         // Place the block in question at the tip of the chain.
         CBlockIndex indexDummy(*newBlock);
@@ -346,183 +792,376 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
     return true;
 }
 
-
-//fixme: (PHASE5) Improve error handling.
-//fixme: (PHASE5) Handle nodes with excessive pruning. //pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+// Serve the witness set as of pPreviousIndexChain from the published snapshot, without taking any locks, if it is the snapshot tip or one of its recent ancestors.
+static bool getAllUnspentWitnessCoinsFromSnapshot(const CBlockIndex* pPreviousIndexChain, std::shared_ptr<const std::map<COutPoint, Coin>>& allWitnessCoins)
 {
-    DO_BENCHMARK("WIT: GetWitnessHelper", BCLog::BENCH|BCLog::WITNESS);
-
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
-
-    /** Generate the pool of potential witnesses for the given block index **/
-    /** Addresses younger than nMinAge blocks are discarded **/
-    uint64_t nMinAge = gMinimumParticipationAge;
-    while (true)
+    auto witnessSnapshot = std::atomic_load(&witnessStateSnapshot);
+    if (!witnessSnapshot)
+        return false;
+    if (witnessSnapshot->pTip == pPreviousIndexChain)
     {
-        witnessInfo.witnessSelectionPoolFiltered.clear();
-        witnessInfo.witnessSelectionPoolFiltered = witnessInfo.witnessSelectionPoolUnfiltered;
+        allWitnessCoins = witnessSnapshot->witnessCoins;
+        return true;
+    }
+    if (witnessSnapshot->nTipHeight - pPreviousIndexChain->nHeight > (int64_t)witnessSnapshot->recentDeltas.size())
+        return false;
 
-        /** Eliminate addresses that have witnessed within the last `gMinimumParticipationAge` blocks **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
+    auto witnessCoins = std::make_shared<std::map<COutPoint, Coin>>(*witnessSnapshot->witnessCoins);
+    int64_t nHeight = witnessSnapshot->nTipHeight;
+    if (!witnessSnapshot->RewindWitnessCoins(*witnessCoins, nHeight, pPreviousIndexChain))
+        return false;
+    allWitnessCoins = std::move(witnessCoins);
+    return true;
+}
 
-        /** Eliminate addresses that have not witnessed within the expected period of time that they should have **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, witnessInfo.nTotalWeightRaw); }), witnessInfo.witnessSelectionPoolFiltered.end());
+// The snapshot and the witness coin index only hold connected blocks, unlike the clone chain they don't run ConnectBlock on a new block that is applied on top of them.
+// So they can only serve a new block that is already connected on top of pPreviousIndexChain, or whose spends are all present in a view of pPreviousIndexChain; otherwise its delta could drop witness coins that ConnectBlock would never let it spend.
+// A view override that is positioned anywhere else than pPreviousIndexChain is likewise beyond them.
+static bool CanApplyBlockToWitnessCoins(const CChain& chain, const CBlockIndex* pPreviousIndexChain, const CBlock* newBlock, const CCoinsViewCache* viewOverride)
+{
+    AssertLockHeld(cs_main);
 
-        /** Eliminate addresses that are within 100 blocks from lock period expiring, or whose lock period has expired. **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight) <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
+    if (viewOverride && viewOverride->GetBestBlock() != pPreviousIndexChain->GetBlockHashPoW2())
+        return false;
+    if (!newBlock)
+        return true;
 
-        // We must have at least 100 accounts to keep odds of being selected down below 1% at all times.
-        if (witnessInfo.witnessSelectionPoolFiltered.size() < 100)
-        {
-            if(!Params().IsTestnet() && nBlockHeight > 880000)
-                CAlert::Notify("Warning network is experiencing low levels of witnessing participants!", true, true);
+    const CBlockIndex* pNextIndex = chain.Next(pPreviousIndexChain);
+    if (pNextIndex && pNextIndex->GetBlockHashLegacy() == newBlock->GetHashLegacy())
+        return true;
 
+    const CCoinsViewCache& view = viewOverride ? *viewOverride : *pcoinsTip;
+    if (view.GetBestBlock() != pPreviousIndexChain->GetBlockHashPoW2())
+        return false;
 
-            // NB!! This part of the code should (ideally) never actually be used, it exists only for instances where there are a shortage of witnesses paticipating on the network.
-            if (nMinAge == 0 || (nMinAge <= 10 && witnessInfo.witnessSelectionPoolFiltered.size() > 5))
-            {
-                break;
-            }
-            else
+    uint64_t nHeight = pPreviousIndexChain->nHeight + 1;
+    std::set<uint256> blockTxids;
+    std::set<COutPoint> spent;
+    for (unsigned int txIndex = 0; txIndex < newBlock->vtx.size(); ++txIndex)
+    {
+        const CTransaction& tx = *newBlock->vtx[txIndex];
+        if (!tx.IsCoinBase() || tx.IsPoW2WitnessCoinBase())
+        {
+            for (const CTxIn& txin : tx.vin)
             {
-                // Try again to reach 100 candidates with a smaller min age.
-                nMinAge -= 5;
+                const COutPoint& prevOut = txin.GetPrevOut();
+                if (prevOut.IsNull())
+                    continue;
+                if (!spent.insert(prevOut).second)
+                    return false;
+                bool fCreatedInBlock = prevOut.isHash ? blockTxids.count(prevOut.getTransactionHash()) > 0 : (prevOut.getTransactionBlockNumber() == nHeight && prevOut.getTransactionIndex() < txIndex);
+                if (!fCreatedInBlock && !view.HaveCoin(prevOut))
+                    return false;
             }
         }
-        else
-        {
-            break;
-        }
+        blockTxids.insert(tx.GetHash());
     }
+    return true;
+}
 
-    if (witnessInfo.witnessSelectionPoolFiltered.size() == 0)
-    {
-        return error("Unable to determine any witnesses for block.");
-    }
+bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride)
+{
+    DO_BENCHMARK("WIT: getAllUnspentWitnessCoins", BCLog::BENCH|BCLog::WITNESS);
 
-    /** Ensure the pool is sorted deterministically **/
-    std::sort(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end());
+    assert(pPreviousIndexChain);
 
-    /** Calculate total eligible weight **/
-    witnessInfo.nTotalWeightEligibleRaw = 0;
-    for (auto& item : witnessInfo.witnessSelectionPoolFiltered)
+    allWitnessCoins.clear();
+    if ((uint64_t)pPreviousIndexChain->nHeight < Params().GetConsensus().pow2Phase2FirstBlockHeight)
+        return true;
+
+    // By far the most common case is a request for the current tip (or a block just below it), which we can serve from the published snapshot without taking any locks.
+    std::shared_ptr<const std::map<COutPoint, Coin>> snapshotWitnessCoins;
+    if (!newBlock && !viewOverride && getAllUnspentWitnessCoinsFromSnapshot(pPreviousIndexChain, snapshotWitnessCoins))
     {
-        witnessInfo.nTotalWeightEligibleRaw += item.nWeight;
+        allWitnessCoins = *snapshotWitnessCoins;
+        return true;
     }
 
-    uint64_t genesisWeight=0;
-    if (Params().numGenesisWitnesses > 0)
+    LOCK(cs_main);
+
+    bool fServed = false;
+    if (CanApplyBlockToWitnessCoins(chain, pPreviousIndexChain, newBlock, viewOverride))
     {
-        if (nBlockHeight > 300)
+        if (getAllUnspentWitnessCoinsFromSnapshot(pPreviousIndexChain, snapshotWitnessCoins))
         {
-            genesisWeight = std::max(witnessInfo.nTotalWeightEligibleRaw / Params().genesisWitnessWeightDivisor, (uint64_t)1);
+            allWitnessCoins = *snapshotWitnessCoins;
+            fServed = true;
         }
-        else
+        // The index only tracks full blocks so phase 3 witnessed blocks are left to the slow path.
+        else if (!IsPhase3WitnessedIndex(pPreviousIndexChain))
         {
-            genesisWeight = std::max(witnessInfo.nTotalWeightEligibleRaw / Params().genesisWitnessWeightDivisor, (uint64_t)1000);
+            fServed = pow2WitnessCoinIndex.GetWitnessCoinsForIndex(pPreviousIndexChain, chainParams, allWitnessCoins);
         }
-        witnessInfo.nTotalWeightEligibleRaw += Params().numGenesisWitnesses*genesisWeight;
     }
-    
-    /** Reduce larger weightings to a maximum weighting of 1% of network weight. **/
-    /** NB!! this actually will end up a little bit more than 1% as the overall network weight will also be reduced as a result. **/
-    /** This is however unimportant as 1% is in and of itself also somewhat arbitrary, simpler code is favoured here over exactness. **/
-    /** So we delibritely make no attempt to compensate for this. **/
-    witnessInfo.nMaxIndividualWeight = std::max(witnessInfo.nTotalWeightEligibleRaw / 100, (uint64_t)1);
-    witnessInfo.nTotalWeightEligibleAdjusted = 0;
-    for (auto& item : witnessInfo.witnessSelectionPoolFiltered)
+    if (!fServed)
     {
-        if (item.nWeight == 0)
-            item.nWeight = genesisWeight;
-        if (item.nWeight > witnessInfo.nMaxIndividualWeight)
-            item.nWeight = witnessInfo.nMaxIndividualWeight;
-        witnessInfo.nTotalWeightEligibleAdjusted += item.nWeight;
-        item.nCumulativeWeight = witnessInfo.nTotalWeightEligibleAdjusted;
+        LogPrint(BCLog::WITNESS, "getAllUnspentWitnessCoins: witness coin index unable to serve [%s] falling back to chain replay\n", pPreviousIndexChain->phashBlock ? pPreviousIndexChain->GetBlockHashPoW2().ToString() : "dummy");
+        return getAllUnspentWitnessCoinsFromCloneChain(chain, chainParams, pPreviousIndexChain, allWitnessCoins, newBlock, viewOverride);
     }
 
-    /** sha256 as random roulette spin/seed - NB! We delibritely use sha256 and -not- the normal PoW hash here as the normal PoW hash is biased towards certain number ranges by -design- (block target) so is not a good RNG... **/
-    arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
-
-    //fixme: (PHASE5) Update whitepaper then delete this code.
-    /** ensure random seed exceeds one full spin of the wheel to prevent any possible bias towards low numbers **/
-    //while (rouletteSelectionSeed < witnessInfo.nTotalWeightEligibleAdjusted)
-    //{
-        //rouletteSelectionSeed = rouletteSelectionSeed * 2;
-    //}
-
-    /** Reduce selection number to fit within possible range of values **/
-    if (rouletteSelectionSeed > arith_uint256(witnessInfo.nTotalWeightEligibleAdjusted))
+    // If we have been passed a new tip block (not yet part of the chain) then apply it on top.
+    if (newBlock)
     {
-        // 'BigNum' Modulo operator via mathematical identity:  a % b = a - (b * int(a/b))
-        rouletteSelectionSeed = rouletteSelectionSeed - (arith_uint256(witnessInfo.nTotalWeightEligibleAdjusted) * arith_uint256(rouletteSelectionSeed/arith_uint256(witnessInfo.nTotalWeightEligibleAdjusted)));
+        StripWitnessFromBlock(*newBlock);
+        CWitnessCoinDelta delta;
+        ComputeWitnessCoinDelta(*newBlock, pPreviousIndexChain->nHeight + 1, allWitnessCoins, delta);
+        delta.Apply(allWitnessCoins);
     }
-
-    /** Perform selection **/
-    auto selectedWitness = std::lower_bound(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), rouletteSelectionSeed.GetLow64());
-    witnessInfo.selectedWitnessTransaction = selectedWitness->coin.out;
-    witnessInfo.selectedWitnessIndex = selectedWitness-(witnessInfo.witnessSelectionPoolFiltered.begin());
-    witnessInfo.selectedWitnessBlockHeight = selectedWitness->coin.nHeight;
-    witnessInfo.selectedWitnessOutpoint = selectedWitness->outpoint;
-
     return true;
 }
 
-bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::shared_ptr<const std::map<COutPoint, Coin>>& allWitnessCoins, CCoinsViewCache* viewOverride)
 {
-    DO_BENCHMARK("WIT: GetWitnessInfo", BCLog::BENCH|BCLog::WITNESS);
+    assert(pPreviousIndexChain);
 
-    #ifdef DISABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
+    if (!viewOverride && (uint64_t)pPreviousIndexChain->nHeight >= Params().GetConsensus().pow2Phase2FirstBlockHeight && getAllUnspentWitnessCoinsFromSnapshot(pPreviousIndexChain, allWitnessCoins))
+        return true;
 
-    // Fetch all unspent witness outputs for the chain in which -block- acts as the tip.
-    if (!getAllUnspentWitnessCoins(chain, chainParams, pPreviousIndexChain, witnessInfo.allWitnessCoins, &block, viewOverride))
+    auto witnessCoins = std::make_shared<std::map<COutPoint, Coin>>();
+    if (!getAllUnspentWitnessCoins(chain, chainParams, pPreviousIndexChain, *witnessCoins, nullptr, viewOverride))
         return false;
+    allWitnessCoins = std::move(witnessCoins);
+    return true;
+}
 
-    // Gather all witnesses that exceed minimum weight and count the total witness weight.
-    for (auto coinIter : witnessInfo.allWitnessCoins)
+
+bool SelectWitnessFromRouletteColumns(const uint256& blockHash, uint64_t nBlockHeight, uint32_t numGenesisWitnesses, uint32_t genesisWitnessWeightDivisor, const CWitnessRouletteColumns& columns, CWitnessRouletteSelection& selection)
+{
+    DO_BENCHMARK("WIT: SelectWitnessFromRouletteColumns", BCLog::BENCH|BCLog::WITNESS);
+
+    const size_t nCandidates = columns.size();
+
+    /** Expiry only depends on age/weight and not on the minimum age, so we determine it once per candidate up front **/
+    /** Likewise we fold the age and the remaining lock length into a single 'headroom' column as both are compared against the same minimum age **/
+    std::vector<uint64_t> headroom(nCandidates);
+    for (size_t i = 0; i < nCandidates; ++i)
     {
-        //fixme: (PHASE5) Unit tests
-        uint64_t nAge = nBlockHeight - coinIter.second.nHeight;
-        COutPoint outPoint = coinIter.first;
-        assert(outPoint.isHash);
-        Coin coin = coinIter.second;
-        if (coin.out.nValue >= ((pPreviousIndexChain->nHeight+1 > 100000 ? gMinimumWitnessAmount : gMinimumWitnessAmountOld)*COIN))
+        uint64_t nAge = nBlockHeight - columns.coinHeight[i];
+        if (witnessHasExpired(nAge, columns.weight[i], columns.nTotalWeightRaw))
+            headroom[i] = 0;
+        else
+            headroom[i] = std::min(nAge, GetPoW2RemainingLockLengthInBlocks(columns.lockUntilBlock[i], nBlockHeight));
+    }
+
+    /** Generate the pool of potential witnesses for the given block index **/
+    /** Addresses younger than nMinAge blocks, that have expired or whose lock is within nMinAge blocks of expiring are discarded **/
+    uint64_t nMinAge = gMinimumParticipationAge;
+    selection.fLowParticipation = false;
+    while (true)
+    {
+        selection.eligible.clear();
+        for (size_t i = 0; i < nCandidates; ++i)
         {
-            uint64_t nUnused1, nUnused2;
-            int64_t nWeight = GetPoW2RawWeightForAmount(coin.out.nValue, pPreviousIndexChain->nHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
-            if (nWeight < (pPreviousIndexChain->nHeight+1 > 100000 ? gMinimumWitnessWeight : gMinimumWitnessWeightOld))
-                continue;
-            witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outPoint, coin, nWeight, nAge));
-            witnessInfo.nTotalWeightRaw += nWeight;
+            if (headroom[i] > nMinAge)
+                selection.eligible.push_back(i);
         }
-        else if (coin.out.output.witnessDetails.lockFromBlock == 1)
+
+        // We must have at least 100 accounts to keep odds of being selected down below 1% at all times.
+        if (selection.eligible.size() < 100)
         {
-            int64_t nWeight = 0;
-            witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outPoint, coin, nWeight, nAge));                     
+            selection.fLowParticipation = true;
+
+            // NB!! This part of the code should (ideally) never actually be used, it exists only for instances where there are a shortage of witnesses paticipating on the network.
+            if (nMinAge == 0 || (nMinAge <= 10 && selection.eligible.size() > 5))
+                break;
+            // Try again to reach 100 candidates with a smaller min age.
+            nMinAge -= 5;
+        }
+        else
+        {
+            break;
         }
     }
-    
+
+    if (selection.eligible.size() == 0)
+        return false;
+
+    /** Ensure the pool is sorted deterministically (identical ordering to RouletteItem::operator<, youngest first is highest coin height first) **/
+    std::sort(selection.eligible.begin(), selection.eligible.end(), [&](uint32_t a, uint32_t b)
+    {
+        if (columns.coinHeight[a] == columns.coinHeight[b])
+            return columns.outpoint[a] < columns.outpoint[b];
+        return columns.coinHeight[a] > columns.coinHeight[b];
+    });
+
+    /** Calculate total eligible weight **/
+    selection.nTotalWeightEligibleRaw = 0;
+    for (uint32_t nCandidate : selection.eligible)
+    {
+        selection.nTotalWeightEligibleRaw += columns.weight[nCandidate];
+    }
+
+    uint64_t genesisWeight=0;
+    if (numGenesisWitnesses > 0)
+    {
+        genesisWeight = std::max(selection.nTotalWeightEligibleRaw / genesisWitnessWeightDivisor, nBlockHeight > 300 ? (uint64_t)1 : (uint64_t)1000);
+        selection.nTotalWeightEligibleRaw += numGenesisWitnesses*genesisWeight;
+    }
+
+    /** Reduce larger weightings to a maximum weighting of 1% of network weight. **/
+    /** NB!! this actually will end up a little bit more than 1% as the overall network weight will also be reduced as a result. **/
+    /** This is however unimportant as 1% is in and of itself also somewhat arbitrary, simpler code is favoured here over exactness. **/
+    /** So we delibritely make no attempt to compensate for this. **/
+    selection.nMaxIndividualWeight = std::max(selection.nTotalWeightEligibleRaw / 100, (uint64_t)1);
+    selection.nTotalWeightEligibleAdjusted = 0;
+    selection.cumulativeWeight.resize(selection.eligible.size());
+    for (size_t i = 0; i < selection.eligible.size(); ++i)
+    {
+        uint64_t nWeight = columns.weight[selection.eligible[i]];
+        if (nWeight == 0)
+            nWeight = genesisWeight;
+        if (nWeight > selection.nMaxIndividualWeight)
+            nWeight = selection.nMaxIndividualWeight;
+        selection.nTotalWeightEligibleAdjusted += nWeight;
+        selection.cumulativeWeight[i] = selection.nTotalWeightEligibleAdjusted;
+    }
+
+    /** sha256 as random roulette spin/seed - NB! We delibritely use sha256 and -not- the normal PoW hash here as the normal PoW hash is biased towards certain number ranges by -design- (block target) so is not a good RNG... **/
+    arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
+
+    /** Reduce selection number to fit within possible range of values **/
+    if (rouletteSelectionSeed > arith_uint256(selection.nTotalWeightEligibleAdjusted))
+    {
+        // 'BigNum' Modulo operator via mathematical identity:  a % b = a - (b * int(a/b))
+        rouletteSelectionSeed = rouletteSelectionSeed - (arith_uint256(selection.nTotalWeightEligibleAdjusted) * arith_uint256(rouletteSelectionSeed/arith_uint256(selection.nTotalWeightEligibleAdjusted)));
+    }
+
+    /** Perform selection **/
+    auto selectedWitness = std::lower_bound(selection.cumulativeWeight.begin(), selection.cumulativeWeight.end(), rouletteSelectionSeed.GetLow64());
+    selection.nSelectedEligibleIndex = selectedWitness - selection.cumulativeWeight.begin();
+    selection.nSelectedCandidate = selection.eligible[selection.nSelectedEligibleIndex];
+    return true;
+}
+
+//fixme: (PHASE5) Improve error handling.
+//fixme: (PHASE5) Handle nodes with excessive pruning. //pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
+    DO_BENCHMARK("WIT: GetWitnessHelper", BCLog::BENCH|BCLog::WITNESS);
+
+    std::shared_ptr<const CWitnessRouletteColumns> rouletteColumns = witnessInfo.rouletteColumns;
+    if (!rouletteColumns)
+    {
+        // The caller filled in the pool directly (e.g. GetWitnessFromUTXO), so we have to lay it out as columns ourselves.
+        auto poolColumns = std::make_shared<CWitnessRouletteColumns>();
+        poolColumns->nPreviousHeight = nBlockHeight - 1;
+        poolColumns->reserve(witnessInfo.witnessSelectionPoolUnfiltered.size());
+        for (const auto& item : witnessInfo.witnessSelectionPoolUnfiltered)
+        {
+            CTxOutPoW2Witness details;
+            GetPow2WitnessOutput(item.coin.out, details);
+            poolColumns->push_back(item.outpoint, nBlockHeight - item.nAge, item.nWeight, details.lockUntilBlock);
+        }
+        poolColumns->nTotalWeightRaw = witnessInfo.nTotalWeightRaw;
+        rouletteColumns = std::move(poolColumns);
+    }
+    assert(rouletteColumns->size() == witnessInfo.witnessSelectionPoolUnfiltered.size());
+
+    CWitnessRouletteSelection selection;
+    bool fSelected = SelectWitnessFromRouletteColumns(blockHash, nBlockHeight, Params().numGenesisWitnesses, Params().genesisWitnessWeightDivisor, *rouletteColumns, selection);
+    if (selection.fLowParticipation && !Params().IsTestnet() && nBlockHeight > 880000)
+        CAlert::Notify("Warning network is experiencing low levels of witnessing participants!", true, true);
+    if (!fSelected)
+    {
+        return error("Unable to determine any witnesses for block.");
+    }
+
+    witnessInfo.nTotalWeightEligibleRaw = selection.nTotalWeightEligibleRaw;
+    witnessInfo.nTotalWeightEligibleAdjusted = selection.nTotalWeightEligibleAdjusted;
+    witnessInfo.nMaxIndividualWeight = selection.nMaxIndividualWeight;
+
+    /** Expose the eligible pool (in roulette order, with adjusted weights) to callers that want to display/inspect it **/
+    witnessInfo.witnessSelectionPoolFiltered.clear();
+    witnessInfo.witnessSelectionPoolFiltered.reserve(selection.eligible.size());
+    for (size_t i = 0; i < selection.eligible.size(); ++i)
+    {
+        witnessInfo.witnessSelectionPoolFiltered.push_back(witnessInfo.witnessSelectionPoolUnfiltered[selection.eligible[i]]);
+        witnessInfo.witnessSelectionPoolFiltered.back().nWeight = selection.adjustedWeight(i);
+        witnessInfo.witnessSelectionPoolFiltered.back().nCumulativeWeight = selection.cumulativeWeight[i];
+    }
+
+    const RouletteItem& selectedWitness = witnessInfo.witnessSelectionPoolUnfiltered[selection.nSelectedCandidate];
+    witnessInfo.selectedWitnessTransaction = selectedWitness.coin.out;
+    witnessInfo.selectedWitnessIndex = selection.nSelectedEligibleIndex;
+    witnessInfo.selectedWitnessBlockHeight = selectedWitness.coin.nHeight;
+    witnessInfo.selectedWitnessOutpoint = selectedWitness.outpoint;
+
+    return true;
+}
+
+// Populate the selection pool from witnessInfo.rouletteColumns, taking the coins from allWitnessCoins (both are in outpoint order).
+static void PopulateWitnessSelectionPool(CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
+    const CWitnessRouletteColumns& columns = *witnessInfo.rouletteColumns;
+    witnessInfo.witnessSelectionPoolUnfiltered.clear();
+    witnessInfo.witnessSelectionPoolUnfiltered.reserve(columns.size());
+    auto coinIter = witnessInfo.allWitnessCoins.begin();
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        while (coinIter != witnessInfo.allWitnessCoins.end() && coinIter->first < columns.outpoint[i])
+            ++coinIter;
+        assert(coinIter != witnessInfo.allWitnessCoins.end() && coinIter->first.isHash && coinIter->first == columns.outpoint[i]);
+        witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(columns.outpoint[i], coinIter->second, columns.weight[i], nBlockHeight - columns.coinHeight[i]));
+    }
+    witnessInfo.nTotalWeightRaw = columns.nTotalWeightRaw;
+}
+
+bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
+    DO_BENCHMARK("WIT: GetWitnessInfo", BCLog::BENCH|BCLog::WITNESS);
+
+    // By far the most common case is a block on top of the tip, the snapshot then has both the witness set and its roulette candidates ready for us.
+    auto witnessSnapshot = std::atomic_load(&witnessStateSnapshot);
+    if (witnessSnapshot && witnessSnapshot->pTip == pPreviousIndexChain && (uint64_t)pPreviousIndexChain->nHeight >= chainParams.GetConsensus().pow2Phase2FirstBlockHeight && WITH_LOCK(cs_main, return CanApplyBlockToWitnessCoins(chain, pPreviousIndexChain, &block, viewOverride)))
+    {
+        GetWitnessInfoFromWitnessCoins(*witnessSnapshot->witnessCoins, pPreviousIndexChain->nHeight, std::move(block), witnessInfo, nBlockHeight, witnessSnapshot->rouletteColumns);
+        return true;
+    }
+
+    // Fetch all unspent witness outputs for the chain in which -block- acts as the tip.
+    if (!getAllUnspentWitnessCoins(chain, chainParams, pPreviousIndexChain, witnessInfo.allWitnessCoins, &block, viewOverride))
+        return false;
+
+    // Gather all witnesses that exceed minimum weight and count the total witness weight.
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    BuildWitnessRouletteColumns(witnessInfo.allWitnessCoins, pPreviousIndexChain->nHeight, *rouletteColumns);
+    witnessInfo.rouletteColumns = std::move(rouletteColumns);
+    PopulateWitnessSelectionPool(witnessInfo, nBlockHeight);
     return true;
 }
 
+void GetWitnessInfoFromWitnessCoins(const std::map<COutPoint, Coin>& previousWitnessCoins, uint64_t nPreviousHeight, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight, std::shared_ptr<const CWitnessRouletteColumns> previousColumns)
+{
+    DO_BENCHMARK("WIT: GetWitnessInfoFromWitnessCoins", BCLog::BENCH|BCLog::WITNESS);
+
+    // Same as getAllUnspentWitnessCoins does for a new block; only the PoW portion of the block counts towards its own witness set.
+    StripWitnessFromBlock(block);
+    CWitnessCoinDelta delta;
+    ComputeWitnessCoinDelta(block, nPreviousHeight + 1, previousWitnessCoins, delta);
+    witnessInfo.allWitnessCoins = previousWitnessCoins;
+    delta.Apply(witnessInfo.allWitnessCoins);
+
+    // Most blocks don't touch the witness set at all, in which case the candidates can be shared as is.
+    if (previousColumns && previousColumns->nPreviousHeight == nPreviousHeight && delta.added.empty() && delta.removed.empty())
+    {
+        witnessInfo.rouletteColumns = std::move(previousColumns);
+    }
+    else
+    {
+        auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+        if (previousColumns)
+            UpdateWitnessRouletteColumns(*previousColumns, delta, false, witnessInfo.allWitnessCoins, nPreviousHeight, *rouletteColumns);
+        else
+            BuildWitnessRouletteColumns(witnessInfo.allWitnessCoins, nPreviousHeight, *rouletteColumns);
+        witnessInfo.rouletteColumns = std::move(rouletteColumns);
+    }
+    PopulateWitnessSelectionPool(witnessInfo, nBlockHeight);
+}
+
 bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo)
 {
     DO_BENCHMARK("WIT: GetWitness", BCLog::BENCH|BCLog::WITNESS);
 
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
-
     // Fetch all the chain info (for specific block) we will need to calculate the witness.
     uint64_t nBlockHeight = pPreviousIndexChain->nHeight + 1;
     if (!GetWitnessInfo(chain, chainParams, viewOverride, pPreviousIndexChain, block, witnessInfo, nBlockHeight))
@@ -531,67 +1170,56 @@ bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache*
     return GetWitnessHelper(block.GetHashLegacy(), witnessInfo, nBlockHeight);
 }
 
-#ifdef WITNESS_HEADER_SYNC
-bool GetWitnessFromSimplifiedUTXO(SimplifiedWitnessUTXOSet simplifiedWitnessUTXO, const CBlockIndex* pBlockIndex, CGetWitnessInfo& witnessInfo)
+SimplifiedWitnessRouletteItem::SimplifiedWitnessRouletteItem(const COutPoint& outPoint, const Coin& coin)
 {
-    DO_BENCHMARK("WIT: GetWitnessFromSimplifiedUTXO", BCLog::BENCH|BCLog::WITNESS);
-    
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
+    assert(outPoint.isHash);
+    blockNumber = coin.nHeight;
+    transactionIndex = coin.nTxIndex;
+    transactionOutputIndex = outPoint.n;
+
+    CTxOutPoW2Witness witnessDetails;
+    GetPow2WitnessOutput(coin.out, witnessDetails);
+    lockUntilBlock = witnessDetails.lockUntilBlock;
+    lockFromBlock = witnessDetails.lockFromBlock;
+    witnessPubKeyID = witnessDetails.witnessKeyID;
+    nValue = coin.out.nValue;
+}
 
-    // Populate the witness info from the utxo
-    uint64_t nBlockHeight = pBlockIndex->nHeight;
+Coin SimplifiedWitnessRouletteItem::GetCoin() const
+{
+    // We delibritely leave failCount, actionNonce and spendingKeyId unset here, as they aren't used by witness selection.
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.witnessKeyID = witnessPubKeyID;
+    witnessDetails.lockFromBlock = lockFromBlock;
+    witnessDetails.lockUntilBlock = lockUntilBlock;
+    return Coin(CTxOut(nValue, witnessDetails), blockNumber, transactionIndex, false, false);
+}
+
+bool GetWitnessFromSimplifiedUTXO(const SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, const CBlockHeader& block, uint64_t nBlockHeight, CGetWitnessInfo& witnessInfo)
+{
+    DO_BENCHMARK("WIT: GetWitnessFromSimplifiedUTXO", BCLog::BENCH|BCLog::WITNESS);
     
     // Equivalent of GetWitnessInfo
+    auto rouletteColumns = std::make_shared<CWitnessRouletteColumns>();
+    rouletteColumns->nPreviousHeight = nBlockHeight - 1;
+    rouletteColumns->reserve(simplifiedWitnessUTXO.witnessCandidates.size());
+    for (const auto& simplifiedRouletteItem : simplifiedWitnessUTXO.witnessCandidates)
     {
-        // Gather all witnesses that exceed minimum weight and count the total witness weight.
-        for (auto simplifiedRouletteItem : simplifiedWitnessUTXO.witnessCandidates)
-        {
-            // We delibritely leave failCount, actionNonce and spendingKeyId unset here, as they aren't used by the code that follows.
-            CTxOutPoW2Witness simplifiedWitnessInfo;
-            simplifiedWitnessInfo.witnessKeyID = simplifiedRouletteItem.witnessPubKeyID;
-            simplifiedWitnessInfo.lockFromBlock = simplifiedRouletteItem.lockFromBlock;
-            simplifiedWitnessInfo.lockUntilBlock = simplifiedRouletteItem.lockUntilBlock;
-            
-            // Set our partially filled in coin item (we have filled in all the parts that GetWitnessHelper touches)
-            Coin rouletteCoin = Coin(CTxOut(simplifiedRouletteItem.nValue, CTxOutPoW2Witness(simplifiedWitnessInfo)), simplifiedRouletteItem.blockNumber, 0, false, false);
-            COutPoint rouletteOutpoint = COutPoint(simplifiedRouletteItem.blockNumber, simplifiedRouletteItem.transactionIndex, simplifiedRouletteItem.transactionOutputIndex);
-            
-            RouletteItem item(rouletteOutpoint, rouletteCoin, 0, 0);
-            item.nAge = nBlockHeight - simplifiedRouletteItem.blockNumber;
-
-            if (simplifiedRouletteItem.nValue >= (gMinimumWitnessAmount*COIN))
-            {
-                item.nWeight = GetPoW2RawWeightForAmount(item.coin.out.nValue, nBlockHeight, simplifiedRouletteItem.GetLockLength());
-                if (item.nWeight < gMinimumWitnessWeight)
-                    continue;
-                witnessInfo.witnessSelectionPoolUnfiltered.push_back(item);
-                witnessInfo.nTotalWeightRaw += item.nWeight;
-            }
-            else if (simplifiedRouletteItem.lockFromBlock == 1)
-            {
-                item.nWeight = 0;
-                witnessInfo.witnessSelectionPoolUnfiltered.push_back(item);
-            }
-        }
+        COutPoint outPoint(simplifiedRouletteItem.blockNumber, simplifiedRouletteItem.transactionIndex, simplifiedRouletteItem.transactionOutputIndex);
+        Coin coin = simplifiedRouletteItem.GetCoin();
+        if (AddWitnessRouletteCandidate(*rouletteColumns, outPoint, coin))
+            witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outPoint, coin, rouletteColumns->weight.back(), nBlockHeight - coin.nHeight));
     }
+    witnessInfo.nTotalWeightRaw = rouletteColumns->nTotalWeightRaw;
+    witnessInfo.rouletteColumns = std::move(rouletteColumns);
 
-    return GetWitnessHelper(pBlockIndex->GetBlockHashLegacy(), witnessInfo, nBlockHeight);
+    return GetWitnessHelper(block.GetHashLegacy(), witnessInfo, nBlockHeight);
 }
 
 bool GetWitnessFromUTXO(std::vector<RouletteItem> witnessUtxo, CBlockIndex* pBlockIndex, CGetWitnessInfo& witnessInfo)
 {
     DO_BENCHMARK("WIT: GetWitnessFromUTXO", BCLog::BENCH|BCLog::WITNESS);
     
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
-
     // Populate the witness info from the utxo
     uint64_t nBlockHeight = pBlockIndex->nHeight;
     
@@ -622,7 +1250,6 @@ bool GetWitnessFromUTXO(std::vector<RouletteItem> witnessUtxo, CBlockIndex* pBlo
 
     return GetWitnessHelper(pBlockIndex->GetBlockHashLegacy(), witnessInfo, nBlockHeight);
 }
-#endif
 
 // Ideally this should have been some hybrid of witInfo.nTotalWeight / witInfo.nReducedTotalWeight - as both independantly aren't perfect.
 // Total weight is prone to be too high if there are lots of large >1% witnesses, nReducedTotalWeight is prone to be too low if there is one large witness who has recently witnessed.
@@ -637,1099 +1264,338 @@ bool witnessHasExpired(uint64_t nWitnessAge, uint64_t nWitnessWeight, uint64_t n
     return ( nWitnessAge > gMaximumParticipationAge ) || ( nWitnessAge > nExpectedWitnessPeriod );
 }
 
-#ifdef WITNESS_HEADER_SYNC
+// Leading byte of every delta, this also tells a block without any witness changes apart from a header that came without a delta.
+const unsigned char witnessUTXODeltaFormat = 1;
+
 const char changeTypeCreation = 0;
 const char changeTypeSpend = 1;
-const char changeTypeRenew = 2;
-const char changeTypeRearrange = 3;
-const char changeTypeIncrease = 4;
-const char changeTypeChangeKey = 5;
-const char changeTypeWitnessAction = 6;
+const char changeTypeWitnessAction = 2;
 
-struct deltaItem
+SimplifiedWitnessUTXOSet GenerateSimplifiedWitnessUTXOSetFromUTXOSet(const std::map<COutPoint, Coin>& allWitnessCoins)
 {
-public:
-    int changeType;
-    std::vector<SimplifiedWitnessRouletteItem> removedItems;
-    std::vector<SimplifiedWitnessRouletteItem> addedItems;
-};
+    // Build up front and insert as one ordered range, inserting one by one into a flat_set costs a move of half the set per item.
+    std::vector<SimplifiedWitnessRouletteItem> items;
+    items.reserve(allWitnessCoins.size());
+    for (const auto& [outPoint, coin] : allWitnessCoins)
+        items.emplace_back(outPoint, coin);
+    std::sort(items.begin(), items.end());
+
+    SimplifiedWitnessUTXOSet simplifiedWitnessUTXO;
+    simplifiedWitnessUTXO.witnessCandidates.insert(boost::container::ordered_unique_range, items.begin(), items.end());
+    return simplifiedWitnessUTXO;
+}
 
-bool GenerateSimplifiedWitnessUTXODeltaUndoForHeader(std::vector<unsigned char>& undoWitnessUTXODelta, SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXOUndo, std::vector<deltaItem>& deltaItems)
+// Encode the removal of 'removed' and then the addition of 'added', applying them to 'simplifiedWitnessUTXO' as we go as spends are encoded by their position in the set.
+static bool EncodeSimplifiedWitnessUTXOChanges(CVectorWriter& deltaStream, SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, const std::map<COutPoint, Coin>& removed, const std::map<COutPoint, Coin>& added)
 {
-    CVectorWriter deltaUndoStream(SER_NETWORK, 0, undoWitnessUTXODelta, 0);
-
-    // Play back the changes to generate the undo info
-    // Note that we have to actually perform the changes as we go, and not just serialise them
-    // The reason for this is that each operation that does an insert/remove can change the index of all future insert/removes
-    // So if we just serialise the indexes will be wrong when we replay the changes later
-    
-    // First handle the witness that signed the block as a special case, as there is always only one of these at the start, then loop for everything else.
+    for (const auto& [outPoint, coin] : removed)
     {
-        // Remove the updated witness item and put back the original one
-        const auto& deltaWitnessItem = deltaItems[0];
-
-        assert(deltaWitnessItem.addedItems.size() == 1);
-        assert(deltaWitnessItem.removedItems.size() == 1);
-        assert(deltaWitnessItem.changeType == changeTypeWitnessAction);
-
-        const auto& addedItemIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(deltaWitnessItem.addedItems[0]);
-        
-        deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(addedItemIter));
-        deltaUndoStream << COMPRESSEDAMOUNT(deltaWitnessItem.removedItems[0].nValue);
-        deltaUndoStream << VARINT(deltaWitnessItem.removedItems[0].blockNumber);
-        deltaUndoStream << VARINT(deltaWitnessItem.removedItems[0].transactionIndex);
-        deltaUndoStream << COMPACTSIZE(deltaWitnessItem.removedItems[0].transactionOutputIndex);
-        
-        pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(addedItemIter);
-        pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(deltaWitnessItem.removedItems[0]);
-        
-        deltaItems.erase(deltaItems.begin());
+        auto spentIter = simplifiedWitnessUTXO.witnessCandidates.find(SimplifiedWitnessRouletteItem(outPoint, coin));
+        if (spentIter == simplifiedWitnessUTXO.witnessCandidates.end())
+            return false;
+        uint64_t nSpentIndex = simplifiedWitnessUTXO.witnessCandidates.index_of(spentIter);
+        deltaStream << changeTypeSpend << VARINT(nSpentIndex);
+        simplifiedWitnessUTXO.witnessCandidates.erase(spentIter);
     }
-    
-    // Loop for remaining changes, and serialise along with change type identifier
-    for (const auto& deltaItem : deltaItems)
+    for (const auto& [outPoint, coin] : added)
     {
-        switch(deltaItem.changeType)
-        {
-            case changeTypeWitnessAction:
-            {
-                continue;
-            }
-            case changeTypeCreation:
-            {
-                // We delete the created item
-                assert(deltaItem.addedItems.size() == 1);
-                assert(deltaItem.removedItems.size() == 0);
-
-                auto addedItemIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(deltaItem.addedItems[0]);
-                               
-                deltaUndoStream << changeTypeCreation;
-                deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(addedItemIter));
-                pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(addedItemIter);
-                
-                break;
-            }
-            case changeTypeSpend:
-            {
-                // We add the spent item back into the set
-                assert(deltaItem.addedItems.size() == 0);
-                assert(deltaItem.removedItems.size() == 1);
-
-                auto originalItem = deltaItem.removedItems[0];
-                pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(originalItem);
-
-                deltaUndoStream << changeTypeSpend;
-                deltaUndoStream << VARINT(originalItem.blockNumber);
-                deltaUndoStream << VARINT(originalItem.transactionIndex);
-                deltaUndoStream << COMPACTSIZE(originalItem.transactionOutputIndex);
-                deltaUndoStream << COMPRESSEDAMOUNT(originalItem.nValue);
-                deltaUndoStream << VARINT(originalItem.lockFromBlock);
-                deltaUndoStream << VARINT(originalItem.lockUntilBlock);
-                deltaUndoStream << originalItem.witnessPubKeyID;
-                
-                break;
-            }
-            case changeTypeRenew:
-            {
-                // Revert the renewed item to its original state/position
-                assert(deltaItem.addedItems.size() == 1);
-                assert(deltaItem.removedItems.size() == 1);
-                
-                auto& renewedItem = deltaItem.addedItems[0];
-                auto renewedItemIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(renewedItem);
-                auto& originalItem = deltaItem.removedItems[0];
-                
-                pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(renewedItemIter);
-                pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(originalItem);
-
-                deltaUndoStream << changeTypeRenew;
-                deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(renewedItemIter));
-                deltaUndoStream << VARINT(originalItem.blockNumber);
-                deltaUndoStream << VARINT(originalItem.transactionIndex);
-                deltaUndoStream << COMPACTSIZE(originalItem.transactionOutputIndex);
-                
-                break;
-            }
-            case changeTypeRearrange:
-            {
-                // Remove all the rearranged items and put back the originals
-                assert(deltaItem.addedItems.size() > 0);
-                assert(deltaItem.removedItems.size() > 0);
-                                
-                deltaUndoStream << changeTypeRearrange << COMPACTSIZE(deltaItem.addedItems.size()) << COMPACTSIZE(deltaItem.removedItems.size());
-
-                for (const auto& addItem : deltaItem.addedItems)
-                {
-                    auto addIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(addItem);
-                    deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(addIter));
-                    pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(addIter);
-                }
-                for (const auto& removeItem : deltaItem.removedItems)
-                {
-                    deltaUndoStream << VARINT(removeItem.blockNumber);
-                    deltaUndoStream << VARINT(removeItem.transactionIndex);
-                    deltaUndoStream << COMPACTSIZE(removeItem.transactionOutputIndex);
-                    deltaUndoStream << COMPRESSEDAMOUNT(removeItem.nValue);
-                    pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(removeItem);
-                }
-                break;
-            }
-            case changeTypeIncrease:
-            {
-                // Remove all the increased items and put back the originals
-                assert(deltaItem.addedItems.size() > 0);
-                assert(deltaItem.removedItems.size() > 0);
-                                
-                deltaUndoStream << changeTypeIncrease << COMPACTSIZE(deltaItem.addedItems.size()) << COMPACTSIZE(deltaItem.removedItems.size()) << VARINT(deltaItem.removedItems[0].lockUntilBlock);
-
-                for (const auto& addItem : deltaItem.addedItems)
-                {
-                    auto addIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(addItem);
-                    deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(addIter));
-                    pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(addIter);
-                }
-                for (const auto& removeItem : deltaItem.removedItems)
-                {
-                    deltaUndoStream << VARINT(removeItem.blockNumber);
-                    deltaUndoStream << VARINT(removeItem.transactionIndex);
-                    deltaUndoStream << COMPACTSIZE(removeItem.transactionOutputIndex);
-                    deltaUndoStream << COMPRESSEDAMOUNT(removeItem.nValue);
-                    deltaUndoStream << VARINT(removeItem.lockFromBlock);
-                    pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(removeItem);
-                }
-                break;
-            }
-            case changeTypeChangeKey:
-            {
-                // Remove all the updated items and put back the items with their original key
-                assert(deltaItem.addedItems.size() > 0);
-                assert(deltaItem.removedItems.size() > 0);
-                assert(deltaItem.addedItems.size() == deltaItem.removedItems.size());
-                
-                deltaUndoStream << changeTypeChangeKey << COMPACTSIZE(deltaItem.removedItems.size()) << deltaItem.removedItems[0].witnessPubKeyID;
-                for (uint64_t i=0; i < deltaItem.addedItems.size(); ++i)
-                {
-                    // Remove added item
-                    auto addIter = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.find(deltaItem.addedItems[i]);                    
-                    deltaUndoStream << VARINT(pow2SimplifiedWitnessUTXOUndo.witnessCandidates.index_of(addIter));
-                    
-                    pow2SimplifiedWitnessUTXOUndo.witnessCandidates.erase(addIter);
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXOUndo.witnessCandidates.insert(deltaItem.removedItems[i]);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                    
-                    // Place back original item
-                    deltaUndoStream << VARINT(deltaItem.removedItems[i].blockNumber);
-                    deltaUndoStream << VARINT(deltaItem.removedItems[i].transactionIndex);
-                    deltaUndoStream << COMPACTSIZE(deltaItem.removedItems[i].transactionOutputIndex);
-                }
-                break;
-            }
-        }
+        // The block number is left out, created items always belong to the block of the header.
+        SimplifiedWitnessRouletteItem item(outPoint, coin);
+        deltaStream << changeTypeCreation;
+        deltaStream << VARINT(item.transactionIndex) << VARINT(item.transactionOutputIndex);
+        deltaStream << COMPRESSEDAMOUNT(item.nValue) << VARINT(item.lockFromBlock) << VARINT(item.lockUntilBlock) << item.witnessPubKeyID;
+        if (!simplifiedWitnessUTXO.witnessCandidates.insert(item).second)
+            return false;
     }
     return true;
 }
 
-bool UndoSimplifiedWitnessUTXODeltaForHeader(SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXO, std::vector<unsigned char>& undoWitnessUTXODelta)
+bool GenerateSimplifiedWitnessUTXODeltaForBlock(const CBlock& block, uint64_t nHeight, const std::map<COutPoint, Coin>& witnessCoins, std::vector<unsigned char>& witnessUTXODelta)
 {
-    VectorReader deltaUndoStream(SER_NETWORK, 0, undoWitnessUTXODelta, 0);
-    
-    // First handle the witness that signed the block as a special case, as there is always only one of these at the start, then loop for everything else.
+    DO_BENCHMARK("WIT: GenerateSimplifiedWitnessUTXODeltaForBlock", BCLog::BENCH|BCLog::WITNESS);
+
+    witnessUTXODelta.clear();
+    CVectorWriter deltaStream(SER_NETWORK, 0, witnessUTXODelta, 0);
+    deltaStream << witnessUTXODeltaFormat;
+
+    SimplifiedWitnessUTXOSet simplifiedWitnessUTXO = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+
+    // The witness is selected from the set with the PoW portion of the block applied (see GetWitnessInfo), so those changes go first.
+    CBlock blockWithoutWitness(block);
+    StripWitnessFromBlock(blockWithoutWitness);
+    CWitnessCoinDelta deltaWithoutWitness;
+    ComputeWitnessCoinDelta(blockWithoutWitness, nHeight, witnessCoins, deltaWithoutWitness);
+    if (!EncodeSimplifiedWitnessUTXOChanges(deltaStream, simplifiedWitnessUTXO, deltaWithoutWitness.removed, deltaWithoutWitness.added))
+        return false;
+
+    if (block.nVersionPoW2Witness != 0)
     {
-        uint64_t selectedWitnessIndex;
-        deltaUndoStream >> VARINT(selectedWitnessIndex);
-        
-        auto witnessIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(selectedWitnessIndex);
-        SimplifiedWitnessRouletteItem witnessItem = *witnessIter;
-        SimplifiedWitnessRouletteItem updatedWitnessItem = witnessItem;
-        deltaUndoStream >> COMPRESSEDAMOUNT(updatedWitnessItem.nValue);
-        deltaUndoStream >> VARINT(updatedWitnessItem.blockNumber);
-        deltaUndoStream >> VARINT(updatedWitnessItem.transactionIndex);
-        deltaUndoStream >> COMPACTSIZE(updatedWitnessItem.transactionOutputIndex);
-        
-        pow2SimplifiedWitnessUTXO.witnessCandidates.erase(witnessIter);
-        auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(updatedWitnessItem);
-        (unused) insertIter;
-        if (!didInsert)
+        deltaStream << changeTypeWitnessAction;
+
+        // Whatever else the full block changes is down to the witness coinbase.
+        std::map<COutPoint, Coin> witnessCoinsWithoutWitness = witnessCoins;
+        deltaWithoutWitness.Apply(witnessCoinsWithoutWitness);
+        CWitnessCoinDelta delta;
+        ComputeWitnessCoinDelta(block, nHeight, witnessCoins, delta);
+        std::map<COutPoint, Coin> witnessCoinsAfter = witnessCoins;
+        delta.Apply(witnessCoinsAfter);
+
+        auto compareOutPoint = [](const std::pair<const COutPoint, Coin>& a, const std::pair<const COutPoint, Coin>& b) { return a.first < b.first; };
+        CWitnessCoinDelta witnessDelta;
+        std::set_difference(witnessCoinsWithoutWitness.begin(), witnessCoinsWithoutWitness.end(), witnessCoinsAfter.begin(), witnessCoinsAfter.end(), std::inserter(witnessDelta.removed, witnessDelta.removed.end()), compareOutPoint);
+        std::set_difference(witnessCoinsAfter.begin(), witnessCoinsAfter.end(), witnessCoinsWithoutWitness.begin(), witnessCoinsWithoutWitness.end(), std::inserter(witnessDelta.added, witnessDelta.added.end()), compareOutPoint);
+        if (!EncodeSimplifiedWitnessUTXOChanges(deltaStream, simplifiedWitnessUTXO, witnessDelta.removed, witnessDelta.added))
             return false;
     }
-    
-    // Rest of the changes are encoded with a type
-    char changeType;
-    while (!deltaUndoStream.empty())
+    return true;
+}
+
+bool ApplySimplifiedWitnessUTXODelta(const std::vector<unsigned char>& witnessUTXODelta, uint64_t nHeight, SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, std::vector<unsigned char>& undoWitnessUTXODelta, const std::function<bool(const SimplifiedWitnessUTXOSet&)>& checkWitnessSelection)
+{
+    DO_BENCHMARK("WIT: ApplySimplifiedWitnessUTXODelta", BCLog::BENCH|BCLog::WITNESS);
+
+    auto& witnessCandidates = simplifiedWitnessUTXO.witnessCandidates;
+    // Every change made so far in order; to roll back with if the delta turns out to be bad and to build the undo data from otherwise.
+    std::vector<std::pair<char, SimplifiedWitnessRouletteItem>> changes;
+    bool fValid = true;
+    bool fWitnessAction = false;
+    try
     {
-        deltaUndoStream >> changeType;
-        switch(changeType)
+        VectorReader deltaStream(SER_NETWORK, 0, witnessUTXODelta, 0);
+        unsigned char nFormat;
+        deltaStream >> nFormat;
+        fValid = (nFormat == witnessUTXODeltaFormat);
+        while (fValid && !deltaStream.empty())
         {
-            // Delete the created item
-            case changeTypeCreation:
-            {
-                uint64_t createdItemIndex;
-                deltaUndoStream >> VARINT(createdItemIndex);
-                pow2SimplifiedWitnessUTXO.witnessCandidates.erase(pow2SimplifiedWitnessUTXO.witnessCandidates.nth(createdItemIndex));
-                break;
-            }
-            // Recreate the deleted/spent item
-            case changeTypeSpend:
+            char changeType;
+            deltaStream >> changeType;
+            switch (changeType)
             {
-                SimplifiedWitnessRouletteItem item;
-                deltaUndoStream >> VARINT(item.blockNumber);
-                deltaUndoStream >> VARINT(item.transactionIndex);
-                deltaUndoStream >> COMPACTSIZE(item.transactionOutputIndex);
-                deltaUndoStream >> COMPRESSEDAMOUNT(item.nValue);
-                deltaUndoStream >> VARINT(item.lockFromBlock);
-                deltaUndoStream >> VARINT(item.lockUntilBlock);
-                deltaUndoStream >> item.witnessPubKeyID;
-                
-                auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                (unused) insertIter;
-                if (!didInsert)
-                    return false;
-
-                break;
-            }
-            // Remove the renewed item and place back the original item
-            case changeTypeRenew:
-            {
-                uint64_t renewedItemIndex;
-                deltaUndoStream >> VARINT(renewedItemIndex);
-                
-                auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(renewedItemIndex);
-                SimplifiedWitnessRouletteItem item = *itemIter;
-                SimplifiedWitnessRouletteItem modifiedItem = item;
-                deltaUndoStream >> VARINT(modifiedItem.blockNumber);
-                deltaUndoStream >> VARINT(modifiedItem.transactionIndex);
-                deltaUndoStream >> COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                
-                pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                (unused) insertIter;
-                if (!didInsert)
-                    return false;
-                
-                break;
-            }
-            // Perform the re-arrangement but in reverse
-            case changeTypeRearrange:
-            {
-                uint64_t numItemsToRemove;
-                uint64_t numItemsToAdd;
-                deltaUndoStream >> COMPACTSIZE(numItemsToRemove) >> COMPACTSIZE(numItemsToAdd);
-                
-                SimplifiedWitnessRouletteItem item;
-                for (uint64_t i=0; i<numItemsToRemove; ++i)
+                case changeTypeSpend:
                 {
-                    uint64_t outputIndex;
-                    deltaUndoStream >> VARINT(outputIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(outputIndex);
-                    if (i == 0)
+                    uint64_t nSpentIndex;
+                    deltaStream >> VARINT(nSpentIndex);
+                    if (nSpentIndex >= witnessCandidates.size())
                     {
-                        item = *itemIter;
+                        fValid = false;
+                        break;
                     }
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
+                    auto spentIter = witnessCandidates.nth(nSpentIndex);
+                    changes.emplace_back(changeTypeSpend, *spentIter);
+                    witnessCandidates.erase(spentIter);
+                    break;
                 }
-                for (uint64_t i=0; i<numItemsToAdd; ++i)
+                case changeTypeCreation:
                 {
-                    deltaUndoStream >> VARINT(item.blockNumber);
-                    deltaUndoStream >> VARINT(item.transactionIndex);
-                    deltaUndoStream >> COMPACTSIZE(item.transactionOutputIndex);
-                    deltaUndoStream >> COMPRESSEDAMOUNT(item.nValue);
-                    
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                }
-                break;
-            }
-            // Reverse the increase/re-arrangement
-            case changeTypeIncrease:
-            {
-                uint64_t numItemsToRemove;
-                uint64_t numItemsToAdd;
-                uint64_t originalLockUntilBlock;
-                deltaUndoStream >> COMPACTSIZE(numItemsToRemove) >> COMPACTSIZE(numItemsToAdd) >> VARINT(originalLockUntilBlock);
-                
-                SimplifiedWitnessRouletteItem item;
-                for (uint64_t i=0; i<numItemsToRemove; ++i)
-                {
-                    uint64_t outputIndex;
-                    deltaUndoStream >> VARINT(outputIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(outputIndex);
-                    if (i == 0)
+                    SimplifiedWitnessRouletteItem item;
+                    item.blockNumber = nHeight;
+                    deltaStream >> VARINT(item.transactionIndex) >> VARINT(item.transactionOutputIndex);
+                    deltaStream >> COMPRESSEDAMOUNT(item.nValue) >> VARINT(item.lockFromBlock) >> VARINT(item.lockUntilBlock) >> item.witnessPubKeyID;
+                    if (!witnessCandidates.insert(item).second)
                     {
-                        item = *itemIter;
-                        item.lockUntilBlock = originalLockUntilBlock;
+                        fValid = false;
+                        break;
                     }
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                }
-                for (uint64_t i=0; i<numItemsToAdd; ++i)
-                {
-                    deltaUndoStream >> VARINT(item.blockNumber);
-                    deltaUndoStream >> VARINT(item.transactionIndex);
-                    deltaUndoStream >> COMPACTSIZE(item.transactionOutputIndex);
-                    deltaUndoStream >> COMPRESSEDAMOUNT(item.nValue);
-                    deltaUndoStream >> VARINT(item.lockFromBlock);
-                    
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
+                    changes.emplace_back(changeTypeCreation, item);
+                    break;
                 }
-                break;
-            }
-            // Change the key back
-            case changeTypeChangeKey:
-            {
-                uint64_t numItems;
-                deltaUndoStream >> COMPACTSIZE(numItems);
-                CKeyID witnessKeyID;
-                deltaUndoStream >> witnessKeyID;
-                
-                for (uint64_t i=0; i < numItems; ++i )
+                case changeTypeWitnessAction:
                 {
-                    uint64_t itemIndex;
-                    deltaUndoStream >> VARINT(itemIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(itemIndex);
-                    SimplifiedWitnessRouletteItem item = *itemIter;
-                    
-                    item.witnessPubKeyID = witnessKeyID;
-                    deltaUndoStream >> VARINT(item.blockNumber);
-                    deltaUndoStream >> VARINT(item.transactionIndex);
-                    deltaUndoStream >> COMPACTSIZE(item.transactionOutputIndex);
-                    
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
+                    fValid = !fWitnessAction && (!checkWitnessSelection || checkWitnessSelection(simplifiedWitnessUTXO));
+                    fWitnessAction = true;
+                    break;
                 }
-                break;
+                default:
+                    fValid = false;
             }
         }
     }
-    return true;
-}
-
-//fixme: (WITNESS_SYNC) - REMOVE AFTER TESTING
-#ifdef DEBUG
-#define EXTRA_DELTA_TESTS 1
-#endif
-
-bool ApplySimplifiedWitnessUTXODeltaForHeader(const CBlockIndex* pIndex, SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXO, std::vector<unsigned char>& undoWitnessUTXODelta)
-{
-    #ifdef EXTRA_DELTA_TESTS
-    SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXOOrig = pow2SimplifiedWitnessUTXO;
-    #endif
-    
-    if (pIndex->witnessUTXODelta.size() == 0)
-        return false;
-
-    VectorReader deltaStream(SER_NETWORK, 0, pIndex->witnessUTXODelta, 0);
-    
-    std::vector<deltaItem> deltaItems;
-
-    // First handle the witness that signed the block as a special case, as there is always only one of these at the start, then loop for everything else.
+    catch (const std::ios_base::failure&)
     {
-        uint64_t selectedWitnessIndex;
-        deltaStream >> VARINT(selectedWitnessIndex);
-        
-        auto removedItemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(selectedWitnessIndex);
-        SimplifiedWitnessRouletteItem witnessItem = *removedItemIter;
-        SimplifiedWitnessRouletteItem updatedWitnessItem = witnessItem;
-        deltaStream >> COMPRESSEDAMOUNT(updatedWitnessItem.nValue);
-        updatedWitnessItem.blockNumber = pIndex->nHeight;
-        deltaStream >> VARINT(updatedWitnessItem.transactionIndex);
-        //We don't encode the transactionOutputIndex it always becomes 0
-        updatedWitnessItem.transactionOutputIndex=0;
-        
-        pow2SimplifiedWitnessUTXO.witnessCandidates.erase(removedItemIter);
-        auto [updatedItemIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(updatedWitnessItem);
-        (unused) updatedItemIter;
-        if (!didInsert)
-            return false;
-        
-        deltaItem undo;
-        undo.changeType=changeTypeWitnessAction;
-        undo.removedItems.push_back(witnessItem);
-        undo.addedItems.push_back(updatedWitnessItem);
-        deltaItems.push_back(undo);
+        fValid = false;
     }
+    if (checkWitnessSelection && !fWitnessAction)
+        fValid = false;
 
-    // Rest of the changes are encoded with a type
-    // We store the changes as we go so that we can generate undo information
-    // NB! Its not possible/enough to generate undo data on the fly, as each action can affect the index(es) of other actions, we must actually replay the actions as we generate the items (just like how we generate the actual changes)
-    char changeType;
-    while (!deltaStream.empty())
+    if (!fValid)
     {
-        deltaStream >> changeType;
-        switch(changeType)
+        for (auto iter = changes.rbegin(); iter != changes.rend(); ++iter)
         {
-            case changeTypeCreation:
-            {
-                SimplifiedWitnessRouletteItem modifiedItem;
-                modifiedItem.blockNumber = pIndex->nHeight;
-                deltaStream >> VARINT(modifiedItem.transactionIndex);
-                deltaStream >> COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                deltaStream >> COMPRESSEDAMOUNT(modifiedItem.nValue);
-                modifiedItem.lockFromBlock = pIndex->nHeight;
-                deltaStream >> VARINT(modifiedItem.lockUntilBlock);
-                deltaStream >> modifiedItem.witnessPubKeyID;
-                
-                auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                (unused) insertIter;
-                if (!didInsert)
-                    return false;
-                
-                deltaItem undo;
-                undo.changeType=changeTypeCreation;
-                undo.addedItems.push_back(modifiedItem);
-                deltaItems.push_back(undo);                
-                break;
-            }
-            case changeTypeSpend:
-            {
-                uint64_t spentWitnessSetIndex;
-                deltaStream >> VARINT(spentWitnessSetIndex);
-                
-                auto iter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(spentWitnessSetIndex);
-                SimplifiedWitnessRouletteItem originalItem = *iter;
-                //only one input allowed, must be completely consumed, so we just cancel its existence in the set
-                pow2SimplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                
-                deltaItem undo;
-                undo.changeType=changeTypeSpend;
-                undo.removedItems.push_back(originalItem);
-                deltaItems.push_back(undo);
-                
-                break;
-            }
-            case changeTypeRenew:
-            {
-                uint64_t renewWitnessSetIndex;
-                deltaStream >> VARINT(renewWitnessSetIndex);
-                
-                auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(renewWitnessSetIndex);
-                SimplifiedWitnessRouletteItem originalItem = *itemIter;
-                SimplifiedWitnessRouletteItem modifiedItem = originalItem;
-                modifiedItem.blockNumber = pIndex->nHeight;
-                deltaStream >> VARINT(modifiedItem.transactionIndex);
-                deltaStream >> COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                
-                pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                (unused) insertIter;
-                if (!didInsert)
-                    return false;
-                
-                deltaItem undo;
-                undo.changeType=changeTypeRenew;
-                undo.removedItems.push_back(originalItem);
-                undo.addedItems.push_back(modifiedItem);
-                deltaItems.push_back(undo);
-                
-                break;
-            }
-            case changeTypeRearrange:
-            {
-                uint64_t numInputs;
-                uint64_t numOutputs;
-                deltaStream >> COMPACTSIZE(numInputs) >> COMPACTSIZE(numOutputs);
-                
-                deltaItem undo;
-                undo.changeType=changeTypeRearrange;
-
-                SimplifiedWitnessRouletteItem item;
-                for (uint64_t i=0; i<numInputs; ++i)
-                {
-                    uint64_t inputIndex;
-                    deltaStream >> VARINT(inputIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(inputIndex);
-                    item=*itemIter;
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                    
-                    undo.removedItems.push_back(item);
-                }
-                for (uint64_t i=0; i<numOutputs; ++i)
-                {
-                    item.blockNumber = pIndex->nHeight;
-                    deltaStream >> VARINT(item.transactionIndex);
-                    deltaStream >> COMPACTSIZE(item.transactionOutputIndex);
-                    deltaStream >> COMPRESSEDAMOUNT(item.nValue);
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                    
-                    undo.addedItems.push_back(item);
-                }
-                deltaItems.push_back(undo);
-                break;
-            }
-            case changeTypeIncrease:
-            {
-                uint64_t numInputs;
-                uint64_t numOutputs;
-                uint64_t lockUntilBlock;
-                deltaStream >> COMPACTSIZE(numInputs) >> COMPACTSIZE(numOutputs) >> VARINT(lockUntilBlock);
-                
-                deltaItem undo;
-                undo.changeType=changeTypeIncrease;
-
-                SimplifiedWitnessRouletteItem item;
-                for (uint64_t i=0; i<numInputs; ++i)
-                {
-                    uint64_t inputIndex;
-                    deltaStream >> VARINT(inputIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(inputIndex);
-                    item = *itemIter;
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                    
-                    undo.removedItems.push_back(item);
-                }                
-                item.lockFromBlock = pIndex->nHeight;
-                item.lockUntilBlock = lockUntilBlock;
-                for (uint64_t i=0; i<numOutputs; ++i)
-                {
-                    item.blockNumber = pIndex->nHeight;
-                    deltaStream >> VARINT(item.transactionIndex);
-                    deltaStream >> COMPACTSIZE(item.transactionOutputIndex);
-                    deltaStream >> COMPRESSEDAMOUNT(item.nValue);
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(item);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                    
-                    undo.addedItems.push_back(item);
-                }
-                deltaItems.push_back(undo);
-                break;
-            }
-            case changeTypeChangeKey:
-            {
-                uint64_t numItems;
-                deltaStream >> COMPACTSIZE(numItems);
-                CKeyID witnessKeyID;
-                deltaStream >> witnessKeyID;
-                
-                deltaItem undo;
-                undo.changeType=changeTypeChangeKey;
-                
-                for (uint64_t i=0; i < numItems; ++i )
-                {
-                    uint64_t itemIndex;
-                    deltaStream >> VARINT(itemIndex);
-                    auto itemIter = pow2SimplifiedWitnessUTXO.witnessCandidates.nth(itemIndex);
-                    SimplifiedWitnessRouletteItem originalItem = *itemIter;
-                    SimplifiedWitnessRouletteItem changedItem = originalItem;
-                    
-                    changedItem.witnessPubKeyID = witnessKeyID;
-                    changedItem.blockNumber = pIndex->nHeight;
-                    deltaStream >> VARINT(changedItem.transactionIndex);
-                    deltaStream >> COMPACTSIZE(changedItem.transactionOutputIndex);
-                    
-                    pow2SimplifiedWitnessUTXO.witnessCandidates.erase(itemIter);
-                    auto [insertIter, didInsert] = pow2SimplifiedWitnessUTXO.witnessCandidates.insert(changedItem);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                    
-                    undo.removedItems.push_back(originalItem);
-                    undo.addedItems.push_back(changedItem);
-                }
-                deltaItems.push_back(undo);
-                break;
-            }
+            if (iter->first == changeTypeCreation)
+                witnessCandidates.erase(iter->second);
+            else
+                witnessCandidates.insert(iter->second);
         }
-    }
-    
-    
-    #ifdef EXTRA_DELTA_TESTS
-    // After applying the undo information the two should be identical again
-    assert(pow2SimplifiedWitnessUTXOOrig != pow2SimplifiedWitnessUTXO);
-    #endif
-    
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOUndo = pow2SimplifiedWitnessUTXO;
-    if (!GenerateSimplifiedWitnessUTXODeltaUndoForHeader(undoWitnessUTXODelta, pow2SimplifiedWitnessUTXOUndo, deltaItems))
         return false;
-    
-    #ifdef EXTRA_DELTA_TESTS
-    // After applying the undo information the two should be identical again
-    assert(pow2SimplifiedWitnessUTXOOrig == pow2SimplifiedWitnessUTXOUndo);
-    
-    pow2SimplifiedWitnessUTXOUndo = pow2SimplifiedWitnessUTXO;
-    UndoSimplifiedWitnessUTXODeltaForHeader(pow2SimplifiedWitnessUTXOUndo, undoWitnessUTXODelta);
-    // After applying the undo information the two should be identical again
-    assert(pow2SimplifiedWitnessUTXOOrig == pow2SimplifiedWitnessUTXOUndo);
-    #endif
-    
+    }
+
+    undoWitnessUTXODelta.clear();
+    CVectorWriter undoStream(SER_NETWORK, 0, undoWitnessUTXODelta, 0);
+    for (auto iter = changes.rbegin(); iter != changes.rend(); ++iter)
+        undoStream << iter->first << iter->second;
     return true;
 }
 
-SimplifiedWitnessUTXOSet GenerateSimplifiedWitnessUTXOSetFromUTXOSet(std::map<COutPoint, Coin> allWitnessCoinsIndexBased)
+bool UndoSimplifiedWitnessUTXODelta(SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, const std::vector<unsigned char>& undoWitnessUTXODelta)
 {
-    SimplifiedWitnessUTXOSet witnessUTXOset;
-    
-    for (const auto& [outpoint, coin] : allWitnessCoinsIndexBased) 
+    // Undo data is generated locally by ApplySimplifiedWitnessUTXODelta, so unlike the delta itself it can be trusted to be well formed.
+    VectorReader undoStream(SER_NETWORK, 0, undoWitnessUTXODelta, 0);
+    while (!undoStream.empty())
     {
+        char changeType;
         SimplifiedWitnessRouletteItem item;
-        
-        item.blockNumber = outpoint.getTransactionBlockNumber();
-        item.transactionIndex = outpoint.getTransactionIndex();
-        item.transactionOutputIndex = outpoint.n;
-        item.lockUntilBlock = coin.out.output.witnessDetails.lockUntilBlock;
-        item.lockFromBlock = coin.out.output.witnessDetails.lockFromBlock;
-        if (item.lockFromBlock == 0)
+        undoStream >> changeType >> item;
+        if (changeType == changeTypeCreation)
+        {
+            if (simplifiedWitnessUTXO.witnessCandidates.erase(item) == 0)
+                return false;
+        }
+        else if (!simplifiedWitnessUTXO.witnessCandidates.insert(item).second)
         {
-            item.lockFromBlock = item.blockNumber;
+            return false;
         }
-        item.witnessPubKeyID = coin.out.output.witnessDetails.witnessKeyID;
-        item.nValue = coin.out.nValue;
-        witnessUTXOset.witnessCandidates.insert(item);
     }
-    
-    return witnessUTXOset;
+    return true;
 }
 
-bool GetSimplifiedWitnessUTXOSetForIndex(const CBlockIndex* pBlockIndex, SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXOForBlock)
+bool CWitnessCoinIndex::GenerateSimplifiedWitnessUTXODelta(const CBlock& block, const CBlockIndex* pindex, std::vector<unsigned char>& witnessUTXODelta)
 {
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOCopy = pow2SimplifiedWitnessUTXO;
-    if (pow2SimplifiedWitnessUTXOCopy.currentTipForSet.IsNull() || pow2SimplifiedWitnessUTXO.currentTipForSet != pBlockIndex->GetBlockHashPoW2())
-    {
-        std::map<COutPoint, Coin> allWitnessCoinsIndexBased;
-        if (!getAllUnspentWitnessCoins(chainActive, Params(), pBlockIndex, allWitnessCoinsIndexBased, nullptr, nullptr, true))
-            return false;
-    
-        pow2SimplifiedWitnessUTXOCopy = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(allWitnessCoinsIndexBased);
-        pow2SimplifiedWitnessUTXOCopy.currentTipForSet = pBlockIndex->GetBlockHashPoW2();
-        pow2SimplifiedWitnessUTXOForBlock = pow2SimplifiedWitnessUTXO = pow2SimplifiedWitnessUTXOCopy;
-        return true;
-    }
-    else
-    {
-        // We are already the tip so no further action required
-        pow2SimplifiedWitnessUTXOForBlock = pow2SimplifiedWitnessUTXOCopy;
-        return true;
-    }
+    AssertLockHeld(cs_main);
+
+    if (!fSynced || !pindex->pprev || tipHash != pindex->pprev->GetBlockHashPoW2())
+        return false;
+    return GenerateSimplifiedWitnessUTXODeltaForBlock(block, pindex->nHeight, *tipWitnessCoins, witnessUTXODelta);
 }
 
+#ifdef WITNESS_HEADER_SYNC
+// SPV: undo data for the headers most recently applied to pow2SimplifiedWitnessUTXO, along with the tip of the set from before each was applied (protected by cs_main)
+static std::deque<std::pair<uint256, std::vector<unsigned char>>> simplifiedWitnessUTXOUndo;
+// The header (and the delta it had) that the set last failed to be brought up past; saves walking the chain up to it again for every header that follows it.
+static uint256 hashSimplifiedWitnessUTXOStall;
+static int nHeightSimplifiedWitnessUTXOStall = 0;
+static std::vector<unsigned char> deltaSimplifiedWitnessUTXOStall;
+
+static void ResetSimplifiedWitnessUTXOToGenesis()
+{
+    // Every client has the genesis block in full, so that is where the set starts out from.
+    std::map<COutPoint, Coin> witnessCoins;
+    CWitnessCoinDelta delta;
+    ComputeWitnessCoinDelta(Params().GenesisBlock(), 0, witnessCoins, delta);
+    delta.Apply(witnessCoins);
+    pow2SimplifiedWitnessUTXO = GenerateSimplifiedWitnessUTXOSetFromUTXOSet(witnessCoins);
+    pow2SimplifiedWitnessUTXO.currentTipForSet = Params().GetConsensus().hashGenesisBlock;
+    simplifiedWitnessUTXOUndo.clear();
+}
 
-bool GetSimplifiedWitnessUTXODeltaForBlockHelper(uint64_t nBlockHeight, const CBlock& block, CVectorWriter& deltaStream, std::vector<deltaItem>& deltaItems, SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, SimplifiedWitnessUTXOSet& simplifiedWitnessUTXOWithoutWitnessAction)
+static void PushSimplifiedWitnessUTXOUndo(const uint256& hashNewTip, std::vector<unsigned char>&& undoWitnessUTXODelta)
 {
-    bool anyChanges=false;
-    // Calculate changes this block would make
-    for (const auto& tx : block.vtx)
-    {
-        if (!tx->witnessBundles)
-            return false;
+    simplifiedWitnessUTXOUndo.emplace_back(pow2SimplifiedWitnessUTXO.currentTipForSet, std::move(undoWitnessUTXODelta));
+    if ((int64_t)simplifiedWitnessUTXOUndo.size() > WITNESS_COIN_INDEX_DELTA_DEPTH)
+        simplifiedWitnessUTXOUndo.pop_front();
+    pow2SimplifiedWitnessUTXO.currentTipForSet = hashNewTip;
+}
 
-        for (const auto& bundle : *tx->witnessBundles)
-        {
-            anyChanges = true;
-            if (bundle.bundleType == CWitnessTxBundle::WitnessType)
-            {
-                // Basic sanity checks
-                assert(bundle.inputs.size() == 1);
-                assert(bundle.outputs.size() == 1);
-                assert(!std::get<2>(bundle.inputs[0]).IsNull());
-                
-                // Find existing item
-                SimplifiedWitnessRouletteItem originalItem(bundle.inputs[0]);
-                auto iter = simplifiedWitnessUTXO.witnessCandidates.find(originalItem);
-                if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                    return false;
+// Bring pow2SimplifiedWitnessUTXO to the state as of pindex, rewinding recently applied headers and replaying the deltas stored in the index as needed.
+static bool SyncSimplifiedWitnessUTXOToIndex(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
 
-                // Generate changeset
-                {
-                    deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-                    deltaStream << COMPRESSEDAMOUNT(std::get<0>(bundle.outputs[0]).nValue);
-                    //No need to encode block number, we can obtain it from the block index
-                    deltaStream << VARINT(std::get<2>(bundle.outputs[0]).getTransactionIndex());
-                    //No need to encode vout position, its always 0
-                    assert(std::get<2>(bundle.outputs[0]).n == 0);
-                }
-                
-                // Perform the change so that subsequent changes can use the right indexing 
-                // from here we can reset the blocknumber and value and identify that signature matches
-                // Only ever one witness action.
-                {
-                    SimplifiedWitnessRouletteItem modifiedItem=originalItem;
-                    modifiedItem.nValue = std::get<0>(bundle.outputs[0]).nValue;
-                    modifiedItem.blockNumber = nBlockHeight;
-                    if (modifiedItem.lockFromBlock == 0)
-                        modifiedItem.lockFromBlock = modifiedItem.blockNumber;
-                    modifiedItem.transactionIndex = std::get<2>(bundle.outputs[0]).getTransactionIndex();
-                    modifiedItem.transactionOutputIndex = 0;
-                    
-                    simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                    auto [insertIter, didInsert] = simplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                    (unused) insertIter;
-                    if (!didInsert)
-                        return false;
-                    
-                    deltaItem undo;
-                    undo.changeType=changeTypeWitnessAction;
-                    undo.removedItems.push_back(originalItem);
-                    undo.addedItems.push_back(modifiedItem);
-                    deltaItems.push_back(undo);
-                }
+    if (pow2SimplifiedWitnessUTXO.currentTipForSet.IsNull())
+        ResetSimplifiedWitnessUTXOToGenesis();
 
-                break;
-            }
+    const CBlockIndex* pindexSet = nullptr;
+    while (true)
+    {
+        auto setIter = mapBlockIndex.find(pow2SimplifiedWitnessUTXO.currentTipForSet);
+        if (setIter != mapBlockIndex.end() && pindex->GetAncestor(setIter->second->nHeight) == setIter->second)
+        {
+            pindexSet = setIter->second;
+            break;
         }
-    }
-    for (const auto& tx : block.vtx)
-    {   
-        for (const auto& bundle : *tx->witnessBundles)
+        if (simplifiedWitnessUTXOUndo.empty())
         {
-            switch (bundle.bundleType)
-            {
-                case CWitnessTxBundle::WitnessType:
-                {
-                    // Already done in previous loop
-                    continue;
-                }
-                case CWitnessTxBundle::CreationType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() == 0);
-                    assert(bundle.outputs.size() > 0);
-
-                    // Treat each item in the bundle as its own seperate creation, instead of trying to cram them all into one
-                    for (const auto& output: bundle.outputs)
-                    {
-                        SimplifiedWitnessRouletteItem modifiedItem;
-                        modifiedItem.blockNumber = nBlockHeight;
-                        modifiedItem.transactionIndex = std::get<2>(output).getTransactionIndex();
-                        modifiedItem.transactionOutputIndex = std::get<2>(output).n;
-                        modifiedItem.nValue = std::get<0>(output).nValue;
-                        modifiedItem.lockFromBlock = modifiedItem.blockNumber;
-                        modifiedItem.lockUntilBlock = std::get<1>(output).lockUntilBlock;
-                        modifiedItem.witnessPubKeyID = std::get<1>(output).witnessKeyID;
-                        
-                        deltaStream << changeTypeCreation;
-                        //no need to encode blockNumber because it can be determined from the header
-                        deltaStream << VARINT(modifiedItem.transactionIndex);
-                        deltaStream << COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                        deltaStream << VARINT(modifiedItem.nValue);
-                        deltaStream << VARINT(modifiedItem.lockUntilBlock);
-                        //lockFrom can in turn be figured out from the blockNumber
-                        deltaStream << modifiedItem.witnessPubKeyID;
-                        
-                        // Insert new item into set
-                        simplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.insert(modifiedItem);
-                        
-                        deltaItem undo;
-                        undo.changeType=changeTypeCreation;
-                        undo.addedItems.push_back(modifiedItem);
-                        deltaItems.push_back(undo);
-                    }
-                    break;
-                }
-                //only one input allowed, must be completely consumed (removed from set)
-                case CWitnessTxBundle::SpendType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() == 1);
-                    assert(bundle.outputs.size() == 0);
-                    assert(!std::get<2>(bundle.inputs[0]).IsNull());
-
-                    // Find existing item
-                    SimplifiedWitnessRouletteItem originalItem(bundle.inputs[0]);
-                    auto iter = simplifiedWitnessUTXO.witnessCandidates.find(originalItem);
-                    if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                        return false;
-                
-                    deltaStream << changeTypeSpend;
-                    deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-                    
-                    // Remove spent item from set
-                    simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                    simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.erase(simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.find(originalItem));
-                    
-                    deltaItem undo;
-                    undo.changeType=changeTypeSpend;
-                    undo.removedItems.push_back(originalItem);
-                    deltaItems.push_back(undo);
+            // The fork is deeper than we keep undo data for; only start over from genesis for a chain with more work than the one the set is on.
+            const CBlockIndex* pindexGenesis = pindex->GetAncestor(0);
+            if (!pindexGenesis || pindexGenesis->GetBlockHashPoW2() != Params().GetConsensus().hashGenesisBlock)
+                return false;
+            if (setIter != mapBlockIndex.end() && setIter->second->nChainWork >= pindex->nChainWork)
+                return false;
+            ResetSimplifiedWitnessUTXOToGenesis();
+            continue;
+        }
+        if (!UndoSimplifiedWitnessUTXODelta(pow2SimplifiedWitnessUTXO, simplifiedWitnessUTXOUndo.back().second))
+        {
+            // Should never happen, the set no longer matches its undo data so rebuild it on next use.
+            LogPrintf("SyncSimplifiedWitnessUTXOToIndex: failed to undo delta of %s\n", pow2SimplifiedWitnessUTXO.currentTipForSet.ToString());
+            pow2SimplifiedWitnessUTXO.currentTipForSet = uint256();
+            simplifiedWitnessUTXOUndo.clear();
+            return false;
+        }
+        pow2SimplifiedWitnessUTXO.currentTipForSet = simplifiedWitnessUTXOUndo.back().first;
+        simplifiedWitnessUTXOUndo.pop_back();
+    }
 
-                    break;
-                }
-                case CWitnessTxBundle::RenewType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() > 0);
-                    assert(bundle.outputs.size() > 0);
-                    assert(bundle.inputs.size() == bundle.outputs.size());
-                    assert(!std::get<2>(bundle.inputs[0]).IsNull());
-                    
-                    // Treat each renew as a seperate change instead of trying to encode them all together
-                    for (uint64_t i=0; i<bundle.inputs.size(); ++i)
-                    {
-                        const auto& input = bundle.inputs[i];
-                        const auto& output = bundle.outputs[i];
-                    
-                        // Find existing item
-                        SimplifiedWitnessRouletteItem originalItem(input);
-                        auto iter = simplifiedWitnessUTXO.witnessCandidates.find(originalItem);
-                        if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                            return false;
-                        
-                        SimplifiedWitnessRouletteItem modifiedItem = originalItem;
-                        modifiedItem.blockNumber = nBlockHeight;
-                        modifiedItem.transactionIndex = std::get<2>(output).getTransactionIndex();
-                        modifiedItem.transactionOutputIndex = std::get<2>(output).n;
-                        if (modifiedItem.lockFromBlock == 0)
-                            modifiedItem.lockFromBlock = modifiedItem.blockNumber;
-                        
-                        deltaStream << changeTypeRenew;
-                        deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-                        //no need to encode blockNumber because it can be determined from the header
-                        deltaStream << VARINT(modifiedItem.transactionIndex);
-                        deltaStream << COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                        
-                        // Update renewed item in set
-                        simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.erase(simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.find(originalItem));
-                        auto [insertIter, didInsert] = simplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                        (unused) insertIter;
-                        if (!didInsert)
-                            assert(0);
-                        
-                        deltaItem undo;
-                        undo.changeType=changeTypeRenew;
-                        undo.removedItems.push_back(originalItem);
-                        undo.addedItems.push_back(modifiedItem);
-                        deltaItems.push_back(undo);
-                    }
-                    break;
-                }
-                case CWitnessTxBundle::RearrangeType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() > 0);
-                    assert(bundle.outputs.size() > 0);
-                    
-                    // Encode common information
-                    deltaStream << changeTypeRearrange << COMPACTSIZE(bundle.inputs.size()) << COMPACTSIZE(bundle.outputs.size());
-                    
-                    deltaItem undo;
-                    undo.changeType=changeTypeRearrange;
-                    
-                    // Encode removal of items; don't perform removal yet as they will then invalidate one anothers indexes
-                    SimplifiedWitnessRouletteItem item;
-                    for (const auto& input : bundle.inputs)
-                    {
-                        item = SimplifiedWitnessRouletteItem(input);
-                        auto iter = simplifiedWitnessUTXO.witnessCandidates.find(item);
-                        if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                            return false;
-
-                        deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-                        
-                        undo.removedItems.push_back(item);
-                        simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.erase(simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.find(item));
-                    }
+    if (pindexSet == pindex)
+        return true;
 
-                    // Encode and perform reinsertion of modified items
-                    for (const auto& output : bundle.outputs)
-                    {
-                        item.blockNumber = nBlockHeight;
-                        item.transactionIndex = std::get<2>(output).getTransactionIndex();
-                        item.transactionOutputIndex = std::get<2>(output).n;
-                        item.nValue = std::get<0>(output).nValue;
-                        if (item.lockFromBlock == 0)
-                            item.lockFromBlock = nBlockHeight;
-                        
-                        //no need to encode blockNumber because it can be determined from the header
-                        deltaStream << VARINT(item.transactionIndex);
-                        deltaStream << COMPACTSIZE(item.transactionOutputIndex);
-                        deltaStream << COMPRESSEDAMOUNT(item.nValue);
-                        
-                        simplifiedWitnessUTXO.witnessCandidates.insert(item);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.insert(item);
-                        undo.addedItems.push_back(item);
-                    }
-                    deltaItems.push_back(undo);
-                    break;
-                }
-                case CWitnessTxBundle::IncreaseType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() > 0);
-                    assert(bundle.outputs.size() > 0);
-                    
-                    // Encode common information, all new items must share the same lockUntilBlock so we encode that here instead of repeating it for each item
-                    uint64_t newLockUntilBlock = std::get<1>(bundle.outputs[0]).lockUntilBlock;
-                    deltaStream << changeTypeIncrease << COMPACTSIZE(bundle.inputs.size()) << COMPACTSIZE(bundle.outputs.size()) << VARINT(newLockUntilBlock);
-                    
-                    deltaItem undo;
-                    undo.changeType=changeTypeIncrease;
-
-                    // Encode removal of items; don't perform removal yet as they will then invalidate one anothers indexes
-                    SimplifiedWitnessRouletteItem item;
-                    for (const auto& input : bundle.inputs)
-                    {
-                        item = SimplifiedWitnessRouletteItem(input);
-                        auto iter = simplifiedWitnessUTXO.witnessCandidates.find(item);
-                        if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                            return false;
-                    
-                        deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-
-                        undo.removedItems.push_back(item);
-                        simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.erase(simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.find(item));
-                    }
+    if (!hashSimplifiedWitnessUTXOStall.IsNull() && nHeightSimplifiedWitnessUTXOStall > pindexSet->nHeight && nHeightSimplifiedWitnessUTXOStall <= pindex->nHeight)
+    {
+        const CBlockIndex* pindexStall = pindex->GetAncestor(nHeightSimplifiedWitnessUTXOStall);
+        if (pindexStall->GetBlockHashPoW2() == hashSimplifiedWitnessUTXOStall && pindexStall->witnessUTXODelta == deltaSimplifiedWitnessUTXOStall)
+            return false;
+    }
 
-                    // Encode and perform reinsertion of modified items
-                    for (const auto& output : bundle.outputs)
-                    {
-                        item.blockNumber = nBlockHeight;
-                        item.transactionIndex = std::get<2>(output).getTransactionIndex();
-                        item.transactionOutputIndex = std::get<2>(output).n;
-                        item.nValue = std::get<0>(output).nValue;
-                        item.lockFromBlock = nBlockHeight;
-                        item.lockUntilBlock = std::get<1>(output).lockUntilBlock;
-                        
-                        //no need to encode blockNumber because it can be determined from the header
-                        deltaStream << VARINT(item.transactionIndex);
-                        deltaStream << COMPACTSIZE(item.transactionOutputIndex);
-                        deltaStream << COMPRESSEDAMOUNT(item.nValue);
-                        //no need to encode lockfrom  because it can be determined from the header (note lockfrom changes with an increase type bundle)
-                        //lockUntilBlock encoded once for all bundles, before this loop
-                        
-                        simplifiedWitnessUTXO.witnessCandidates.insert(item);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.insert(item);
-                        undo.addedItems.push_back(item);
-                    }
-                    deltaItems.push_back(undo);
-                    break;
-                }
-                case CWitnessTxBundle::ChangeWitnessKeyType:
-                {
-                    // Basic sanity checks
-                    assert(bundle.inputs.size() > 0);
-                    assert(bundle.inputs.size() == bundle.outputs.size());
-                    
-                    // Encode common information
-                    // Can have multiple inputs/outputs, always matching in number so only encode output size
-                    // All new items must share a new witness key, so encode the key once here instead of individually for each item
-                    CKeyID newWitnessKeyID = std::get<1>(bundle.outputs[0]).witnessKeyID;
-                    deltaStream << changeTypeChangeKey << COMPACTSIZE(bundle.outputs.size()) << newWitnessKeyID;
-                    
-                    deltaItem undo;
-                    undo.changeType=changeTypeChangeKey;
-                    
-                    for (uint64_t index=0; index < bundle.inputs.size();++index)
-                    {
-                        auto& input = bundle.inputs[index];
-                        auto& output = bundle.outputs[index];
-
-                        SimplifiedWitnessRouletteItem originalItem(input);
-                        auto iter = simplifiedWitnessUTXO.witnessCandidates.find(originalItem);
-                        if (iter == simplifiedWitnessUTXO.witnessCandidates.end())
-                            return false;
-                    
-                        deltaStream << VARINT(simplifiedWitnessUTXO.witnessCandidates.index_of(iter));
-                        
-                        SimplifiedWitnessRouletteItem modifiedItem = originalItem;
-                        modifiedItem.blockNumber = nBlockHeight;
-                        modifiedItem.transactionIndex = std::get<2>(output).getTransactionIndex();
-                        modifiedItem.transactionOutputIndex = std::get<2>(output).n;
-                        modifiedItem.witnessPubKeyID = newWitnessKeyID;
-                        
-                        //no need to encode blockNumber because it can be determined from the header
-                        deltaStream << VARINT(modifiedItem.transactionIndex);
-                        deltaStream << COMPACTSIZE(modifiedItem.transactionOutputIndex);
-                        //no need to encode lockfrom  because it can be determined from the header (note lockfrom changes with an increase type bundle)
-                        
-                        simplifiedWitnessUTXO.witnessCandidates.erase(iter);
-                        simplifiedWitnessUTXO.witnessCandidates.insert(modifiedItem);
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.erase(simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.find(originalItem));
-                        simplifiedWitnessUTXOWithoutWitnessAction.witnessCandidates.insert(modifiedItem);
-                        
-                        undo.removedItems.push_back(originalItem);
-                        undo.addedItems.push_back(modifiedItem);
-                    }
-                    deltaItems.push_back(undo);
-                    break;
-                }
-            }
+    std::vector<const CBlockIndex*> vReplay;
+    for (const CBlockIndex* pindexWalk = pindex; pindexWalk != pindexSet; pindexWalk = pindexWalk->pprev)
+        vReplay.push_back(pindexWalk);
+    for (auto iter = vReplay.rbegin(); iter != vReplay.rend(); ++iter)
+    {
+        const CBlockIndex* pindexReplay = *iter;
+        std::vector<unsigned char> undoWitnessUTXODelta;
+        if (pindexReplay->witnessUTXODelta.empty() || !ApplySimplifiedWitnessUTXODelta(pindexReplay->witnessUTXODelta, pindexReplay->nHeight, pow2SimplifiedWitnessUTXO, undoWitnessUTXODelta))
+        {
+            hashSimplifiedWitnessUTXOStall = pindexReplay->GetBlockHashPoW2();
+            nHeightSimplifiedWitnessUTXOStall = pindexReplay->nHeight;
+            deltaSimplifiedWitnessUTXOStall = pindexReplay->witnessUTXODelta;
+            return false;
         }
+        PushSimplifiedWitnessUTXOUndo(pindexReplay->GetBlockHashPoW2(), std::move(undoWitnessUTXODelta));
     }
-    if (!anyChanges)
-        return false;
-
     return true;
 }
 
-bool GetSimplifiedWitnessUTXODeltaForBlock(const CBlockIndex* pBlockIndex, const CBlock& block, std::shared_ptr<SimplifiedWitnessUTXOSet> pow2SimplifiedWitnessUTXOForPrevBlock, std::vector<unsigned char>& compWitnessUTXODelta, CPubKey* pubkey)
+bool ConnectSimplifiedWitnessUTXOHeader(const CBlockHeader& header, const CBlockIndex* pindexPrev, bool& fWitnessVerified)
 {
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOModified = *pow2SimplifiedWitnessUTXOForPrevBlock;
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOModifiedWithoutWitnessAction = pow2SimplifiedWitnessUTXOModified;
-    
-    #ifdef EXTRA_DELTA_TESTS
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOOrig = pow2SimplifiedWitnessUTXOModified;
-    #endif
-    
-    // Calculate what changes the block makes to the simplified witness utxo set
-    std::vector<deltaItem> deltaItems;
-    CVectorWriter deltaStream(SER_NETWORK, 0, compWitnessUTXODelta, 0);
-    if (!GetSimplifiedWitnessUTXODeltaForBlockHelper(pBlockIndex->nHeight, block, deltaStream, deltaItems, pow2SimplifiedWitnessUTXOModified, pow2SimplifiedWitnessUTXOModifiedWithoutWitnessAction))
-        return false;
+    AssertLockHeld(cs_main);
+    DO_BENCHMARK("WIT: ConnectSimplifiedWitnessUTXOHeader", BCLog::BENCH|BCLog::WITNESS);
 
-    // Our copy must have changes so should not match the original
-    #ifdef EXTRA_DELTA_TESTS
-    assert(pow2SimplifiedWitnessUTXOModified != pow2SimplifiedWitnessUTXOOrig);
-    #endif
-    
-    if (pubkey)
-    {
-        DO_BENCHMARKT("CheckBlockHeaderIsPoWValid - VERIFYWITNESS_SIMPLIFIED_INTERNAL", BCLog::BENCH, 0);
+    fWitnessVerified = false;
+    if (header.witnessUTXODelta.empty() || !pindexPrev || !SyncSimplifiedWitnessUTXOToIndex(pindexPrev))
+        return true;
 
-        CGetWitnessInfo witInfo;
-        GetWitnessFromSimplifiedUTXO(pow2SimplifiedWitnessUTXOModifiedWithoutWitnessAction, pBlockIndex, witInfo);
-        if(witInfo.selectedWitnessTransaction.GetType() == CTxOutType::PoW2WitnessOutput)
+    uint64_t nHeight = pindexPrev->nHeight + 1;
+    std::function<bool(const SimplifiedWitnessUTXOSet&)> checkWitnessSelection;
+    if (header.nVersionPoW2Witness != 0 && nHeight > (uint64_t)Params().GetConsensus().pow2Phase5FirstBlockHeight)
+    {
+        checkWitnessSelection = [&](const SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO)
         {
-            if (witInfo.selectedWitnessTransaction.output.witnessDetails.witnessKeyID != pubkey->GetID())
-            {
+            CPubKey pubkey;
+            if (!pubkey.RecoverCompact(header.GetHashPoW2(), header.witnessHeaderPoW2Sig))
                 return false;
-            }
-        }
-        else
-        {
-            return false;
-        }
+            CGetWitnessInfo witnessInfo;
+            if (!GetWitnessFromSimplifiedUTXO(simplifiedWitnessUTXO, header, nHeight, witnessInfo))
+                return false;
+            if (witnessInfo.selectedWitnessTransaction.GetType() != CTxOutType::PoW2WitnessOutput)
+                return false;
+            return witnessInfo.selectedWitnessTransaction.output.witnessDetails.witnessKeyID == pubkey.GetID();
+        };
     }
-    
-    // Generate the undo info, when done pow2SimplifiedWitnessUTXOUndo should match our original item again
-    SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXOUndo = pow2SimplifiedWitnessUTXOModified;
+
     std::vector<unsigned char> undoWitnessUTXODelta;
-    if (!GenerateSimplifiedWitnessUTXODeltaUndoForHeader(undoWitnessUTXODelta, pow2SimplifiedWitnessUTXOUndo, deltaItems))
+    if (!ApplySimplifiedWitnessUTXODelta(header.witnessUTXODelta, nHeight, pow2SimplifiedWitnessUTXO, undoWitnessUTXODelta, checkWitnessSelection))
         return false;
-    
-    // As we have now undone the changes while generating the undo info, we should match the original again
-    #ifdef EXTRA_DELTA_TESTS
-    assert(pow2SimplifiedWitnessUTXOUndo == pow2SimplifiedWitnessUTXOOrig);
-    #endif
-    
-    // Revert to the modified set (with changes), apply the generated undo info, and ensure the final result matches the original set (this tests full roundtrip)
-    #ifdef EXTRA_DELTA_TESTS
-    pow2SimplifiedWitnessUTXOUndo = pow2SimplifiedWitnessUTXOModified;
-    UndoSimplifiedWitnessUTXODeltaForHeader(pow2SimplifiedWitnessUTXOUndo, undoWitnessUTXODelta);
-    assert(pow2SimplifiedWitnessUTXOUndo == pow2SimplifiedWitnessUTXOOrig);
-    #endif
-
-    // Set our modified set as the latest we have
-    if (pBlockIndex->nVersionPoW2Witness != 0)
-    {
-        pow2SimplifiedWitnessUTXOModified.currentTipForSet = pBlockIndex->GetBlockHashPoW2();    
-        pow2SimplifiedWitnessUTXO = pow2SimplifiedWitnessUTXOModified;
-    }
-    
+    PushSimplifiedWitnessUTXOUndo(header.GetHashPoW2(), std::move(undoWitnessUTXODelta));
+    fWitnessVerified = (bool)checkWitnessSelection;
     return true;
 }
 #endif
@@ -8,11 +8,11 @@
 
 #include "validation/validation.h"
 #include <boost/container/flat_set.hpp>
+#include <functional>
 
 //fixme: (PHASE5) - Properly document all of these; including pre/post conditions;
 //fixme: (PHASE5) implement unit tests.
 
-#ifdef WITNESS_HEADER_SYNC
 // Encapusulate the bare minimum information we need to know about every witness address in order to select/verify a valid witness for a block
 // Without any of the additional information thats necessary for other parts of the witness system (e.g. spending key) but not this specific function
 // And without information that can be derived from this core information (e.g. age)
@@ -20,32 +20,35 @@ class SimplifiedWitnessRouletteItem
 {
 public:
     SimplifiedWitnessRouletteItem(){};
-    SimplifiedWitnessRouletteItem(const std::tuple<const CTxOut, CTxOutPoW2Witness, COutPoint>& witnessInput)
-    {    
-        blockNumber = std::get<2>(witnessInput).getTransactionBlockNumber();
-        transactionIndex = std::get<2>(witnessInput).getTransactionIndex();
-        transactionOutputIndex = std::get<2>(witnessInput).n;
-
-        lockUntilBlock = std::get<1>(witnessInput).lockUntilBlock;
-        lockFromBlock = std::get<1>(witnessInput).lockFromBlock;
-        if (lockFromBlock == 0)
-        {
-            lockFromBlock = blockNumber;
-        }
-        witnessPubKeyID = std::get<1>(witnessInput).witnessKeyID;
-        nValue = std::get<0>(witnessInput).nValue;
-    }
+    SimplifiedWitnessRouletteItem(const COutPoint& outPoint, const Coin& coin);
     uint64_t blockNumber;
     uint64_t transactionIndex;
     uint32_t transactionOutputIndex;
     uint64_t lockUntilBlock;
+    // As in the output itself, so 0 if the lock starts at blockNumber
     uint64_t lockFromBlock;
     CKeyID witnessPubKeyID;
     CAmount nValue;
     
-    uint64_t GetLockLength()
+    uint64_t GetLockLength() const
     {
-        return (lockUntilBlock-lockFromBlock)+1;
+        return (lockUntilBlock-(lockFromBlock == 0 ? blockNumber : lockFromBlock))+1;
+    }
+
+    //! Reconstruct the witness coin this item was made from, as far as witness selection is concerned.
+    Coin GetCoin() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(blockNumber));
+        READWRITE(VARINT(transactionIndex));
+        READWRITE(VARINT(transactionOutputIndex));
+        READWRITE(VARINT(lockUntilBlock));
+        READWRITE(VARINT(lockFromBlock));
+        READWRITE(witnessPubKeyID);
+        READWRITE(COMPRESSEDAMOUNT(nValue));
     }
     
     friend inline bool operator!=(const SimplifiedWitnessRouletteItem& a, const SimplifiedWitnessRouletteItem& b)
@@ -59,6 +62,7 @@ public:
             a.transactionIndex != b.transactionIndex ||
             a.transactionOutputIndex != b.transactionOutputIndex ||
             a.lockUntilBlock != b.lockUntilBlock ||
+            a.lockFromBlock != b.lockFromBlock ||
             a.nValue != b.nValue ||
             a.witnessPubKeyID != b.witnessPubKeyID
         )
@@ -122,18 +126,174 @@ public:
     }
 };
 
-SimplifiedWitnessUTXOSet GenerateSimplifiedWitnessUTXOSetFromUTXOSet(std::map<COutPoint, Coin> allWitnessCoinsIndexBased);
-bool GetSimplifiedWitnessUTXOSetForIndex(const CBlockIndex* pBlockIndex, SimplifiedWitnessUTXOSet& pow2SimplifiedWitnessUTXOForBlock);
-bool GetSimplifiedWitnessUTXODeltaForBlock(const CBlockIndex* pBlockIndexPrev, const CBlock& block, std::shared_ptr<SimplifiedWitnessUTXOSet> pow2SimplifiedWitnessUTXOForPrevBlock, std::vector<unsigned char>& compWitnessUTXODelta, CPubKey* pubkey);
+SimplifiedWitnessUTXOSet GenerateSimplifiedWitnessUTXOSetFromUTXOSet(const std::map<COutPoint, Coin>& allWitnessCoins);
+
+// A witness UTXO delta (CBlockHeader::witnessUTXODelta) describes the changes a block makes to the simplified witness set as a list of spends (by position in the set at that point) and creations.
+// The changes made by the witness coinbase come last, after a witness action marker; the set as it is at the marker is the one the witness of the block is selected from.
+// Deltas are generated by full nodes as they connect blocks and served along with the headers, SPV clients use them to track the set and verify witness headers against it.
+
+//! Generate the delta of 'block' (at height nHeight) when connected on top of the witness set 'witnessCoins'.
+bool GenerateSimplifiedWitnessUTXODeltaForBlock(const CBlock& block, uint64_t nHeight, const std::map<COutPoint, Coin>& witnessCoins, std::vector<unsigned char>& witnessUTXODelta);
+//! Apply the delta of the header at nHeight to 'simplifiedWitnessUTXO', filling in the data to undo it again with.
+//! If checkWitnessSelection is set it is called with the set at the witness action marker and the delta must contain one.
+//! Fails (leaving the set untouched) if the delta is malformed, doesn't fit the set or checkWitnessSelection returns false.
+bool ApplySimplifiedWitnessUTXODelta(const std::vector<unsigned char>& witnessUTXODelta, uint64_t nHeight, SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, std::vector<unsigned char>& undoWitnessUTXODelta, const std::function<bool(const SimplifiedWitnessUTXOSet&)>& checkWitnessSelection=nullptr);
+bool UndoSimplifiedWitnessUTXODelta(SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, const std::vector<unsigned char>& undoWitnessUTXODelta);
+
+#ifdef WITNESS_HEADER_SYNC
+//! SPV: advance pow2SimplifiedWitnessUTXO over 'header' (a child of pindexPrev) using the delta it carries, verifying the witness that signed it against the set where possible.
+//! fWitnessVerified is set if the witness signature was verified, returns false if the delta is invalid or the signature doesn't belong to the selected witness.
+//! Headers the set can't be brought up to (e.g. because an ancestor came without a delta) are left alone, as are headers without a delta.
+bool ConnectSimplifiedWitnessUTXOHeader(const CBlockHeader& header, const CBlockIndex* pindexPrev, bool& fWitnessVerified);
 #endif
 
 /** Global variable that points to the witness coins database (protected by cs_main) */
 extern CWitViewDB* ppow2witdbview;
 extern std::shared_ptr<CCoinsViewCache> ppow2witTip;
 #ifdef WITNESS_HEADER_SYNC
+/** SPV: simplified witness set as of currentTipForSet, maintained from the witness UTXO deltas of the headers (protected by cs_main) */
 extern SimplifiedWitnessUTXOSet pow2SimplifiedWitnessUTXO;
 #endif
 
+//! How many blocks below the tip we retain per block witness deltas for; queries for blocks on forks deeper than this fall back to replaying a cloned chain.
+static const int64_t WITNESS_COIN_INDEX_DELTA_DEPTH = 100;
+
+// Changes that a single block makes to the set of unspent witness coins.
+struct CWitnessCoinDelta
+{
+    uint64_t nHeight = 0;
+    std::map<COutPoint, Coin> added;
+    std::map<COutPoint, Coin> removed;
+
+    void Apply(std::map<COutPoint, Coin>& witnessCoins) const;
+    void Undo(std::map<COutPoint, Coin>& witnessCoins) const;
+};
+
+// Compute the witness delta for 'block' (at height nHeight) when connected on top of the witness set 'witnessCoins'.
+// Mirrors the witness side of UpdateCoins/AddCoins so that the result is identical to what a chained witness view would observe.
+void ComputeWitnessCoinDelta(const CBlock& block, uint64_t nHeight, const std::map<COutPoint, Coin>& witnessCoins, CWitnessCoinDelta& delta);
+
+/** Structure of arrays store of witness roulette candidates.
+ *  Each column is contiguous so that the filter/sum/select passes of witness selection only stream through the data they actually need,
+ *  weight and lock information is extracted once when the candidate is added instead of on every pass.
+ *  Candidates are kept in outpoint order (the order of the witness set they are built from), so they can be maintained from witness coin deltas.
+ */
+struct CWitnessRouletteColumns
+{
+    //! Candidate columns (parallel arrays, one entry per candidate)
+    std::vector<COutPoint> outpoint;
+    std::vector<uint64_t> coinHeight;
+    std::vector<uint64_t> weight;
+    std::vector<uint64_t> lockUntilBlock;
+
+    //! Height of the block before the one being witnessed that the weights and minimums were determined for
+    uint64_t nPreviousHeight = 0;
+    //! Sum of the weight column
+    uint64_t nTotalWeightRaw = 0;
+
+    size_t size() const { return outpoint.size(); }
+    void reserve(size_t nCandidates)
+    {
+        outpoint.reserve(nCandidates);
+        coinHeight.reserve(nCandidates);
+        weight.reserve(nCandidates);
+        lockUntilBlock.reserve(nCandidates);
+    }
+    void clear()
+    {
+        outpoint.clear();
+        coinHeight.clear();
+        weight.clear();
+        lockUntilBlock.clear();
+        nTotalWeightRaw = 0;
+    }
+    void push_back(const COutPoint& outpoint_, uint64_t nCoinHeight, uint64_t nWeight, uint64_t nLockUntilBlock)
+    {
+        outpoint.push_back(outpoint_);
+        coinHeight.push_back(nCoinHeight);
+        weight.push_back(nWeight);
+        lockUntilBlock.push_back(nLockUntilBlock);
+        nTotalWeightRaw += nWeight;
+    }
+};
+
+// Build the roulette candidates of 'witnessCoins' for the block after nPreviousHeight, i.e. all coins that meet the basic criteria of minimum weight/amount.
+void BuildWitnessRouletteColumns(const std::map<COutPoint, Coin>& witnessCoins, uint64_t nPreviousHeight, CWitnessRouletteColumns& columns);
+// Derive the candidates after applying (or with fUndo undoing) 'delta' to the witness set 'previous' was built from; weights are only determined for the coins the delta adds.
+// 'witnessCoins' is the witness set after the change, it is only used if the candidate rules differ between previous.nPreviousHeight and nPreviousHeight (in which case everything is rebuilt).
+void UpdateWitnessRouletteColumns(const CWitnessRouletteColumns& previous, const CWitnessCoinDelta& delta, bool fUndo, const std::map<COutPoint, Coin>& witnessCoins, uint64_t nPreviousHeight, CWitnessRouletteColumns& columns);
+
+/** Immutable view of the witness state at a specific tip of chainActive.
+ *  A new snapshot is published (see GetWitnessStateSnapshot) every time the tip changes, readers hold a reference to the snapshot
+ *  and can then work against a consistent witness set for as long as they like without holding cs_main.
+ */
+struct CWitnessStateSnapshot
+{
+    const CBlockIndex* pTip = nullptr;
+    uint256 tipHash;
+    int64_t nTipHeight = 0;
+    //! All unspent witness coins with pTip as the tip (identical to what getAllUnspentWitnessCoins returns for pTip)
+    //! Shared with the witness coin index (and any other snapshot of the same tip), never null.
+    std::shared_ptr<const std::map<COutPoint, Coin>> witnessCoins = std::make_shared<const std::map<COutPoint, Coin>>();
+    //! Network weight with pTip as the tip (identical to what GetPow2NetworkWeight returns for pTip)
+    int64_t nNumWitnessAddresses = 0;
+    int64_t nTotalWeight = 0;
+    //! Deltas of pTip and its ancestors, tip first, for as far back as the index retains them (at most WITNESS_COIN_INDEX_DELTA_DEPTH).
+    std::vector<std::shared_ptr<const CWitnessCoinDelta>> recentDeltas;
+    //! Roulette candidates of witnessCoins for the block after pTip, shared with the witness coin index, never null.
+    std::shared_ptr<const CWitnessRouletteColumns> rouletteColumns = std::make_shared<const CWitnessRouletteColumns>();
+
+    //! Rewind 'witnessCoins', which hold the witness set as of the ancestor of pTip at nHeight, to pTarget; lock free.
+    //! Returns false (leaving witnessCoins untouched) if pTarget isn't an ancestor of pTip, is further back than recentDeltas reach or is a phase 3 witnessed block.
+    bool RewindWitnessCoins(std::map<COutPoint, Coin>& witnessCoins, int64_t& nHeight, const CBlockIndex* pTarget) const;
+};
+
+//! Fetch the most recently published witness state snapshot; lock free unless no snapshot has been published yet.
+//! Phase 3 witnessed tips are not tracked by the index, for these a one off (unpublished) snapshot is built if fBuildIfUnpublished is set.
+//! Returns nullptr if there is no tip or no snapshot could be obtained.
+std::shared_ptr<const CWitnessStateSnapshot> GetWitnessStateSnapshot(bool fBuildIfUnpublished=true);
+
+/** In memory index of all unspent witness coins (protected by cs_main)
+ *  Tracks the witness set at the tip of chainActive and is maintained incrementally as blocks are connected/disconnected.
+ *  Per block deltas are retained for recent blocks (both on chainActive and on recent forks) so that the witness set as of
+ *  any recent block can be derived by rewinding/applying a handful of deltas instead of replaying blocks into a throwaway view.
+ */
+class CWitnessCoinIndex
+{
+public:
+    //! Called after 'pindex' has been connected as the new tip of chainActive.
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+    //! Generate the witness UTXO delta of 'block' at 'pindex', which is being connected on top of the tip; returns false if the index doesn't track the tip.
+    bool GenerateSimplifiedWitnessUTXODelta(const CBlock& block, const CBlockIndex* pindex, std::vector<unsigned char>& witnessUTXODelta);
+    //! Called after 'pindex' has been disconnected from the tip of chainActive.
+    void BlockDisconnected(const CBlockIndex* pindex);
+    //! Drop all state; the index is lazily rebuilt from the witness view on next use.
+    void Invalidate();
+
+    //! Fetch the witness set as of 'pindex' (i.e. with 'pindex' as the tip); returns false if the index can't answer and the caller should fall back to a chain replay.
+    bool GetWitnessCoinsForIndex(const CBlockIndex* pindex, const CChainParams& chainParams, std::map<COutPoint, Coin>& witnessCoins);
+
+private:
+    bool SyncWithTip();
+    void RecalculateTipNetworkWeight(int64_t nTipHeight);
+    void RecordTipNetworkWeight(const CBlockIndex* pTip);
+    void PublishSnapshot(const CBlockIndex* pTip);
+
+    friend std::shared_ptr<const CWitnessStateSnapshot> GetWitnessStateSnapshot(bool fBuildIfUnpublished);
+
+    bool fSynced = false;
+    uint256 tipHash;
+    //! Replaced (copy on write) rather than modified as the tip moves, so that published snapshots can share it.
+    std::shared_ptr<const std::map<COutPoint, Coin>> tipWitnessCoins = std::make_shared<const std::map<COutPoint, Coin>>();
+    //! Network weight of tipWitnessCoins at the tip height, maintained alongside the coins so that pow2NetworkWeightSeries can be extended for free.
+    int64_t nTipNumWitnessAddresses = 0;
+    int64_t nTipNetworkWeight = 0;
+    //! Roulette candidates of tipWitnessCoins for the block after the tip, maintained (copy on write) alongside the coins.
+    std::shared_ptr<const CWitnessRouletteColumns> tipRouletteColumns = std::make_shared<const CWitnessRouletteColumns>();
+    std::map<uint256, std::shared_ptr<const CWitnessCoinDelta>> blockDeltas;
+};
+extern CWitnessCoinIndex pow2WitnessCoinIndex;
+
 struct RouletteItem
 {
 public:
@@ -164,6 +324,9 @@ struct CGetWitnessInfo
     //! All witness coins on the network that meet the basic criteria of minimum weight/amount
     std::vector<RouletteItem> witnessSelectionPoolUnfiltered;
 
+    //! witnessSelectionPoolUnfiltered in column form (same order); if not set GetWitnessHelper builds it from the pool.
+    std::shared_ptr<const CWitnessRouletteColumns> rouletteColumns;
+
     //! All witness coins on the network that were considered eligible for the purpose of selecting the winner. (All contenders)
     std::vector<RouletteItem> witnessSelectionPoolFiltered;
 
@@ -194,6 +357,32 @@ struct CGetWitnessInfo
     uint64_t nMaxIndividualWeight = 0;
 };
 
+struct CWitnessRouletteSelection
+{
+    //! Indices of eligible candidates in deterministic roulette order, and the prefix sums of their adjusted weights
+    std::vector<uint32_t> eligible;
+    std::vector<uint64_t> cumulativeWeight;
+
+    //! Index of the selected witness in eligible
+    uint64_t nSelectedEligibleIndex = 0;
+    //! Index of the selected witness in the candidate columns
+    uint64_t nSelectedCandidate = 0;
+    uint64_t nTotalWeightEligibleRaw = 0;
+    uint64_t nTotalWeightEligibleAdjusted = 0;
+    uint64_t nMaxIndividualWeight = 0;
+    //! Set if there were fewer than 100 eligible witnesses at the standard minimum participation age
+    bool fLowParticipation = false;
+
+    uint64_t adjustedWeight(size_t nEligibleIndex) const
+    {
+        return cumulativeWeight[nEligibleIndex] - (nEligibleIndex == 0 ? 0 : cumulativeWeight[nEligibleIndex-1]);
+    }
+};
+
+// Perform the witness roulette for 'blockHash' over the candidates in 'columns'; selection is a binary search over the prefix sums of the eligible weights.
+// NB! This must produce precisely the same result as the historical RouletteItem based implementation, it is consensus critical.
+bool SelectWitnessFromRouletteColumns(const uint256& blockHash, uint64_t nBlockHeight, uint32_t numGenesisWitnesses, uint32_t genesisWitnessWeightDivisor, const CWitnessRouletteColumns& columns, CWitnessRouletteSelection& selection);
+
 int GetPoW2WitnessCoinbaseIndex(const CBlock& block);
 
 // Returns all competing orphans at same height and same parent as current tip.
@@ -217,15 +406,19 @@ uint64_t expectedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeigh
 uint64_t estimatedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeight);
 
 bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock=nullptr, CCoinsViewCache* viewOverride=nullptr);
+//! As above but without a new block, sharing rather than copying the witness set where it is already held by a snapshot or the witness coin index.
+bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::shared_ptr<const std::map<COutPoint, Coin>>& allWitnessCoins, CCoinsViewCache* viewOverride=nullptr);
 
 bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
 
 bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
+//! Equivalent of GetWitnessInfo where the witness set as of the block before 'block' (at nPreviousHeight) is already known, e.g. from a witness state snapshot.
+//! If the roulette candidates of that set are known as well (previousColumns) they are updated rather than rebuilt.
+void GetWitnessInfoFromWitnessCoins(const std::map<COutPoint, Coin>& previousWitnessCoins, uint64_t nPreviousHeight, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight, std::shared_ptr<const CWitnessRouletteColumns> previousColumns=nullptr);
 
 bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo);
-#ifdef WITNESS_HEADER_SYNC
-bool GetWitnessFromSimplifiedUTXO(SimplifiedWitnessUTXOSet simplifiedWitnessUTXO, const CBlockIndex* pBlockIndex, CGetWitnessInfo& witnessInfo);
-#endif
+//! Equivalent of GetWitness for 'block' at nBlockHeight where the witness selection set is known in its simplified form.
+bool GetWitnessFromSimplifiedUTXO(const SimplifiedWitnessUTXOSet& simplifiedWitnessUTXO, const CBlockHeader& block, uint64_t nBlockHeight, CGetWitnessInfo& witnessInfo);
 
 bool witnessHasExpired(uint64_t nWitnessAge, uint64_t nWitnessWeight, uint64_t nNetworkTotalWitnessWeight);
 
@@ -703,13 +703,20 @@ bool CAccountHD::AddKeyPubKey(const CKey& key, const CPubKey &pubkey, int keyCha
     // The exception being PoW² witnesses which may contain witness keys unencrypted (change chain keys)
     assert(IsPoW2Witness());
     assert(keyChain == KEYCHAIN_WITNESS);
-    return internalKeyStore.AddKeyPubKey(key, pubkey);
+    if (!internalKeyStore.AddKeyPubKey(key, pubkey))
+        return false;
+    if (keyIndex)
+        keyIndex->AddKey(pubkey.GetID(), this, keyChain);
+    return true;
 }
 
 bool CAccountHD::AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey, int keyChain)
 {
     if(keyChain == KEYCHAIN_EXTERNAL)
-        return externalKeyStore.AddKeyPubKey(HDKeyIndex, pubkey);
+    {
+        if (!externalKeyStore.AddKeyPubKey(HDKeyIndex, pubkey))
+            return false;
+    }
     else
     {
         // Add public key with null private key - we later write the private key IFF it is used in a witnessing operation
@@ -725,8 +732,12 @@ bool CAccountHD::AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey, int key
                 }
             }
         }
-        return internalKeyStore.AddKeyPubKey(HDKeyIndex, pubkey);
+        if (!internalKeyStore.AddKeyPubKey(HDKeyIndex, pubkey))
+            return false;
     }
+    if (keyIndex)
+        keyIndex->AddKey(pubkey.GetID(), this, keyChain);
+    return true;
 }
 
 
@@ -1039,12 +1050,17 @@ bool CAccount::AddKeyPubKey(const CKey& key, const CPubKey &pubkey, int keyChain
 {
     if(keyChain == KEYCHAIN_EXTERNAL)
     {
-        return externalKeyStore.AddKeyPubKey(key, pubkey);
+        if (!externalKeyStore.AddKeyPubKey(key, pubkey))
+            return false;
     }
     else
     {
-        return internalKeyStore.AddKeyPubKey(key, pubkey);
+        if (!internalKeyStore.AddKeyPubKey(key, pubkey))
+            return false;
     }
+    if (keyIndex)
+        keyIndex->AddKey(pubkey.GetID(), this, keyChain);
+    return true;
 }
 
 bool CAccount::AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey, int keyChain)
@@ -1072,7 +1088,11 @@ bool CAccount::RemoveWatchOnly(const CScript &dest)
 //fixme: (FUT) (ACCOUNTS)
 bool CAccount::AddCScript(const CScript& redeemScript)
 {
-    return externalKeyStore.AddCScript(redeemScript);
+    if (!externalKeyStore.AddCScript(redeemScript))
+        return false;
+    if (keyIndex)
+        keyIndex->AddScript(CScriptID(redeemScript), this);
+    return true;
 }
 
 bool CAccount::AddCryptedKeyWithChain(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret, int64_t nKeyChain)
@@ -1093,6 +1113,8 @@ bool CAccount::AddCryptedKeyWithChain(const CPubKey &vchPubKey, const std::vecto
         if (!internalKeyStore.AddCryptedKey(vchPubKey, vchCryptedSecret))
             return false;
     }
+    if (keyIndex)
+        keyIndex->AddKey(vchPubKey.GetID(), this, nKeyChain);
 
     // If we don't have a wallet yet (busy during wallet upgrade) - then the below not being called is fine as the wallet does a 'force resave' of all keys at the end of the upgrade.
     if (pactiveWallet)
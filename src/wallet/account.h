@@ -40,6 +40,7 @@
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
 
 class CAccountHD;
+class CAccountKeyIndex;
 class CWallet;
 class CWalletDB;
 class CKeyMetadata;
@@ -440,8 +441,10 @@ protected:
     bool m_readOnly = false;
 
     CKeyingMaterial vMasterKey; // Memory only.
+    CAccountKeyIndex* keyIndex = nullptr; // Memory only, wallet index that new keys/scripts are reported to (see CAccountKeyIndex).
     friend class CExtWallet;
     friend class CWallet;
+    friend class CAccountKeyIndex;
 
     AccountStatus nWarningState = AccountStatus::Default; // Memory only
 };
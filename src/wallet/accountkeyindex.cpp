@@ -0,0 +1,277 @@
+// Copyright (c) 2016-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "wallet/accountkeyindex.h"
+#include "wallet/account.h"
+
+#include "primitives/transaction.h"
+#include "script/script.h"
+
+#include <algorithm>
+
+void CAccountKeyIndex::AddEntry(IndexMap& index, const uint160& id, CAccount* account, int keyChain)
+{
+    CAccountKeyOwners& owners = index[id];
+    for (const auto& entry : owners)
+    {
+        if (entry.account == account)
+            return;
+    }
+    owners.push_back({account, keyChain, account->IsPoW2Witness()});
+    recentIds.emplace_back(++nGeneration, id);
+    if (recentIds.size() > MAX_RECENT_IDS)
+    {
+        nRecentIdsSince = recentIds.front().first;
+        recentIds.pop_front();
+    }
+}
+
+void CAccountKeyIndex::AddAccount(CAccount* account)
+{
+    LOCK(cs_index);
+    account->keyIndex = this;
+
+    // The internal key store holds the change chain keys, for HD and legacy accounts alike.
+    std::set<CKeyID> setKeysExternal;
+    std::set<CKeyID> setKeysInternal;
+    account->GetKeys(setKeysExternal, setKeysInternal);
+    for (const auto& keyID : setKeysExternal)
+        AddEntry(mapKeys, keyID, account, KEYCHAIN_EXTERNAL);
+    for (const auto& keyID : setKeysInternal)
+        AddEntry(mapKeys, keyID, account, KEYCHAIN_CHANGE);
+
+    std::set<CScriptID> setScripts;
+    account->externalKeyStore.GetCScripts(setScripts);
+    for (const auto& scriptID : setScripts)
+        AddEntry(mapScripts, scriptID, account, -1);
+    // Also for accounts without any keys yet, the set of accounts changed.
+    ++nGeneration;
+    ++nAccountGeneration;
+}
+
+void CAccountKeyIndex::RemoveAccount(CAccount* account)
+{
+    LOCK(cs_index);
+    if (account->keyIndex == this)
+        account->keyIndex = nullptr;
+
+    for (IndexMap* index : { &mapKeys, &mapScripts })
+    {
+        for (auto iter = index->begin(); iter != index->end();)
+        {
+            auto& owners = iter->second;
+            owners.erase(std::remove_if(owners.begin(), owners.end(), [&](const CAccountKeyIndexEntry& entry) { return entry.account == account; }), owners.end());
+            if (owners.empty())
+                iter = index->erase(iter);
+            else
+                ++iter;
+        }
+    }
+    ++nGeneration;
+    ++nAccountGeneration;
+}
+
+void CAccountKeyIndex::AddKey(const CKeyID& keyID, CAccount* account, int keyChain)
+{
+    LOCK(cs_index);
+    AddEntry(mapKeys, keyID, account, keyChain);
+}
+
+void CAccountKeyIndex::AddScript(const CScriptID& scriptID, CAccount* account)
+{
+    LOCK(cs_index);
+    AddEntry(mapScripts, scriptID, account, -1);
+}
+
+// Owners are copied out rather than visited, so callers can ask the accounts (which take their own locks and may report new keys) without holding cs_index.
+void CAccountKeyIndex::Lookup(const IndexMap& index, const uint160& id, CAccountKeyOwners& owners) const
+{
+    LOCK(cs_index);
+    auto iter = index.find(id);
+    if (iter == index.end())
+        owners.clear();
+    else
+        owners = iter->second;
+}
+
+void CAccountKeyIndex::LookupKey(const CKeyID& keyID, CAccountKeyOwners& owners) const
+{
+    Lookup(mapKeys, keyID, owners);
+}
+
+void CAccountKeyIndex::LookupScript(const CScriptID& scriptID, CAccountKeyOwners& owners) const
+{
+    Lookup(mapScripts, scriptID, owners);
+}
+
+void CAccountKeyIndex::AppendOwners(const IndexMap& index, const uint160& id, std::vector<CAccount*>& accounts) const
+{
+    auto iter = index.find(id);
+    if (iter == index.end())
+        return;
+    for (const auto& entry : iter->second)
+    {
+        if (std::find(accounts.begin(), accounts.end(), entry.account) == accounts.end())
+            accounts.push_back(entry.account);
+    }
+}
+
+// Ownership checks visit accounts in mapAccounts (uuid) order, keep doing so for the candidates so that ties (e.g. the same key in two accounts) resolve the same way.
+void CAccountKeyIndex::SortAccounts(std::vector<CAccount*>& accounts)
+{
+    if (accounts.size() > 1)
+        std::sort(accounts.begin(), accounts.end(), [](const CAccount* a, const CAccount* b) { return a->getUUID() < b->getUUID(); });
+}
+
+bool CAccountKeyIndex::GetCandidateAccounts(const CScript& scriptPubKey, std::vector<CAccount*>& accounts) const
+{
+    // Mirrors the key/script lookups IsMine(const CKeyStore&, const CScript&) performs for each script type.
+    std::vector<std::vector<unsigned char>> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+
+    LOCK(cs_index);
+    switch (whichType)
+    {
+        case TX_NONSTANDARD:
+        case TX_NULL_DATA:
+            break;
+        case TX_PUBKEY:
+            AppendOwners(mapKeys, CPubKey(vSolutions[0]).GetID(), accounts);
+            break;
+        case TX_PUBKEYHASH:
+            AppendOwners(mapKeys, uint160(vSolutions[0]), accounts);
+            break;
+        case TX_SCRIPTHASH:
+            AppendOwners(mapScripts, uint160(vSolutions[0]), accounts);
+            break;
+        case TX_MULTISIG:
+            // Only mine if a single account holds all the keys, so the holders of the first key are the only candidates.
+            AppendOwners(mapKeys, CPubKey(vSolutions[1]).GetID(), accounts);
+            break;
+        case TX_STANDARD_WITNESS:
+        case TX_STANDARD_PUBKEY_HASH:
+            return false;
+    }
+    SortAccounts(accounts);
+    return true;
+}
+
+bool CAccountKeyIndex::GetCandidateAccounts(const CTxOut& txout, std::vector<CAccount*>& accounts) const
+{
+    switch (txout.GetType())
+    {
+        case CTxOutType::ScriptLegacyOutput:
+            return GetCandidateAccounts(txout.output.scriptPubKey, accounts);
+        case CTxOutType::PoW2WitnessOutput:
+        {
+            LOCK(cs_index);
+            AppendOwners(mapKeys, txout.output.witnessDetails.spendingKeyID, accounts);
+            AppendOwners(mapKeys, txout.output.witnessDetails.witnessKeyID, accounts);
+            SortAccounts(accounts);
+            return true;
+        }
+        case CTxOutType::StandardKeyHashOutput:
+        {
+            LOCK(cs_index);
+            AppendOwners(mapKeys, txout.output.standardKeyHash.keyID, accounts);
+            SortAccounts(accounts);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CAccountKeyIndex::GetCandidateAccounts(const CTxDestination& dest, std::vector<CAccount*>& accounts) const
+{
+    if (const CPoW2WitnessDestination* witnessDetails = boost::get<CPoW2WitnessDestination>(&dest))
+    {
+        LOCK(cs_index);
+        AppendOwners(mapKeys, witnessDetails->spendingKey, accounts);
+        AppendOwners(mapKeys, witnessDetails->witnessKey, accounts);
+        SortAccounts(accounts);
+        return true;
+    }
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+    {
+        LOCK(cs_index);
+        AppendOwners(mapKeys, *keyID, accounts);
+        SortAccounts(accounts);
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+    {
+        LOCK(cs_index);
+        AppendOwners(mapScripts, *scriptID, accounts);
+        SortAccounts(accounts);
+        return true;
+    }
+    return false;
+}
+
+bool CAccountKeyIndex::GetIdsAddedSince(uint64_t nSinceGeneration, std::vector<uint160>& ids) const
+{
+    LOCK(cs_index);
+    if (nSinceGeneration < nRecentIdsSince)
+        return false;
+    for (auto iter = recentIds.rbegin(); iter != recentIds.rend() && iter->first > nSinceGeneration; ++iter)
+        ids.push_back(iter->second);
+    std::reverse(ids.begin(), ids.end());
+    return true;
+}
+
+bool CAccountKeyIndex::GetOutputIds(const CTxOut& txout, std::vector<uint160>& ids)
+{
+    switch (txout.GetType())
+    {
+        case CTxOutType::ScriptLegacyOutput:
+        {
+            std::vector<std::vector<unsigned char>> vSolutions;
+            txnouttype whichType;
+            if (!Solver(txout.output.scriptPubKey, whichType, vSolutions))
+                return false;
+            switch (whichType)
+            {
+                case TX_NONSTANDARD:
+                case TX_NULL_DATA:
+                    return true;
+                case TX_PUBKEY:
+                    ids.push_back(CPubKey(vSolutions[0]).GetID());
+                    return true;
+                case TX_PUBKEYHASH:
+                case TX_SCRIPTHASH:
+                    ids.push_back(uint160(vSolutions[0]));
+                    return true;
+                case TX_MULTISIG:
+                    for (size_t i = 1; i + 1 < vSolutions.size(); ++i)
+                        ids.push_back(CPubKey(vSolutions[i]).GetID());
+                    return true;
+                case TX_STANDARD_WITNESS:
+                case TX_STANDARD_PUBKEY_HASH:
+                    return false;
+            }
+            return false;
+        }
+        case CTxOutType::PoW2WitnessOutput:
+            ids.push_back(txout.output.witnessDetails.spendingKeyID);
+            ids.push_back(txout.output.witnessDetails.witnessKeyID);
+            return true;
+        case CTxOutType::StandardKeyHashOutput:
+            ids.push_back(txout.output.standardKeyHash.keyID);
+            return true;
+    }
+    return false;
+}
+
+void CAccountKeyIndex::ForEachKey(const std::function<void(const CKeyID&)>& fn) const
+{
+    LOCK(cs_index);
+    for (const auto& [keyID, owners] : mapKeys)
+    {
+        (unused) owners;
+        fn(CKeyID(keyID));
+    }
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2016-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef WALLET_ACCOUNTKEYINDEX_H
+#define WALLET_ACCOUNTKEYINDEX_H
+
+#include "crypto/common.h"
+#include "prevector.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "sync.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class CAccount;
+class CTxOut;
+
+//! One owner of a key (or script) in the account key index.
+struct CAccountKeyIndexEntry
+{
+    CAccount* account;
+    //! KEYCHAIN_EXTERNAL/KEYCHAIN_CHANGE for keys, -1 for scripts.
+    int keyChain;
+    //! The owning account is a witness account, saves a virtual call when filtering for witness ownership.
+    bool isWitness;
+};
+
+//! The owner(s) of a key (or script), nearly always just the one so they are kept inline.
+typedef prevector<2, CAccountKeyIndexEntry> CAccountKeyOwners;
+
+/**
+ * Wallet wide index from key id (and script id) to the account(s) that hold the key.
+ *
+ * Ownership checks (IsMine/GetDebit/GetCredit etc.) used to ask every account in the wallet in turn, which for wallets with thousands of accounts
+ * means thousands of map lookups per output of every transaction. Instead they look up the key ids an output pays to here and then only ask the
+ * account(s) returned; the account itself remains the authority on whether the output is actually its own.
+ *
+ * Accounts are registered with AddAccount once they are part of the wallet, after which the account reports every key/script it gains to the index itself.
+ */
+class CAccountKeyIndex
+{
+public:
+    //! Register account with the index and index all keys and scripts it already holds.
+    void AddAccount(CAccount* account);
+    //! Drop account and all its keys from the index (account purge).
+    void RemoveAccount(CAccount* account);
+    void AddKey(const CKeyID& keyID, CAccount* account, int keyChain);
+    void AddScript(const CScriptID& scriptID, CAccount* account);
+
+    //! Set owners to the entries (in the order they were indexed) of the accounts that hold keyID/scriptID, empty if none do.
+    void LookupKey(const CKeyID& keyID, CAccountKeyOwners& owners) const;
+    void LookupScript(const CScriptID& scriptID, CAccountKeyOwners& owners) const;
+
+    //! Accounts (in wallet order, without duplicates) that may own txout/dest.
+    //! Returns false if the candidates can't be determined from the index (e.g. non standard scripts) in which case the caller has to ask every account.
+    bool GetCandidateAccounts(const CTxOut& txout, std::vector<CAccount*>& accounts) const;
+    bool GetCandidateAccounts(const CTxDestination& dest, std::vector<CAccount*>& accounts) const;
+    bool GetCandidateAccounts(const CScript& scriptPubKey, std::vector<CAccount*>& accounts) const;
+
+    //! Call fn for every key id in the index (once per key, regardless of how many accounts hold it).
+    void ForEachKey(const std::function<void(const CKeyID&)>& fn) const;
+
+    //! Incremented whenever a key or script is added or an account is added or removed, lets callers that matched against the index detect that their result may be stale.
+    uint64_t GetGeneration() const { return nGeneration; }
+    //! Incremented only when an account is added or removed.
+    uint64_t GetAccountGeneration() const { return nAccountGeneration; }
+    //! Key and script ids added to an account since generation nSinceGeneration (see GetGeneration).
+    //! Returns false if that is further back than the index remembers, in which case the caller has to assume that anything may have changed.
+    bool GetIdsAddedSince(uint64_t nSinceGeneration, std::vector<uint160>& ids) const;
+
+    //! Key and script ids that txout may pay to (for multisig all of its keys), false if they can't be determined.
+    static bool GetOutputIds(const CTxOut& txout, std::vector<uint160>& ids);
+
+private:
+    struct Hasher
+    {
+        size_t operator()(const uint160& id) const { return ReadLE64(id.begin()); }
+    };
+    typedef std::unordered_map<uint160, CAccountKeyOwners, Hasher> IndexMap;
+
+    void AddEntry(IndexMap& index, const uint160& id, CAccount* account, int keyChain);
+    void Lookup(const IndexMap& index, const uint160& id, CAccountKeyOwners& owners) const;
+    void AppendOwners(const IndexMap& index, const uint160& id, std::vector<CAccount*>& accounts) const;
+    static void SortAccounts(std::vector<CAccount*>& accounts);
+
+    mutable RecursiveMutex cs_index;
+    IndexMap mapKeys;
+    IndexMap mapScripts;
+    std::atomic<uint64_t> nGeneration{0};
+    std::atomic<uint64_t> nAccountGeneration{0};
+
+    //! Most recently added ids along with the generation their addition bumped the index to.
+    static const size_t MAX_RECENT_IDS = 10000;
+    std::deque<std::pair<uint64_t, uint160>> recentIds;
+    //! Generation before the oldest entry in recentIds, anything since then is remembered.
+    uint64_t nRecentIdsSince = 0;
+};
+
+#endif // WALLET_ACCOUNTKEYINDEX_H
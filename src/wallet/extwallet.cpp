@@ -255,15 +255,15 @@ std::string accountNameForAddress(const CWallet &wallet, const CTxDestination& d
     std::string accountNameForAddress;
 
     isminetype ret = isminetype::ISMINE_NO;
-    for (const auto& accountItem : wallet.mapAccounts)
+    for (const auto& account : wallet.GetCandidateAccounts(dest))
     {
         for (auto keyChain : { KEYCHAIN_EXTERNAL, KEYCHAIN_CHANGE })
         {
-            isminetype temp = ( keyChain == KEYCHAIN_EXTERNAL ? IsMine(accountItem.second->externalKeyStore, dest) : IsMine(accountItem.second->internalKeyStore, dest) );
+            isminetype temp = ( keyChain == KEYCHAIN_EXTERNAL ? IsMine(account->externalKeyStore, dest) : IsMine(account->internalKeyStore, dest) );
             if (temp > ret)
             {
                 ret = temp;
-                accountNameForAddress = accountItem.second->getLabel();
+                accountNameForAddress = account->getLabel();
             }
         }
     }
@@ -277,11 +277,11 @@ isminetype IsMine(const CWallet &wallet, const CTxDestination& dest)
     LOCK(wallet.cs_wallet);
 
     isminetype ret = isminetype::ISMINE_NO;
-    for (const auto& accountItem : wallet.mapAccounts)
+    for (const auto& account : wallet.GetCandidateAccounts(dest))
     {
         for (auto keyChain : { KEYCHAIN_EXTERNAL, KEYCHAIN_CHANGE })
         {
-            isminetype temp = ( keyChain == KEYCHAIN_EXTERNAL ? IsMine(accountItem.second->externalKeyStore, dest) : IsMine(accountItem.second->internalKeyStore, dest) );
+            isminetype temp = ( keyChain == KEYCHAIN_EXTERNAL ? IsMine(account->externalKeyStore, dest) : IsMine(account->internalKeyStore, dest) );
             if (temp > ret)
                 ret = temp;
         }
@@ -294,9 +294,8 @@ isminetype IsMine(const CWallet &wallet, const CTxOut& out)
     LOCK(wallet.cs_wallet);
 
     isminetype ret = isminetype::ISMINE_NO;
-    for (const auto& [accountUUID, account] : wallet.mapAccounts)
+    for (const auto& account : wallet.GetCandidateAccounts(out))
     {
-        (unused)accountUUID;
         isminetype temp = IsMine(*account, out);
         if (temp > ret)
         {
@@ -314,11 +313,10 @@ isminetype IsMineWitness(const CWallet &wallet, const CTxOut& out)
     LOCK(wallet.cs_wallet);
 
     isminetype ret = isminetype::ISMINE_NO;
-    for (const auto& [accountUUID, account] : wallet.mapAccounts)
+    for (const auto& account : wallet.GetCandidateAccounts(out))
     {
         if (account->IsPoW2Witness() && account->m_State == AccountState::Normal)
         {
-            (unused)accountUUID;
             isminetype temp = IsMine(*account, out);
             if (temp > ret)
             {
@@ -332,6 +330,36 @@ isminetype IsMineWitness(const CWallet &wallet, const CTxOut& out)
     return ret;
 }
 
+std::vector<CAccount*> CExtWallet::GetCandidateAccounts(const CTxOut& txout) const
+{
+    std::vector<CAccount*> accounts;
+    if (!keyIndex.GetCandidateAccounts(txout, accounts))
+    {
+        accounts.clear();
+        for (const auto& [accountUUID, account] : mapAccounts)
+        {
+            (unused) accountUUID;
+            accounts.push_back(account);
+        }
+    }
+    return accounts;
+}
+
+std::vector<CAccount*> CExtWallet::GetCandidateAccounts(const CTxDestination& dest) const
+{
+    std::vector<CAccount*> accounts;
+    if (!keyIndex.GetCandidateAccounts(dest, accounts))
+    {
+        accounts.clear();
+        for (const auto& [accountUUID, account] : mapAccounts)
+        {
+            (unused) accountUUID;
+            accounts.push_back(account);
+        }
+    }
+    return accounts;
+}
+
 bool IsMine(const CKeyStore* forAccount, const CWalletTx& tx)
 {
     for (const auto& txout : tx.tx->vout)
@@ -376,9 +404,11 @@ void CExtWallet::MarkKeyUsed(CKeyID keyID, uint64_t usageTime)
     //Update accounts if needed (creation time - shadow accounts etc.)
     {
         LOCK(cs_wallet);
-        for (const auto& accountIter : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupKey(keyID, owners);
+        for (const auto& entry : owners)
         {
-            auto& forAccount = accountIter.second;
+            CAccount* forAccount = entry.account;
             if (forAccount->HaveKey(keyID))
             {
                 if (usageTime > 0)
@@ -654,6 +684,7 @@ void CExtWallet::deleteAccount(CWalletDB& db, CAccount* account, bool shouldPurg
         LogPrintf("CExtWallet::deleteAccount - wipe account from memory");
         mapAccountLabels.erase(mapAccountLabels.find(account->getUUID()));
         mapAccounts.erase(mapAccounts.find(account->getUUID()));
+        keyIndex.RemoveAccount(account);
 
         // Make sure we are no longer the active account
         if(!getActiveAccount() || (getActiveAccount()->getUUID() == account->getUUID()))
@@ -707,6 +738,7 @@ void CExtWallet::addAccount(CAccount* account, const std::string& newName, bool
             throw std::runtime_error("Writing account failed");
         }
         mapAccounts[account->getUUID()] = account;
+        keyIndex.AddAccount(account);
         changeAccountName(account, newName, false);
     }
     NotifyAccountAdded(static_cast<CWallet*>(this), account);
@@ -31,6 +31,7 @@
 //Munt specific includes
 #include "wallet/walletdberrors.h"
 #include "account.h"
+#include "wallet/accountkeyindex.h"
 
 #include <boost/thread.hpp>
 
@@ -157,10 +158,11 @@ public:
     virtual bool GetKey(const CKeyID &address, CKey& keyOut) const
     {
         LOCK(cs_wallet);
-        for (const auto& [accountUUID, forAccount] : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupKey(address, owners);
+        for (const auto& entry : owners)
         {
-            (unused) accountUUID;
-            if (forAccount->GetKey(address, keyOut))
+            if (entry.account->GetKey(address, keyOut))
                 return true;
         }
         return false;
@@ -170,10 +172,11 @@ public:
     virtual bool GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut)
     {
         LOCK(cs_wallet);
-        for (const auto& [accountUUID, forAccount] : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupKey(address, owners);
+        for (const auto& entry : owners)
         {
-            (unused) accountUUID;
-            if (forAccount->GetPubKey(address, vchPubKeyOut))
+            if (entry.account->GetPubKey(address, vchPubKeyOut))
                 return true;
         }
         return false;
@@ -207,10 +210,11 @@ public:
     virtual bool HaveCScript(const CScriptID &hash)
     {
         LOCK(cs_wallet);
-        for (const auto& [accountUUID, forAccount] : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupScript(hash, owners);
+        for (const auto& entry : owners)
         {
-            (unused) accountUUID;
-            if (forAccount->HaveCScript(hash))
+            if (entry.account->HaveCScript(hash))
                 return true;
         }
         return false;
@@ -219,10 +223,11 @@ public:
     virtual bool GetCScript(const CScriptID &hash, CScript& redeemScriptOut)
     {
         LOCK(cs_wallet);
-        for (const auto& [accountUUID, forAccount] : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupScript(hash, owners);
+        for (const auto& entry : owners)
         {
-            (unused) accountUUID;
-            if (forAccount->GetCScript(hash, redeemScriptOut))
+            if (entry.account->GetCScript(hash, redeemScriptOut))
                 return true;
         }
         return false;
@@ -232,10 +237,11 @@ public:
     virtual bool HaveKey(const CKeyID &address) const
     {
         LOCK(cs_wallet);
-        for (const auto& [accountUUID, forAccount] : mapAccounts)
+        CAccountKeyOwners owners;
+        keyIndex.LookupKey(address, owners);
+        for (const auto& entry : owners)
         {
-            (unused) accountUUID;
-            if (forAccount->HaveKey(address))
+            if (entry.account->HaveKey(address))
                 return true;
         }
         return false;
@@ -262,6 +268,11 @@ public:
     virtual void RemoveAddressFromKeypoolIfIsMine(const CTxOut& txout, uint64_t time);
     virtual void RemoveAddressFromKeypoolIfIsMine(const CTransaction& tx, uint64_t time);
 
+    //! Accounts that may own txout/dest according to keyIndex (in mapAccounts order), every account if the index can't narrow it down.
+    //! Callers still have to check ownership with the account itself.
+    std::vector<CAccount*> GetCandidateAccounts(const CTxOut& txout) const;
+    std::vector<CAccount*> GetCandidateAccounts(const CTxDestination& dest) const;
+
     void changeAccountName(CAccount* account, const std::string& newName, bool notify=true);
     void addAccount(CAccount* account, const std::string& newName, bool bMakeActive=true);
     void deleteAccount(CWalletDB& walletDB, CAccount* account, bool shouldPurge=false);
@@ -307,6 +318,8 @@ public:
 
     std::map<boost::uuids::uuid, CHDSeed*> mapSeeds;
     std::map<boost::uuids::uuid, CAccount*> mapAccounts;
+    //! Key id/script id -> owning account(s) for every account in mapAccounts, accounts must be registered with it (AddAccount) when inserted into mapAccounts.
+    CAccountKeyIndex keyIndex;
     std::map<boost::uuids::uuid, std::string> mapAccountLabels;
     std::map<uint256, CWalletTx> mapWallet;
 
@@ -124,18 +124,29 @@ const CBlockIndex* CSPVScanner::LastBlockProcessed() const
 void CSPVScanner::onKeyPoolToppedUp()
 {
     static std::atomic_flag computingRanges;
+    // Set by a top up that arrives while the ranges are being computed, the running computation then goes around again for it instead of the top up being dropped.
+    static std::atomic<bool> rerunPending{false};
 
-    const CBlockIndex* pIndexLast = LastBlockProcessed();
-    if (pIndexLast == nullptr)
+    if (LastBlockProcessed() == nullptr)
         return;
 
-    if (computingRanges.test_and_set())
+    rerunPending = true;
+    if (!computingRanges.test_and_set())
     {
-        std::thread([&, pIndexLast]() {
-            uint64_t nBirthBLockHard = pIndexLast->nHeight;
-            uint64_t nDummyBlockSoft = Checkpoints::LastCheckPointHeight();
-            ComputeNewFilterRanges(nBirthBLockHard, nDummyBlockSoft);
-            computingRanges.clear();
+        std::thread([&]() {
+            do
+            {
+                rerunPending = false;
+                const CBlockIndex* pIndexLast = LastBlockProcessed();
+                if (pIndexLast)
+                {
+                    uint64_t nBirthBLockHard = pIndexLast->nHeight;
+                    uint64_t nDummyBlockSoft = Checkpoints::LastCheckPointHeight();
+                    ComputeNewFilterRanges(nBirthBLockHard, nDummyBlockSoft);
+                }
+                computingRanges.clear();
+                // A top up that came in after the clear already started a computation of its own.
+            } while (rerunPending && !computingRanges.test_and_set());
         }).detach();
     }
 }
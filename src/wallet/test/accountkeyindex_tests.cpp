@@ -0,0 +1,283 @@
+// Copyright (c) 2022 The Centure developers
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "wallet/accountkeyindex.h"
+#include "wallet/account.h"
+
+#include "primitives/transaction.h"
+#include "script/standard.h"
+#include "test/test.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(accountkeyindex_tests, BasicTestingSetup)
+
+static CKey NewKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key;
+}
+
+static void AddKey(CAccount& account, const CKey& key)
+{
+    BOOST_REQUIRE(account.AddKeyPubKey(key, key.GetPubKey(), KEYCHAIN_EXTERNAL));
+}
+
+static std::vector<CAccount*> Owners(const CAccountKeyOwners& owners)
+{
+    std::vector<CAccount*> accounts;
+    for (const auto& entry : owners)
+        accounts.push_back(entry.account);
+    return accounts;
+}
+
+// Candidates come back in uuid order, as the ownership checks visit mapAccounts.
+static std::vector<CAccount*> Sorted(std::vector<CAccount*> accounts)
+{
+    std::sort(accounts.begin(), accounts.end(), [](const CAccount* a, const CAccount* b) { return a->getUUID() < b->getUUID(); });
+    return accounts;
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_lookup)
+{
+    CAccountKeyIndex index;
+    CAccount accountA;
+    CAccount accountB;
+    const CKey keyA = NewKey();
+    const CKey keyB = NewKey();
+    const CKey keyShared = NewKey();
+    const CScript redeemScript = GetScriptForRawPubKey(keyA.GetPubKey());
+
+    // Keys held before the account is registered are indexed by AddAccount, later ones are reported by the account itself.
+    AddKey(accountA, keyA);
+    index.AddAccount(&accountA);
+    AddKey(accountA, keyShared);
+    BOOST_REQUIRE(accountA.AddCScript(redeemScript));
+    index.AddAccount(&accountB);
+    AddKey(accountB, keyB);
+    AddKey(accountB, keyShared);
+
+    CAccountKeyOwners owners;
+    index.LookupKey(keyA.GetPubKey().GetID(), owners);
+    BOOST_CHECK(Owners(owners) == std::vector<CAccount*>({&accountA}));
+    index.LookupKey(keyB.GetPubKey().GetID(), owners);
+    BOOST_CHECK(Owners(owners) == std::vector<CAccount*>({&accountB}));
+    index.LookupKey(keyShared.GetPubKey().GetID(), owners);
+    BOOST_CHECK(Owners(owners) == std::vector<CAccount*>({&accountA, &accountB}));
+    index.LookupScript(CScriptID(redeemScript), owners);
+    BOOST_CHECK(Owners(owners) == std::vector<CAccount*>({&accountA}));
+    // A miss leaves owners empty, also when it wasn't to start with.
+    index.LookupKey(NewKey().GetPubKey().GetID(), owners);
+    BOOST_CHECK(owners.empty());
+
+    size_t nKeys = 0;
+    index.ForEachKey([&](const CKeyID&) { ++nKeys; });
+    BOOST_CHECK_EQUAL(nKeys, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_candidates)
+{
+    CAccountKeyIndex index;
+    CAccount accountA;
+    CAccount accountB;
+    const CKey keyA = NewKey();
+    const CKey keyB = NewKey();
+    const CKey keyShared = NewKey();
+    index.AddAccount(&accountA);
+    index.AddAccount(&accountB);
+    AddKey(accountA, keyA);
+    AddKey(accountB, keyB);
+    AddKey(accountB, keyShared);
+    AddKey(accountA, keyShared);
+    const CScript redeemScript = GetScriptForRawPubKey(keyB.GetPubKey());
+    BOOST_REQUIRE(accountB.AddCScript(redeemScript));
+
+    auto candidates = [&](const auto& outputOrDest)
+    {
+        std::vector<CAccount*> accounts;
+        BOOST_CHECK(index.GetCandidateAccounts(outputOrDest, accounts));
+        return accounts;
+    };
+    const std::vector<CAccount*> none;
+    const std::vector<CAccount*> onlyA({&accountA});
+    const std::vector<CAccount*> onlyB({&accountB});
+    const std::vector<CAccount*> both = Sorted({&accountA, &accountB});
+
+    BOOST_CHECK(candidates(GetScriptForRawPubKey(keyA.GetPubKey())) == onlyA);
+    BOOST_CHECK(candidates(GetScriptForDestination(keyB.GetPubKey().GetID())) == onlyB);
+    BOOST_CHECK(candidates(GetScriptForDestination(keyShared.GetPubKey().GetID())) == both);
+    BOOST_CHECK(candidates(GetScriptForDestination(CScriptID(redeemScript))) == onlyB);
+    BOOST_CHECK(candidates(GetScriptForDestination(NewKey().GetPubKey().GetID())) == none);
+    BOOST_CHECK(candidates(CScript() << OP_RETURN) == none);
+    BOOST_CHECK(candidates(CTxDestination(keyA.GetPubKey().GetID())) == onlyA);
+    BOOST_CHECK(candidates(CTxOut(COIN, CTxOutStandardKeyHash(keyB.GetPubKey().GetID()))) == onlyB);
+
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.spendingKeyID = keyA.GetPubKey().GetID();
+    witnessDetails.witnessKeyID = keyB.GetPubKey().GetID();
+    BOOST_CHECK(candidates(CTxOut(COIN, witnessDetails)) == both);
+
+    // Scripts the index can't break down into keys leave it to the caller to ask every account.
+    std::vector<CAccount*> accounts;
+    BOOST_CHECK(!index.GetCandidateAccounts(CScript() << OP_1 << OP_1, accounts));
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_generation)
+{
+    CAccountKeyIndex index;
+    CAccount accountA;
+    CAccount accountB;
+    const CKey key = NewKey();
+    const CKey keyShared = NewKey();
+
+    // Registering an account changes the set of accounts, even if it doesn't have any keys yet.
+    uint64_t nGeneration = index.GetGeneration();
+    index.AddAccount(&accountA);
+    BOOST_CHECK(index.GetGeneration() != nGeneration);
+
+    nGeneration = index.GetGeneration();
+    AddKey(accountA, key);
+    BOOST_CHECK(index.GetGeneration() != nGeneration);
+    nGeneration = index.GetGeneration();
+    index.AddKey(key.GetPubKey().GetID(), &accountA, KEYCHAIN_EXTERNAL);
+    BOOST_CHECK_EQUAL(index.GetGeneration(), nGeneration);
+
+    AddKey(accountA, keyShared);
+    index.AddAccount(&accountB);
+    AddKey(accountB, keyShared);
+
+    // Removing an account drops it from all keys, and the keys only it held.
+    nGeneration = index.GetGeneration();
+    index.RemoveAccount(&accountA);
+    BOOST_CHECK(index.GetGeneration() != nGeneration);
+    CAccountKeyOwners owners;
+    index.LookupKey(key.GetPubKey().GetID(), owners);
+    BOOST_CHECK(owners.empty());
+    index.LookupKey(keyShared.GetPubKey().GetID(), owners);
+    BOOST_CHECK(Owners(owners) == std::vector<CAccount*>({&accountB}));
+    size_t nKeys = 0;
+    index.ForEachKey([&](const CKeyID&) { ++nKeys; });
+    BOOST_CHECK_EQUAL(nKeys, 1U);
+
+    // Nor does the account report its new keys any more.
+    const CKey keyAfterRemoval = NewKey();
+    AddKey(accountA, keyAfterRemoval);
+    index.LookupKey(keyAfterRemoval.GetPubKey().GetID(), owners);
+    BOOST_CHECK(owners.empty());
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_entry_flags)
+{
+    CAccountKeyIndex index;
+    CAccount account;
+    CAccount witnessAccount;
+    witnessAccount.m_Type = PoW2Witness;
+    const CKey keyExternal = NewKey();
+    const CKey keyChange = NewKey();
+    const CKey keyChangeLater = NewKey();
+    const CKey keyWitness = NewKey();
+    const CScript redeemScript = GetScriptForRawPubKey(keyExternal.GetPubKey());
+
+    // The key chain is known both for keys AddAccount picks up and for those the account reports later.
+    AddKey(account, keyExternal);
+    BOOST_REQUIRE(account.AddKeyPubKey(keyChange, keyChange.GetPubKey(), KEYCHAIN_CHANGE));
+    index.AddAccount(&account);
+    BOOST_REQUIRE(account.AddKeyPubKey(keyChangeLater, keyChangeLater.GetPubKey(), KEYCHAIN_CHANGE));
+    BOOST_REQUIRE(account.AddCScript(redeemScript));
+    index.AddAccount(&witnessAccount);
+    BOOST_REQUIRE(witnessAccount.AddKeyPubKey(keyWitness, keyWitness.GetPubKey(), KEYCHAIN_WITNESS));
+
+    auto checkEntry = [&](const CAccountKeyOwners& owners, CAccount* expectedAccount, int nExpectedKeyChain, bool fExpectedWitness)
+    {
+        BOOST_REQUIRE_EQUAL(owners.size(), 1U);
+        BOOST_CHECK(owners[0].account == expectedAccount);
+        BOOST_CHECK_EQUAL(owners[0].keyChain, nExpectedKeyChain);
+        BOOST_CHECK_EQUAL(owners[0].isWitness, fExpectedWitness);
+    };
+    CAccountKeyOwners owners;
+    index.LookupKey(keyExternal.GetPubKey().GetID(), owners);
+    checkEntry(owners, &account, KEYCHAIN_EXTERNAL, false);
+    index.LookupKey(keyChange.GetPubKey().GetID(), owners);
+    checkEntry(owners, &account, KEYCHAIN_CHANGE, false);
+    index.LookupKey(keyChangeLater.GetPubKey().GetID(), owners);
+    checkEntry(owners, &account, KEYCHAIN_CHANGE, false);
+    index.LookupScript(CScriptID(redeemScript), owners);
+    checkEntry(owners, &account, -1, false);
+    index.LookupKey(keyWitness.GetPubKey().GetID(), owners);
+    checkEntry(owners, &witnessAccount, KEYCHAIN_WITNESS, true);
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_ids_added_since)
+{
+    CAccountKeyIndex index;
+    CAccount accountA;
+    CAccount accountB;
+    const CKey keyA = NewKey();
+    const CKey keyB = NewKey();
+    const CScript redeemScript = GetScriptForRawPubKey(keyA.GetPubKey());
+
+    index.AddAccount(&accountA);
+    const uint64_t nAccountGeneration = index.GetAccountGeneration();
+    const uint64_t nGeneration = index.GetGeneration();
+
+    // Keys and scripts added to an account don't change the account generation, and are reported in the order they were added.
+    AddKey(accountA, keyA);
+    BOOST_REQUIRE(accountA.AddCScript(redeemScript));
+    BOOST_CHECK_EQUAL(index.GetAccountGeneration(), nAccountGeneration);
+    std::vector<uint160> ids;
+    BOOST_CHECK(index.GetIdsAddedSince(nGeneration, ids));
+    BOOST_CHECK(ids == std::vector<uint160>({keyA.GetPubKey().GetID(), CScriptID(redeemScript)}));
+    ids.clear();
+    BOOST_CHECK(index.GetIdsAddedSince(index.GetGeneration(), ids));
+    BOOST_CHECK(ids.empty());
+
+    // Adding or removing an account does.
+    index.AddAccount(&accountB);
+    BOOST_CHECK(index.GetAccountGeneration() != nAccountGeneration);
+    const uint64_t nGenerationB = index.GetGeneration();
+    AddKey(accountB, keyB);
+    ids.clear();
+    BOOST_CHECK(index.GetIdsAddedSince(nGenerationB, ids));
+    BOOST_CHECK(ids == std::vector<uint160>({keyB.GetPubKey().GetID()}));
+
+    // Additions beyond what the index remembers can't be reported.
+    for (int i = 0; i < 10001; ++i)
+        index.AddKey(CKeyID(uint160(InsecureRandBytes(20))), &accountB, KEYCHAIN_EXTERNAL);
+    ids.clear();
+    BOOST_CHECK(!index.GetIdsAddedSince(nGenerationB, ids));
+}
+
+BOOST_AUTO_TEST_CASE(account_key_index_output_ids)
+{
+    const CKey key = NewKey();
+    const CKey keyOther = NewKey();
+    const CKeyID keyID = key.GetPubKey().GetID();
+    const CKeyID keyIDOther = keyOther.GetPubKey().GetID();
+
+    auto outputIds = [](const CTxOut& txout)
+    {
+        std::vector<uint160> ids;
+        BOOST_CHECK(CAccountKeyIndex::GetOutputIds(txout, ids));
+        return ids;
+    };
+    BOOST_CHECK(outputIds(CTxOut(1, GetScriptForRawPubKey(key.GetPubKey()))) == std::vector<uint160>({keyID}));
+    BOOST_CHECK(outputIds(CTxOut(1, GetScriptForDestination(keyID))) == std::vector<uint160>({keyID}));
+    const CScript redeemScript = GetScriptForRawPubKey(key.GetPubKey());
+    BOOST_CHECK(outputIds(CTxOut(1, GetScriptForDestination(CScriptID(redeemScript)))) == std::vector<uint160>({CScriptID(redeemScript)}));
+    BOOST_CHECK(outputIds(CTxOut(1, GetScriptForMultisig(1, {key.GetPubKey(), keyOther.GetPubKey()}))) == std::vector<uint160>({keyID, keyIDOther}));
+
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.spendingKeyID = keyID;
+    witnessDetails.witnessKeyID = keyIDOther;
+    BOOST_CHECK(outputIds(CTxOut(1, witnessDetails)) == std::vector<uint160>({keyID, keyIDOther}));
+
+    // Scripts the solver doesn't recognise can't be narrowed down.
+    CScript nonStandard;
+    nonStandard << OP_TRUE;
+    std::vector<uint160> ids;
+    BOOST_CHECK(!CAccountKeyIndex::GetOutputIds(CTxOut(1, nonStandard), ids));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,7 @@
 
 #include "consensus/validation.h"
 #include "rpc/server.h"
+#include "script/interpreter.h"
 #include "test/test.h"
 #include "validation/validation.h"
 #include "blockstore.h"
@@ -34,6 +35,7 @@ extern CWallet* pwalletMain;
 extern UniValue importmulti(const JSONRPCRequest& request);
 extern UniValue dumpwallet(const JSONRPCRequest& request);
 extern UniValue importwallet(const JSONRPCRequest& request);
+extern bool IsMine(const CKeyStore* forAccount, const CWalletTx& tx);
 
 // how many times to run all the tests to have a chance to catch errors that only show up with particular random shuffles
 #define RUN_TESTS 100
@@ -461,6 +463,144 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+static CMutableTransaction CreateSignedSpend(const CTransaction& prevTx, const CKey& prevKey, const CKey& toKey, CAmount nValue)
+{
+    CScript prevScript = GetScriptForRawPubKey(prevKey.GetPubKey());
+    CMutableTransaction spend(TEST_DEFAULT_TX_VERSION);
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    COutPoint prevOut = spend.vin[0].GetPrevOut();
+    prevOut.setHash(prevTx.GetHash());
+    prevOut.n = 0;
+    spend.vin[0].SetPrevOut(prevOut);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = nValue;
+    spend.vout[0].output.scriptPubKey = GetScriptForRawPubKey(toKey.GetPubKey());
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(prevScript, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(prevKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+static void AddRescanKeys(CWallet& wallet, const std::vector<CKey>& keys)
+{
+    LOCK(wallet.cs_wallet);
+    wallet.GenerateNewLegacyAccount("My account");
+    CAccount* account = wallet.getActiveAccount();
+    for (const auto& key : keys)
+        wallet.AddKeyPubKey(key, key.GetPubKey(), *account, KEYCHAIN_EXTERNAL);
+}
+
+// The scan as it was before it was pipelined: every transaction of every block on the chain, in chain order.
+static void SerialScanForWalletTransactions(CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex))
+    {
+        CBlock block;
+        BOOST_REQUIRE(blockStore.ReadBlockFromDisk(block, pindex->GetBlockPos(), Params(), pindex));
+        for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock)
+            wallet.AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, true);
+    }
+}
+
+static void CheckSameWalletTransactions(CWallet& wallet, CWallet& expected)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    LOCK(expected.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), expected.mapWallet.size());
+    for (const auto& [hash, wtx] : expected.mapWallet)
+    {
+        auto walletIter = wallet.mapWallet.find(hash);
+        BOOST_REQUIRE(walletIter != wallet.mapWallet.end());
+        BOOST_CHECK(walletIter->second.hashBlock == wtx.hashBlock);
+        BOOST_CHECK_EQUAL(walletIter->second.nIndex, wtx.nIndex);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalance(nullptr, false), expected.GetBalance(nullptr, false));
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), expected.GetImmatureBalance());
+}
+
+// Verify the pipelined ScanForWalletTransactions finds exactly what a serial scan does, also when the chain reorganises while it scans.
+BOOST_FIXTURE_TEST_CASE(rescan_pipelined_matches_serial, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // A spend to a second wallet key, followed by a spend of that in a later block, so the scan has to track spends of earlier matches.
+    CMutableTransaction spendToOther = CreateSignedSpend(coinbaseTxns[0], coinbaseKey, otherKey, 900 * COIN);
+    CMutableTransaction spendBack = CreateSignedSpend(CTransaction(spendToOther), otherKey, coinbaseKey, 800 * COIN);
+    CreateAndProcessBlock({spendToOther}, reservedScript);
+    CBlockIndex* forkBlock = chainActive.Tip();
+    CreateAndProcessBlock({spendBack}, reservedScript);
+    for (int i = 0; i < 5; ++i)
+        CreateAndProcessBlock({}, reservedScript);
+
+    for (const char* strThreads : {"1", "4"})
+    {
+        ForceSetArg("-rescanthreads", strThreads);
+        CWallet wallet;
+        AddRescanKeys(wallet, {coinbaseKey, otherKey});
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis()) == nullptr);
+
+        CWallet serialWallet;
+        AddRescanKeys(serialWallet, {coinbaseKey, otherKey});
+        SerialScanForWalletTransactions(serialWallet);
+        BOOST_CHECK(serialWallet.mapWallet.count(spendBack.GetHash()) > 0);
+        CheckSameWalletTransactions(wallet, serialWallet);
+    }
+
+    // Reorganise the blocks after the first progress report away while the workers are already reading ahead,
+    // replacing them with a chain that only confirms the first spend.
+    ForceSetArg("-rescanthreads", "4");
+    CWallet wallet;
+    AddRescanKeys(wallet, {coinbaseKey, otherKey});
+    bool fReorged = false;
+    wallet.ShowProgress.connect([&](const std::string&, int nProgress)
+    {
+        if (fReorged || nProgress == 0 || nProgress == 100)
+            return;
+        fReorged = true;
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), forkBlock));
+        BOOST_REQUIRE(ActivateBestChain(state, Params()));
+        for (int i = 0; i < 8; ++i)
+            CreateAndProcessBlock(i == 0 ? std::vector<CMutableTransaction>{spendToOther} : std::vector<CMutableTransaction>{}, reservedScript);
+    });
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    wallet.ShowProgress.disconnect_all_slots();
+    BOOST_REQUIRE(fReorged);
+
+    // Nothing from the disconnected blocks may have been committed...
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.mapWallet.count(spendBack.GetHash()) == 0);
+        for (const auto& [hash, wtx] : wallet.mapWallet)
+        {
+            (unused) hash;
+            auto blockIter = mapBlockIndex.find(wtx.hashBlock);
+            BOOST_CHECK(blockIter != mapBlockIndex.end() && chainActive.Contains(blockIter->second));
+        }
+    }
+
+    // ...and once the wallet catches up with the new chain (as the block notifications would take care of) it matches a serial scan of it.
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    CWallet serialWallet;
+    AddRescanKeys(serialWallet, {coinbaseKey, otherKey});
+    SerialScanForWalletTransactions(serialWallet);
+    BOOST_CHECK(serialWallet.mapWallet.count(spendToOther.GetHash()) > 0);
+    BOOST_CHECK(serialWallet.mapWallet.count(spendBack.GetHash()) == 0);
+    CheckSameWalletTransactions(wallet, serialWallet);
+
+    ForceSetArg("-rescanthreads", strprintf("%d", DEFAULT_RESCAN_THREADS));
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -555,6 +695,188 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 1000*COIN);
 }
 
+// The balances as GetBalance/GetBalanceForDepth/GetUnconfirmedBalance/GetImmatureBalance added them up before the balance ledger, by walking mapWallet.
+static CWalletBalanceLedger::Balances WalkWalletBalances(const CWallet& wallet, const CAccount* forAccount)
+{
+    CWalletBalanceLedger::Balances balances;
+    for (const auto& [hash, wtx] : wallet.mapWallet)
+    {
+        (unused) hash;
+        if (forAccount && !::IsMine(forAccount, wtx))
+            continue;
+        if (wtx.isAbandoned() || wtx.mapValue.count("replaced_by_txid") != 0)
+            continue;
+        const int nDepth = wtx.GetDepthInMainChain();
+        for (int i = 0; i < 2; ++i)
+        {
+            CAmount nCredit = i ? wtx.GetAvailableCreditIncludingLockedWitnesses(false, forAccount, false) : wtx.GetAvailableCredit(false, forAccount, false);
+            if (wtx.IsTrusted())
+            {
+                balances.available[i] += nCredit;
+                if (nDepth >= 1)
+                    balances.availableConfirmed[i] += nCredit;
+            }
+            else if (nDepth == 0 && wtx.InMempool())
+            {
+                balances.unconfirmed[i] += nCredit;
+            }
+            if (nDepth > 0)
+                balances.immature[i] += i ? wtx.GetImmatureCreditIncludingLockedWitnesses(false, forAccount, false) : wtx.GetImmatureCredit(false, forAccount, false);
+        }
+    }
+    return balances;
+}
+
+static void CheckBalanceLedger(const CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    std::vector<const CAccount*> accounts(1, nullptr);
+    for (const auto& [accountUUID, account] : wallet.mapAccounts)
+    {
+        (unused) accountUUID;
+        accounts.push_back(account);
+    }
+    for (const CAccount* account : accounts)
+    {
+        const CWalletBalanceLedger::Balances expected = WalkWalletBalances(wallet, account);
+        for (int i = 0; i < 2; ++i)
+        {
+            BOOST_CHECK_EQUAL(wallet.GetBalance(account, true, i), expected.available[i]);
+            BOOST_CHECK_EQUAL(wallet.GetBalanceForDepth(0, account, i), expected.available[i]);
+            BOOST_CHECK_EQUAL(wallet.GetBalanceForDepth(1, account, i), expected.availableConfirmed[i]);
+            BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(account, i), expected.unconfirmed[i]);
+            BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(account, i), expected.immature[i]);
+        }
+    }
+}
+
+// Verify the incrementally maintained balances stay equal to a walk of mapWallet through everything that changes a transaction's contribution.
+BOOST_FIXTURE_TEST_CASE(balance_ledger_matches_wallet_walk, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    std::shared_ptr<CReserveKeyOrScript> reservedScript = std::make_shared<CReserveKeyOrScript>(scriptPubKey);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CKey foreignKey;
+    foreignKey.MakeNewKey(true);
+
+    CWallet wallet;
+    AddRescanKeys(wallet, {coinbaseKey});
+    auto mineAndScan = [&](const std::vector<CMutableTransaction>& txns)
+    {
+        CreateAndProcessBlock(txns, reservedScript);
+        wallet.ScanForWalletTransactions(chainActive.Tip(), true);
+    };
+    auto addUnconfirmed = [&](const CMutableTransaction& tx)
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.AddToWalletIfInvolvingMe(MakeTransactionRef(tx), nullptr, 0, true);
+    };
+
+    // Coinbase maturity: all coinbases are still immature, the next block matures the first.
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    mineAndScan({});
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), coinbaseTxns[0].GetValueOut());
+
+    // A second account (an account change on its own rebuilds the ledger) that receives from a spend of the first.
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewLegacyAccount("Other account");
+        wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey(), *wallet.getActiveAccount(), KEYCHAIN_EXTERNAL);
+    }
+    CheckBalanceLedger(wallet);
+    mineAndScan({CreateSignedSpend(coinbaseTxns[0], coinbaseKey, otherKey, 900 * COIN)});
+    CheckBalanceLedger(wallet);
+
+    // Unconfirmed receive from outside the wallet, then its confirmation.
+    CMutableTransaction spendToForeign = CreateSignedSpend(coinbaseTxns[1], coinbaseKey, foreignKey, 900 * COIN);
+    mineAndScan({spendToForeign});
+    CMutableTransaction foreignSpend = CreateSignedSpend(CTransaction(spendToForeign), foreignKey, otherKey, 800 * COIN);
+    {
+        CValidationState state;
+        BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, MakeTransactionRef(foreignSpend), false, nullptr));
+    }
+    addUnconfirmed(foreignSpend);
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK(wallet.GetUnconfirmedBalance() > 0);
+    mineAndScan({foreignSpend});
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 0);
+
+    // A spend that never made it to the mempool holds on to its input until it is abandoned.
+    CMutableTransaction abandonedSpend = CreateSignedSpend(coinbaseTxns[2], coinbaseKey, otherKey, 900 * COIN);
+    const CAmount nBalanceBeforeAbandonedSpend = wallet.GetBalance();
+    addUnconfirmed(abandonedSpend);
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK(wallet.GetBalance() < nBalanceBeforeAbandonedSpend);
+    BOOST_REQUIRE(wallet.AbandonTransaction(abandonedSpend.GetHash()));
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nBalanceBeforeAbandonedSpend);
+
+    // A spend that conflicts with one that got mined.
+    CMutableTransaction conflictedSpend = CreateSignedSpend(coinbaseTxns[3], coinbaseKey, otherKey, 900 * COIN);
+    addUnconfirmed(conflictedSpend);
+    CheckBalanceLedger(wallet);
+    mineAndScan({CreateSignedSpend(coinbaseTxns[3], coinbaseKey, foreignKey, 800 * COIN)});
+    CBlockIndex* forkBlock = chainActive.Tip();
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.mapWallet.at(conflictedSpend.GetHash()).GetDepthInMainChain() < 0);
+    }
+    CheckBalanceLedger(wallet);
+
+    // Witness lock expiry, the locked output only counts toward the balances including locked witnesses until the tip passes its lock.
+    // Regtest has no PoW2 witnesses so the witness transaction is only added to the wallet, as confirmed by the tip.
+    CMutableTransaction witnessTx(CTransaction::CURRENT_VERSION);
+    witnessTx.vin.resize(1);
+    witnessTx.vin[0].SetPrevOut(COutPoint(GetRandHash(), 0));
+    CTxOutPoW2Witness witnessDetails;
+    witnessDetails.spendingKeyID = otherKey.GetPubKey().GetID();
+    witnessDetails.witnessKeyID = otherKey.GetPubKey().GetID();
+    witnessDetails.lockFromBlock = chainActive.Tip()->nHeight;
+    witnessDetails.lockUntilBlock = chainActive.Tip()->nHeight + 2;
+    witnessTx.vout.push_back(CTxOut(500 * COIN, witnessDetails));
+    {
+        LOCK(wallet.cs_wallet);
+        CWalletTx wtx(&wallet, MakeTransactionRef(witnessTx));
+        wtx.SetMerkleBranch(chainActive.Tip(), 1);
+        wallet.AddToWallet(wtx);
+    }
+    CheckBalanceLedger(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(nullptr, true, true) - wallet.GetBalance(), 500 * COIN);
+    for (int i = 0; i < 3; ++i)
+    {
+        mineAndScan({});
+        CheckBalanceLedger(wallet);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalance(nullptr, true, true), wallet.GetBalance());
+
+    // Reorg away the block with the conflicting spend (and everything built on it) and replace it with empty blocks.
+    {
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), forkBlock));
+        BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    }
+    CheckBalanceLedger(wallet);
+    for (int i = 0; i < 5; ++i)
+    {
+        mineAndScan({});
+        CheckBalanceLedger(wallet);
+    }
+
+    // A key added to an existing account doesn't rebuild the ledger, the transactions that pay to it or spend from it are re-evaluated instead.
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.AddKeyPubKey(foreignKey, foreignKey.GetPubKey(), *wallet.getActiveAccount(), KEYCHAIN_EXTERNAL);
+    }
+    CheckBalanceLedger(wallet);
+}
+
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
 {
     CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
@@ -952,6 +952,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for(PAIRTYPE(const uint256, CWalletTx)& item : mapWallet)
             item.second.MarkDirty();
+        balanceLedger.MarkAllDirty();
     }
 }
 
@@ -26,6 +26,7 @@
 #include "script/sign.h"
 #include "wallet/crypter.h"
 #include "wallet/walletdb.h"
+#include "wallet/walletbalanceledger.h"
 #include "wallet/rpcwallet.h"
 
 #include <algorithm>
@@ -84,6 +85,10 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! -rescanthreads default, 0 means one thread per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Number of blocks the read/match stage of a rescan may run ahead of the block being committed to the wallet
+static const unsigned int WALLET_RESCAN_WINDOW = 256;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -593,6 +598,8 @@ public:
     }
 
     std::map<uint256, CWalletTx> mapWallet;
+    //! Per account balance totals over mapWallet, kept up to date through CWalletTx::MarkDirty; protected by cs_wallet.
+    mutable CWalletBalanceLedger balanceLedger;
     std::map<uint256, uint256> mapWalletHash;
     void maintainHashMap(const CWalletTx& wtxIn, uint256& hash);
     /** Transaction hash from outpoint. Even if it is index based. */
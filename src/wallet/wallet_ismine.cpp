@@ -14,6 +14,7 @@
 #include "wallet/wallettx.h"
 
 #include "validation/validation.h"
+#include "blockstore.h"
 #include "net.h"
 #include "scheduler.h"
 #include "timedata.h"
@@ -22,6 +23,12 @@
 #include <unity/appmanager.h>
 #include <script/ismine.h>
 
+#include <boost/scope_exit.hpp>
+
+#include <condition_variable>
+#include <limits>
+#include <thread>
+
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
@@ -114,11 +121,94 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     return startTime;
 }
 
+namespace
+{
+/** Outcome of the read/match stage of a rescan for one block. */
+struct CRescanBlock
+{
+    CBlock block;
+    bool fRead = false;
+    //! Key index generation the outputs were matched against.
+    uint64_t nGeneration = 0;
+    //! Per transaction: one of the outputs may pay to a key/script of ours.
+    std::vector<bool> vOutputMatch;
+};
+
+/**
+ * The wallet transactions (and the outputs they spend) that a transaction's inputs can involve it with.
+ * Built from mapWallet at the start of a rescan and kept current by the commit stage, so that blocks whose inputs
+ * don't touch the wallet (and whose outputs don't pay to it) can be passed over without taking cs_wallet.
+ */
+class CRescanSpendFilter
+{
+public:
+    void AddWalletTx(const uint256& hash, const CWalletTx& wtx)
+    {
+        setTxHashes.insert(hash);
+        // Index based outpoints, see CWallet::maintainHashMap
+        if (wtx.nHeight > 0)
+        {
+            for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i)
+                setBucketHashes.insert(COutPoint(wtx.nHeight, wtx.nIndex, i).getBucketHash());
+        }
+        // Conflict detection (mapTxSpends)
+        for (const auto& txin : wtx.tx->vin)
+            setSpentOutPoints.insert(txin.GetPrevOut());
+    }
+
+    bool MayInvolve(const CTransaction& tx) const
+    {
+        if (setTxHashes.count(tx.GetHash()))
+            return true;
+        for (const auto& txin : tx.vin)
+        {
+            const COutPoint& prevout = txin.GetPrevOut();
+            if (prevout.isHash ? setTxHashes.count(prevout.getTransactionHash()) : setBucketHashes.count(prevout.getBucketHash()))
+                return true;
+            if (setSpentOutPoints.count(prevout))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::set<uint256> setTxHashes;
+    std::set<uint256> setBucketHashes;
+    std::set<COutPoint> setSpentOutPoints;
+};
+}
+
+// The output half of IsMine for a rescan, needs neither cs_main nor cs_wallet: flag transactions with an output the key index has candidate accounts for.
+// Outputs the index can't classify are flagged too, AddToWalletIfInvolvingMe settles those (and any false positives) in the commit stage.
+static void MatchRescanOutputs(const CAccountKeyIndex& keyIndex, CRescanBlock& result)
+{
+    result.nGeneration = keyIndex.GetGeneration();
+    result.vOutputMatch.assign(result.block.vtx.size(), false);
+    std::vector<CAccount*> candidates;
+    for (size_t i = 0; i < result.block.vtx.size(); ++i)
+    {
+        for (const CTxOut& txout : result.block.vtx[i]->vout)
+        {
+            candidates.clear();
+            if (!keyIndex.GetCandidateAccounts(txout, candidates) || !candidates.empty())
+            {
+                result.vOutputMatch[i] = true;
+                break;
+            }
+        }
+    }
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * The scan is a pipeline: -rescanthreads workers read blocks ahead (up to WALLET_RESCAN_WINDOW blocks) and match their outputs
+ * against the account key index, the calling thread then commits the blocks in chain order taking cs_main/cs_wallet only for blocks
+ * that involve the wallet. Keys allocated while committing (key pool top up) bump the key index generation, blocks matched before
+ * that are matched again before they are committed.
+ *
  * Returns null if scan was successful. Otherwise, if a complete rescan was not
  * possible (due to pruning or corruption), returns pointer to the most recent
  * block that could not be scanned.
@@ -129,8 +219,15 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
 
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
+    std::vector<CBlockIndex*> vBlocks;
+    std::vector<CDiskBlockPos> vBlockPos;
+    std::vector<uint256> vBlockHash;
+    CRescanSpendFilter spendFilter;
+    uint64_t nProgressStart;
+    uint64_t nProgressTip;
+    uint64_t nWorkQuantity;
     {
-        LOCK2(cs_main, cs_wallet); // Required for ReadBlockFromDisk.
+        LOCK2(cs_main, cs_wallet);
         fAbortRescan = false;
         fScanningWallet = true;
 
@@ -147,41 +244,154 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
             LogPrintf("Nothing to do for rescan, chain empty.\n");
             return ret;
         }
-        LogPrintf("Rescanning...\n");
-        uint64_t nProgressStart = pindex->nHeight;
-        uint64_t nProgressTip = chainActive.Tip()->nHeight;
-        uint64_t nWorkQuantity = nProgressTip - nProgressStart;
-        while (pindex && !fAbortRescan && nWorkQuantity > 0)
-        {
-            // Temporarily release lock to allow shadow key allocation a chance to do it's thing
-            LEAVE_CRITICAL_SECTION(cs_main)
-            LEAVE_CRITICAL_SECTION(cs_wallet)
-            nTransactionScanProgressPercent = ((pindex->nHeight-nProgressStart) / (double)(nWorkQuantity)) * 100;
-            nTransactionScanProgressPercent = std::max(1, std::min(99, nTransactionScanProgressPercent));
-            if (pindex->nHeight % 100 == 0 && nProgressTip - nProgressStart > 0)
+        nProgressStart = pindex->nHeight;
+        nProgressTip = chainActive.Tip()->nHeight;
+        nWorkQuantity = nProgressTip - nProgressStart;
+        if (nWorkQuantity > 0)
+        {
+            for (CBlockIndex* pblock = pindex; pblock; pblock = chainActive.Next(pblock))
             {
-                ShowProgress(_("Rescanning..."), nTransactionScanProgressPercent);
+                vBlocks.push_back(pblock);
+                vBlockPos.push_back((pblock->nStatus & BLOCK_HAVE_DATA) ? pblock->GetBlockPos() : CDiskBlockPos());
+                vBlockHash.push_back(pblock->GetBlockHashPoW2());
             }
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%d%%\n", pindex->nHeight, nTransactionScanProgressPercent);
+        }
+        for (const auto& [hash, wtx] : mapWallet)
+            spendFilter.AddWalletTx(hash, wtx);
+    }
+    LogPrintf("Rescanning...\n");
+
+    // Read/match stage, block n is handed over in vSlots[n % nWindow] once vSlotBlock[n % nWindow] == n.
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = std::max(GetNumCores(), 1);
+    const size_t nWindow = WALLET_RESCAN_WINDOW;
+    std::vector<CRescanBlock> vSlots(nWindow);
+    std::vector<size_t> vSlotBlock(nWindow, std::numeric_limits<size_t>::max());
+    size_t nNextRead = 0;
+    size_t nCommitted = 0;
+    bool fStopWorkers = false;
+    Mutex cs_rescanPipeline;
+    std::condition_variable cvRescanPipeline;
+    auto readAndMatch = [&]()
+    {
+        while (true)
+        {
+            size_t nBlock;
+            {
+                WAIT_LOCK(cs_rescanPipeline, lock);
+                while (!fStopWorkers && nNextRead < vBlocks.size() && nNextRead >= nCommitted + nWindow)
+                    cvRescanPipeline.wait(lock);
+                if (fStopWorkers || nNextRead >= vBlocks.size())
+                    return;
+                nBlock = nNextRead++;
             }
-            ENTER_CRITICAL_SECTION(cs_main)
-            ENTER_CRITICAL_SECTION(cs_wallet)
-
-            if (ShutdownRequested())
-                return ret;
-
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-            } else {
-                ret = pindex;
+
+            // No cs_main here, the caller may well be holding it (RPC imports) while waiting for this block.
+            CRescanBlock result;
+            result.fRead = blockStore.ReadBlockFromDiskConcurrent(result.block, vBlockPos[nBlock], vBlockHash[nBlock]);
+            if (result.fRead)
+                MatchRescanOutputs(keyIndex, result);
+
+            {
+                LOCK(cs_rescanPipeline);
+                vSlots[nBlock % nWindow] = std::move(result);
+                vSlotBlock[nBlock % nWindow] = nBlock;
             }
-            pindex = chainActive.Next(pindex);
+            cvRescanPipeline.notify_all();
+        }
+    };
+    std::vector<std::thread> vWorkers;
+    auto stopWorkers = [&]()
+    {
+        {
+            LOCK(cs_rescanPipeline);
+            fStopWorkers = true;
+        }
+        cvRescanPipeline.notify_all();
+        for (auto& worker : vWorkers)
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+    };
+    // However the commit stage is left; joinable threads would otherwise terminate the process if it throws.
+    BOOST_SCOPE_EXIT(&stopWorkers) { stopWorkers(); } BOOST_SCOPE_EXIT_END
+    for (int i = 0; i < nThreads && (size_t)i < vBlocks.size(); ++i)
+        vWorkers.emplace_back(readAndMatch);
+
+    // Commit stage, in chain order.
+    bool fShutdown = false;
+    for (size_t nBlock = 0; nBlock < vBlocks.size(); ++nBlock)
+    {
+        pindex = vBlocks[nBlock];
+        if (fAbortRescan)
+            break;
+        nTransactionScanProgressPercent = ((pindex->nHeight-nProgressStart) / (double)(nWorkQuantity)) * 100;
+        nTransactionScanProgressPercent = std::max(1, std::min(99, nTransactionScanProgressPercent));
+        if (pindex->nHeight % 100 == 0 && nProgressTip - nProgressStart > 0)
+        {
+            ShowProgress(_("Rescanning..."), nTransactionScanProgressPercent);
+        }
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%d%%\n", pindex->nHeight, nTransactionScanProgressPercent);
+        }
+        if (ShutdownRequested())
+        {
+            fShutdown = true;
+            break;
         }
+
+        CRescanBlock result;
+        {
+            WAIT_LOCK(cs_rescanPipeline, lock);
+            while (vSlotBlock[nBlock % nWindow] != nBlock)
+                cvRescanPipeline.wait(lock);
+            result = std::move(vSlots[nBlock % nWindow]);
+            nCommitted = nBlock + 1;
+        }
+        cvRescanPipeline.notify_all();
+
+        if (!result.fRead)
+        {
+            ret = pindex;
+            continue;
+        }
+        if (result.nGeneration != keyIndex.GetGeneration())
+            MatchRescanOutputs(keyIndex, result);
+
+        bool fInvolvesWallet = false;
+        for (size_t posInBlock = 0; posInBlock < result.block.vtx.size() && !fInvolvesWallet; ++posInBlock)
+            fInvolvesWallet = result.vOutputMatch[posInBlock] || spendFilter.MayInvolve(*result.block.vtx[posInBlock]);
+        if (!fInvolvesWallet)
+            continue;
+
+        LOCK2(cs_main, cs_wallet);
+        // The remaining blocks were disconnected by a reorg while scanning, the wallet learns about the new chain through the usual notifications.
+        if (!chainActive.Contains(pindex))
+        {
+            pindex = nullptr;
+            break;
+        }
+        // All transactions of the block, not just the matched ones, so that spends within the block are seen exactly as by a serial scan.
+        for (size_t posInBlock = 0; posInBlock < result.block.vtx.size(); ++posInBlock) {
+            AddToWalletIfInvolvingMe(result.block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+        }
+        for (const auto& ptx : result.block.vtx)
+        {
+            auto walletIter = mapWallet.find(ptx->GetHash());
+            if (walletIter != mapWallet.end())
+                spendFilter.AddWalletTx(walletIter->first, walletIter->second);
+        }
+    }
+
+    stopWorkers();
+    if (fShutdown)
+        return ret;
+
+    {
+        LOCK2(cs_main, cs_wallet);
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(pindex));
         }
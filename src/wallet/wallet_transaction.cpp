@@ -31,9 +31,8 @@
 std::vector<CAccount*> CWallet::FindAccountsForTransaction(const CTxOut& out)
 {
     std::vector<CAccount*> ret;
-    for (const auto& [accountUUID, forAccount] : mapAccounts)
+    for (const auto& forAccount : GetCandidateAccounts(out))
     {
-        (unused) accountUUID;
         if (::IsMine(*forAccount, out) == ISMINE_SPENDABLE)
         {
             ret.push_back(forAccount);
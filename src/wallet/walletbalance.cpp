@@ -509,11 +509,15 @@ CAmount CWallet::GetBalanceForDepth(int minDepth, const CAccount* forAccount, bo
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (minDepth <= 1)
+        {
+            const CWalletBalanceLedger::Balances balances = balanceLedger.Get(*this, forAccount);
+            nTotal = minDepth <= 0 ? balances.available[includePoW2LockedWitnesses] : balances.availableConfirmed[includePoW2LockedWitnesses];
+        }
+        else for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
            
-            //fixme: (FUT) (ACCOUNT) - is this okay? Should it be cached or something? (CBSU?)
             if (pcoin->GetDepthInMainChain() < minDepth)
                 continue;
             if (pcoin->IsTrusted() && !pcoin->isAbandoned() && pcoin->mapValue.count("replaced_by_txid") == 0)
@@ -546,11 +550,13 @@ CAmount CWallet::GetBalance(const CAccount* forAccount, bool useCache, bool incl
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        // Callers that pass useCache=false want every transaction revalued, keep walking mapWallet for those.
+        if (useCache)
+            nTotal = balanceLedger.Get(*this, forAccount).available[includePoW2LockedWitnesses];
+        else for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
            
-            //fixme: (FUT) (ACCOUNT) - is this okay? Should it be cached or something? (CBSU?)
             if (!forAccount || ::IsMine(forAccount, *pcoin))
             {
                 if (pcoin->IsTrusted() && !pcoin->isAbandoned() && pcoin->mapValue.count("replaced_by_txid") == 0)
@@ -605,18 +611,7 @@ CAmount CWallet::GetUnconfirmedBalance(const CAccount* forAccount, bool includeP
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            //fixme: (FUT) (ACCOUNTS) - is this okay? Should it be cached or something? (CBSU?)
-            if (!forAccount || ::IsMine(forAccount, *pcoin))
-            {
-                if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool() && !pcoin->isAbandoned() && pcoin->mapValue.count("replaced_by_txid") == 0)
-                {
-                    nTotal += includePoW2LockedWitnesses ? pcoin->GetAvailableCreditIncludingLockedWitnesses(true, forAccount, false) : pcoin->GetAvailableCredit(true, forAccount, false);
-                }
-            }
-        }
+        nTotal = balanceLedger.Get(*this, forAccount).unconfirmed[includePoW2LockedWitnesses];
     }
     if (forAccount && includeChildren)
     {
@@ -637,17 +632,7 @@ CAmount CWallet::GetImmatureBalance(const CAccount* forAccount, bool includePoW2
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->isAbandoned() && pcoin->GetDepthInMainChain() > 0 && pcoin->mapValue.count("replaced_by_txid") == 0)
-            {
-                if (!forAccount || ::IsMine(forAccount, *pcoin))
-                {
-                    nTotal += includePoW2LockedWitnesses ? pcoin->GetImmatureCreditIncludingLockedWitnesses(true, forAccount, false) : pcoin->GetImmatureCredit(true, forAccount, false);
-                }
-            }
-        }
+        nTotal = balanceLedger.Get(*this, forAccount).immature[includePoW2LockedWitnesses];
     }
     if (forAccount && includeChildren)
     {
@@ -0,0 +1,267 @@
+// Copyright (c) 2016-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#include "wallet/walletbalanceledger.h"
+#include "wallet/wallet.h"
+#include "wallet/wallettx.h"
+
+#include "txmempool.h"
+#include "validation/validation.h"
+#include "witnessutil.h"
+
+#include <algorithm>
+
+extern bool IsMine(const CKeyStore* forAccount, const CWalletTx& tx);
+
+void CWalletBalanceLedger::Balances::Add(const Balances& other, int sign)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        available[i] += sign * other.available[i];
+        unconfirmed[i] += sign * other.unconfirmed[i];
+        immature[i] += sign * other.immature[i];
+        availableConfirmed[i] += sign * other.availableConfirmed[i];
+    }
+}
+
+bool CWalletBalanceLedger::Balances::IsNull() const
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        if (available[i] != 0 || unconfirmed[i] != 0 || immature[i] != 0 || availableConfirmed[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+void CWalletBalanceLedger::MarkDirty(const uint256& hash)
+{
+    LOCK(cs_dirty);
+    if (!fRebuild)
+        setDirty.insert(hash);
+}
+
+void CWalletBalanceLedger::MarkAllDirty()
+{
+    LOCK(cs_dirty);
+    fRebuild = true;
+    setDirty.clear();
+}
+
+bool CWalletBalanceLedger::IsVolatile(const CWalletTx& wtx)
+{
+    if (wtx.GetDepthInMainChain() <= 0)
+        return true;
+    if (wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0)
+        return true;
+    if (chainActive.Tip())
+    {
+        for (const auto& txout : wtx.tx->vout)
+        {
+            if (IsPoW2WitnessLocked(txout, chainActive.Tip()->nHeight))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Same conditions and credit calls as the mapWallet walks in walletbalance.cpp, just evaluated once per transaction instead of once per read.
+void CWalletBalanceLedger::ComputeContributions(const CWallet& wallet, const CWalletTx& wtx, Contributions& contributions)
+{
+    contributions.clear();
+    if (wtx.isAbandoned() || wtx.mapValue.count("replaced_by_txid") != 0)
+        return;
+
+    const int nDepth = wtx.GetDepthInMainChain();
+    const bool fAvailable = wtx.IsTrusted();
+    const bool fUnconfirmed = !fAvailable && nDepth == 0 && wtx.InMempool();
+    const bool fImmature = nDepth > 0;
+    if (!fAvailable && !fUnconfirmed && !fImmature)
+        return;
+
+    std::vector<const CAccount*> accounts(1, nullptr);
+    for (const auto& txout : wtx.tx->vout)
+    {
+        for (const CAccount* account : wallet.GetCandidateAccounts(txout))
+        {
+            if (std::find(accounts.begin(), accounts.end(), account) == accounts.end())
+                accounts.push_back(account);
+        }
+    }
+
+    for (const CAccount* account : accounts)
+    {
+        if (account && !::IsMine(account, wtx))
+            continue;
+
+        Balances balances;
+        if (fAvailable || fUnconfirmed)
+        {
+            CAmount nCredit[2] = { wtx.GetAvailableCredit(false, account, false), wtx.GetAvailableCreditIncludingLockedWitnesses(false, account, false) };
+            for (int i = 0; i < 2; ++i)
+            {
+                if (fAvailable)
+                {
+                    balances.available[i] = nCredit[i];
+                    if (nDepth >= 1)
+                        balances.availableConfirmed[i] = nCredit[i];
+                }
+                else
+                {
+                    balances.unconfirmed[i] = nCredit[i];
+                }
+            }
+        }
+        if (fImmature)
+        {
+            balances.immature[0] = wtx.GetImmatureCredit(false, account, false);
+            balances.immature[1] = wtx.GetImmatureCreditIncludingLockedWitnesses(false, account, false);
+        }
+
+        if (!balances.IsNull())
+            contributions.emplace_back(account, balances);
+    }
+}
+
+void CWalletBalanceLedger::UpdateTransaction(const CWallet& wallet, const uint256& hash)
+{
+    auto iter = mapContributions.find(hash);
+    if (iter != mapContributions.end())
+    {
+        for (const auto& [account, balances] : iter->second)
+            mapTotals[account].Add(balances, -1);
+        mapContributions.erase(iter);
+    }
+    setVolatile.erase(hash);
+
+    auto walletIter = wallet.mapWallet.find(hash);
+    if (walletIter == wallet.mapWallet.end())
+        return;
+
+    Contributions contributions;
+    ComputeContributions(wallet, walletIter->second, contributions);
+    for (const auto& [account, balances] : contributions)
+        mapTotals[account].Add(balances, 1);
+    if (!contributions.empty())
+        mapContributions.emplace(hash, std::move(contributions));
+    if (IsVolatile(walletIter->second))
+        setVolatile.insert(hash);
+}
+
+void CWalletBalanceLedger::Rebuild(const CWallet& wallet)
+{
+    mapContributions.clear();
+    mapTotals.clear();
+    setVolatile.clear();
+    for (const auto& [hash, wtx] : wallet.mapWallet)
+    {
+        (unused) wtx;
+        UpdateTransaction(wallet, hash);
+    }
+}
+
+// Keys added to an account can only change what transactions that pay to them, or spend from outputs that pay to them, contribute.
+void CWalletBalanceLedger::AddTransactionsPayingTo(const CWallet& wallet, const std::vector<uint160>& ids, std::set<uint256>& setUpdate)
+{
+    if (ids.empty())
+        return;
+
+    const std::set<uint160> setIds(ids.begin(), ids.end());
+    std::vector<uint160> outputIds;
+    auto paysTo = [&](const CTxOut& txout)
+    {
+        outputIds.clear();
+        // Outputs the index can't tell anything about are checked against every account, so any added key might have changed them.
+        if (!CAccountKeyIndex::GetOutputIds(txout, outputIds))
+            return true;
+        return std::any_of(outputIds.begin(), outputIds.end(), [&](const uint160& id) { return setIds.count(id) > 0; });
+    };
+
+    for (const auto& [hash, wtx] : wallet.mapWallet)
+    {
+        bool fAffected = std::any_of(wtx.tx->vout.begin(), wtx.tx->vout.end(), paysTo);
+        for (size_t i = 0; !fAffected && i < wtx.tx->vin.size(); ++i)
+        {
+            const COutPoint& prevOut = wtx.tx->vin[i].GetPrevOut();
+            if (const CWalletTx* prev = wallet.GetWalletTx(prevOut))
+                fAffected = prevOut.n < prev->tx->vout.size() && paysTo(prev->tx->vout[prevOut.n]);
+        }
+        if (fAffected)
+            setUpdate.insert(hash);
+    }
+}
+
+CWalletBalanceLedger::Balances CWalletBalanceLedger::Get(const CWallet& wallet, const CAccount* forAccount)
+{
+    AssertLockHeld(wallet.cs_wallet);
+
+    const CBlockIndex* pTip = chainActive.Tip();
+    const CBlockIndex* pPartialTip = IsPartialSyncActive() ? partialChain.Tip() : nullptr;
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    const bool fTipChanged = (pTip != pLastTip || pPartialTip != pLastPartialTip);
+
+    const uint64_t nKeyGeneration = wallet.keyIndex.GetGeneration();
+    const uint64_t nAccountGeneration = wallet.keyIndex.GetAccountGeneration();
+    bool fRebuildNow = (nAccountGeneration != nLastAccountGeneration);
+    // Depths of confirmed transactions only stay valid if the new tip extends the old one.
+    if (pLastTip && pTip != pLastTip && !chainActive.Contains(pLastTip))
+        fRebuildNow = true;
+    if (pLastPartialTip && pPartialTip != pLastPartialTip && (!pPartialTip || pLastPartialTip->nHeight < partialChain.HeightOffset() || !partialChain.Contains(pLastPartialTip)))
+        fRebuildNow = true;
+
+    std::set<uint256> setUpdate;
+    {
+        LOCK(cs_dirty);
+        fRebuildNow = fRebuildNow || fRebuild;
+        fRebuild = false;
+        setUpdate.swap(setDirty);
+    }
+
+    if (!fRebuildNow && nKeyGeneration != nLastKeyGeneration)
+    {
+        std::vector<uint160> addedIds;
+        if (wallet.keyIndex.GetIdsAddedSince(nLastKeyGeneration, addedIds))
+            AddTransactionsPayingTo(wallet, addedIds, setUpdate);
+        else
+            fRebuildNow = true;
+    }
+
+    if (fRebuildNow)
+    {
+        Rebuild(wallet);
+    }
+    else
+    {
+        if (fTipChanged || nMempoolUpdated != nLastMempoolUpdated)
+        {
+            for (const uint256& hash : setVolatile)
+            {
+                setUpdate.insert(hash);
+                // Whether the outputs a transaction spends count as spent depends on its own state as well.
+                auto walletIter = wallet.mapWallet.find(hash);
+                if (walletIter == wallet.mapWallet.end())
+                    continue;
+                for (const auto& txin : walletIter->second.tx->vin)
+                {
+                    if (const CWalletTx* prev = wallet.GetWalletTx(txin.GetPrevOut()))
+                        setUpdate.insert(prev->GetHash());
+                }
+            }
+        }
+        for (const uint256& hash : setUpdate)
+            UpdateTransaction(wallet, hash);
+    }
+
+    pLastTip = pTip;
+    pLastPartialTip = pPartialTip;
+    nLastMempoolUpdated = nMempoolUpdated;
+    nLastKeyGeneration = nKeyGeneration;
+    nLastAccountGeneration = nAccountGeneration;
+
+    auto iter = mapTotals.find(forAccount);
+    if (iter == mapTotals.end())
+        return Balances();
+    return iter->second;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2016-2022 The Centure developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GNU Lesser General Public License v3, see the accompanying
+// file COPYING
+
+#ifndef WALLET_WALLETBALANCELEDGER_H
+#define WALLET_WALLETBALANCELEDGER_H
+
+#include "amount.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class CAccount;
+class CBlockIndex;
+class CWallet;
+class CWalletTx;
+
+/**
+ * Running per-account balance totals for GetBalance/GetUnconfirmedBalance/GetImmatureBalance/GetBalances.
+ *
+ * Every wallet transaction contributes to the totals of the accounts (and of the wallet as a whole, keyed by nullptr) it pays to, exactly what
+ * the corresponding mapWallet walks would have added up for it. When a transaction is marked dirty its old contribution is taken out and the new
+ * one added in on the next read, so a read only costs as much as the transactions that changed since the previous one.
+ *
+ * Contributions that depend on the chain tip or the mempool rather than on the transaction itself (unconfirmed and conflicted transactions,
+ * immature coinbases, outputs in locked witnesses) are re-evaluated whenever the tip or the mempool changed, along with the transactions they spend
+ * from as those may have become (un)spent. Keys added to an account re-evaluate the transactions that pay to them or spend from outputs that do.
+ * A tip change that is not an extension of the previous tip, adding or removing an account and CWallet::MarkDirty all rebuild the ledger from scratch.
+ */
+class CWalletBalanceLedger
+{
+public:
+    struct Balances
+    {
+        // [0] excluding, [1] including PoW2 locked witnesses
+        CAmount available[2] = {0, 0};
+        CAmount unconfirmed[2] = {0, 0};
+        CAmount immature[2] = {0, 0};
+        //! Available balance of transactions with at least one confirmation (GetBalanceForDepth(1)).
+        CAmount availableConfirmed[2] = {0, 0};
+
+        void Add(const Balances& other, int sign);
+        bool IsNull() const;
+    };
+
+    void MarkDirty(const uint256& hash);
+    void MarkAllDirty();
+
+    //! Bring the totals up to date with wallet and return those of forAccount (nullptr for the whole wallet), caller holds cs_main and cs_wallet.
+    Balances Get(const CWallet& wallet, const CAccount* forAccount);
+
+private:
+    typedef std::vector<std::pair<const CAccount*, Balances>> Contributions;
+
+    void Rebuild(const CWallet& wallet);
+    void UpdateTransaction(const CWallet& wallet, const uint256& hash);
+    static bool IsVolatile(const CWalletTx& wtx);
+    static void AddTransactionsPayingTo(const CWallet& wallet, const std::vector<uint160>& ids, std::set<uint256>& setUpdate);
+    static void ComputeContributions(const CWallet& wallet, const CWalletTx& wtx, Contributions& contributions);
+
+    // Guards the dirty set only, which CWalletTx::MarkDirty fills from wherever it is called; the rest is only touched by Get under cs_wallet.
+    Mutex cs_dirty;
+    std::set<uint256> setDirty;
+    bool fRebuild = true;
+
+    std::map<uint256, Contributions> mapContributions;
+    std::unordered_map<const CAccount*, Balances> mapTotals;
+    std::set<uint256> setVolatile;
+
+    const CBlockIndex* pLastTip = nullptr;
+    const CBlockIndex* pLastPartialTip = nullptr;
+    unsigned int nLastMempoolUpdated = 0;
+    uint64_t nLastKeyGeneration = 0;
+    uint64_t nLastAccountGeneration = 0;
+};
+
+#endif // WALLET_WALLETBALANCELEDGER_H
@@ -880,6 +880,7 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 newAccount->setUUID(strAccountUUID);
                 ssValue >> *newAccount;
                 pwallet->mapAccounts[getUUIDFromString(strAccountUUID)] = newAccount;
+                pwallet->keyIndex.AddAccount(newAccount);
                 //If no active account saved (for whatever reason) - make the first one we run into the active one.
                 if (!pwallet->activeAccount)
                     pwallet->activeAccount = newAccount;
@@ -895,6 +896,7 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 newAccount->setUUID(strAccountUUID);
                 ssValue >> *newAccount;
                 pwallet->mapAccounts[getUUIDFromString(strAccountUUID)] = newAccount;
+                pwallet->keyIndex.AddAccount(newAccount);
                 if (!pwallet->activeAccount)
                     pwallet->activeAccount = newAccount;
             }
@@ -1137,6 +1139,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet, WalletLoadState& nExtraLoadStat
                 pwallet->activeAccount = new CAccount();
                 pwallet->activeAccount->setLabel("Legacy", nullptr);
                 pwallet->mapAccounts[pwallet->activeAccount->getUUID()] = pwallet->activeAccount;
+                pwallet->keyIndex.AddAccount(pwallet->activeAccount);
                 pwallet->mapAccountLabels[pwallet->activeAccount->getUUID()] = "Legacy";
             }
         }
@@ -13,6 +13,23 @@
 #include "wallet.h"
 #include "wallettx.h"
 
+void CWalletTx::MarkDirty()
+{
+    fChangeCached = false;
+    nChangeCached = 0;
+    debitCached.clear();
+    creditCached.clear();
+    immatureCreditCached.clear();
+    availableCreditCached.clear();
+    availableCreditCachedIncludingLockedWitnesses.clear();
+    watchDebitCached.clear();
+    watchCreditCached.clear();
+    immatureWatchCreditCached.clear();
+    availableWatchCreditCached.clear();
+    if (pwallet)
+        pwallet->balanceLedger.MarkDirty(GetHash());
+}
+
 int64_t CWalletTx::GetTxTime() const
 {
     int64_t n = nTimeSmart;
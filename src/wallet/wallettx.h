@@ -228,20 +228,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fChangeCached = false;
-        nChangeCached = 0;
-        debitCached.clear();
-        creditCached.clear();
-        immatureCreditCached.clear();
-        availableCreditCached.clear();
-        availableCreditCachedIncludingLockedWitnesses.clear();
-        watchDebitCached.clear();
-        watchCreditCached.clear();
-        immatureWatchCreditCached.clear();
-        availableWatchCreditCached.clear();
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
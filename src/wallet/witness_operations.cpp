@@ -26,12 +26,12 @@
 
 static witnessOutputsInfoVector getCurrentOutputsForWitnessAccount(CAccount* forAccount)
 {
-    std::map<COutPoint, Coin> allWitnessCoins;
-    if (!getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+    if (!witnessSnapshot)
         throw std::runtime_error("Failed to enumerate all witness coins.");
 
     witnessOutputsInfoVector matchedOutputs;
-    for (const auto& [outpoint, coin] : allWitnessCoins)
+    for (const auto& [outpoint, coin] : *witnessSnapshot->witnessCoins)
     {
         if (IsMine(*forAccount, coin.out))
         {
@@ -1201,22 +1201,21 @@ uint64_t combinedWeight(const std::vector<CAmount> amounts, uint64_t height, uin
 
 std::string witnessAddressForAccount(CWallet* pWallet, CAccount* account)
 {
-    LOCK2(cs_main, pWallet->cs_wallet);
+    // Fetch the snapshot before taking the wallet lock, if nothing has been published yet this needs cs_main (which must be taken first)
+    auto witnessSnapshot = GetWitnessStateSnapshot();
+
+    LOCK(pWallet->cs_wallet);
 
-    if (chainActive.Tip())
+    if (witnessSnapshot)
     {
-        std::map<COutPoint, Coin> allWitnessCoins;
-        if (getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+        for (const auto& [witnessOutPoint, witnessCoin] : *witnessSnapshot->witnessCoins)
         {
-            for (const auto& [witnessOutPoint, witnessCoin] : allWitnessCoins)
+            (unused)witnessOutPoint;
+            CTxOutPoW2Witness witnessDetails;
+            GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
+            if (account->HaveKey(witnessDetails.witnessKeyID))
             {
-                (unused)witnessOutPoint;
-                CTxOutPoW2Witness witnessDetails;
-                GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
-                if (account->HaveKey(witnessDetails.witnessKeyID))
-                {
-                    return CNativeAddress(CPoW2WitnessDestination(witnessDetails.spendingKeyID, witnessDetails.witnessKeyID)).ToString();
-                }
+                return CNativeAddress(CPoW2WitnessDestination(witnessDetails.spendingKeyID, witnessDetails.witnessKeyID)).ToString();
             }
         }
     }
@@ -1226,22 +1225,20 @@ std::string witnessAddressForAccount(CWallet* pWallet, CAccount* account)
 
 CKeyID spendingKeyForWitnessAccount(CWallet* pWallet, CAccount* account)
 {
-    LOCK2(cs_main, pWallet->cs_wallet);
+    auto witnessSnapshot = GetWitnessStateSnapshot();
 
-    if (chainActive.Tip())
+    LOCK(pWallet->cs_wallet);
+
+    if (witnessSnapshot)
     {
-        std::map<COutPoint, Coin> allWitnessCoins;
-        if (getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+        for (const auto& [witnessOutPoint, witnessCoin] : *witnessSnapshot->witnessCoins)
         {
-            for (const auto& [witnessOutPoint, witnessCoin] : allWitnessCoins)
+            (unused)witnessOutPoint;
+            CTxOutPoW2Witness witnessDetails;
+            GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
+            if (account->HaveKey(witnessDetails.witnessKeyID))
             {
-                (unused)witnessOutPoint;
-                CTxOutPoW2Witness witnessDetails;
-                GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
-                if (account->HaveKey(witnessDetails.witnessKeyID))
-                {
-                    return witnessDetails.spendingKeyID;
-                }
+                return witnessDetails.spendingKeyID;
             }
         }
     }
@@ -1249,26 +1246,25 @@ CKeyID spendingKeyForWitnessAccount(CWallet* pWallet, CAccount* account)
     return CKeyID();
 }
 
-std::string witnessKeysLinkUrlForAccount(CWallet* pWallet, CAccount* account)
+std::string witnessKeysLinkUrlForAccount(CWallet* pWallet, CAccount* account, std::shared_ptr<const CWitnessStateSnapshot> witnessSnapshot)
 {
     std::set<CKeyID> keys;
 
-    LOCK2(cs_main, pWallet->cs_wallet);
+    if (!witnessSnapshot)
+        witnessSnapshot = GetWitnessStateSnapshot();
+
+    LOCK(pWallet->cs_wallet);
 
-    if (chainActive.Tip())
+    if (witnessSnapshot)
     {
-        std::map<COutPoint, Coin> allWitnessCoins;
-        if (getAllUnspentWitnessCoins(chainActive, Params(), chainActive.Tip(), allWitnessCoins))
+        for (const auto& [witnessOutPoint, witnessCoin] : *witnessSnapshot->witnessCoins)
         {
-            for (const auto& [witnessOutPoint, witnessCoin] : allWitnessCoins)
+            (unused)witnessOutPoint;
+            CTxOutPoW2Witness witnessDetails;
+            GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
+            if (account->HaveKey(witnessDetails.witnessKeyID))
             {
-                (unused)witnessOutPoint;
-                CTxOutPoW2Witness witnessDetails;
-                GetPow2WitnessOutput(witnessCoin.out, witnessDetails);
-                if (account->HaveKey(witnessDetails.witnessKeyID))
-                {
-                    keys.insert(witnessDetails.witnessKeyID);
-                }
+                keys.insert(witnessDetails.witnessKeyID);
             }
         }
     }
@@ -14,6 +14,7 @@
 
 class CWallet;
 class CAccount;
+struct CWitnessStateSnapshot;
 
 // Error codes match exaclty with the codes used in rpc (plain copy)
 // This is now local to the witness operations but perhaps it could be promotoed to application wide
@@ -116,6 +117,7 @@ uint64_t combinedWeight(const std::vector<CAmount> amounts, uint64_t nHeight, ui
 double witnessFraction(const std::vector<CAmount>& amounts, uint64_t nHeight, const uint64_t duration, const uint64_t totalWeight);
 std::string witnessAddressForAccount(CWallet* pWallet, CAccount* account);
 CKeyID spendingKeyForWitnessAccount(CWallet* pWallet, CAccount* account);
-std::string witnessKeysLinkUrlForAccount(CWallet* pWallet, CAccount* account);
+//! Uses 'witnessSnapshot' if given, otherwise fetches the current witness state snapshot.
+std::string witnessKeysLinkUrlForAccount(CWallet* pWallet, CAccount* account, std::shared_ptr<const CWitnessStateSnapshot> witnessSnapshot=nullptr);
 
 #endif // WITNESS_OPERATIONS_H
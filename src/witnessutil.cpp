@@ -14,11 +14,11 @@
 #include "validation/versionbitsvalidation.h"
 #include "validation/witnessvalidation.h"
 #include "versionbits.h"
+#include "witnessutil.h"
 #include "net_processing.h"
 #include "txdb.h"
 
 #include "primitives/transaction.h"
-#include <LRUCache/LRUCache11.hpp>
 
 
 #ifdef ENABLE_WALLET
@@ -198,8 +198,8 @@ int64_t GetPoW2RawWeightForAmount(int64_t nAmount, int64_t nHeight, int64_t nLoc
     static const arith_uint256 base3 = base*base*base;
     static const arith_uint256 BlocksPerYear = arith_uint256(365 * 288);
     #define BASE(x) (arith_uint256(x)*base)
-    arith_uint256 Quantity = nHeight > 100000 ? arith_uint256(nAmount*100) : arith_uint256(nAmount);
-    arith_uint256 Modifier = nHeight > 114000 ? arith_uint256(10000) : arith_uint256(100000);
+    arith_uint256 Quantity = nHeight > gPoW2RawWeightQuantityChangeHeight ? arith_uint256(nAmount*100) : arith_uint256(nAmount);
+    arith_uint256 Modifier = nHeight > gPoW2RawWeightModifierChangeHeight ? arith_uint256(10000) : arith_uint256(100000);
     arith_uint256 nWeight = ((BASE(Quantity)) + ((Quantity*Quantity) / Modifier)) * (BASE(1) + (BASE(nLockLengthInBlocks) / BlocksPerYear));
     #undef BASE
     nWeight /= base3;
@@ -233,49 +233,146 @@ uint64_t GetPoW2RemainingLockLengthInBlocks(uint64_t lockUntilBlock, uint64_t ti
     return (lockUntilBlock < tipHeight) ? 0 : (lockUntilBlock - tipHeight) + 1;
 }
 
-typedef std::pair<int64_t, int64_t> NumAndWeight;
-typedef lru11::Cache<uint256, NumAndWeight, lru11::NullLock, std::unordered_map<uint256, typename std::list<lru11::KeyValuePair<uint256, NumAndWeight>>::iterator, BlockHasher>> BlockWeightCache;
-BlockWeightCache networkWeightCache(800,100);
+CNetworkWeightSeries pow2NetworkWeightSeries;
+
+void CNetworkWeightSeries::Store(const uint256& blockHash, int64_t nHeight, int64_t nNumWitnessAddresses, int64_t nTotalWeight)
+{
+    AssertLockHeld(cs_series);
+
+    if (series.size() <= (uint64_t)nHeight)
+        series.resize(nHeight + 1);
+    series[nHeight].blockHash = blockHash;
+    series[nHeight].nNumWitnessAddresses = nNumWitnessAddresses;
+    series[nHeight].nTotalWeight = nTotalWeight;
+}
+
+void CNetworkWeightSeries::Record(const uint256& blockHash, int64_t nHeight, int64_t nNumWitnessAddresses, int64_t nTotalWeight)
+{
+    if (pwitnessweightdb)
+        pwitnessweightdb->WriteNetworkWeight(blockHash, nNumWitnessAddresses, nTotalWeight);
+
+    LOCK(cs_series);
+    Store(blockHash, nHeight, nNumWitnessAddresses, nTotalWeight);
+}
+
+bool CNetworkWeightSeries::Lookup(const uint256& blockHash, int64_t nHeight, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight)
+{
+    {
+        LOCK(cs_series);
+        if ((uint64_t)nHeight < series.size() && series[nHeight].blockHash == blockHash)
+        {
+            nNumWitnessAddresses = series[nHeight].nNumWitnessAddresses;
+            nTotalWeight = series[nHeight].nTotalWeight;
+            return true;
+        }
+    }
+
+    if (!pwitnessweightdb || !pwitnessweightdb->ReadNetworkWeight(blockHash, nNumWitnessAddresses, nTotalWeight))
+        return false;
+
+    // Promote to the in memory series so subsequent lookups don't have to hit the disk.
+    LOCK(cs_series);
+    Store(blockHash, nHeight, nNumWitnessAddresses, nTotalWeight);
+    return true;
+}
+
+void CNetworkWeightSeries::LookupRange(std::vector<CNetworkWeightPoint>& points, std::vector<bool>& found)
+{
+    found.assign(points.size(), false);
+
+    LOCK(cs_series);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        CNetworkWeightPoint& point = points[i];
+        if (point.nHeight < series.size() && series[point.nHeight].blockHash == point.blockHash)
+        {
+            point.nNumWitnessAddresses = series[point.nHeight].nNumWitnessAddresses;
+            point.nTotalWeight = series[point.nHeight].nTotalWeight;
+            found[i] = true;
+        }
+    }
+}
+
+void CNetworkWeightSeries::Clear()
+{
+    LOCK(cs_series);
+    series.clear();
+    series.shrink_to_fit();
+}
+
 bool GetPow2NetworkWeight(const CBlockIndex* pIndex, const CChainParams& chainparams, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight, CChain& chain, CCoinsViewCache* viewOverride)
 {
     DO_BENCHMARK("WIT: GetPow2NetworkWeight", BCLog::BENCH|BCLog::WITNESS);
 
-    const auto& blockHash = pIndex->GetBlockHashPoW2();
-    if (networkWeightCache.contains(blockHash))
+    // Anything seen before (which includes every tip as it is connected) is served from the series without touching cs_main.
+    if (pIndex->phashBlock && pow2NetworkWeightSeries.Lookup(pIndex->GetBlockHashPoW2(), pIndex->nHeight, nNumWitnessAddresses, nTotalWeight))
+        return true;
+    auto witnessSnapshot = GetWitnessStateSnapshot(false);
+    if (witnessSnapshot && witnessSnapshot->pTip == pIndex)
     {
-        const auto& cachePair = networkWeightCache.get(blockHash);
-        nNumWitnessAddresses = cachePair.first;
-        nTotalWeight = cachePair.second;
+        nNumWitnessAddresses = witnessSnapshot->nNumWitnessAddresses;
+        nTotalWeight = witnessSnapshot->nTotalWeight;
         return true;
     }
 
+    // Recent ancestors of the tip are rewound from the snapshot lock free, getAllUnspentWitnessCoins only takes cs_main beyond that.
+    std::shared_ptr<const std::map<COutPoint, Coin>> allWitnessCoins;
+    if (!getAllUnspentWitnessCoins(chain, chainparams, pIndex, allWitnessCoins, viewOverride))
+        return error("GetPow2NetworkWeight: Failed to enumerate all unspent witness coins");
+
+    nNumWitnessAddresses = 0;
+    nTotalWeight = 0;
+    for (const auto& [outPoint, coin] : *allWitnessCoins)
+    {
+        if ((int64_t)coin.nHeight <= pIndex->nHeight)
+        {
+            uint64_t nUnused1, nUnused2;
+            nTotalWeight += GetPoW2RawWeightForAmount(coin.out.nValue, pIndex->nHeight, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
+            ++nNumWitnessAddresses;
+        }
+    }
+    if (pIndex->phashBlock)
+        pow2NetworkWeightSeries.Record(pIndex->GetBlockHashPoW2(), pIndex->nHeight, nNumWitnessAddresses, nTotalWeight);
+    return true;
+}
+
+bool GetPow2NetworkWeightRange(uint64_t nHeightFrom, uint64_t nHeightTo, const CChainParams& chainparams, std::vector<CNetworkWeightPoint>& points)
+{
+    DO_BENCHMARK("WIT: GetPow2NetworkWeightRange", BCLog::BENCH|BCLog::WITNESS);
+
+    points.clear();
+    std::vector<const CBlockIndex*> rangeIndexes;
     {
-        #ifdef ENABLE_WALLET
-        LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
-        #else
         LOCK(cs_main);
-        #endif
 
-        std::map<COutPoint, Coin> allWitnessCoins;
-        if (!getAllUnspentWitnessCoins(chain, chainparams, pIndex, allWitnessCoins, nullptr, viewOverride))
-            return error("GetPow2NetworkWeight: Failed to enumerate all unspent witness coins");
+        if (chainActive.Height() < 0)
+            return false;
+        nHeightTo = std::min(nHeightTo, (uint64_t)chainActive.Height());
+        if (nHeightFrom > nHeightTo)
+            return false;
 
-        nNumWitnessAddresses = 0;
-        nTotalWeight = 0;
+        rangeIndexes.reserve(nHeightTo - nHeightFrom + 1);
+        for (uint64_t nHeight = nHeightFrom; nHeight <= nHeightTo; ++nHeight)
+            rangeIndexes.push_back(chainActive[nHeight]);
+    }
 
-        for (auto iter : allWitnessCoins)
-        {
-            if (pIndex == nullptr || iter.second.nHeight <= pIndex->nHeight)
-            {
-                CTxOut output = iter.second.out;
+    points.resize(rangeIndexes.size());
+    for (size_t i = 0; i < rangeIndexes.size(); ++i)
+    {
+        points[i].nHeight = rangeIndexes[i]->nHeight;
+        points[i].blockHash = rangeIndexes[i]->GetBlockHashPoW2();
+    }
+    std::vector<bool> found;
+    pow2NetworkWeightSeries.LookupRange(points, found);
 
-                uint64_t nUnused1, nUnused2;
-                nTotalWeight += GetPoW2RawWeightForAmount(output.nValue, pIndex->nHeight, GetPoW2LockLengthInBlocksFromOutput(output, iter.second.nHeight, nUnused1, nUnused2));
-                ++nNumWitnessAddresses;
-            }
+    for (size_t i = 0; i < rangeIndexes.size(); ++i)
+    {
+        if (!found[i] && !GetPow2NetworkWeight(rangeIndexes[i], chainparams, points[i].nNumWitnessAddresses, points[i].nTotalWeight, chainActive))
+        {
+            points.clear();
+            return false;
         }
     }
-    networkWeightCache.insert(blockHash, std::pair(nNumWitnessAddresses, nTotalWeight));
     return true;
 }
 
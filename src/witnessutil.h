@@ -15,6 +15,7 @@
 #include "chainparams.h"
 #include "chain.h"
 #include "coins.h"
+#include "sync.h"
 
 #ifdef ENABLE_WALLET
 void ResetSPVStartRescanThread();
@@ -31,10 +32,62 @@ bool IsPow2Phase5Active(uint64_t nHeight);
 bool IsPow2WitnessingActive(uint64_t nHeight);
 int GetPoW2Phase(const CBlockIndex* pindexPrev);
 
+//! Network weight (number of witness addresses and their total raw weight) with pIndex as the tip.
+//! Served from the published witness snapshot or pow2NetworkWeightSeries without taking cs_main, only a block that was never seen before takes cs_main to enumerate its witness set.
 bool GetPow2NetworkWeight(const CBlockIndex* pIndex, const CChainParams& chainparams, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight, CChain& chain, CCoinsViewCache* viewOverride=nullptr);
 
+struct CNetworkWeightPoint
+{
+    uint64_t nHeight = 0;
+    //! Block the weight belongs to, so a caller can tell whether chainActive still held it at nHeight.
+    uint256 blockHash;
+    int64_t nNumWitnessAddresses = 0;
+    int64_t nTotalWeight = 0;
+};
+
+//! Fetch the network weight for every block on chainActive with height in [nHeightFrom, nHeightTo] (clamped to the current tip)
+//! The series is consulted once for the whole range, only blocks it doesn't hold are looked up individually.
+bool GetPow2NetworkWeightRange(uint64_t nHeightFrom, uint64_t nHeightTo, const CChainParams& chainparams, std::vector<CNetworkWeightPoint>& points);
+
+/** Per height series of the network weight, keyed by block hash so that any index for a block (including those of clone chains) is served from it.
+ *  Holds the most recently recorded block for each height; new tips of chainActive are recorded incrementally as they are connected (see CWitnessCoinIndex).
+ *  Every value is also memoised to disk by block hash (see CWitnessWeightDB) so that blocks displaced from the series and restarts don't need a recalculation.
+ *  Has its own lock, doesn't require cs_main.
+ */
+class CNetworkWeightSeries
+{
+public:
+    void Record(const uint256& blockHash, int64_t nHeight, int64_t nNumWitnessAddresses, int64_t nTotalWeight);
+    bool Lookup(const uint256& blockHash, int64_t nHeight, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight);
+    //! Fill in every point (identified by nHeight and blockHash) held in memory under a single lock, sets found[i] for those that were.
+    void LookupRange(std::vector<CNetworkWeightPoint>& points, std::vector<bool>& found);
+    void Clear();
+private:
+    void Store(const uint256& blockHash, int64_t nHeight, int64_t nNumWitnessAddresses, int64_t nTotalWeight);
+
+    struct Entry
+    {
+        uint256 blockHash;
+        int64_t nNumWitnessAddresses = 0;
+        int64_t nTotalWeight = 0;
+    };
+    Mutex cs_series;
+    std::vector<Entry> series;
+};
+extern CNetworkWeightSeries pow2NetworkWeightSeries;
+
 int64_t GetPoW2RawWeightForAmount(int64_t nAmount, int64_t nHeight, int64_t nLockLengthInBlocks);
 
+//! Heights after which the raw weight formula of GetPoW2RawWeightForAmount changes.
+static const int64_t gPoW2RawWeightQuantityChangeHeight = 100000;
+static const int64_t gPoW2RawWeightModifierChangeHeight = 114000;
+
+//! The raw weight for a given amount/lock length only differs between heights that fall in different eras.
+inline int GetPoW2RawWeightEra(int64_t nHeight)
+{
+    return (nHeight > gPoW2RawWeightQuantityChangeHeight ? 1 : 0) + (nHeight > gPoW2RawWeightModifierChangeHeight ? 1 : 0);
+}
+
 
 //! Calculate how many blocks a witness transaction is locked for from an output
 //! Always use this helper instead of attempting to calculate directly - to avoid off by 1 errors.